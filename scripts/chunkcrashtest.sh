@@ -0,0 +1,174 @@
+#!/bin/bash
+#
+# $Id$
+#
+# Copyright 2010 Quantcast Corp.
+#
+# This file is part of Kosmos File System (KFS).
+#
+# Licensed under the Apache License, Version 2.0
+# (the "License"); you may not use this file except in compliance with
+# the License. You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+# implied. See the License for the specific language governing
+# permissions and limitations under the License.
+#
+#
+# Chunk server crash test for the delayed (write back) chunk header writes.
+# Starts a meta server and 3 chunk servers on the local host, and then:
+#  1. writes a file with replication 3, waits for the chunk header write back
+#     window (chunkServer.metaSyncMaxDelayTimeSecs) to expire, kills all
+#     chunk servers with SIGKILL, restarts them, and verifies that the
+#     file can be read back, and that all chunk headers and checksums are
+#     valid (chunkscrubber);
+#  2. writes another file, kills one chunk server with SIGKILL while its
+#     chunk headers are still dirty, restarts it, and verifies that the file
+#     can be read back.
+#
+# usage: ./chunkcrashtest.sh -b <build dir> [-d <test dir>] [-s <size MB>]
+#                            [-p <base port>]
+
+me=$0
+BUILD=""
+TESTDIR=/tmp/kfscrashtest
+SIZEMB=150
+PORT=20000
+NUMCS=3
+SYNCDELAY=2
+SYNCMAXDELAY=5
+
+while getopts "b:d:s:p:h" opt
+do
+    case $opt in
+        b) BUILD=$OPTARG ;;
+        d) TESTDIR=$OPTARG ;;
+        s) SIZEMB=$OPTARG ;;
+        p) PORT=$OPTARG ;;
+        *) echo "usage: $me -b <build dir> [-d <test dir>] [-s <size MB>] [-p <base port>]"
+           exit 1 ;;
+    esac
+done
+
+if [ -z "$BUILD" ]; then
+    echo "usage: $me -b <build dir> [-d <test dir>] [-s <size MB>] [-p <base port>]"
+    exit 1
+fi
+
+METASERVER=$BUILD/src/cc/meta/metaserver
+CHUNKSERVER=$BUILD/src/cc/chunk/chunkserver
+SCRUBBER=$BUILD/src/cc/chunk/chunkscrubber
+CPTOKFS=$BUILD/src/cc/tools/cptokfs
+CPFROMKFS=$BUILD/src/cc/tools/cpfromkfs
+CSPORT=$((PORT + 10000))
+METAPID=""
+CSPIDS=()
+
+fail()
+{
+    echo "FAILED: $*"
+    cleanup
+    exit 1
+}
+
+cleanup()
+{
+    for pid in $METAPID ${CSPIDS[@]}; do
+        kill -KILL $pid > /dev/null 2>&1
+    done
+    wait > /dev/null 2>&1
+}
+
+start_chunkserver()
+{
+    local i=$1
+    local dir=$TESTDIR/cs$i
+    (cd $dir && exec $CHUNKSERVER cs.prp $dir/cs.log > $dir/out 2>&1) &
+    CSPIDS[$i]=$!
+}
+
+write_file()
+{
+    head -c $((SIZEMB << 20)) /dev/urandom > $TESTDIR/$1 || fail "data gen"
+    $CPTOKFS -s 127.0.0.1 -p $PORT -d $TESTDIR/$1 -k /$1 -r $NUMCS ||
+        fail "write $1"
+}
+
+verify_file()
+{
+    rm -f $TESTDIR/$1.out
+    $CPFROMKFS -s 127.0.0.1 -p $PORT -d $TESTDIR/$1.out -k /$1 ||
+        fail "read $1"
+    cmp $TESTDIR/$1 $TESTDIR/$1.out || fail "data mismatch $1"
+}
+
+for f in $METASERVER $CHUNKSERVER $SCRUBBER $CPTOKFS $CPFROMKFS; do
+    [ -x $f ] || fail "$f not found"
+done
+
+trap cleanup INT TERM
+
+rm -rf $TESTDIR
+mkdir -p $TESTDIR/meta/logs $TESTDIR/meta/checkpoints || fail "mkdir"
+cat > $TESTDIR/meta/ms.prp <<EOF
+metaServer.clientPort = $PORT
+metaServer.chunkServerPort = $CSPORT
+metaServer.logDir = $TESTDIR/meta/logs
+metaServer.cpDir = $TESTDIR/meta/checkpoints
+metaServer.minChunkservers = 1
+EOF
+(cd $TESTDIR/meta && exec $METASERVER ms.prp $TESTDIR/meta/ms.log > out 2>&1) &
+METAPID=$!
+sleep 1
+
+for i in $(seq 1 $NUMCS); do
+    dir=$TESTDIR/cs$i
+    mkdir -p $dir/chunks $dir/logs || fail "mkdir"
+    cat > $dir/cs.prp <<EOF
+chunkServer.metaServer.hostname = 127.0.0.1
+chunkServer.metaServer.port = $CSPORT
+chunkServer.clientPort = $((CSPORT + i))
+chunkServer.chunkDir = $dir/chunks
+chunkServer.logDir = $dir/logs
+chunkServer.totalSpace = $((SIZEMB * 4 << 20))
+chunkServer.hostname = 127.0.0.1
+chunkServer.metaSyncDelayTimeSecs = $SYNCDELAY
+chunkServer.metaSyncMaxDelayTimeSecs = $SYNCMAXDELAY
+EOF
+    start_chunkserver $i
+done
+sleep 5
+
+echo "crash after the write back window"
+write_file crash1.dat
+sleep $((SYNCMAXDELAY + SYNCDELAY + 2))
+for i in $(seq 1 $NUMCS); do
+    kill -KILL ${CSPIDS[$i]}
+done
+wait ${CSPIDS[@]} > /dev/null 2>&1
+for i in $(seq 1 $NUMCS); do
+    out=$($SCRUBBER -d $TESTDIR/cs$i/chunks 2>&1)
+    echo "$out" | grep -E "mismatch|failed|Unable" && fail "scrub cs$i"
+done
+for i in $(seq 1 $NUMCS); do
+    start_chunkserver $i
+done
+sleep 5
+verify_file crash1.dat
+
+echo "crash within the write back window"
+write_file crash2.dat
+kill -KILL ${CSPIDS[1]}
+wait ${CSPIDS[1]} > /dev/null 2>&1
+start_chunkserver 1
+sleep 5
+verify_file crash2.dat
+verify_file crash1.dat
+
+cleanup
+echo "PASSED"
+exit 0
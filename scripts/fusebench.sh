@@ -0,0 +1,124 @@
+#!/bin/bash
+#
+# $Id$
+#
+# Copyright 2010 Quantcast Corp.
+#
+# This file is part of Kosmos File System (KFS).
+#
+# Licensed under the Apache License, Version 2.0
+# (the "License"); you may not use this file except in compliance with
+# the License. You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+# implied. See the License for the specific language governing
+# permissions and limitations under the License.
+#
+#
+# Read throughput through a KFS fuse mount (kfs_fuse).
+# Writes N files of the given size into the mount, drops the kernel page
+# cache (when run as root), and then reports:
+#  1. sequential read of one file;
+#  2. N readers, each reading its own file, in parallel;
+#  3. N readers reading the same file in parallel;
+#  4. sequential re-read of one file (kernel page cache).
+#
+# usage: ./fusebench.sh -m <mount point> [-n <readers>] [-s <size MB>]
+#                       [-b <dd block size>]
+
+me=$0
+MNT=""
+NREADERS=4
+SIZEMB=256
+BS=1M
+
+while getopts "m:n:s:b:h" opt
+do
+    case $opt in
+        m) MNT=$OPTARG ;;
+        n) NREADERS=$OPTARG ;;
+        s) SIZEMB=$OPTARG ;;
+        b) BS=$OPTARG ;;
+        *) echo "usage: $me -m <mount point> [-n <readers>] [-s <size MB>] [-b <block size>]"
+           exit 1 ;;
+    esac
+done
+
+if [ -z "$MNT" ]; then
+    echo "usage: $me -m <mount point> [-n <readers>] [-s <size MB>] [-b <block size>]"
+    exit 1
+fi
+
+DIR=$MNT/fusebench.$$
+
+fail()
+{
+    echo "FAILED: $*"
+    rm -rf $DIR
+    exit 1
+}
+
+now()
+{
+    date +%s.%N
+}
+
+# report <name> <start> <total MB>
+report()
+{
+    echo "$1 $3 $2 $(now)" |
+        awk '{ t = $4 - $3; if (t <= 0) t = 1e-6;
+               printf("%-20s %8d MB %8.2f sec %10.2f MB/sec\n", $1, $2, t, $2 / t) }'
+}
+
+drop_caches()
+{
+    sync
+    [ -w /proc/sys/vm/drop_caches ] && echo 3 > /proc/sys/vm/drop_caches
+}
+
+read_file()
+{
+    dd if=$1 of=/dev/null bs=$BS 2>/dev/null || fail "read $1"
+}
+
+mkdir -p $DIR || fail "mkdir $DIR"
+
+start=$(now)
+for i in $(seq 1 $NREADERS); do
+    dd if=/dev/zero of=$DIR/f$i bs=1M count=$SIZEMB 2>/dev/null ||
+        fail "write $DIR/f$i"
+done
+report "write" $start $((SIZEMB * NREADERS))
+
+drop_caches
+start=$(now)
+read_file $DIR/f1
+report "sequential" $start $SIZEMB
+
+drop_caches
+start=$(now)
+for i in $(seq 1 $NREADERS); do
+    read_file $DIR/f$i &
+done
+wait
+report "parallel-files" $start $((SIZEMB * NREADERS))
+
+drop_caches
+start=$(now)
+for i in $(seq 1 $NREADERS); do
+    read_file $DIR/f1 &
+done
+wait
+report "parallel-same-file" $start $((SIZEMB * NREADERS))
+
+start=$(now)
+read_file $DIR/f1
+report "cached-reread" $start $SIZEMB
+
+rm -rf $DIR
+exit 0
@@ -27,6 +27,7 @@
 #include <jni.h>
 #include <string>
 #include <cstddef>
+#include <cerrno>
 #include <iostream>
 #include <vector>
 #include <netinet/in.h>
@@ -39,6 +40,7 @@ using std::endl;
 using std::ostringstream;
 
 #include <fcntl.h>
+#include <sys/uio.h>
 #include "libkfsClient/KfsClient.h"
 using namespace KFS;
 
@@ -138,6 +140,14 @@ extern "C" {
     jint Java_org_kosmix_kosmosfs_access_KfsInputChannel_read(
         JNIEnv *jenv, jclass jcls, jlong jptr, jint jfd, jobject buf, jint begin, jint end);
 
+    jint Java_org_kosmix_kosmosfs_access_KfsInputChannel_pread(
+        JNIEnv *jenv, jclass jcls, jlong jptr, jint jfd, jlong joffset,
+        jobject buf, jint begin, jint end);
+
+    jlong Java_org_kosmix_kosmosfs_access_KfsInputChannel_preadv(
+        JNIEnv *jenv, jclass jcls, jlong jptr, jint jfd, jlong joffset,
+        jobjectArray bufs, jintArray begins, jintArray ends);
+
     jint Java_org_kosmix_kosmosfs_access_KfsInputChannel_seek(
         JNIEnv *jenv, jclass jcls, jlong jptr, jint jfd, jlong joffset);
 
@@ -697,6 +707,71 @@ jint Java_org_kosmix_kosmosfs_access_KfsInputChannel_read(
     return (jint)sz;
 }
 
+// The positioned reads do not take any JVM resources, such as critical
+// array regions, for the duration of the read: the direct buffer memory
+// does not move, and the read itself does not hold the client lock.
+
+jint Java_org_kosmix_kosmosfs_access_KfsInputChannel_pread(
+    JNIEnv *jenv, jclass jcls, jlong jptr, jint jfd, jlong joffset,
+    jobject buf, jint begin, jint end)
+{
+    KfsClient *clnt = (KfsClient *) jptr;
+
+    if(!buf)
+        return 0;
+
+    void * addr = jenv->GetDirectBufferAddress(buf);
+    jlong cap = jenv->GetDirectBufferCapacity(buf);
+
+    if(!addr || cap < 0)
+        return 0;
+    if(begin < 0 || end > cap || begin > end)
+        return 0;
+
+    struct iovec iov;
+    iov.iov_base = (void *)(uintptr_t(addr) + begin);
+    iov.iov_len  = (size_t) (end - begin);
+
+    ssize_t sz = clnt->PReadV((int) jfd, (off_t) joffset, &iov, 1);
+    return (jint)sz;
+}
+
+jlong Java_org_kosmix_kosmosfs_access_KfsInputChannel_preadv(
+    JNIEnv *jenv, jclass jcls, jlong jptr, jint jfd, jlong joffset,
+    jobjectArray bufs, jintArray begins, jintArray ends)
+{
+    KfsClient *clnt = (KfsClient *) jptr;
+
+    if(!bufs || !begins || !ends)
+        return -EINVAL;
+
+    const jsize cnt = jenv->GetArrayLength(bufs);
+    if(jenv->GetArrayLength(begins) < cnt || jenv->GetArrayLength(ends) < cnt)
+        return -EINVAL;
+
+    vector<jint> b(cnt + 1), e(cnt + 1);
+    jenv->GetIntArrayRegion(begins, 0, cnt, &b[0]);
+    jenv->GetIntArrayRegion(ends, 0, cnt, &e[0]);
+
+    vector<struct iovec> iov(cnt + 1);
+    for (jsize i = 0; i < cnt; i++) {
+        jobject buf = jenv->GetObjectArrayElement(bufs, i);
+        void * addr = buf ? jenv->GetDirectBufferAddress(buf) : 0;
+        jlong cap = buf ? jenv->GetDirectBufferCapacity(buf) : -1;
+        if (buf)
+            jenv->DeleteLocalRef(buf);
+        if(!addr || cap < 0)
+            return -EINVAL;
+        if(b[i] < 0 || e[i] > cap || b[i] > e[i])
+            return -EINVAL;
+        iov[i].iov_base = (void *)(uintptr_t(addr) + b[i]);
+        iov[i].iov_len  = (size_t) (e[i] - b[i]);
+    }
+
+    ssize_t sz = clnt->PReadV((int) jfd, (off_t) joffset, &iov[0], (int) cnt);
+    return (jlong)sz;
+}
+
 
 jint Java_org_kosmix_kosmosfs_access_KfsOutputChannel_write(
     JNIEnv *jenv, jclass jcls, jlong jptr, jint jfd, jobject buf, jint begin, jint end) 
@@ -45,6 +45,12 @@ extern "C" {
 #define Py_RETURN_NONE return Py_INCREF(Py_None), Py_None
 #endif // !defined(Py_RETURN_NONE)
 
+// The "s*" and "w*" argument formats, and the new buffer protocol that
+// accepts bytearray and memoryview objects are part of Python 2.6.
+#if PY_VERSION_HEX >= 0x02060000
+#define KFS_PY_HAS_BUFFER_ARGS 1
+#endif
+
 using std::string;
 using std::vector;
 using namespace KFS;
@@ -72,6 +78,7 @@ static PyObject *kfs_rmdir(PyObject *pself, PyObject *args);
 static PyObject *kfs_rmdirs(PyObject *pself, PyObject *args);
 static PyObject *kfs_readdir(PyObject *pself, PyObject *args);
 static PyObject *kfs_readdirplus(PyObject *pself, PyObject *args);
+static PyObject *kfs_readdirplus_batch(PyObject *pself, PyObject *args);
 static PyObject *kfs_create(PyObject *pself, PyObject *args);
 static PyObject *kfs_stat(PyObject *pself, PyObject *args);
 static PyObject *kfs_getNumChunks(PyObject *pself, PyObject *args);
@@ -100,6 +107,8 @@ static PyMethodDef Client_methods[] = {
 	{ "readdir", kfs_readdir, METH_VARARGS, "Read directory." },
 	{ "readdirplus", kfs_readdirplus, METH_VARARGS,
 		"Read directory with attributes." },
+	{ "readdirplus_batch", kfs_readdirplus_batch, METH_VARARGS,
+		"Read part of directory with attributes." },
 	{ "stat", kfs_stat, METH_VARARGS, "Stat file." },
 	{ "getNumChunks", kfs_getNumChunks, METH_VARARGS, "Get # of chunks in a file." },
 	{ "getChunkSize", kfs_getChunkSize, METH_VARARGS, "Get default chunksize for a file." },
@@ -129,6 +138,9 @@ PyDoc_STRVAR(Client_doc,
 "\trmdirs(path) -- remove a directory tree\n"
 "\treaddir(path) -- return a tuple of directory contents\n"
 "\treaddirplus(path) -- directory entries plus attributes\n"
+"\treaddirplus_batch(path[, start[, count]]) -- up to count directory\n"
+"\t\tentries after start, with numeric attributes, and the start of\n"
+"\t\tthe next batch (None at the end of the directory)\n"
 "\tisdir(path) -- return TRUE if path is a directory\n"
 "\tisfile(path) -- return TRUE if path is a file\n"
 "\tstat(path)   --  file attributes, compatible with os.stat\n"
@@ -261,8 +273,11 @@ set_file_members(
 		return -1;
 
 	// open the file if necessary
-	if (fd < 0)
+	if (fd < 0) {
+		Py_BEGIN_ALLOW_THREADS
 		fd = client->client->Open(path, mode);
+		Py_END_ALLOW_THREADS
+	}
 
 	if (fd < 0) {
 		PyErr_SetString(PyExc_IOError, strerror(-fd));
@@ -350,7 +365,9 @@ kfs_close(PyObject *pself, PyObject *args)
 	kfs_File *self = (kfs_File *)pself;
 	kfs_Client *cl = (kfs_Client *)self->pclient;
 	if (self->fd != -1) {
+		Py_BEGIN_ALLOW_THREADS
 		cl->client->Close(self->fd);
+		Py_END_ALLOW_THREADS
 		self->fd = -1;
 	}
 	Py_RETURN_NONE;
@@ -384,7 +401,10 @@ kfs_read(PyObject *pself, PyObject *args)
 		return NULL;
 
 	char *buf = PyString_AsString(v);
-	ssize_t nr = cl->client->Read(self->fd, buf, rsize);
+	ssize_t nr;
+	Py_BEGIN_ALLOW_THREADS
+	nr = cl->client->Read(self->fd, buf, rsize);
+	Py_END_ALLOW_THREADS
 	if (nr < 0) {
 		Py_DECREF(v);
 		PyErr_SetString(PyExc_IOError, strerror(-nr));
@@ -395,30 +415,88 @@ kfs_read(PyObject *pself, PyObject *args)
 	return v;
 }
 
+/*!
+ * \brief read into a caller supplied writable buffer
+ *
+ * Avoids the string allocation and copy of read(): the data is read
+ * straight into the buffer, such as bytearray, array, mmap, or memoryview.
+ * Returns the number of bytes read, 0 at EOF.
+ */
 static PyObject *
-kfs_write(PyObject *pself, PyObject *args)
+kfs_readinto(PyObject *pself, PyObject *args)
 {
 	kfs_File *self = (kfs_File *)pself;
 	kfs_Client *cl = (kfs_Client *)self->pclient;
-	int wsize = -1;
 	char *buf = NULL;
+	ssize_t rsize;
+#ifdef KFS_PY_HAS_BUFFER_ARGS
+	Py_buffer pbuf;
 
-	if (!PyArg_ParseTuple(args, "s#", &buf, &wsize))
+	if (!PyArg_ParseTuple(args, "w*", &pbuf))
 		return NULL;
+	buf = (char *)pbuf.buf;
+	rsize = pbuf.len;
+#else
+	int len = -1;
 
-	if (self->fd == -1) {
-		PyErr_SetString(PyExc_IOError, strerror(EBADF));
+	if (!PyArg_ParseTuple(args, "w#", &buf, &len))
+		return NULL;
+	rsize = len;
+#endif
+
+	ssize_t nr = -EBADF;
+	if (self->fd != -1) {
+		Py_BEGIN_ALLOW_THREADS
+		nr = cl->client->Read(self->fd, buf, rsize);
+		Py_END_ALLOW_THREADS
+	}
+#ifdef KFS_PY_HAS_BUFFER_ARGS
+	PyBuffer_Release(&pbuf);
+#endif
+	if (nr < 0) {
+		PyErr_SetString(PyExc_IOError, strerror(-nr));
 		return NULL;
 	}
+	return PyInt_FromSsize_t(nr);
+}
+
+static PyObject *
+kfs_write(PyObject *pself, PyObject *args)
+{
+	kfs_File *self = (kfs_File *)pself;
+	kfs_Client *cl = (kfs_Client *)self->pclient;
+	const char *buf = NULL;
+#ifdef KFS_PY_HAS_BUFFER_ARGS
+	// Any object with the buffer interface: no copy into a string.
+	Py_buffer pbuf;
 
-	ssize_t nw = cl->client->Write(self->fd, buf, (ssize_t)wsize);
+	if (!PyArg_ParseTuple(args, "s*", &pbuf))
+		return NULL;
+	buf = (const char *)pbuf.buf;
+	const long wsize = (long)pbuf.len;
+#else
+	int wsize = -1;
+
+	if (!PyArg_ParseTuple(args, "s#", &buf, &wsize))
+		return NULL;
+#endif
+
+	ssize_t nw = -EBADF;
+	if (self->fd != -1) {
+		Py_BEGIN_ALLOW_THREADS
+		nw = cl->client->Write(self->fd, buf, (ssize_t)wsize);
+		Py_END_ALLOW_THREADS
+	}
+#ifdef KFS_PY_HAS_BUFFER_ARGS
+	PyBuffer_Release(&pbuf);
+#endif
 	if (nw < 0) {
 		PyErr_SetString(PyExc_IOError, strerror(-nw));
 		return NULL;
 	}
 	if (nw != wsize) {
 		PyObject *msg = PyString_FromFormat(
-	"requested write of %d bytes but %ld were written", wsize, nw);
+	"requested write of %ld bytes but %ld were written", (long)wsize, (long)nw);
 		return msg;
 	}
 	Py_RETURN_NONE;
@@ -495,7 +573,10 @@ kfs_truncate(PyObject *pself, PyObject *args)
 		return NULL;
 	}
 
-	int s = cl->client->Truncate(self->fd, (off_t)off);
+	int s;
+	Py_BEGIN_ALLOW_THREADS
+	s = cl->client->Truncate(self->fd, (off_t)off);
+	Py_END_ALLOW_THREADS
 	if (s < 0) {
 		PyErr_SetString(PyExc_IOError, strerror(-s));
 		return NULL;
@@ -509,7 +590,10 @@ kfs_sync(PyObject *pself, PyObject *args)
 {
 	kfs_File *self = (kfs_File *)pself;
 	kfs_Client *cl = (kfs_Client *)self->pclient;
-	int s = cl->client->Sync(self->fd);
+	int s;
+	Py_BEGIN_ALLOW_THREADS
+	s = cl->client->Sync(self->fd);
+	Py_END_ALLOW_THREADS
 	if (s < 0) {
 		PyErr_SetString(PyExc_IOError, strerror(-s));
 		return NULL;
@@ -533,7 +617,11 @@ kfs_seek(PyObject *pself, PyObject *args)
 		return NULL;
 	}
 
-	off_t s = cl->client->Seek(self->fd, (off_t)off, whence);
+	off_t s;
+	// Seek flushes the dirty data, when it moves onto another chunk.
+	Py_BEGIN_ALLOW_THREADS
+	s = cl->client->Seek(self->fd, (off_t)off, whence);
+	Py_END_ALLOW_THREADS
 	if (s < 0) {
 		PyErr_SetString(PyExc_IOError, strerror(-s));
 		return NULL;
@@ -564,6 +652,7 @@ static PyMethodDef File_methods[] = {
 	{ "open", kfs_reopen, METH_VARARGS, "Open a closed file." },
 	{ "close", kfs_close, METH_NOARGS, "Close file." },
 	{ "read", kfs_read, METH_VARARGS, "Read from file." },
+	{ "readinto", kfs_readinto, METH_VARARGS, "Read from file into buffer." },
 	{ "write", kfs_write, METH_VARARGS, "Write to file." },
 	{ "truncate", kfs_truncate, METH_VARARGS, "Truncate a file." },
 	{ "chunk_locations", kfs_chunkLocations, METH_VARARGS, "Get location(s) of a chunk." },
@@ -591,7 +680,8 @@ PyDoc_STRVAR(File_doc,
 "\topen([mode]) -- reopen closed file\n"
 "\tclose()     -- close file\n"
 "\tread(len)   -- read len bytes, return as string\n"
-"\twrite(str)  -- write string to file\n"
+"\treadinto(buf) -- read into writable buffer, return # of bytes read\n"
+"\twrite(str)  -- write string, or any buffer object to file\n"
 "\ttruncate(off) -- truncate file at specified offset\n"
 "\tseek(off)   -- seek to specified offset\n"
 "\ttell()      -- return current offest\n"
@@ -945,14 +1035,22 @@ kfs_readdir(PyObject *pself, PyObject *args)
 static PyObject *
 package_fattr(KfsFileAttr &fa)
 {
+	static PyObject *dirstr = NULL;
+	static PyObject *filestr = NULL;
+	if (dirstr == NULL) {
+		dirstr = PyString_InternFromString("dir");
+		filestr = PyString_InternFromString("file");
+	}
+	PyObject *type = fa.isDirectory ? dirstr : filestr;
+	Py_INCREF(type);
+
 	PyObject *tuple = PyTuple_New(7);
 	PyTuple_SetItem(tuple, 0, PyString_FromString(fa.filename.c_str()));
 	PyTuple_SetItem(tuple, 1, PyLong_FromLong(fa.fileId));
 	PyTuple_SetItem(tuple, 2, PyString_FromString(ctime(&fa.mtime.tv_sec)));
 	PyTuple_SetItem(tuple, 3, PyString_FromString(ctime(&fa.ctime.tv_sec)));
 	PyTuple_SetItem(tuple, 4, PyString_FromString(ctime(&fa.crtime.tv_sec)));
-	PyTuple_SetItem(tuple, 5, PyString_FromString(
-				fa.isDirectory ? "dir" : "file"));
+	PyTuple_SetItem(tuple, 5, type);
 	PyTuple_SetItem(tuple, 6, PyLong_FromLong(fa.fileSize));
 
 	return tuple;
@@ -977,7 +1075,10 @@ kfs_readdirplus(PyObject *pself, PyObject *args)
 	string path = build_path(self->cwd, patharg);
 
 	vector <KfsFileAttr> result;
-	int status = self->client->ReaddirPlus(path.c_str(), result);
+	int status;
+	Py_BEGIN_ALLOW_THREADS
+	status = self->client->ReaddirPlus(path.c_str(), result);
+	Py_END_ALLOW_THREADS
 	if (status < 0) {
 		PyErr_SetString(PyExc_IOError, strerror(-status));
 		return NULL;
@@ -991,6 +1092,77 @@ kfs_readdirplus(PyObject *pself, PyObject *args)
 	return outer;
 }
 
+/*!
+ * \brief read part of directory with attributes
+ *
+ * Lists a directory one batch at a time with the paged readdirplus rpc,
+ * so that the memory used is bounded by the batch size.  The attributes
+ * are numeric, thus each entry costs a name string, and a few numbers:
+ *
+ * ((name, fid, mtime, ctime, crtime, isdir, size), ...), next
+ *
+ * where the times are in seconds, and next is the start argument for the
+ * next batch, or None at the end of the directory.
+ */
+static PyObject *
+kfs_readdirplus_batch(PyObject *pself, PyObject *args)
+{
+	kfs_Client *self = (kfs_Client *)pself;
+	char *patharg;
+	char *startarg = (char *)"";
+	int count = 1024;
+
+	if (!PyArg_ParseTuple(args, "s|si", &patharg, &startarg, &count))
+		return NULL;
+	if (count <= 0) {
+		PyErr_SetString(PyExc_ValueError, "count must be positive");
+		return NULL;
+	}
+
+	string path = build_path(self->cwd, patharg);
+	string start(startarg);
+
+	vector <KfsFileAttr> result;
+	bool more = false;
+	int status;
+	Py_BEGIN_ALLOW_THREADS
+	status = self->client->ReaddirPlus(
+		path.c_str(), start, count, result, more);
+	Py_END_ALLOW_THREADS
+	if (status < 0) {
+		PyErr_SetString(PyExc_IOError, strerror(-status));
+		return NULL;
+	}
+	int n = result.size();
+	PyObject *outer = PyTuple_New(n);
+	if (outer == NULL)
+		return NULL;
+	for (int i = 0; i != n; i++) {
+		const KfsFileAttr &fa = result[i];
+		PyObject *isdir = fa.isDirectory ? Py_True : Py_False;
+		Py_INCREF(isdir);
+		PyObject *inner = PyTuple_New(7);
+		if (inner == NULL) {
+			Py_DECREF(isdir);
+			Py_DECREF(outer);
+			return NULL;
+		}
+		PyTuple_SET_ITEM(inner, 0,
+			PyString_FromStringAndSize(fa.filename.data(),
+				fa.filename.size()));
+		PyTuple_SET_ITEM(inner, 1, PyLong_FromLongLong(fa.fileId));
+		PyTuple_SET_ITEM(inner, 2, PyInt_FromLong(fa.mtime.tv_sec));
+		PyTuple_SET_ITEM(inner, 3, PyInt_FromLong(fa.ctime.tv_sec));
+		PyTuple_SET_ITEM(inner, 4, PyInt_FromLong(fa.crtime.tv_sec));
+		PyTuple_SET_ITEM(inner, 5, isdir);
+		PyTuple_SET_ITEM(inner, 6, PyLong_FromLongLong(fa.fileSize));
+		PyTuple_SET_ITEM(outer, i, inner);
+	}
+	if (!more || n == 0)
+		return Py_BuildValue("(NO)", outer, Py_None);
+	return Py_BuildValue("(Ns)", outer, result.back().filename.c_str());
+}
+
 static PyObject *
 kfs_stat(PyObject *pself, PyObject *args)
 {
@@ -121,6 +121,7 @@ Then meta server updates list of chunk servers hosting the chunk based on the
 #include <iomanip>
 #include <sstream>
 #include <cerrno>
+#include <cstdlib>
 #include <boost/pool/pool_alloc.hpp>
 
 #include "common/log.h"
@@ -161,6 +162,8 @@ RecordAppendOp::RecordAppendOp(kfsSeq_t s)
       checksum(0),
       servers(),
       masterCommittedOffset(-1),
+      recordCount(0),
+      recordLengths(),
       dataBuf(),
       origClnt(0),
       origSeq(s),
@@ -189,7 +192,8 @@ RecordAppendOp::Show() const
        " servers: " << servers <<
        " checksum: " << checksum <<
        " client-seq: " << clientSeq <<
-       " master-committed: " << masterCommittedOffset
+       " master-committed: " << masterCommittedOffset <<
+       " records: " << recordCount
     ;
     return os.str();
 }
@@ -215,6 +219,38 @@ AtomicRecordAppendManager::DecAppendersWithWidCount()
     }
 }
 
+// The batched append carries the lengths of the client's records: each
+// record must be non empty, and the records must add up to the append.
+// The appends from the senders that do not send the lengths are not
+// validated.
+static bool
+IsValidRecordLengths(const RecordAppendOp& op)
+{
+    if (op.recordLengths.empty()) {
+        return true;
+    }
+    const char* p     = op.recordLengths.c_str();
+    int         count = 0;
+    size_t      sum   = 0;
+    for (; ;) {
+        while (*p == ' ') {
+            p++;
+        }
+        if (! *p) {
+            break;
+        }
+        char*      e   = 0;
+        const long len = strtol(p, &e, 10);
+        if (e == p || len <= 0 || (*e && *e != ' ') ||
+                (sum += len) > op.numBytes) {
+            return false;
+        }
+        count++;
+        p = e;
+    }
+    return (count == op.recordCount && sum == op.numBytes);
+}
+
 // One per chunk
 class AtomicRecordAppender : public KfsCallbackObj
 {
@@ -1095,6 +1131,15 @@ AtomicRecordAppender::AppendBegin(
     } else if (mNumServers != op->numServers) {
         status = kErrParameters;
         msg    = "invalid replication factor";
+    } else if (op->recordCount < 0 ||
+            size_t(op->recordCount) > op->numBytes) {
+        // Batched appends carry the number of the client's records; each
+        // record is at least one byte.
+        status = kErrParameters;
+        msg    = "invalid record count";
+    } else if (! IsValidRecordLengths(*op)) {
+        status = kErrParameters;
+        msg    = "invalid record boundaries";
     } else if (mNextOffset + op->numBytes > off_t(CHUNKSIZE)) {
         msg    = "out of chunk space";
         status = kErrParameters;
@@ -1220,7 +1265,7 @@ AtomicRecordAppender::AppendBegin(
     // for replication health check.
     RemoteSyncSMPtr peer;
     if (status == 0 && uint32_t(mReplicationPos + 1) < mNumServers) {
-        if (! (peer = gChunkServer.FindServer(peerLoc))) {
+        if (! (peer = gChunkServer.FindServer(peerLoc, true, mChunkId))) {
             status = kErrReplicationFailed;
             msg    = "replication connection setup failure";
         } else {
@@ -1376,6 +1421,7 @@ AtomicRecordAppender::OpDone(RecordAppendOp* op)
         Cntrs().mAppendCount++;
         if (op->status >= 0) {
             Cntrs().mAppendByteCount += op->numBytes;
+            Cntrs().mAppendRecordCount += op->recordCount;
         } else {
             Cntrs().mAppendErrorCount++;
             if (mState == kStateReplicationFailed) {
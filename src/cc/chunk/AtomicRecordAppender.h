@@ -47,6 +47,7 @@ public:
 
         Counter mAppendCount;
         Counter mAppendByteCount;
+        Counter mAppendRecordCount;
         Counter mAppendErrorCount;
         Counter mReplicationErrorCount;
         Counter mReplicationTimeoutCount;
@@ -80,6 +81,7 @@ public:
         {
             mAppendCount = 0;
             mAppendByteCount = 0;
+            mAppendRecordCount = 0;
             mAppendErrorCount = 0;
             mReplicationErrorCount = 0;
             mReplicationTimeoutCount = 0;
@@ -0,0 +1,202 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2010/12/22
+//
+// Copyright 2010 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Background (re-replication) io rate limiter implementation.
+//----------------------------------------------------------------------------
+
+#include "BackgroundIoThrottle.h"
+
+#include "common/log.h"
+#include "common/properties.h"
+#include "libkfsIO/Globals.h"
+#include "libkfsIO/KfsCallbackObj.h"
+
+#include <sys/time.h>
+#include <algorithm>
+
+namespace KFS
+{
+
+using std::string;
+using std::min;
+using std::make_pair;
+
+BackgroundIoThrottle gBackgroundIoThrottle;
+
+void
+BackgroundIoThrottle::Bucket::SetRate(double rate, int64_t now)
+{
+    // Start with the full burst, or keep the current balance.
+    mTokens = (mRate > 0 && rate > 0) ? min(mTokens, rate) : rate;
+    mRate   = rate;
+    mTime   = now;
+}
+
+void
+BackgroundIoThrottle::Bucket::Refill(int64_t now)
+{
+    if (mRate <= 0 || now <= mTime) {
+        return;
+    }
+    mTokens = min(mRate, mTokens + mRate * (now - mTime) * 1e-6);
+    mTime   = now;
+}
+
+BackgroundIoThrottle::BackgroundIoThrottle()
+    : ITimeout(),
+      mNetBytesRate(0),
+      mDiskBytesRate(0),
+      mDiskOpsRate(0),
+      mNetBytes(),
+      mDisks(),
+      mWaiters(),
+      mRegisteredFlag(false),
+      mCounters()
+{
+}
+
+BackgroundIoThrottle::~BackgroundIoThrottle()
+{
+    // Not unregistered: the global net manager might be already gone.
+}
+
+void
+BackgroundIoThrottle::SetParameters(const Properties& props)
+{
+    mNetBytesRate = props.getValue(
+        "chunkServer.replication.maxNetBytesPerSec", mNetBytesRate);
+    mDiskBytesRate = props.getValue(
+        "chunkServer.replication.maxDiskBytesPerSec", mDiskBytesRate);
+    mDiskOpsRate = props.getValue(
+        "chunkServer.replication.maxDiskOpsPerSec", mDiskOpsRate);
+    const int64_t now = NowUsec();
+    mNetBytes.SetRate(mNetBytesRate, now);
+    for (Disks::iterator it = mDisks.begin(); it != mDisks.end(); ++it) {
+        it->second.mBytes.SetRate(mDiskBytesRate, now);
+        it->second.mOps.SetRate(mDiskOpsRate, now);
+    }
+    if (! mRegisteredFlag) {
+        mRegisteredFlag = true;
+        libkfsio::globalNetManager().RegisterTimeoutHandler(this);
+    }
+    KFS_LOG_STREAM_INFO <<
+        "replication throttle:"
+        " net bytes/sec: "  << mNetBytesRate <<
+        " disk bytes/sec: " << mDiskBytesRate <<
+        " disk ops/sec: "   << mDiskOpsRate <<
+    KFS_LOG_EOM;
+}
+
+int64_t
+BackgroundIoThrottle::NowUsec()
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return (int64_t(tv.tv_sec) * 1000 * 1000 + tv.tv_usec);
+}
+
+BackgroundIoThrottle::Disk&
+BackgroundIoThrottle::GetDisk(const string& dirName, int64_t now)
+{
+    Disks::iterator it = mDisks.find(dirName);
+    if (it == mDisks.end()) {
+        it = mDisks.insert(make_pair(dirName, Disk())).first;
+        it->second.mBytes.SetRate(mDiskBytesRate, now);
+        it->second.mOps.SetRate(mDiskOpsRate, now);
+    }
+    return it->second;
+}
+
+void
+BackgroundIoThrottle::Take(Disk& disk, int64_t bytes)
+{
+    mNetBytes.Take(bytes);
+    disk.mBytes.Take(bytes);
+    disk.mOps.Take(1);
+    mCounters.mBytes += bytes;
+}
+
+bool
+BackgroundIoThrottle::Acquire(const string& dirName, int64_t bytes,
+    KfsCallbackObj* cb)
+{
+    const int64_t now  = NowUsec();
+    Disk&         disk = GetDisk(dirName, now);
+    mNetBytes.Refill(now);
+    disk.mBytes.Refill(now);
+    disk.mOps.Refill(now);
+    // Do not pass the requests that are already waiting.
+    if (mWaiters.empty() && CanStart(disk)) {
+        Take(disk, bytes);
+        return true;
+    }
+    mWaiters.push_back(Waiter(cb, &disk, bytes, now));
+    mCounters.mThrottledCount++;
+    mCounters.mThrottledBytes += bytes;
+    return false;
+}
+
+void
+BackgroundIoThrottle::Cancel(KfsCallbackObj* cb)
+{
+    for (Waiters::iterator it = mWaiters.begin(); it != mWaiters.end(); ) {
+        if (it->mCb == cb) {
+            it = mWaiters.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void
+BackgroundIoThrottle::Timeout()
+{
+    if (mWaiters.empty()) {
+        return;
+    }
+    const int64_t now = NowUsec();
+    mNetBytes.Refill(now);
+    // The waiters blocked by their disk buckets do not hold the ones
+    // queued behind them to the other disks.
+    Waiters ready;
+    for (Waiters::iterator it = mWaiters.begin();
+            it != mWaiters.end() && ! mNetBytes.IsLimited(); ) {
+        Disk& disk = *it->mDisk;
+        disk.mBytes.Refill(now);
+        disk.mOps.Refill(now);
+        if (CanStart(disk)) {
+            Take(disk, it->mBytes);
+            mCounters.mWaitTimeUsec += now - it->mStart;
+            Waiters::iterator const cur = it++;
+            ready.splice(ready.end(), mWaiters, cur);
+        } else {
+            ++it;
+        }
+    }
+    // The callbacks can acquire again.
+    while (! ready.empty()) {
+        KfsCallbackObj* const cb = ready.front().mCb;
+        ready.pop_front();
+        cb->HandleEvent(EVENT_CMD_DONE, 0);
+    }
+}
+
+}
@@ -0,0 +1,166 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2010/12/22
+//
+// Copyright 2010 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Background (re-replication) io rate limiter.
+//
+// The metaserver bounds the number of concurrent replications per server,
+// but each replication moves the data as fast as the network and the disk
+// allow, and competes with the client io. Both ends of the replication
+// acquire the tokens for each chunk of data: the replicator before sending
+// the read to the source, and the source before reading the data from its
+// disk. Evacuation and rebalancing load the source the most, thus the
+// source's disks and network are paced by its own buckets. The network
+// bucket is shared by all replications, in and out, and each chunk
+// directory has its own bytes and ops buckets. If any bucket has no
+// tokens, the request waits until the buckets are refilled. The buckets
+// can go into debt, thus requests larger than the burst size are admitted,
+// and the average rate is still bounded. The rates are in bytes or ops per
+// second, 0 means no limit.
+//----------------------------------------------------------------------------
+
+#ifndef CHUNKSERVER_BACKGROUNDIOTHROTTLE_H
+#define CHUNKSERVER_BACKGROUNDIOTHROTTLE_H
+
+#include <stdint.h>
+#include <list>
+#include <map>
+#include <string>
+
+#include "libkfsIO/ITimeout.h"
+
+namespace KFS
+{
+class KfsCallbackObj;
+class Properties;
+
+class BackgroundIoThrottle : public ITimeout
+{
+public:
+    struct Counters
+    {
+        Counters()
+            : mThrottledCount(0),
+              mThrottledBytes(0),
+              mWaitTimeUsec(0),
+              mBytes(0),
+              mWaitingCount(0)
+            {}
+        int64_t mThrottledCount; ///< requests that had to wait
+        int64_t mThrottledBytes; ///< bytes of the requests that had to wait
+        int64_t mWaitTimeUsec;   ///< total wait time
+        int64_t mBytes;          ///< total bytes admitted
+        int64_t mWaitingCount;   ///< requests waiting now
+    };
+
+    BackgroundIoThrottle();
+    virtual ~BackgroundIoThrottle();
+    void SetParameters(const Properties& props);
+    /// Acquire the tokens for the io of the given size to the chunk
+    /// directory.
+    /// @retval true if the io can start now; otherwise
+    /// cb->HandleEvent(EVENT_CMD_DONE, 0) is invoked once it can.
+    bool Acquire(const std::string& dirName, int64_t bytes,
+        KfsCallbackObj* cb);
+    /// Remove the waiting request, if any.
+    void Cancel(KfsCallbackObj* cb);
+    void GetCounters(Counters& counters) const
+    {
+        counters = mCounters;
+        counters.mWaitingCount = (int64_t)mWaiters.size();
+    }
+    virtual void Timeout(); // ITimeout
+
+private:
+    class Bucket
+    {
+    public:
+        Bucket()
+            : mRate(0),
+              mTokens(0),
+              mTime(0)
+            {}
+        void SetRate(double rate, int64_t now);
+        /// Add the tokens accumulated since the last call, up to 1 sec.
+        /// worth of tokens.
+        void Refill(int64_t now);
+        bool IsLimited() const
+            { return (mRate > 0 && mTokens < 0); }
+        void Take(double count)
+        {
+            if (mRate > 0) {
+                mTokens -= count;
+            }
+        }
+    private:
+        double  mRate;   ///< per second, 0 -- no limit
+        double  mTokens;
+        int64_t mTime;   ///< last refill time, usec
+    };
+    struct Disk
+    {
+        Bucket mBytes;
+        Bucket mOps;
+    };
+    struct Waiter
+    {
+        Waiter(KfsCallbackObj* cb, Disk* disk, int64_t bytes, int64_t start)
+            : mCb(cb),
+              mDisk(disk),
+              mBytes(bytes),
+              mStart(start)
+            {}
+        KfsCallbackObj* mCb;
+        Disk*           mDisk;
+        int64_t         mBytes;
+        int64_t         mStart;
+    };
+    typedef std::map<std::string, Disk> Disks;
+    typedef std::list<Waiter>           Waiters;
+
+    double   mNetBytesRate;
+    double   mDiskBytesRate;
+    double   mDiskOpsRate;
+    Bucket   mNetBytes;
+    Disks    mDisks;
+    Waiters  mWaiters;
+    bool     mRegisteredFlag;
+    Counters mCounters;
+
+    Disk& GetDisk(const std::string& dirName, int64_t now);
+    bool CanStart(const Disk& disk) const
+    {
+        return (! mNetBytes.IsLimited() &&
+            ! disk.mBytes.IsLimited() && ! disk.mOps.IsLimited());
+    }
+    void Take(Disk& disk, int64_t bytes);
+    static int64_t NowUsec();
+
+private:
+    // No copies.
+    BackgroundIoThrottle(const BackgroundIoThrottle&);
+    BackgroundIoThrottle& operator=(const BackgroundIoThrottle&);
+};
+
+extern BackgroundIoThrottle gBackgroundIoThrottle;
+
+}
+
+#endif // CHUNKSERVER_BACKGROUNDIOTHROTTLE_H
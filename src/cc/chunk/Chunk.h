@@ -30,9 +30,11 @@
 #include <unistd.h>
 #include <string.h>
 #include <boost/shared_ptr.hpp>
+#include <boost/pool/pool.hpp>
 
 #include <vector>
 #include <iomanip>
+#include <new>
 
 #include "common/log.h"
 #include "common/kfstypes.h"
@@ -129,6 +131,70 @@ struct DiskChunkInfo_t {
     char filename[MAX_FILENAME_LEN];
 };
 
+/// Fixed size block allocator for the in-core chunk checksum arrays.
+/// The checksum array is 4KB per chunk, and with large number of chunks
+/// loaded the malloc overhead and fragmentation become noticeable. The
+/// allocator keeps track of the number of blocks in use, and the chunk
+/// manager evicts the checksums of the least recently used chunks when the
+/// memory budget is exceeded.
+class ChunkChecksumAllocator
+{
+public:
+    enum { kBlockSize = MAX_CHUNK_CHECKSUM_BLOCKS * sizeof(uint32_t) };
+
+    static ChunkChecksumAllocator& Instance()
+    {
+        // Never deleted, chunk info can be destroyed by static destructors.
+        static ChunkChecksumAllocator* const sInstance =
+            new ChunkChecksumAllocator();
+        return *sInstance;
+    }
+    uint32_t* Allocate()
+    {
+        uint32_t* const ret = static_cast<uint32_t*>(mPool.malloc());
+        if (! ret) {
+            throw std::bad_alloc();
+        }
+        mInUseCount++;
+        return ret;
+    }
+    void Release(uint32_t* blk)
+    {
+        if (! blk) {
+            return;
+        }
+        assert(mInUseCount > 0);
+        mInUseCount--;
+        mPool.free(blk);
+    }
+    void SetMemoryBudget(int64_t bytes)
+        { mMaxInUseCount = bytes / kBlockSize; }
+    int64_t GetMemoryBudget() const
+        { return (mMaxInUseCount * kBlockSize); }
+    bool IsOverBudget() const
+        { return (mMaxInUseCount > 0 && mInUseCount > mMaxInUseCount); }
+    int64_t GetInUseCount() const
+        { return mInUseCount; }
+    int64_t GetInUseBytes() const
+        { return (mInUseCount * kBlockSize); }
+private:
+    enum { kBlocksPerSlab = 64 };
+    boost::pool<> mPool;
+    int64_t       mInUseCount;
+    int64_t       mMaxInUseCount;
+
+    ChunkChecksumAllocator()
+        : mPool(kBlockSize, kBlocksPerSlab),
+          mInUseCount(0),
+          mMaxInUseCount(0)
+        {}
+    ~ChunkChecksumAllocator()
+        {}
+private:
+    ChunkChecksumAllocator(const ChunkChecksumAllocator&);
+    ChunkChecksumAllocator& operator=(const ChunkChecksumAllocator&);
+};
+
 // This structure is in-core
 struct ChunkInfo_t {
 
@@ -138,7 +204,7 @@ struct ChunkInfo_t {
         // memset(chunkBlockChecksum, 0, sizeof(chunkBlockChecksum));
     }
     ~ChunkInfo_t() {
-        delete [] chunkBlockChecksum;
+        ChunkChecksumAllocator::Instance().Release(chunkBlockChecksum);
     }
     ChunkInfo_t(const ChunkInfo_t &other) :
         fileId(other.fileId), chunkId(other.chunkId), chunkVersion(other.chunkVersion),
@@ -160,7 +226,8 @@ struct ChunkInfo_t {
         fileId = f;
         chunkId = c;
         chunkVersion = v;
-        chunkBlockChecksum = new uint32_t[MAX_CHUNK_CHECKSUM_BLOCKS];
+        ChunkChecksumAllocator::Instance().Release(chunkBlockChecksum);
+        chunkBlockChecksum = ChunkChecksumAllocator::Instance().Allocate();
         memset(chunkBlockChecksum, 0, MAX_CHUNK_CHECKSUM_BLOCKS * sizeof(uint32_t));
     }
 
@@ -177,7 +244,7 @@ struct ChunkInfo_t {
     }
 
     void UnloadChecksums() {
-        delete [] chunkBlockChecksum;
+        ChunkChecksumAllocator::Instance().Release(chunkBlockChecksum);
         chunkBlockChecksum = NULL;
         KFS_LOG_STREAM_DEBUG <<
             "Unloading chunk checksum for chunk " << chunkId <<
@@ -185,13 +252,17 @@ struct ChunkInfo_t {
     }
 
     void SetChecksums(const uint32_t *checksums) {
-        delete [] chunkBlockChecksum;
         if (checksums == NULL) {
+            ChunkChecksumAllocator::Instance().Release(chunkBlockChecksum);
             chunkBlockChecksum = NULL;
             return;
         }
-
-        chunkBlockChecksum = new uint32_t[MAX_CHUNK_CHECKSUM_BLOCKS];
+        if (checksums == chunkBlockChecksum) {
+            return;
+        }
+        if (! chunkBlockChecksum) {
+            chunkBlockChecksum = ChunkChecksumAllocator::Instance().Allocate();
+        }
         memcpy(chunkBlockChecksum, checksums, MAX_CHUNK_CHECKSUM_BLOCKS * sizeof(uint32_t));
     }
 
@@ -233,8 +304,9 @@ struct ChunkInfo_t {
         chunkSize = dci.chunkSize;
         chunkVersion = dci.chunkVersion;
 
-        delete [] chunkBlockChecksum;
-        chunkBlockChecksum = new uint32_t[MAX_CHUNK_CHECKSUM_BLOCKS];
+        if (! chunkBlockChecksum) {
+            chunkBlockChecksum = ChunkChecksumAllocator::Instance().Allocate();
+        }
         memcpy(chunkBlockChecksum, dci.chunkBlockChecksum,
                MAX_CHUNK_CHECKSUM_BLOCKS * sizeof(uint32_t));
         KFS_LOG_STREAM_DEBUG <<
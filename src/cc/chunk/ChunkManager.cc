@@ -55,6 +55,8 @@ extern "C" {
 #include <algorithm>
 #include <string>
 #include <set>
+#include <new>
+#include <boost/pool/pool.hpp>
 
 using std::ofstream;
 using std::ifstream;
@@ -81,6 +83,28 @@ ChunkManager gChunkManager;
 typedef QCDLList<ChunkInfoHandle, 0> ChunkLru;
 typedef QCDLList<ChunkInfoHandle, 1> PendingMetaSyncQueue;
 
+// The chunk header image is written in io buffer size blocks. The first
+// block has the chunk size, version, and all but the last few checksums, and
+// is always written. The remaining "tail" blocks are written only when their
+// content changes, which with 64K checksum blocks happens only when the last
+// 640K of the chunk are written.
+const int kChunkHeaderIoBlockSize  = 4 << 10;
+const int kChunkHeaderTailBlocks   =
+    (int(sizeof(DiskChunkInfo_t)) + kChunkHeaderIoBlockSize - 1) /
+    kChunkHeaderIoBlockSize - 1;
+
+static inline uint64_t
+ChunkHeaderBlockHash(const char* buf, int len)
+{
+    // 64 bit FNV-1a.
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char* const end = buf + len; buf < end; ++buf) {
+        hash ^= (unsigned char)*buf;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
 /// Encapsulate a chunk file descriptor and information about the
 /// chunk such as name and version #.
 class ChunkInfoHandle : public KfsCallbackObj
@@ -89,17 +113,35 @@ public:
     ChunkInfoHandle()
         : KfsCallbackObj(),
           lastIOTime(0),
+          metaDirtyTime(0),
           readChunkMetaOp(NULL),
           isBeingReplicated(false),
           createFile(false),
           mMetaSyncPending(false),
           mMetaSyncInFlight(false),
           mDeleteFlag(false),
-          mWriteAppenderOwnsFlag(false)
+          mWriteAppenderOwnsFlag(false),
+          mHeaderTailHashValidFlag(false)
     {
         ChunkLru::Init(*this);
         PendingMetaSyncQueue::Init(*this);
     }
+    // Handles are allocated from the slab pool, to avoid malloc overhead
+    // with large number of chunks.
+    static void* operator new(size_t size)
+    {
+        assert(size == sizeof(ChunkInfoHandle));
+        void* const ret = sPool.malloc();
+        if (! ret) {
+            throw std::bad_alloc();
+        }
+        return ret;
+    }
+    static void operator delete(void* ptr)
+        { sPool.free(ptr); }
+    static size_t GetPoolMemoryUsage(size_t count)
+        { return (count * sPool.get_requested_size()); }
+
     void Delete(ChunkInfoHandle** chunkInfoLists)
     {
         ChunkLru::Remove(chunkInfoLists, *this);
@@ -121,6 +163,7 @@ public:
     /// offset by the header amount
     DiskIo::FilePtr dataFH;
     time_t lastIOTime;  // when was the last I/O done on this chunk
+    time_t metaDirtyTime; // when the pending meta data sync was scheduled
 
     /// keep track of the op that is doing the read
     ReadChunkMetaOp *readChunkMetaOp;
@@ -135,7 +178,11 @@ public:
         return (IsFileOpen() && ! dataFH.unique());
     }
 
-    bool SyncMeta();
+    bool SyncMeta(bool forceFlag = false);
+    bool IsMetaSyncPending() const {
+        return mMetaSyncPending;
+    }
+    int TrimCleanHeaderBlocks(IOBuffer& buf);
     inline void LruUpdate(ChunkInfoHandle** chunkInfoLists);
     inline void ScheduleSyncMeta(ChunkInfoHandle** chunkInfoLists);
     inline void SetMetaWriteInFlight(ChunkInfoHandle** chunkInfoLists, KfsOp* op);
@@ -150,8 +197,11 @@ private:
     bool             mMetaSyncInFlight:1;
     bool             mDeleteFlag:1;
     bool             mWriteAppenderOwnsFlag:1;
+    bool             mHeaderTailHashValidFlag:1;
+    uint64_t         mHeaderTailHash[kChunkHeaderTailBlocks];
     ChunkInfoHandle* mPrevPtr[ChunkManager::kChunkInfoHandleListCount];
     ChunkInfoHandle* mNextPtr[ChunkManager::kChunkInfoHandleListCount];
+    static boost::pool<> sPool;
 
     int HandleChunkMetaWriteDone(int code, void *data);
     virtual ~ChunkInfoHandle() {
@@ -168,6 +218,8 @@ private:
     ChunkInfoHandle& operator=(const  ChunkInfoHandle&);
 };
 
+boost::pool<> ChunkInfoHandle::sPool(sizeof(ChunkInfoHandle), 1 << 10);
+
 inline bool ChunkManager::IsInLru(const ChunkInfoHandle& cih) const {
     return ChunkLru::IsInList(mChunkInfoLists, cih);
 }
@@ -184,6 +236,9 @@ inline void ChunkInfoHandle::LruUpdate(ChunkInfoHandle** chunkInfoLists) {
 }
 
 inline void ChunkInfoHandle::ScheduleSyncMeta(ChunkInfoHandle** chunkInfoLists) {
+    if (! mMetaSyncPending) {
+        metaDirtyTime = globalNetManager().Now();
+    }
     mMetaSyncPending = true;
     LruUpdate(chunkInfoLists); // pretent that we've scheduled io
     PendingMetaSyncQueue::PushBack(chunkInfoLists, *this);
@@ -246,6 +301,9 @@ ChunkInfoHandle::Release(ChunkInfoHandle** chunkInfoLists)
         KFS_LOG_EOM;
         dataFH.reset();
     }
+    // The header might be re-written by other means while the file is closed,
+    // write the whole header on the next open.
+    mHeaderTailHashValidFlag = false;
     KFS_LOG_STREAM_INFO <<
         "Closing chunk " << chunkInfo.chunkId << " and might give up lease" <<
     KFS_LOG_EOM;
@@ -270,6 +328,7 @@ ChunkInfoHandle::HandleChunkMetaWriteDone(int code, void *data)
             "failed to sync meta for chunk " << chunkInfo.chunkId <<
             " status: " << status <<
         KFS_LOG_EOM;
+        mHeaderTailHashValidFlag = false;
         if (! isBeingReplicated &&
                 ! gChunkManager.IsWritePending(chunkInfo.chunkId)) {
             gChunkManager.ChunkIOFailed(chunkInfo.chunkId, -EIO);
@@ -282,7 +341,7 @@ ChunkInfoHandle::HandleChunkMetaWriteDone(int code, void *data)
 }
 
 bool
-ChunkInfoHandle::SyncMeta()
+ChunkInfoHandle::SyncMeta(bool forceFlag)
 {
     if (! mMetaSyncPending || mMetaSyncInFlight ||
             isBeingReplicated || ! IsFileOpen()) {
@@ -295,8 +354,9 @@ ChunkInfoHandle::SyncMeta()
     int     blockSize;
     dataFH->GetDiskQueuePendingCount(freeRequestCount, requestCount,
         readBlockCount, writeBlockCount, blockSize);
-    if (freeRequestCount <= 0 || requestCount * 2 > freeRequestCount ||
-            int64_t(writeBlockCount) * blockSize > (int64_t(128) << 20)) {
+    if (! forceFlag && (
+            freeRequestCount <= 0 || requestCount * 2 > freeRequestCount ||
+            int64_t(writeBlockCount) * blockSize > (int64_t(128) << 20))) {
         KFS_LOG_STREAM_INFO << "deferring chunk meta data sync for: " <<
             chunkInfo.chunkId <<
             " requests: " << requestCount <<
@@ -314,6 +374,46 @@ ChunkInfoHandle::SyncMeta()
     return mMetaSyncInFlight;
 }
 
+/// Trim the serialized header image in the buffer to the smallest prefix
+/// that includes all the blocks that changed since the last header write.
+/// Returns the number of bytes to write.
+int
+ChunkInfoHandle::TrimCleanHeaderBlocks(IOBuffer& buf)
+{
+    const int numBytes = buf.BytesConsumable();
+    uint64_t  hash[kChunkHeaderTailBlocks];
+    int       lastDirty = 0;
+    int       i         = -1;
+    for (IOBuffer::iterator it = buf.begin(); it != buf.end(); ++it) {
+        if (it->IsEmpty()) {
+            continue;
+        }
+        if (it->BytesConsumable() != kChunkHeaderIoBlockSize ||
+                ++i > kChunkHeaderTailBlocks) {
+            // Unexpected buffer layout, write everything.
+            mHeaderTailHashValidFlag = false;
+            return numBytes;
+        }
+        if (i <= 0) {
+            continue;
+        }
+        hash[i - 1] = ChunkHeaderBlockHash(
+            it->Consumer(), kChunkHeaderIoBlockSize);
+        if (! mHeaderTailHashValidFlag || hash[i - 1] != mHeaderTailHash[i - 1]) {
+            lastDirty = i;
+        }
+    }
+    if (i != kChunkHeaderTailBlocks) {
+        mHeaderTailHashValidFlag = false;
+        return numBytes;
+    }
+    std::copy(hash, hash + kChunkHeaderTailBlocks, mHeaderTailHash);
+    mHeaderTailHashValidFlag = true;
+    const int ret = (lastDirty + 1) * kChunkHeaderIoBlockSize;
+    buf.Trim(ret);
+    return ret;
+}
+
 /// A Timeout interface object for taking checkpoints on the
 /// ChunkManager object.
 class ChunkManager::ChunkManagerTimeoutImpl : public ITimeout {
@@ -359,6 +459,9 @@ ChunkManager::ChunkManager()
     mChunkManagerTimeoutImpl = 0;
     mIsChunkTableDirty = false;
     mLastDriveChosen = -1;
+    mDirLoadWeight = 1.0;
+    mDirLoadQueueDepth = 8;
+    mDirLoadIoTimeMicroSec = 50 * 1000;
     time_t now = time(NULL);
     srand48(now);
     mMaxOpenChunkFiles = 1 << 10;
@@ -367,6 +470,7 @@ ChunkManager::ChunkManager()
     PendingMetaSyncQueue::Init(mChunkInfoLists);
     mNextPendingMetaSyncScanTime = 0;
     mMetaSyncDelayTimeSecs = 5;
+    mMetaSyncMaxDelayTimeSecs = 30;
     mNextInactiveFdCleanupTime = 0;
     mInactiveFdsCleanupIntervalSecs = 300;
     mNextInactiveFdCleanupTime = 0;
@@ -391,6 +495,9 @@ ChunkManager::~ChunkManager()
 void
 ChunkManager::Shutdown()
 {
+    // Write out all delayed chunk headers, the loop below waits for the
+    // writes to complete, as the files with io in flight are "in use".
+    SyncPendingMeta();
     ScavengePendingWrites(time(0) + 2 * mMaxPendingWriteLruSecs);
     for (CMI iter = mChunkTable.begin(); iter != mChunkTable.end(); ) {
         ChunkInfoHandle * const cih = iter->second;
@@ -440,6 +547,16 @@ ChunkManager::Shutdown()
     }
 }
 
+void
+ChunkManager::SyncPendingMeta()
+{
+    PendingMetaSyncQueue::Iterator it(mChunkInfoLists);
+    ChunkInfoHandle* cih;
+    while ((cih = it.Next())) {
+        cih->SyncMeta(true);
+    }
+}
+
 bool
 ChunkManager::IsWriteAppenderOwns(kfsChunkId_t chunkId) const
 {
@@ -459,6 +576,9 @@ ChunkManager::Init(const vector<string> &chunkDirs, int64_t totalSpace, const Pr
     mMetaSyncDelayTimeSecs = std::max(1, prop.getValue(
         "chunkServer.metaSyncDelayTimeSecs",
         mMetaSyncDelayTimeSecs));
+    mMetaSyncMaxDelayTimeSecs = std::max(mMetaSyncDelayTimeSecs,
+        prop.getValue("chunkServer.metaSyncMaxDelayTimeSecs",
+        mMetaSyncMaxDelayTimeSecs));
     mMaxPendingWriteLruSecs = std::max(1, prop.getValue(
         "chunkServer.maxPendingWriteLruSecs",
         mMaxPendingWriteLruSecs));
@@ -468,6 +588,20 @@ ChunkManager::Init(const vector<string> &chunkDirs, int64_t totalSpace, const Pr
     mChunkDirsCheckIntervalSecs = std::max(1, prop.getValue(
         "chunkServer.chunkDirsCheckIntervalSecs",
         mChunkDirsCheckIntervalSecs));
+    // 0 -- no limit. Checksums are unloaded by the inactive fd cleanup.
+    ChunkChecksumAllocator::Instance().SetMemoryBudget(prop.getValue(
+        "chunkServer.checksumMemoryBudget",
+        int64_t(256) << 20));
+    // 0 -- place chunks by free space only.
+    mDirLoadWeight = std::max(0., prop.getValue(
+        "chunkServer.dirLoadWeight",
+        mDirLoadWeight));
+    mDirLoadQueueDepth = std::max(1, prop.getValue(
+        "chunkServer.dirLoadQueueDepth",
+        mDirLoadQueueDepth));
+    mDirLoadIoTimeMicroSec = std::max(int64_t(1), prop.getValue(
+        "chunkServer.dirLoadIoTimeMicroSec",
+        mDirLoadIoTimeMicroSec));
 
     mTotalSpace = totalSpace;
     for (uint32_t i = 0; i < chunkDirs.size(); i++) {
@@ -615,6 +749,8 @@ ChunkManager::MakeChunkStable(kfsChunkId_t chunkId)
     );
     cih->SetWriteAppenderOwns(mChunkInfoLists, false);
     mPendingWrites.Delete(chunkId, cih->chunkInfo.chunkVersion);
+    // Do not leave the header of the stable chunk in the write back window.
+    cih->SyncMeta(true);
     // strip out the "/dirty" and do the rename
     string       dirname  = cih->chunkInfo.GetDirname();
     const string dirtyDir = GetDirtyChunkPath(string());
@@ -797,10 +933,10 @@ ChunkManager::WriteChunkMetadata(kfsChunkId_t chunkId, KfsCallbackObj *cb)
     wcm->dataBuf = new IOBuffer();
     cih->chunkInfo.Serialize(wcm->dataBuf);
     wcm->dataBuf->ZeroFillLast();
-    const size_t numBytes = wcm->dataBuf->BytesConsumable();
-    if (KFS_CHUNK_HEADER_SIZE < numBytes) {
+    if (KFS_CHUNK_HEADER_SIZE < (size_t)wcm->dataBuf->BytesConsumable()) {
         die("bad io buffer size");
     }
+    const size_t numBytes = cih->TrimCleanHeaderBlocks(*wcm->dataBuf);
     LruUpdate(*cih);
 
     res = wcm->diskIo->Write(0, numBytes, wcm->dataBuf);
@@ -808,6 +944,8 @@ ChunkManager::WriteChunkMetadata(kfsChunkId_t chunkId, KfsCallbackObj *cb)
         delete wcm;
     } else {
         cih->SetMetaWriteInFlight(mChunkInfoLists, wcm);
+        mCounters.mMetaWriteCount++;
+        mCounters.mMetaWriteByteCount += numBytes;
     }
     return res >= 0 ? 0 : res;
 }
@@ -822,6 +960,9 @@ ChunkManager::ScheduleWriteChunkMetadata(kfsChunkId_t chunkId)
     ChunkInfoHandle *cih = tableEntry->second;
     if (! cih->chunkInfo.AreChecksumsLoaded())
         return -EINVAL;
+    if (cih->IsMetaSyncPending()) {
+        mCounters.mMetaWriteCoalescedCount++;
+    }
     cih->ScheduleSyncMeta(mChunkInfoLists);
     return 0;
 }
@@ -1107,20 +1248,63 @@ ChunkManager::UpdateDirSpace(ChunkInfoHandle *cih, off_t nbytes)
     }
 }
 
+double
+ChunkManager::GetDirLoad(const string& dirname, DirLoad* dirLoad) const
+{
+    DiskIo::DeviceLoad dl;
+    if (! DiskIo::GetDeviceLoad(dirname.c_str(), dl)) {
+        return 0;
+    }
+    const double load =
+        double(dl.mReadReqCount + dl.mWriteReqCount) / mDirLoadQueueDepth +
+        double(dl.mAvgIoTimeMicroSec) / mDirLoadIoTimeMicroSec;
+    if (dirLoad) {
+        dirLoad->dirname           = dirname;
+        dirLoad->readReqCount      = dl.mReadReqCount;
+        dirLoad->writeReqCount     = dl.mWriteReqCount;
+        dirLoad->readPendingBytes  = dl.mReadPendingBytes;
+        dirLoad->writePendingBytes = dl.mWritePendingBytes;
+        dirLoad->avgIoTimeMicroSec = dl.mAvgIoTimeMicroSec;
+        dirLoad->load              = load;
+    }
+    return load;
+}
+
+void
+ChunkManager::GetDirLoad(vector<DirLoad>& dirs) const
+{
+    dirs.clear();
+    for (uint32_t i = 0; i < mChunkDirs.size(); i++) {
+        if (mChunkDirs[i].availableSpace <= 0) {
+            continue;
+        }
+        dirs.push_back(DirLoad());
+        GetDirLoad(mChunkDirs[i].dirname, &dirs.back());
+    }
+}
+
 string
 ChunkManager::GetDirForChunk()
 {
     if (mChunkDirs.size() == 1)
         return mChunkDirs[0].dirname;
 
-    // do weighted random, so that we can fill all drives
-    off_t totalFreeSpace = 0;
+    // Do weighted random, so that we can fill all drives. The weight is the
+    // free space scaled down by the disk load, in order to keep new chunks,
+    // and with them the writes and subsequent reads, away from the disks
+    // that already have deep queues or slow ios.
+    vector<double> weights(mChunkDirs.size(), 0.);
+    double totalWeight = 0;
     for (uint32_t i = 0; i < mChunkDirs.size(); i++) {
         if ((mChunkDirs[i].availableSpace <= 0) ||
             ((mChunkDirs[i].availableSpace - mChunkDirs[i].usedSpace) < (off_t) CHUNKSIZE)) {
             continue;
         }
-        totalFreeSpace += (mChunkDirs[i].availableSpace - mChunkDirs[i].usedSpace);
+        weights[i] = (double) (mChunkDirs[i].availableSpace - mChunkDirs[i].usedSpace);
+        if (mDirLoadWeight > 0) {
+            weights[i] /= 1. + mDirLoadWeight * GetDirLoad(mChunkDirs[i].dirname);
+        }
+        totalWeight += weights[i];
     }
 
     bool found = false;
@@ -1128,11 +1312,10 @@ ChunkManager::GetDirForChunk()
     double bucketLow = 0.0, bucketHi = 0.0;
     double randVal = drand48();
     for (uint32_t i = 0; i < mChunkDirs.size(); i++) {
-        if ((mChunkDirs[i].availableSpace <= 0) ||
-            ((mChunkDirs[i].availableSpace - mChunkDirs[i].usedSpace) < (off_t) CHUNKSIZE)) {
+        if (weights[i] <= 0) {
             continue;
         }
-        bucketHi = bucketLow + ((double) (mChunkDirs[i].availableSpace - mChunkDirs[i].usedSpace) / (double) totalFreeSpace);
+        bucketHi = bucketLow + weights[i] / totalWeight;
         if ((bucketLow <= randVal) && (randVal <= bucketHi)) {
             dirToUse = i;
             found = true;
@@ -1144,8 +1327,7 @@ ChunkManager::GetDirForChunk()
     if (!found) {
         // to account for rounding errors, if we didn't pick a drive, but some drive has space, use it.
         for (uint32_t i = 0; i < mChunkDirs.size(); i++) {
-            if ((mChunkDirs[i].availableSpace <= 0) ||
-                ((mChunkDirs[i].availableSpace - mChunkDirs[i].usedSpace) < (off_t) CHUNKSIZE)) {
+            if (weights[i] <= 0) {
                 continue;
             }
             dirToUse = i;
@@ -1304,7 +1486,7 @@ ChunkManager::CloseChunk(kfsChunkId_t chunkId)
     }
 
     // Close file if not in use.
-    if (cih->IsFileOpen() && ! cih->IsFileInUse() && ! cih->SyncMeta()) {
+    if (cih->IsFileOpen() && ! cih->IsFileInUse() && ! cih->SyncMeta(true)) {
         Release(*cih);
     } else {
         KFS_LOG_STREAM_INFO <<
@@ -1376,6 +1558,7 @@ ChunkManager::ReadChunk(ReadOp *op)
         return -KFS::ESERVERBUSY;
 
     op->diskIo.reset(d);
+    op->diskIo->SetBackgroundFlag(op->isForReplication);
 
     // schedule a read based on the chunk size
     if (op->offset >= cih->chunkInfo.chunkSize) {
@@ -1524,6 +1707,7 @@ ChunkManager::WriteChunk(WriteOp *op)
         return -KFS::ESERVERBUSY;
 
     op->diskIo.reset(d);
+    op->diskIo->SetBackgroundFlag(op->isFromReReplication);
 
     /*
     KFS_LOG_STREAM_DEBUG <<
@@ -2320,18 +2504,31 @@ ChunkManager::Timeout()
         // cleanup inactive fd's and thereby free up fd's
         CleanupInactiveFds(now);
     } else if (now > mNextPendingMetaSyncScanTime) {
+        // The queue is in the last io time order. Continuous writes keep
+        // pushing the sync back, the max delay bounds the time the header
+        // can stay dirty.
         PendingMetaSyncQueue::Iterator it(mChunkInfoLists);
         int i = 0;
         ChunkInfoHandle* cih;
-        while ((cih = it.Next()) &&
-                cih->lastIOTime + mMetaSyncDelayTimeSecs < now) {
+        while ((cih = it.Next())) {
+            const bool idleFlag =
+                cih->lastIOTime + mMetaSyncDelayTimeSecs < now;
+            const bool expiredFlag =
+                cih->metaDirtyTime + mMetaSyncMaxDelayTimeSecs < now;
+            if (! idleFlag && ! expiredFlag) {
+                continue;
+            }
             KFS_LOG_STREAM_DEBUG << "[" << ++i <<
                 "] starting sync for chunkId=" << cih->chunkInfo.chunkId <<
+                (idleFlag ? "" : " max delay exceeded") <<
             KFS_LOG_EOM;
-            cih->SyncMeta();
+            cih->SyncMeta(expiredFlag);
         }
         mNextPendingMetaSyncScanTime = now + (mMetaSyncDelayTimeSecs + 2) / 3;
     }
+    if (ChunkChecksumAllocator::Instance().IsOverBudget()) {
+        CleanupInactiveFds();
+    }
     if (now > mNextChunkDirsCheckTime) {
         // once in a while check that the drives hosting the chunks are good by doing disk IO.
         CheckChunkDirs();
@@ -2382,28 +2579,42 @@ ChunkManager::Sync(WriteOp *op)
     return op->diskIo->Sync(op->waitForSyncDone);
 }
 
+int64_t
+ChunkManager::GetChunkTableMemoryUsage() const
+{
+    return (mChunkTable.GetMemoryUsage() +
+        ChunkInfoHandle::GetPoolMemoryUsage(mChunkTable.size()));
+}
+
 void
 ChunkManager::CleanupInactiveFds(time_t now)
 {
     const bool periodic = now > 0;
     // if we haven't cleaned up in 5 mins or if we too many fd's that
     // are open, clean up.
-    if ((periodic ? now < mNextInactiveFdCleanupTime :
-            (globals().ctrOpenDiskFds.GetValue() +
-             globals().ctrOpenNetFds.GetValue()) <
-             uint64_t(mMaxOpenChunkFiles))) {
+    const bool fdCleanupFlag = periodic ?
+        now >= mNextInactiveFdCleanupTime :
+        (globals().ctrOpenDiskFds.GetValue() +
+            globals().ctrOpenNetFds.GetValue()) >=
+            uint64_t(mMaxOpenChunkFiles);
+    // The checksums are unloaded when the chunk is released, evict the
+    // least recently used chunks if the checksums exceed memory budget.
+    const ChunkChecksumAllocator& checksums =
+        ChunkChecksumAllocator::Instance();
+    if (! fdCleanupFlag && ! checksums.IsOverBudget()) {
         return;
     }
 
     const time_t cur = periodic ? now : globalNetManager().Now();
     // either we are periodic cleaning or we have too many FDs open
     // shorten the interval if we're out of fd.
-    const time_t expireTime = cur - (periodic ?
+    const time_t expireTime = fdCleanupFlag ? cur - (periodic ?
         mInactiveFdsCleanupIntervalSecs :
-        (mInactiveFdsCleanupIntervalSecs + 2) / 3);
+        (mInactiveFdsCleanupIntervalSecs + 2) / 3) : 0;
     ChunkLru::Iterator it(mChunkInfoLists);
     ChunkInfoHandle* cih;
-    while ((cih = it.Next()) && cih->lastIOTime < expireTime) {
+    while ((cih = it.Next()) &&
+            (cih->lastIOTime < expireTime || checksums.IsOverBudget())) {
         if (! cih->IsFileOpen() || cih->isBeingReplicated) {
             // Doesn't belong here, if / when io completes it will be added back.
             ChunkLru::Remove(mChunkInfoLists, *cih);
@@ -2431,9 +2642,16 @@ ChunkManager::CleanupInactiveFds(time_t now)
             "fileid="    << cih->dataFH.get() <<
             " chunk="    << cih->chunkInfo.chunkId <<
             " last io= " << (now - cih->lastIOTime) << " sec. ago" <<
+            (cih->lastIOTime < expireTime ? "" : " checksum memory budget") <<
         KFS_LOG_EOM;
+        if (cih->lastIOTime >= expireTime) {
+            mCounters.mChecksumEvictCount++;
+        }
         Release(*cih);
     }
+    if (! fdCleanupFlag) {
+        return;
+    }
     cih = ChunkLru::Front(mChunkInfoLists);
     mNextInactiveFdCleanupTime = mInactiveFdsCleanupIntervalSecs +
         ((cih && cih->lastIOTime > expireTime) ? cih->lastIOTime : cur);
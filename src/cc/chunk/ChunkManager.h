@@ -28,8 +28,8 @@
 #ifndef _CHUNKMANAGER_H
 #define _CHUNKMANAGER_H
 
-#include <tr1/unordered_map>
 #include <vector>
+#include <list>
 #include <string>
 #include <set>
 #include <map>
@@ -39,6 +39,7 @@
 #include "Chunk.h"
 #include "KfsOps.h"
 #include "common/cxxutil.h"
+#include "common/FlatHashMap.h"
 #include "qcdio/qcdllist.h"
 
 namespace KFS
@@ -79,6 +80,10 @@ public:
         Counter mCorruptedChunksCount;
         Counter mDirLostChunkCount;
         Counter mChunkDirLostCount;
+        Counter mChecksumEvictCount;
+        Counter mMetaWriteCount;
+        Counter mMetaWriteByteCount;
+        Counter mMetaWriteCoalescedCount;
 
         void Clear()
         {
@@ -90,8 +95,30 @@ public:
             mCorruptedChunksCount     = 0;
             mDirLostChunkCount        = 0;
             mChunkDirLostCount        = 0;
+            mChecksumEvictCount       = 0;
+            mMetaWriteCount           = 0;
+            mMetaWriteByteCount       = 0;
+            mMetaWriteCoalescedCount  = 0;
         }
     };
+    /// Per chunk directory disk load, reported in the heartbeat.
+    struct DirLoad
+    {
+        DirLoad()
+            : dirname(), readReqCount(0), writeReqCount(0),
+              readPendingBytes(0), writePendingBytes(0),
+              avgIoTimeMicroSec(0), load(0)
+            {}
+        std::string dirname;
+        int         readReqCount;
+        int         writeReqCount;
+        int64_t     readPendingBytes;
+        int64_t     writePendingBytes;
+        int64_t     avgIoTimeMicroSec;
+        /// Queue depth and io time relative to the configured "busy"
+        /// values; 1.0 means that the disk is as busy as configured.
+        double      load;
+    };
 
     ChunkManager();
     ~ChunkManager();
@@ -192,7 +219,13 @@ public:
     /// is done.
     /// @retval 0 if op was successfully scheduled; -errno otherwise
     int		WriteChunkMetadata(kfsChunkId_t chunkId, KfsCallbackObj *cb);
+    /// Mark the chunk meta-data dirty. The header write is delayed until
+    /// the chunk is idle for chunkServer.metaSyncDelayTimeSecs, but no
+    /// longer than chunkServer.metaSyncMaxDelayTimeSecs, or the chunk is
+    /// closed, made stable, or the chunk server shuts down.
     int		ScheduleWriteChunkMetadata(kfsChunkId_t chunkId);
+    /// Start writes of all delayed chunk meta-data.
+    void	SyncPendingMeta();
     int		ReadChunkMetadata(kfsChunkId_t chunkId, KfsOp *cb);
     
     /// Notification that read is finished
@@ -381,6 +414,10 @@ public:
     enum { kChunkInfoHandleListCount = 2 };
     void GetCounters(Counters& counters)
         { counters = mCounters; }
+    /// Chunk table memory footprint, excluding the checksums.
+    int64_t GetChunkTableMemoryUsage() const;
+    /// Return disk load for the usable chunk directories.
+    void GetDirLoad(std::vector<DirLoad>& dirs) const;
 
 private:
     class PendingWrites
@@ -606,14 +643,10 @@ private:
         int64_t availableSpace;
     };
 
-    /// Map from a chunk id to a chunk handle
+    /// Map from a chunk id to a chunk handle. Open addressing table:
+    /// no per entry allocation, and erase doesn't invalidate iterators.
     ///
-    typedef std::tr1::unordered_map<kfsChunkId_t, ChunkInfoHandle*,
-        std::tr1::hash<kfsChunkId_t>,
-        std::equal_to<kfsChunkId_t>,
-        boost::fast_pool_allocator<
-            std::pair<const kfsChunkId_t, ChunkInfoHandle*> >
-    > CMap;
+    typedef FlatHashMap<kfsChunkId_t, ChunkInfoHandle*> CMap;
     typedef CMap::const_iterator CMI;
     /// Periodically write out the chunk manager state to disk
     class ChunkManagerTimeoutImpl;
@@ -641,6 +674,14 @@ private:
     /// chunk
     int mLastDriveChosen;
 
+    /// Chunk directory placement: the free space is divided by
+    /// 1 + mDirLoadWeight * load, where the load is the disk queue depth
+    /// divided by mDirLoadQueueDepth plus average io time divided by
+    /// mDirLoadIoTimeMicroSec.
+    double  mDirLoadWeight;
+    int     mDirLoadQueueDepth;
+    int64_t mDirLoadIoTimeMicroSec;
+
     /// See the comments in KfsOps.cc near WritePrepareOp related to write handling
     int64_t mWriteId;
     PendingWrites mPendingWrites;
@@ -659,6 +700,7 @@ private:
     ChunkInfoHandle* mChunkInfoLists[kChunkInfoHandleListCount];
     time_t           mNextPendingMetaSyncScanTime;
     int              mMetaSyncDelayTimeSecs;
+    int              mMetaSyncMaxDelayTimeSecs;
 
     /// Periodically do an IO and check the chunk dirs and identify failed drives
     time_t	     mNextChunkDirsCheckTime;
@@ -680,6 +722,7 @@ private:
     /// Of the various directories this chunkserver is configured with, find the directory to store a chunk file.  
     /// This method does a "directory allocation".
     std::string GetDirForChunk();
+    double GetDirLoad(const std::string& dirname, DirLoad* dirLoad = 0) const;
 
     void CheckChunkDirs();
 
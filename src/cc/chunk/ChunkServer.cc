@@ -155,12 +155,9 @@ KFS::StopNetProcessor(int status)
     netProcessor.exit(status);
 }
 
-RemoteSyncSMPtr ChunkServer::FindServer(const ServerLocation &location, bool connect)
-{
-    return KFS::FindServer(mRemoteSyncers, location, connect);
-}
-
 void ChunkServer::RemoveServer(RemoteSyncSM *target)
 {
-    KFS::RemoveServer(mRemoteSyncers, target);
+    if (! mRemoteSyncers.Remove(target)) {
+        mReplicationSyncers.Remove(target);
+    }
 }
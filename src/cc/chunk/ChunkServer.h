@@ -38,7 +38,10 @@ namespace KFS
 {
 class ChunkServer {
 public:
-    ChunkServer() : mOpCount(0), mKickNetThread(false) { };
+    ChunkServer()
+        : mOpCount(0), mKickNetThread(false),
+          mRemoteSyncers(4), mReplicationSyncers(1)
+        { };
     
     void Init();
 
@@ -47,9 +50,29 @@ public:
     bool IsLocalServer(const ServerLocation &location) const {
         return mLocation == location;
     }
+    /// Foreground (record append, close) connection to the peer: the ops
+    /// with the same key go over the same connection.
     RemoteSyncSMPtr FindServer(const ServerLocation &location,
-                               bool connect = true);
+                               bool connect = true, uint64_t key = 0) {
+        return mRemoteSyncers.Find(location, key, connect);
+    }
+    /// Background (re-replication) connection to the peer: the replication
+    /// reads do not delay the foreground ops to the same peer.
+    RemoteSyncSMPtr FindReplicationServer(const ServerLocation &location,
+                                          uint64_t key = 0) {
+        return mReplicationSyncers.Find(location, key, true);
+    }
     void RemoveServer(RemoteSyncSM *target);
+    void SetMaxPeerConnections(int count, int replicationCount) {
+        mRemoteSyncers.SetMaxConnectionsPerPeer(count);
+        mReplicationSyncers.SetMaxConnectionsPerPeer(replicationCount);
+    }
+    size_t GetPeerConnectionCount() const {
+        return mRemoteSyncers.GetConnectionCount();
+    }
+    size_t GetReplicationConnectionCount() const {
+        return mReplicationSyncers.GetConnectionCount();
+    }
 
     std::string GetMyLocation() const {
         return mLocation.ToString();
@@ -84,7 +107,8 @@ private:
     int mOpCount;
     bool mKickNetThread;
     ServerLocation mLocation;
-    std::list<RemoteSyncSMPtr> mRemoteSyncers;
+    RemoteSyncSMPool mRemoteSyncers;
+    RemoteSyncSMPool mReplicationSyncers;
     // telemetry reporter...used for notifying slow writes thru this node
     TelemetryClient mTelemetryReporter;
 };
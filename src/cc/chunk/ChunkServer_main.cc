@@ -50,6 +50,7 @@
 #include "ChunkManager.h"
 #include "Logger.h"
 #include "AtomicRecordAppender.h"
+#include "BackgroundIoThrottle.h"
 #include "RemoteSyncSM.h"
 
 using namespace KFS;
@@ -498,6 +499,7 @@ ReadChunkServerProperties(char *fileName)
         gProp.getValue("chunkServer.client.idleTimeoutSec", 10 * 60)
     );
     gAtomicRecordAppendManager.SetParameters(gProp);
+    gBackgroundIoThrottle.SetParameters(gProp);
     RemoteSyncSM::SetResponseTimeoutSec(
         gProp.getValue("chunkServer.remoteSync.responseTimeoutSec",
             RemoteSyncSM::GetResponseTimeoutSec())
@@ -505,6 +507,15 @@ ReadChunkServerProperties(char *fileName)
     RemoteSyncSM::SetTraceRequestResponse(
         gProp.getValue("chunkServer.remoteSync.traceRequestResponse", false)
     );
+    gChunkServer.SetMaxPeerConnections(
+        gProp.getValue("chunkServer.remoteSync.maxConnectionsPerPeer", 4),
+        gProp.getValue(
+            "chunkServer.remoteSync.maxReplicationConnectionsPerPeer", 1)
+    );
+    ClientSM::SetCutThroughMinBytes(
+        gProp.getValue("chunkServer.writeCutThroughMinBytes",
+            ClientSM::GetCutThroughMinBytes())
+    );
     NetErrorSimulatorConfigure(
         libkfsio::globalNetManager(),
         gProp.getValue("chunkServer.netErrorSimulator", "")
@@ -30,6 +30,7 @@
 #include "Utils.h"
 #include "KfsOps.h"
 #include "AtomicRecordAppender.h"
+#include "libkfsIO/Checksum.h"
 
 #include <string>
 #include <sstream>
@@ -55,6 +56,7 @@ using namespace KFS::libkfsio;
 const int kMaxCmdHeaderLength = 1 << 10;
 bool ClientSM::sTraceRequestResponse = false;
 uint64_t ClientSM::sInstanceNum = 10000;
+int ClientSM::sCutThroughMinBytes = 128 << 10;
 
 inline std::string ClientSM::GetPeerName()
 {
@@ -83,6 +85,9 @@ inline void ClientSM::SendResponse(KfsOp* op, ClientSM::ByteCount opBytes)
 ClientSM::ClientSM(NetConnectionPtr &conn)
     : mNetConnection(conn),
       mCurOp(0),
+      mRemoteSyncers(),
+      mFwdPeer(),
+      mFwdBytes(0),
       mPrevNumToWrite(0),
       mRecursionCnt(0),
       mInstanceNum(sInstanceNum++)
@@ -149,6 +154,7 @@ ClientSM::SendResponse(KfsOp *op)
     op->ResponseContent(iobuf, len);
     mNetConnection->Write(iobuf, len);
     gClientManager.RequestDone((int64_t)(timespent * 1e6), *op);
+    UpdateOpLatency(*op);
 }
 
 ///
@@ -312,6 +318,7 @@ ClientSM::HandleRequest(int code, void *data)
         } else {
             std::list<RemoteSyncSMPtr> serversToRelease;
 
+            mFwdPeer.reset();
             mRemoteSyncers.swap(serversToRelease);
             // get rid of the connection to all the peers in daisy chain;
             // if there were any outstanding ops, they will all come back
@@ -518,8 +525,14 @@ ClientSM::HandleClientCmd(IOBuffer *iobuf, int cmdLen)
         WritePrepareOp* const wop = static_cast<WritePrepareOp*>(op);
         assert(! wop->dataBuf);
         if (! GetWriteOp(wop, wop->offset, iobuf, cmdLen, wop->dataBuf)) {
+            if (mCurOp == wop) {
+                CutThrough(wop, *iobuf);
+            }
             return false;
         }
+        if (wop->writeFwdOp) {
+            CutThrough(wop, *wop->dataBuf);
+        }
         bufferBytes = IoRequestBytes(wop->numBytes);
     } else if (op->op == CMD_RECORD_APPEND) {
         RecordAppendOp* const waop = static_cast<RecordAppendOp*>(op);
@@ -707,6 +720,57 @@ ClientSM::ReleaseChunkSpaceReservations()
     }
 }
 
+void
+ClientSM::CutThrough(WritePrepareOp* wop, const IOBuffer& buf)
+{
+    if (! wop->writeFwdOp) {
+        // Do not start while waiting for io buffers, as the peer would have
+        // to wait as well.
+        ServerLocation peerLoc;
+        if (sCutThroughMinBytes < 0 ||
+                wop->numBytes < (size_t)sCutThroughMinBytes ||
+                IsWaiting() ||
+                ! wop->CanStartForwarding(peerLoc) ||
+                ! (mFwdPeer = FindServer(peerLoc)) ||
+                mFwdPeer->IsStreaming()) {
+            mFwdPeer.reset();
+            return;
+        }
+        mFwdBytes = 0;
+        wop->writeFwdOp = new WritePrepareFwdOp(
+            mFwdPeer->NextSeqnum(), wop, 0);
+        wop->writeFwdOp->clnt = wop;
+        CLIENT_SM_LOG_STREAM_DEBUG <<
+            "cut-through forwarding to " << peerLoc.ToString() <<
+            " " << wop->writeFwdOp->Show() <<
+        KFS_LOG_EOM;
+        mFwdPeer->StartStream(wop->writeFwdOp);
+    }
+    if (! mFwdPeer) {
+        return;
+    }
+    const int nAvail = std::min(buf.BytesConsumable(), (int)wop->numBytes);
+    if (nAvail <= mFwdBytes) {
+        return;
+    }
+    // Share the buffers with the op, and compute the checksum while the
+    // rest of the data is in flight.
+    IOBuffer data;
+    data.Copy(&buf, nAvail);
+    data.Consume(mFwdBytes);
+    const int nBytes = nAvail - mFwdBytes;
+    wop->computedChecksum = mFwdBytes > 0 ?
+        ComputeBlockChecksum(wop->computedChecksum, &data, nBytes) :
+        ComputeBlockChecksum(&data, nBytes);
+    mFwdBytes = nAvail;
+    wop->hasComputedChecksum = (size_t)mFwdBytes >= wop->numBytes;
+    RemoteSyncSMPtr const peer = mFwdPeer;
+    if (wop->hasComputedChecksum) {
+        mFwdPeer.reset();
+    }
+    peer->StreamData(&data, nBytes);
+}
+
 RemoteSyncSMPtr
 ClientSM::FindServer(const ServerLocation &loc, bool connect)
 {
@@ -141,6 +141,15 @@ public:
     static void SetTraceRequestResponse(bool flag) {
         sTraceRequestResponse = flag;
     }
+    /// Writes of at least this size are forwarded to the next server in the
+    /// daisy chain as the data arrives; negative value turns cut-through
+    /// forwarding off.
+    static void SetCutThroughMinBytes(int numBytes) {
+        sCutThroughMinBytes = numBytes;
+    }
+    static int GetCutThroughMinBytes() {
+        return sCutThroughMinBytes;
+    }
 
     virtual void Granted(ByteCount byteCount);
 private:
@@ -161,12 +170,20 @@ private:
     PendingOpsList            mPendingSubmitQueue;
 
     /// for writes, we daisy-chain the chunkservers in the forwarding path.  this list
-    /// maintains the set of servers to which we have a connection.
+    /// maintains the set of servers to which we have a connection. The
+    /// connections are not shared with the other clients: the cut-through
+    /// write prepare streamed on a connection holds the other ops queued
+    /// on it, and the client disconnect fails all of them.
     std::list<RemoteSyncSMPtr> mRemoteSyncers;
+    /// Peer that the current write prepare is being streamed to, and the
+    /// number of bytes sent so far.
+    RemoteSyncSMPtr            mFwdPeer;
+    int                        mFwdBytes;
     ByteCount                  mPrevNumToWrite;
     int                        mRecursionCnt;
     const uint64_t             mInstanceNum;
     static bool                sTraceRequestResponse;
+    static int                 sCutThroughMinBytes;
     static uint64_t            sInstanceNum;
 
     /// Given a (possibly) complete op in a buffer, run it.
@@ -180,6 +197,9 @@ private:
     /// Submit ops that have been held waiting for doneOp to finish.
     void		OpFinished(KfsOp *doneOp);
     template <typename T> bool GetWriteOp(T* wop, int align, IOBuffer *iobuf, int cmdLen, IOBuffer*& ioOpBuf);
+    /// Cut-through forwarding: start forwarding the write, and send the
+    /// data received so far, which starts at the beginning of the buffer.
+    void CutThrough(WritePrepareOp* wop, const IOBuffer& buf);
     std::string GetPeerName();
     inline void SendResponse(KfsOp* op, ByteCount opBytes);
     inline static BufferManager& GetBufferManager();
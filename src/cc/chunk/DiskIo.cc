@@ -23,6 +23,7 @@
 //----------------------------------------------------------------------------
 
 #include <cerrno>
+#include <sys/time.h>
 #include <algorithm>
 #include <limits>
 
@@ -31,6 +32,7 @@
 
 #include "libkfsIO/IOBuffer.h"
 #include "libkfsIO/Globals.h"
+#include "libkfsIO/LatencyHistogram.h"
 #include "common/properties.h"
 #include "common/log.h"
 #include "common/kfstypes.h"
@@ -50,6 +52,16 @@ static void DiskIoReportError(
     std::string inMsg)
 { DiskIoReportError(inMsg.c_str()); }
 
+static inline int64_t
+DiskIoNowMicroSec()
+{
+    struct timeval theTime;
+    if (gettimeofday(&theTime, 0)) {
+        QCUtils::FatalError("gettimeofday", errno);
+    }
+    return (int64_t(theTime.tv_sec) * 1000000 + theTime.tv_usec);
+}
+
 class DiskQueue : public QCDiskQueue
 {
 public:
@@ -61,8 +73,11 @@ public:
         const char*   inFileNamePrefixPtr)
         : QCDiskQueue(),
           mFileNamePrefixes(inFileNamePrefixPtr ? inFileNamePrefixPtr : ""),
-          mDeviceId(inDeviceId)
+          mDeviceId(inDeviceId),
+          mLoad(),
+          mLastIoDoneTime(0)
     {
+        mLoad.Clear();
         mFileNamePrefixes.append(1, (char)0);
         DiskQueueList::Init(*this);
         DiskQueueList::PushBack(inListPtr, *this);
@@ -103,9 +118,61 @@ public:
         mFileNamePrefixes.append(inFileNamePtr ? inFileNamePtr : "");
         mFileNamePrefixes.append(1, (char)0);
     }
+    // The load accounting is done by the network (main) thread only.
+    void IoStarted(
+        bool    inReadFlag,
+        int64_t inByteCount)
+    {
+        if (inReadFlag) {
+            mLoad.mReadReqCount++;
+            mLoad.mReadPendingBytes += inByteCount;
+        } else {
+            mLoad.mWriteReqCount++;
+            mLoad.mWritePendingBytes += inByteCount;
+        }
+    }
+    void IoDone(
+        bool    inReadFlag,
+        int64_t inByteCount,
+        int64_t inStartTime)
+    {
+        if (inReadFlag) {
+            mLoad.mReadReqCount--;
+            mLoad.mReadPendingBytes -= inByteCount;
+        } else {
+            mLoad.mWriteReqCount--;
+            mLoad.mWritePendingBytes -= inByteCount;
+        }
+        QCASSERT(mLoad.mReadReqCount >= 0 && mLoad.mWriteReqCount >= 0);
+        if (inStartTime < 0) {
+            return; // Canceled, no io time sample.
+        }
+        mLastIoDoneTime = DiskIoNowMicroSec();
+        // Move the average by 1/8 of the difference with every completion.
+        mLoad.mAvgIoTimeMicroSec += (std::max(int64_t(0),
+            mLastIoDoneTime - inStartTime) - mLoad.mAvgIoTimeMicroSec) / 8;
+    }
+    void GetLoad(
+        DiskIo::DeviceLoad& outLoad) const
+    {
+        outLoad = mLoad;
+        if (mLoad.mReadReqCount > 0 || mLoad.mWriteReqCount > 0 ||
+                mLoad.mAvgIoTimeMicroSec <= 0) {
+            return;
+        }
+        // Idle device: halve the average for every idle second, otherwise
+        // the device would look busy after the load spike until the next io
+        // completes, and the chunk placement would avoid it.
+        const int64_t theIdleSecs =
+            (DiskIoNowMicroSec() - mLastIoDoneTime) / 1000000;
+        outLoad.mAvgIoTimeMicroSec = theIdleSecs >= 63 ? 0 :
+            mLoad.mAvgIoTimeMicroSec >> theIdleSecs;
+    }
 private:
     std::string         mFileNamePrefixes;
     const unsigned long mDeviceId;
+    DiskIo::DeviceLoad  mLoad;
+    int64_t             mLastIoDoneTime;
     DiskQueue*          mPrevPtr[1];
     DiskQueue*          mNextPtr[1];
 
@@ -184,7 +251,9 @@ public:
           mMutex(),
           mBufferAllocator(),
           mBufferManager(inConfig.getValue(
-            "chunkServer.bufferManager.enabled", true))
+            "chunkServer.bufferManager.enabled", true)),
+          mReadLatency(),
+          mWriteLatency()
     {
         mCounters.Clear();
         DoneQueue::Init(mIoQueuesPtr);
@@ -321,6 +390,7 @@ public:
                     inIo.mRequestId, 0);
             }
         }
+        inIo.IoFinished(false);
         QCStMutexLocker theLocker(mMutex);
         DoneQueue::Remove(mIoQueuesPtr, inIo);
         inIo.mRequestId = QCDiskQueue::kRequestIdNone;
@@ -336,6 +406,18 @@ public:
             {}
         return thePtr;
     }
+    bool GetDeviceLoad(
+        const char*         inDirNamePtr,
+        DiskIo::DeviceLoad& outLoad)
+    {
+        const DiskQueue* const theQueuePtr = FindDiskQueue(inDirNamePtr);
+        if (! theQueuePtr) {
+            outLoad.Clear();
+            return false;
+        }
+        theQueuePtr->GetLoad(outLoad);
+        return true;
+    }
     DiskQueue* FindDiskQueue(
         unsigned long inDeviceId)
     {
@@ -448,6 +530,19 @@ public:
     void GetCounters(
         Counters& outCounters)
         { outCounters = mCounters; }
+    void IoDone(
+        bool    inReadFlag,
+        int64_t inIoTimeMicroSec)
+    {
+        (inReadFlag ? mReadLatency : mWriteLatency).Update(inIoTimeMicroSec);
+    }
+    void GetLatency(
+        LatencyHistogram& outReadLatency,
+        LatencyHistogram& outWriteLatency)
+    {
+        outReadLatency  = mReadLatency;
+        outWriteLatency = mWriteLatency;
+    }
 private:
     typedef DiskIo::IoBuffers IoBuffers;
     class WriteCancelWaiter : public QCDiskQueue::IoCompletion
@@ -532,6 +627,8 @@ private:
     DiskIo*               mIoQueuesPtr[1];
     DiskQueue*            mDiskQueuesPtr[1];
     Counters              mCounters;
+    LatencyHistogram      mReadLatency;
+    LatencyHistogram      mWriteLatency;
 
     QCIoBufferPool& GetBufferPool()
         { return mBufferAllocator.GetBufferPool(); }
@@ -666,6 +763,31 @@ DiskIo::GetCounters(
     sDiskIoQueuesPtr->GetCounters(outCounters);
 }
 
+    /* static */ void
+DiskIo::GetLatency(
+    LatencyHistogram& outReadLatency,
+    LatencyHistogram& outWriteLatency)
+{
+    if (! sDiskIoQueuesPtr) {
+        outReadLatency.Clear();
+        outWriteLatency.Clear();
+        return;
+    }
+    sDiskIoQueuesPtr->GetLatency(outReadLatency, outWriteLatency);
+}
+
+    /* static */ bool
+DiskIo::GetDeviceLoad(
+    const char* inDirNamePtr,
+    DeviceLoad& outLoad)
+{
+    if (! sDiskIoQueuesPtr) {
+        outLoad.Clear();
+        return false;
+    }
+    return sDiskIoQueuesPtr->GetDeviceLoad(inDirNamePtr, outLoad);
+}
+
     bool
 DiskIo::File::Open(
     const char*  inFileNamePtr,
@@ -822,8 +944,12 @@ DiskIo::DiskIo(
       mReadBufOffset(0),
       mReadLength(0),
       mIoRetCode(0),
+      mIoQueuePtr(0),
+      mIoStartTime(0),
+      mIoPendingBytes(0),
       mCompletionRequestId(QCDiskQueue::kRequestIdNone),
-      mCompletionCode(QCDiskQueue::kErrorNone)
+      mCompletionCode(QCDiskQueue::kErrorNone),
+      mBackgroundFlag(false)
 {
     QCRTASSERT(mCallbackObjPtr && mFilePtr.get());
     DiskIoQueues::DoneQueue::Init(*this);
@@ -888,10 +1014,12 @@ DiskIo::Read(
         0, // inBufferIteratorPtr // allocate buffers just beofre read
         theBufferCnt,
         this,
-        sDiskIoQueuesPtr->GetMaxEnqueueWaitTimeNanoSec()
+        sDiskIoQueuesPtr->GetMaxEnqueueWaitTimeNanoSec(),
+        mBackgroundFlag
     );
     if (theStatus.IsGood()) {
         sDiskIoQueuesPtr->ReadPending(inNumBytes);
+        IoStarted(*theQueuePtr, inNumBytes);
         mRequestId = theStatus.GetRequestId();
         QCRTASSERT(mRequestId != QCDiskQueue::kRequestIdNone);
         return inNumBytes;
@@ -993,10 +1121,12 @@ DiskIo::Write(
         &theBufItr,
         mIoBuffers.size(),
         this,
-        sDiskIoQueuesPtr->GetMaxEnqueueWaitTimeNanoSec()
+        sDiskIoQueuesPtr->GetMaxEnqueueWaitTimeNanoSec(),
+        mBackgroundFlag
     );
     if (theStatus.IsGood()) {
         sDiskIoQueuesPtr->WritePending(inNumBytes - theNWr);
+        IoStarted(*theQueuePtr, inNumBytes - theNWr);
         mRequestId = theStatus.GetRequestId();
         QCRTASSERT(mRequestId != QCDiskQueue::kRequestIdNone);
         return (inNumBytes - theNWr);
@@ -1112,6 +1242,7 @@ DiskIo::RunCompletion()
 {
     QCASSERT(mCompletionRequestId == mRequestId && sDiskIoQueuesPtr);
     mRequestId = QCDiskQueue::kRequestIdNone;
+    IoFinished(true);
     if (mReadLength > 0) {
         sDiskIoQueuesPtr->ReadPending(-int64_t(mReadLength), mIoRetCode);
     } else if (! mIoBuffers.empty()) {
@@ -1170,6 +1301,35 @@ DiskIo::RunCompletion()
     IoCompletion(&theIoBuffer, theNumRead);
 }
 
+    void
+DiskIo::IoStarted(
+    DiskQueue& inQueue,
+    int64_t    inByteCount)
+{
+    QCASSERT(! mIoQueuePtr);
+    mIoQueuePtr     = &inQueue;
+    mIoPendingBytes = inByteCount;
+    mIoStartTime    = DiskIoNowMicroSec();
+    mIoQueuePtr->IoStarted(mReadLength > 0, mIoPendingBytes);
+}
+
+    void
+DiskIo::IoFinished(
+    bool inCompletedFlag)
+{
+    if (! mIoQueuePtr) {
+        return;
+    }
+    mIoQueuePtr->IoDone(mReadLength > 0, mIoPendingBytes,
+        inCompletedFlag ? mIoStartTime : int64_t(-1));
+    if (inCompletedFlag && sDiskIoQueuesPtr) {
+        sDiskIoQueuesPtr->IoDone(mReadLength > 0,
+            DiskIoNowMicroSec() - mIoStartTime);
+    }
+    mIoQueuePtr     = 0;
+    mIoPendingBytes = 0;
+}
+
     void
 DiskIo::IoCompletion(
     IOBuffer*   inBufferPtr,
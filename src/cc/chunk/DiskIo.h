@@ -43,6 +43,7 @@ class IOBuffer;
 class DiskQueue;
 class Properties;
 class BufferManager;
+class LatencyHistogram;
 
 ///
 /// Disk DiskIo encapsulates an fd and some disk IO requests.  On
@@ -76,6 +77,26 @@ public:
             mSyncErrorCount  = 0;
         }
     };
+    /// Per device (disk queue) load. Requests are counted from enqueue to
+    /// completion. The io time includes the time spent in the queue, and is
+    /// exponentially decayed average, that decays toward 0 when the device
+    /// is idle.
+    struct DeviceLoad
+    {
+        int     mReadReqCount;
+        int     mWriteReqCount;
+        int64_t mReadPendingBytes;
+        int64_t mWritePendingBytes;
+        int64_t mAvgIoTimeMicroSec;
+        void Clear()
+        {
+            mReadReqCount      = 0;
+            mWriteReqCount     = 0;
+            mReadPendingBytes  = 0;
+            mWritePendingBytes = 0;
+            mAvgIoTimeMicroSec = 0;
+        }
+    };
     static bool Init(
         const Properties& inProperties,
         std::string*      inErrMessagePtr = 0);
@@ -92,6 +113,14 @@ public:
     static BufferManager& GetBufferManager();
     static void GetCounters(
         Counters& outCounters);
+    /// Read and write latency histograms, enqueue to completion.
+    static void GetLatency(
+        LatencyHistogram& outReadLatency,
+        LatencyHistogram& outWriteLatency);
+    /// Return false if no disk queue is configured for the directory.
+    static bool GetDeviceLoad(
+        const char* inDirNamePtr,
+        DeviceLoad& outLoad);
 
     class File
     {
@@ -175,6 +204,12 @@ public:
         size_t    inNumBytes,
         IOBuffer* inBufferPtr);
 
+    /// Background (re-replication) io is queued behind the foreground
+    /// requests to the same disk.
+    void SetBackgroundFlag(
+        bool inFlag)
+        { mBackgroundFlag = inFlag; }
+
     /// Sync the previously written data to disk.
     /// @param[in] inNotifyDoneFlag if set, notify upstream objects that the
     /// sync operation has finished.
@@ -191,12 +226,21 @@ private:
     size_t                 mReadBufOffset;
     size_t                 mReadLength;
     ssize_t                mIoRetCode;
+    DiskQueue*             mIoQueuePtr;
+    int64_t                mIoStartTime;
+    int64_t                mIoPendingBytes;
     QCDiskQueue::RequestId mCompletionRequestId;
     QCDiskQueue::Error     mCompletionCode;
+    bool                   mBackgroundFlag;
     DiskIo*                mPrevPtr[1];
     DiskIo*                mNextPtr[1];
 
     void RunCompletion();
+    void IoStarted(
+        DiskQueue& inQueue,
+        int64_t    inByteCount);
+    void IoFinished(
+        bool inCompletedFlag);
     void IoCompletion(
         IOBuffer* inBufferPtr,
         int       inRetCode,
@@ -30,6 +30,7 @@
 #include "common/Version.h"
 #include "common/kfstypes.h"
 #include "libkfsIO/Globals.h"
+#include "libkfsIO/LatencyHistogram.h"
 #include "meta/thread.h"
 #include "meta/queue.h"
 #include "libkfsIO/Checksum.h"
@@ -39,6 +40,7 @@
 #include "ChunkServer.h"
 #include "LeaseClerk.h"
 #include "Replicator.h"
+#include "BackgroundIoThrottle.h"
 #include "AtomicRecordAppender.h"
 #include "Utils.h"
 
@@ -58,6 +60,7 @@ using std::ostream;
 using std::for_each;
 using std::vector;
 using std::min;
+using std::max;
 
 using namespace KFS;
 using namespace KFS::libkfsio;
@@ -93,6 +96,22 @@ static struct OpCounterMap : public map<KfsOp_t, Counter *>
 } gCounters;
 typedef OpCounterMap::iterator OpCounterMapIter;
 
+// Client request latency histograms, see UpdateOpLatency().
+enum {
+    kLatencyQueue,
+    kLatencyDisk,
+    kLatencyFwd,
+    kLatencyTotal,
+    kLatencyPhaseCount
+};
+static const char* const kLatencyPhaseNames[kLatencyPhaseCount] = {
+    "queue",
+    "disk",
+    "fwd",
+    "total"
+};
+static LatencyStats gOpLatency(kLatencyPhaseNames, kLatencyPhaseCount);
+
 
 const char *KFS_VERSION_STR = "KFS/1.0";
 
@@ -137,9 +156,36 @@ void
 KFS::SubmitOp(KfsOp *op)
 {
     op->type = OP_REQUEST;
+    op->submitTime = MicroSecsNow();
     op->Execute();
 }
 
+///
+/// The request processing phases are: queue -- waiting for io buffers, or
+/// for the previous write to finish; disk -- submit to disk io completion;
+/// fwd -- submit to the completion of the forwarding to the next server in
+/// the daisy chain; total -- receive to response.
+///
+void
+KFS::UpdateOpLatency(const KfsOp& op)
+{
+    if (! gOpLatency.HasOpName(op.op)) {
+        return;
+    }
+    const int64_t start  = MicroSecs(op.startTime);
+    const int64_t submit = op.submitTime > 0 ? op.submitTime : start;
+    gOpLatency.Update(op.op, kLatencyQueue, submit - start);
+    if (op.diskDoneTime > 0) {
+        gOpLatency.Update(op.op, kLatencyDisk, op.diskDoneTime - submit);
+    }
+    if (op.fwdDoneTime > 0) {
+        // The cut-through forwarding ends before the op is submitted.
+        gOpLatency.Update(op.op, kLatencyFwd,
+            max(int64_t(0), op.fwdDoneTime - submit));
+    }
+    gOpLatency.Update(op.op, kLatencyTotal, MicroSecsNow() - start);
+}
+
 void
 KFS::SubmitOpResponse(KfsOp *op)
 {
@@ -332,7 +378,11 @@ KFS::ParseCommand(std::istream& is, KfsOp **res)
 
     prop.loadProperties(is, separator, false);
 
-    return (*handler)(prop, res);
+    const int ret = (*handler)(prop, res);
+    if (ret == 0 && *res && ! gOpLatency.HasOpName((*res)->op)) {
+        gOpLatency.SetOpName((*res)->op, cmdStr.c_str());
+    }
+    return ret;
 }
 
 void
@@ -396,6 +446,7 @@ parseHandlerRead(Properties &prop, KfsOp **c)
     rc->numBytes = prop.getValue("Num-bytes", (long long) 0);
     if (rc->numBytes > CHUNKSIZE)
         rc->numBytes = 131072;
+    rc->isForReplication = prop.getValue("Replication", 0) != 0;
     *c = rc;
 
     return 0;
@@ -466,6 +517,8 @@ parseHandlerRecordAppend(Properties &prop, KfsOp **c)
     ra->checksum              = (uint32_t)prop.getValue("Checksum",   (off_t) 0);
     ra->clientSeq             = prop.getValue("Client-cseq",            ra->seq);
     ra->masterCommittedOffset = prop.getValue("Master-committed",     (off_t)-1);
+    ra->recordCount           = prop.getValue("Record-count",                 0);
+    ra->recordLengths         = prop.getValue("Record-lengths",              "");
     *c = ra;
 
     return 0;
@@ -818,6 +871,7 @@ parseHandlerStats(Properties &prop, KfsOp **c)
     parseCommon(prop, seq);
 
     so = new StatsOp(seq);
+    so->latencyFlag = prop.getValue("Latency-histograms", 0) != 0;
     *c = so;
     return 0;
 }
@@ -908,6 +962,7 @@ ReadOp::HandleDone(int code, void *data)
 
         gettimeofday(&timeNow, NULL);
         diskIOTime = ComputeTimeDiff(startTime, timeNow);
+        diskDoneTime = MicroSecs(timeNow);
     }
     
     kfsFileId_t dummy;
@@ -1242,7 +1297,7 @@ CloseOp::Execute()
 void
 CloseOp::ForwardToPeer(const ServerLocation &loc)
 {
-    RemoteSyncSMPtr const peer = gChunkServer.FindServer(loc);
+    RemoteSyncSMPtr const peer = gChunkServer.FindServer(loc, true, chunkId);
     if (! peer) {
         KFS_LOG_STREAM_DEBUG <<
             "unable to forward to peer: " << loc.ToString() <<
@@ -1364,7 +1419,10 @@ TruncateChunkOp::HandleChunkMetaReadDone(int code, void *data)
 void
 ReplicateChunkOp::Execute()
 {
-    RemoteSyncSMPtr peer = gChunkServer.FindServer(location);
+    // Replication has its own connections, and does not delay the
+    // foreground writes to the same peer.
+    RemoteSyncSMPtr peer = gChunkServer.FindReplicationServer(
+        location, chunkId);
 
     UpdateCounter(CMD_REPLICATE_CHUNK);
 
@@ -1559,6 +1617,16 @@ HeartbeatOp::Execute()
     Append("Chunk-open-errors",   "open", cm.mOpenErrorCount);
     Append("Dir-chunk-lost",      "dce",  cm.mDirLostChunkCount);
     Append("Chunk-dir-lost",      "cdl",  cm.mChunkDirLostCount);
+    cmdShow << " mem:";
+    const ChunkChecksumAllocator& csAlloc = ChunkChecksumAllocator::Instance();
+    Append("Chunk-table-bytes",     "tbl",   gChunkManager.GetChunkTableMemoryUsage());
+    Append("Chunk-checksum-bytes",  "csum",  csAlloc.GetInUseBytes());
+    Append("Chunk-checksum-budget", "limit", csAlloc.GetMemoryBudget());
+    Append("Chunk-checksum-evict",  "evict", cm.mChecksumEvictCount);
+    cmdShow << " meta:";
+    Append("Chunk-meta-writes",     "wr",    cm.mMetaWriteCount);
+    Append("Chunk-meta-write-bytes", "bytes", cm.mMetaWriteByteCount);
+    Append("Chunk-meta-coalesced",  "coal",  cm.mMetaWriteCoalescedCount);
 
     MetaServerSM::Counters mc;
     gMetaServerSM.GetCounters(mc);
@@ -1576,6 +1644,19 @@ HeartbeatOp::Execute()
     cmdShow << " cli:";
     Append("Client-accept",  "accept", cli.mAcceptCount);
     Append("Client-active",  "cur",    cli.mClientCount);
+    cmdShow << " peers:";
+    Append("Peer-connections",             "cur",
+        gChunkServer.GetPeerConnectionCount());
+    Append("Peer-replication-connections", "repl",
+        gChunkServer.GetReplicationConnectionCount());
+    BackgroundIoThrottle::Counters bt;
+    gBackgroundIoThrottle.GetCounters(bt);
+    cmdShow << " repl-throttle:";
+    Append("Replication-bytes",              "bytes",   bt.mBytes);
+    Append("Replication-throttled-count",    "cnt",     bt.mThrottledCount);
+    Append("Replication-throttled-bytes",    "tbytes",  bt.mThrottledBytes);
+    Append("Replication-throttle-wait-usec", "wait",    bt.mWaitTimeUsec);
+    Append("Replication-throttle-waiting",   "waiting", bt.mWaitingCount);
     cmdShow << " req: err:";
     Append("Client-req-invalid",        "inval", cli.mBadRequestCount);
     Append("Client-req-invalid-header", "hdr",   cli.mBadRequestHeaderCount);
@@ -1614,6 +1695,7 @@ HeartbeatOp::Execute()
     gAtomicRecordAppendManager.GetCounters(wa);
     Append("WAppend-count", "cnt",   wa.mAppendCount);
     Append("WAppend-bytes", "bytes", wa.mAppendByteCount);
+    Append("WAppend-records", "rec", wa.mAppendRecordCount);
     Append("WAppend-errors","err",   wa.mAppendErrorCount);
     cmdShow << " repl:";
     Append("WAppend-replication-errors",   "err", wa.mReplicationErrorCount);
@@ -1685,6 +1767,47 @@ HeartbeatOp::Execute()
     cmdShow <<  " sync:";
     Append("Disk-sync-count", "cnt",   dio.mSyncCount);
     Append("Disk-sync-errors","err",   dio.mSyncErrorCount);
+    vector<ChunkManager::DirLoad> dirLoad;
+    gChunkManager.GetDirLoad(dirLoad);
+    double        loadSum   = 0;
+    double        loadMax   = 0;
+    int64_t       reqCount  = 0;
+    int64_t       ioTimeMax = 0;
+    int64_t       writePend = 0;
+    ostringstream dirLoadStr;
+    for (vector<ChunkManager::DirLoad>::const_iterator it = dirLoad.begin();
+            it != dirLoad.end();
+            ++it) {
+        loadSum   += it->load;
+        loadMax    = max(loadMax, it->load);
+        reqCount  += it->readReqCount + it->writeReqCount;
+        ioTimeMax  = max(ioTimeMax, it->avgIoTimeMicroSec);
+        writePend += it->writePendingBytes;
+        dirLoadStr << (it == dirLoad.begin() ? "" : ";") <<
+            it->dirname           << " " <<
+            it->readReqCount      << " " <<
+            it->writeReqCount     << " " <<
+            it->readPendingBytes  << " " <<
+            it->writePendingBytes << " " <<
+            it->avgIoTimeMicroSec << " " <<
+            it->load;
+    }
+    cmdShow <<  " load:";
+    Append("Disk-load-avg", "avg",
+        dirLoad.empty() ? 0. : loadSum / dirLoad.size());
+    Append("Disk-load-max", "max", loadMax);
+    Append("Disk-queue-depth", "qd", reqCount);
+    Append("Disk-io-micro-sec-max", "tm", ioTimeMax);
+    Append("Disk-write-pending-bytes", "wpend", writePend);
+    // Per directory: name, read and write requests, read and write pending
+    // bytes, average io time, and load.
+    Append("Dir-load", "", dirLoadStr.str());
+
+    cmdShow <<  " net:";
+    Append("Net-bytes-to-send", "send",
+        libkfsio::globalNetManager().GetNumBytesToSend());
+    Append("Net-overloaded",    "ovl",
+        libkfsio::globalNetManager().IsNetworkOverloaded() ? 1 : 0);
 
     cmdShow <<  " msglog:";
     MsgLogger::Counters msgLogCntrs;
@@ -1782,6 +1905,22 @@ ReadOp::HandleChunkMetaReadDone(int code, void *data)
         return 0;
     }
 
+    SET_HANDLER(this, &ReadOp::HandleThrottleDone);
+    if (isForReplication) {
+        // The replicator paces its reads with the receiving server's
+        // buckets; pace the sending server's disk and network the same way.
+        const ChunkInfo_t* const info = gChunkManager.GetChunkInfo(chunkId);
+        if (info && ! gBackgroundIoThrottle.Acquire(
+                info->dirname, numBytes, this)) {
+            return 0;
+        }
+    }
+    return HandleThrottleDone(EVENT_CMD_DONE, 0);
+}
+
+int
+ReadOp::HandleThrottleDone(int code, void *data)
+{
     SET_HANDLER(this, &ReadOp::HandleDone);    
     status = gChunkManager.ReadChunk(this);
 
@@ -1899,7 +2038,7 @@ WriteIdAllocOp::ForwardToPeer(const ServerLocation &loc)
     assert(! fwdedOp && status == 0 && (clnt || isForRecordAppend));
 
     RemoteSyncSMPtr const peer = isForRecordAppend ?
-        gChunkServer.FindServer(loc) :
+        gChunkServer.FindServer(loc, true, chunkId) :
         static_cast<ClientSM *>(clnt)->FindServer(loc);
     if (! peer) {
         status    = -EHOSTUNREACH;
@@ -2032,7 +2171,8 @@ WritePrepareOp::Execute()
     }
 
     if (checksum != 0) {
-        const uint32_t val = ComputeBlockChecksum(dataBuf, numBytes);
+        const uint32_t val = hasComputedChecksum ?
+            computedChecksum : ComputeBlockChecksum(dataBuf, numBytes);
         if (val != checksum) {
             statusMsg = "checksum mismatch";
             KFS_LOG_STREAM_ERROR <<
@@ -2061,7 +2201,8 @@ WritePrepareOp::Execute()
         return;
     }
 
-    if (needToForward) {
+    // With cut-through the data is already forwarded.
+    if (needToForward && ! writeFwdOp) {
         IOBuffer * const clonedData = dataBuf->Clone();
         status = ForwardToPeer(peerLoc, clonedData);
         if (status < 0) {
@@ -2112,11 +2253,34 @@ WritePrepareOp::ForwardToPeer(const ServerLocation &loc, IOBuffer *dataBuf)
     return 0;
 }
 
+bool
+WritePrepareOp::CanStartForwarding(ServerLocation &peerLoc)
+{
+    // Same checks as Execute(), except the checksum, as the data is not
+    // here yet. The downstream servers verify the checksum on their own.
+    int myPos = -1;
+    if (! needToForwardToPeer(
+            servers, numServers, myPos, peerLoc, true, writeId)) {
+        return false;
+    }
+    if (! gChunkManager.IsValidWriteId(writeId) ||
+            ! gChunkManager.IsChunkMetadataLoaded(chunkId) ||
+            gChunkManager.GetWriteStatus(writeId) < 0) {
+        return false;
+    }
+    return (myPos != 0 || gLeaseClerk.IsLeaseValid(chunkId));
+}
+
 int
 WritePrepareOp::Done(int code, void *data)
 {
     verifyExecutingOnEventProcessor();    
 
+    if (data && data == writeOp) {
+        diskDoneTime = MicroSecsNow();
+    } else if (data && data == writeFwdOp) {
+        fwdDoneTime = MicroSecsNow();
+    }
     if (status >= 0 && writeFwdOp && writeFwdOp->status < 0) {
         status    = writeFwdOp->status;
         statusMsg = writeFwdOp->statusMsg;
@@ -2559,6 +2723,14 @@ StatsOp::Execute()
     os << "Num aios: " << 0 << "\r\n";
     os << "Num ops: " << gChunkServer.GetNumOps() << "\r\n";
     globals().counterManager.Show(os);
+    if (latencyFlag) {
+        gOpLatency.Show(os);
+        LatencyHistogram readLatency;
+        LatencyHistogram writeLatency;
+        DiskIo::GetLatency(readLatency, writeLatency);
+        LatencyStats::Show(os, "DISK_READ-total", readLatency);
+        LatencyStats::Show(os, "DISK_WRITE-total", writeLatency);
+    }
     stats = os.str();
     status = 0;
     // clnt->HandleEvent(EVENT_CMD_DONE, this);
@@ -2688,7 +2860,11 @@ RecordAppendOp::Request(ostream &os)
         "Client-cseq: "      << clientSeq             << "\r\n"
         "Servers: "          << servers               << "\r\n"
         "Master-committed: " << masterCommittedOffset << "\r\n"
-    "\r\n";
+        "Record-count: "     << recordCount           << "\r\n";
+    if (! recordLengths.empty()) {
+        os << "Record-lengths: " << recordLengths << "\r\n";
+    }
+    os << "\r\n";
 }
 
 void
@@ -2781,6 +2957,9 @@ ReadOp::Request(ostream &os)
     os << "Chunk-handle: " << chunkId << "\r\n";
     os << "Chunk-version: " << chunkVersion << "\r\n";
     os << "Offset: " << offset << "\r\n";
+    if (isForReplication) {
+        os << "Replication: 1\r\n";
+    }
     os << "Num-bytes: " << numBytes << "\r\n\r\n";
 }
 
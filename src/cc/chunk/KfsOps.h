@@ -33,7 +33,9 @@
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <list>
 #include <sys/time.h>
+#include <boost/shared_ptr.hpp>
 
 namespace KFS
 {
@@ -132,10 +134,16 @@ struct KfsOp : public KfsCallbackObj {
     KfsCallbackObj* clnt;
     // keep statistics
     struct timeval  startTime;
+    // latency histograms: times in microseconds when the op was submitted
+    // for execution, when its disk io completed, and when forwarding to the
+    // next server in the daisy chain completed; 0 if not applicable
+    int64_t         submitTime;
+    int64_t         diskDoneTime;
+    int64_t         fwdDoneTime;
 
     KfsOp (KfsOp_t o, kfsSeq_t s, KfsCallbackObj *c = NULL) :
         op(o), type(OP_REQUEST), seq(s), status(0), cancelled(false), done(false),
-        statusMsg(), clnt(c)
+        statusMsg(), clnt(c), submitTime(0), diskDoneTime(0), fwdDoneTime(0)
     {
         SET_HANDLER(this, &KfsOp::HandleDone);
         gettimeofday(&startTime, NULL);
@@ -500,6 +508,8 @@ struct RecordAppendOp : public KfsOp {
     uint32_t     checksum;              /* input: as computed by the sender; 0 means sender didn't send */
     std::string  servers;               /* input: set of servers on which to write */
     off_t        masterCommittedOffset; /* input piggy back master's ack to slave */
+    int          recordCount;           /* input: # of records; 0 means sender didn't send */
+    std::string  recordLengths;         /* input: space separated record lengths; empty means sender didn't send */
     IOBuffer     dataBuf;               /* buffer with the data to be written */
     /* 
      * when a record append is to be fwd'ed along a daisy chain,
@@ -666,10 +676,15 @@ struct WritePrepareOp : public KfsOp {
     uint32_t numDone; // if we did forwarding, we wait for
                       // local/remote to be done; otherwise, we only
                       // wait for local to be done
+    /* set by the client sm with cut-through forwarding: the checksum is
+       computed as the data arrives */
+    uint32_t computedChecksum;
+    bool     hasComputedChecksum;
 
     WritePrepareOp(kfsSeq_t s) :
         KfsOp(CMD_WRITE_PREPARE, s), writeId(-1), checksum(0), 
-        dataBuf(NULL), writeFwdOp(NULL), writeOp(NULL), numDone(0)
+        dataBuf(NULL), writeFwdOp(NULL), writeOp(NULL), numDone(0),
+        computedChecksum(0), hasComputedChecksum(false)
     {
         SET_HANDLER(this, &WritePrepareOp::Done);
     }
@@ -679,6 +694,10 @@ struct WritePrepareOp : public KfsOp {
     void Execute();
 
     int ForwardToPeer(const ServerLocation &peer, IOBuffer *data);
+    /// Cut-through forwarding: can the write be forwarded before all the
+    /// data is received.
+    /// @retval true if the write is valid so far, and has to be forwarded
+    bool CanStartForwarding(ServerLocation &peerLoc);
     int Done(int code, void *data);
 
     std::string Show() const {
@@ -924,6 +943,8 @@ struct ReadOp : public KfsOp {
     std::vector<uint32_t> checksum; /* checksum over the data that is sent back to client */
     float diskIOTime; /* how long did the AIOs take */
     std::string driveName; /* for telemetry, provide the drive info to the client */
+    /* re-replication read: the disk io is queued as background */
+    bool isForReplication;
     /*
      * for writes that require the associated checksum block to be
      * read in, store the pointer to the associated write op.
@@ -931,14 +952,14 @@ struct ReadOp : public KfsOp {
     WriteOp *wop;
     ReadOp(kfsSeq_t s) :
         KfsOp(CMD_READ, s), numBytesIO(0), dataBuf(NULL),
-        wop(NULL)
+        isForReplication(false), wop(NULL)
     {
         SET_HANDLER(this, &ReadOp::HandleDone);
     }
     ReadOp(WriteOp *w, off_t o, size_t n) :
         KfsOp(CMD_READ, w->seq), chunkId(w->chunkId),
         chunkVersion(w->chunkVersion), offset(o), numBytes(n),
-        numBytesIO(0), dataBuf(NULL), wop(w)
+        numBytesIO(0), dataBuf(NULL), isForReplication(false), wop(w)
     {
         clnt = w;
         SET_HANDLER(this, &ReadOp::HandleDone);
@@ -958,6 +979,8 @@ struct ReadOp : public KfsOp {
     int HandleDone(int code, void *data);
     // handler for reading in the chunk meta-data
     int HandleChunkMetaReadDone(int code, void *data);
+    // handler for the replication read throttle
+    int HandleThrottleDone(int code, void *data);
     // handler for dealing with re-replication events
     int HandleReplicatorDone(int code, void *data);
     std::string Show() const {
@@ -1113,9 +1136,10 @@ struct DumpChunkMapOp : public KfsOp {
 
 // used to extract out all the counters we have
 struct StatsOp : public KfsOp {
+    bool latencyFlag; // input: include the latency histograms
     std::string stats; // result
     StatsOp(kfsSeq_t s) :
-        KfsOp(CMD_STATS, s) { }
+        KfsOp(CMD_STATS, s), latencyFlag(false) { }
     void Response(std::ostream &os);
     void Execute();
     std::string Show() const {
@@ -1312,6 +1336,9 @@ extern int ParseCommand(std::istream& istream, KfsOp **res);
 
 extern void SubmitOp(KfsOp *op);
 extern void SubmitOpResponse(KfsOp *op);
+/// Update the client request latency histograms, invoked before the
+/// response is sent.
+extern void UpdateOpLatency(const KfsOp& op);
 
 }
 
@@ -76,7 +76,6 @@ Logger::Logger()
 {
     mLogDir = "";
     mLogFilename = "";
-    mLoggerTimeoutImpl = new LoggerTimeoutImpl(this);
     mLogGenNum = 1;
     sprintf(ckptLogVersionStr, "version: %d", KFS_LOG_VERSION);
 }
@@ -84,7 +83,6 @@ Logger::Logger()
 Logger::~Logger()
 {
     mFile.close();
-    delete mLoggerTimeoutImpl;
 }
 
 void
@@ -96,53 +94,6 @@ Logger::Init(const string &logDir)
 
 }
 
-static void *
-logger_main(void *dummy)
-{
-    (void) dummy; // shut-up g++
-    gLogger.MainLoop();
-    return NULL;
-}
-
-void
-Logger::MainLoop()
-{
-    KfsOp *op;
-    list<KfsOp *> done;
-    list<KfsOp *>::iterator iter;
-
-    while (1) {
-        op = mPending.dequeue();
-        while (op != NULL) {
-            // pull as many as we can and log them
-            if (op->op == CMD_CHECKPOINT) {
-                // Checkpoint ops are special.  There is log handling
-                // that needs to be done.  After writing out the
-                // checkpoint, get rid of the op.
-                mFile.flush();
-                Checkpoint(op);
-                delete op;
-            } else { 
-                if (op->status >= 0) {
-                    op->Log(mFile);
-                }
-                done.push_back(op);
-            }
-            op = mPending.dequeue_nowait();
-        }
-        // one flush for everything we have in the queue
-        mFile.flush();
-        // now, allow everything that was flushed
-        while ((iter = done.begin()) != done.end()) {
-            op = *iter;
-            done.erase(iter);
-            mLogged.enqueue(op);
-        }
-        globalNetManager().Wakeup();
-        KFS_LOG_DEBUG("Kicked the net manager");
-    }
-}
-
 void
 Logger::Submit(KfsOp *op)
 {
@@ -158,34 +109,6 @@ Logger::Submit(KfsOp *op)
     }
 }
 
-void
-Logger::Dispatch()
-{
-    KfsOp *op;
-
-#ifdef DEBUG
-    verifyExecutingOnNetProcessor();    
-#endif
-
-    // KFS_LOG_DEBUG("Logger timeout");
-
-    while (!mLogged.empty()) {
-        op = mLogged.dequeue_nowait();
-        if (op == NULL)
-            break;
-
-        // When internally generated ops are done, they go
-        // back to the event processor to finish up processing
-        if (op->op == CMD_WRITE) {
-            KFS::SubmitOpResponse(op);
-        } else {
-            assert(op->clnt != NULL);
-            op->clnt->HandleEvent(EVENT_CMD_DONE, op);
-        }
-    }
-}
-
-
 void
 Logger::Start()
 {
@@ -210,8 +133,6 @@ Logger::Start()
         KFS_LOG_VA_WARN("Unable to open: %s", filename.c_str());
     }
     assert(!mFile.fail());
-    globalNetManager().RegisterTimeoutHandler(mLoggerTimeoutImpl);
-    mWorker.start(logger_main, NULL);
 }
 
 void
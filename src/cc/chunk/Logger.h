@@ -31,19 +31,12 @@
 #include <fstream>
 #include <string>
 
-#include "libkfsIO/ITimeout.h"
-#include "libkfsIO/NetManager.h"
 #include "KfsOps.h"
 #include "Chunk.h"
 
-#include "meta/queue.h"
-#include "meta/thread.h"
-
 namespace KFS
 {
 
-class LoggerTimeoutImpl;
-
 ///
 /// Between a pair of checkpoints, the operations at the chunk server
 /// relating to allocate/delete chunks as well as writes to chunks are
@@ -59,19 +52,13 @@ public:
     /// Set up for logging
     void Start();
 
-    /// The main loop for the logger thread.  It pulls requests that
-    /// have been submitted for logging and logs them.
-    void MainLoop();
-
     /// Submit a request for logging.  This is called by the main
-    /// thread and the request is sent down to the logger thread.
+    /// thread.  Starting with V2 the chunk meta data is kept in the chunk
+    /// headers, and nothing is logged: the op processing resumes
+    /// immediately, without a hand off to another thread.
     /// @param[in] op  The op that needs to be logged
     void Submit(KfsOp *op);
 
-    /// This is called by the main thread to pull requests that have
-    /// been logged.  Processing for the logged requests resumes.
-    void Dispatch();
-
     /// Starting with V2 of the chunk meta file, the checkpoint only
     /// contains a version number.  This is used to detect if we need
     /// to upgrade.
@@ -102,14 +89,6 @@ private:
 
     /// The handle to the log file
     std::ofstream mFile;
-    /// pending ops that need to be logged
-    MetaQueue<KfsOp> mPending;
-    /// ops for which logging is done
-    MetaQueue<KfsOp> mLogged;
-    /// thread that does the logging and flushes the log file to disk
-    MetaThread mWorker;
-    /// Timer object to pull out logged requests and dispatch them
-    LoggerTimeoutImpl *mLoggerTimeoutImpl;
 
 
     /// Rotate the logs whenever the system takes a checkpoint
@@ -143,24 +122,6 @@ private:
     int GetLogVersion(const char *versionLine);
 };
 
-/// A Timeout interface object for pulling out the logged requests and
-/// dispatching them
-class LoggerTimeoutImpl : public ITimeout {
-public:
-    LoggerTimeoutImpl(Logger *log) {
-        mLogger = log;
-        // set a checkpoint once every min.
-        // SetTimeoutInterval(60*1000);
-    };
-    /// On a timeout, pull out whatever is logged
-    void Timeout() {
-        mLogger->Dispatch();
-    };
-private:
-    /// Owning logger object
-    Logger	*mLogger;
-};
-
 extern Logger gLogger;
 
 }
@@ -44,6 +44,7 @@ using std::istringstream;
 using std::ostringstream;
 using std::list;
 using std::string;
+using std::make_pair;
 
 using namespace KFS;
 using namespace KFS::libkfsio;
@@ -80,6 +81,9 @@ RemoteSyncSM::UpdateRecvTimeout()
 
 RemoteSyncSM::RemoteSyncSM(const ServerLocation &location)         
     : mLocation(location),
+      mStreamOp(0),
+      mStreamRemaining(0),
+      mStreamPendingOps(),
       mReplySeqNum(-1),
       mReplyNumBytes(0),
       mLastRecvTime(0)
@@ -98,7 +102,8 @@ RemoteSyncSM::~RemoteSyncSM()
 {
     if (mNetConnection)
         mNetConnection->Close();
-    assert(mDispatchedOps.size() == 0);
+    assert(mDispatchedOps.size() == 0 && ! mStreamOp &&
+        mStreamPendingOps.empty());
 }
 
 bool
@@ -143,6 +148,12 @@ RemoteSyncSM::Connect()
 void
 RemoteSyncSM::Enqueue(KfsOp *op)
 {
+    if (mStreamOp && op != mStreamOp) {
+        // The data of the op being streamed must not be interleaved with
+        // other requests.
+        mStreamPendingOps.push_back(op);
+        return;
+    }
     if (!mNetConnection) {
         if (!Connect()) {
             KFS_LOG_VA_INFO("Connect to peer %s failed; failing ops", mLocation.ToString().c_str());
@@ -182,6 +193,11 @@ RemoteSyncSM::Enqueue(KfsOp *op)
         op->status = 0;
         KFS::SubmitOpResponse(op); 
     }
+    else if (op == mStreamOp) {
+        // the data is sent by StreamData(); keep the op in the dispatched
+        // queue to fail it if the connection fails in the meantime
+        mDispatchedOps.push_back(op);
+    }
     else if (op->op == CMD_WRITE_PREPARE_FWD) {
         // send the data as well
         WritePrepareFwdOp *wpfo = static_cast<WritePrepareFwdOp *>(op);        
@@ -205,6 +221,53 @@ RemoteSyncSM::Enqueue(KfsOp *op)
     }
 }
 
+void
+RemoteSyncSM::StartStream(WritePrepareFwdOp *op)
+{
+    assert(op && ! op->dataBuf && ! mStreamOp && mStreamPendingOps.empty());
+    mStreamOp        = op;
+    mStreamRemaining = (int)op->owner->numBytes;
+    Enqueue(op);
+}
+
+void
+RemoteSyncSM::StreamData(IOBuffer *buf, int numBytes)
+{
+    if (! mStreamOp) {
+        // the connection has failed, and the op with it
+        return;
+    }
+    assert(0 < numBytes && numBytes <= mStreamRemaining);
+    if (! mNetConnection || ! mNetConnection->IsGood()) {
+        KFS_LOG_STREAM_INFO <<
+            "Lost the connection to peer " << mLocation.ToString() <<
+            " while streaming: " << mStreamOp->Show() << "; failing ops" <<
+        KFS_LOG_EOM;
+        Finish();
+        return;
+    }
+    mNetConnection->Write(buf, numBytes);
+    mStreamRemaining -= numBytes;
+    if (mStreamRemaining <= 0) {
+        KfsOp* const op = mStreamOp;
+        mStreamOp = 0;
+        mDispatchedOps.remove(op);
+        list<KfsOp*> pending;
+        pending.swap(mStreamPendingOps);
+        // fire'n'forget, same as the write prepare forwarded with the data
+        op->status = 0;
+        KFS::SubmitOpResponse(op);
+        while (! pending.empty()) {
+            KfsOp* const p = pending.front();
+            pending.pop_front();
+            Enqueue(p);
+        }
+    }
+    UpdateRecvTimeout();
+    if (mNetConnection) {
+        mNetConnection->StartFlush();
+    }
+}
 
 int
 RemoteSyncSM::HandleEvent(int code, void *data)
@@ -397,6 +460,11 @@ public:
 void
 RemoteSyncSM::FailAllOps()
 {
+    // The stream op is in the dispatched queue; the ops waiting for the
+    // stream end go after it.
+    mStreamOp        = 0;
+    mStreamRemaining = 0;
+    mDispatchedOps.splice(mDispatchedOps.end(), mStreamPendingOps);
     if (mDispatchedOps.empty())
         return;
 
@@ -499,3 +567,56 @@ KFS::ReleaseAllServers(list<RemoteSyncSMPtr> &remoteSyncers)
         r->Finish();
     }
 }
+
+RemoteSyncSMPtr
+RemoteSyncSMPool::Find(const ServerLocation &location, uint64_t key,
+    bool connect)
+{
+    Peers::iterator it = mPeers.find(location);
+    if (it == mPeers.end()) {
+        if (! connect) {
+            return RemoteSyncSMPtr();
+        }
+        it = mPeers.insert(make_pair(location,
+            Connections(mMaxConnectionsPerPeer))).first;
+    }
+    RemoteSyncSMPtr& slot = it->second[key % it->second.size()];
+    if (slot || ! connect) {
+        return slot;
+    }
+    RemoteSyncSMPtr peer(new RemoteSyncSM(location));
+    if (peer->Connect()) {
+        slot = peer;
+        mConnectionCount++;
+    } else {
+        // we couldn't connect...so, force destruction
+        peer.reset();
+    }
+    return peer;
+}
+
+bool
+RemoteSyncSMPool::Remove(RemoteSyncSM *target)
+{
+    Peers::iterator const it = mPeers.find(target->GetLocation());
+    if (it == mPeers.end()) {
+        return false;
+    }
+    bool found = false;
+    bool empty = true;
+    for (Connections::iterator ci = it->second.begin();
+            ci != it->second.end();
+            ++ci) {
+        if (ci->get() == target) {
+            ci->reset();
+            mConnectionCount--;
+            found = true;
+        } else if (*ci) {
+            empty = false;
+        }
+    }
+    if (empty) {
+        mPeers.erase(it);
+    }
+    return found;
+}
@@ -38,6 +38,10 @@
 #include <sys/types.h>
 #include <time.h>
 
+#include <algorithm>
+#include <map>
+#include <vector>
+
 #include <boost/shared_ptr.hpp>
 #include <boost/enable_shared_from_this.hpp>
 
@@ -62,6 +66,17 @@ public:
 
     void Enqueue(KfsOp *op);
 
+    /// Cut-through write forwarding: send the write prepare header now,
+    /// and the data with StreamData() as it arrives from the client. The
+    /// ops enqueued until all the data is sent wait for the stream end.
+    /// The op completes when the last byte is queued for sending, or when
+    /// the connection fails.
+    void StartStream(WritePrepareFwdOp *op);
+    void StreamData(IOBuffer *buf, int numBytes);
+    bool IsStreaming() const {
+        return (mStreamOp != 0);
+    }
+
     void Finish();
 
     // void Dispatch();
@@ -92,6 +107,12 @@ private:
     /// Queue of outstanding ops sent to remote server.
     std::list<KfsOp *> mDispatchedOps;
 
+    /// Write prepare op being streamed, the bytes that remain to be
+    /// sent, and the ops waiting for the stream end.
+    KfsOp*            mStreamOp;
+    int               mStreamRemaining;
+    std::list<KfsOp*> mStreamPendingOps;
+
     kfsSeq_t mReplySeqNum;
     int      mReplyNumBytes;
     time_t   mLastRecvTime;
@@ -116,6 +137,48 @@ typedef boost::shared_ptr<RemoteSyncSM> RemoteSyncSMPtr;
     void RemoveServer(std::list<RemoteSyncSMPtr> &remoteSyncers, RemoteSyncSM *target);
 
     void ReleaseAllServers(std::list<RemoteSyncSMPtr> &remoteSyncers);
+
+// Bounded pool of the connections to the other chunk servers. The ops are
+// pipelined on a connection, and matched with the replies by the sequence
+// number. Each peer has up to the max number of connections: the op key
+// selects the connection, thus the ops with the same key are sent over
+// the same connection, and arrive in order.
+class RemoteSyncSMPool
+{
+public:
+    RemoteSyncSMPool(int maxConnectionsPerPeer = 1)
+        : mPeers(),
+          mMaxConnectionsPerPeer(std::max(1, maxConnectionsPerPeer)),
+          mConnectionCount(0)
+        {}
+    RemoteSyncSMPtr Find(const ServerLocation &location, uint64_t key,
+        bool connect);
+    /// @retval true if the target was in the pool
+    bool Remove(RemoteSyncSM *target);
+    /// Only affects the peers with no connections yet.
+    void SetMaxConnectionsPerPeer(int count) {
+        mMaxConnectionsPerPeer = std::max(1, count);
+    }
+    int GetMaxConnectionsPerPeer() const {
+        return mMaxConnectionsPerPeer;
+    }
+    size_t GetConnectionCount() const {
+        return mConnectionCount;
+    }
+
+private:
+    typedef std::vector<RemoteSyncSMPtr>         Connections;
+    typedef std::map<ServerLocation, Connections> Peers;
+
+    Peers  mPeers;
+    int    mMaxConnectionsPerPeer;
+    size_t mConnectionCount;
+
+private:
+    // No copies.
+    RemoteSyncSMPool(const RemoteSyncSMPool&);
+    RemoteSyncSMPool& operator=(const RemoteSyncSMPool&);
+};
 }
 
 #endif // CHUNKSERVER_REMOTESYNCSM_H
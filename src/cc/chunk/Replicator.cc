@@ -30,6 +30,7 @@
 
 #include "Replicator.h"
 #include "ChunkServer.h"
+#include "BackgroundIoThrottle.h"
 #include "Utils.h"
 #include "libkfsIO/Globals.h"
 #include "libkfsIO/Checksum.h"
@@ -89,6 +90,7 @@ Replicator::Replicator(ReplicateChunkOp *op) :
 {
     mReadOp.chunkId = op->chunkId;
     mReadOp.chunkVersion = op->chunkVersion;
+    mReadOp.isForReplication = true;
     mReadOp.clnt = this;
     mWriteOp.clnt = this;
     mChunkMetadataOp.clnt = this;
@@ -99,6 +101,7 @@ Replicator::Replicator(ReplicateChunkOp *op) :
 
 Replicator::~Replicator()
 {
+    gBackgroundIoThrottle.Cancel(this);
     InFlightReplications::iterator const it =
         sInFlightReplications.find(mChunkId);
     if (it != sInFlightReplications.end() && it->second == this) {
@@ -183,6 +186,10 @@ Replicator::HandleStartDone(int code, void *data)
         Terminate();
         return -1;
     }
+    const ChunkInfo_t* const info = gChunkManager.GetChunkInfo(mChunkId);
+    if (info) {
+        mDirName = info->dirname;
+    }
     KFS_LOG_STREAM_INFO <<
         "Starting re-replication for chunk " << mChunkId <<
         " with size " << mChunkSize <<
@@ -219,6 +226,36 @@ Replicator::Read()
         return;
     }
 
+    // read an MB 
+    mReadOp.numBytes = 1 << 20;
+    SET_HANDLER(this, &Replicator::HandleThrottleDone);
+    if (! gBackgroundIoThrottle.Acquire(mDirName,
+            std::min((off_t)mReadOp.numBytes, (off_t)mChunkSize - mOffset),
+            this)) {
+        return;
+    }
+    SendRead();
+}
+
+int
+Replicator::HandleThrottleDone(int code, void *data)
+{
+#ifdef DEBUG
+    verifyExecutingOnEventProcessor();
+#endif
+    ReplicatorPtr const self = shared_from_this();
+
+    if (mCancelFlag) {
+        Terminate();
+        return 0;
+    }
+    SendRead();
+    return 0;
+}
+
+void
+Replicator::SendRead()
+{
     SET_HANDLER(this, &Replicator::HandleReadDone);
 
     mReadOp.seq = mPeer->NextSeqnum();
@@ -226,8 +263,6 @@ Replicator::Read()
     mReadOp.offset = mOffset;
     mReadOp.numBytesIO = 0;
     mReadOp.checksum.clear();
-    // read an MB 
-    mReadOp.numBytes = 1 << 20;
     mPeer->Enqueue(&mReadOp);
 }
 
@@ -333,7 +368,10 @@ Replicator::Terminate()
 int
 Replicator::HandleReplicationDone(int code, void *data)
 {
-    const int status = data ? *reinterpret_cast<int*>(data) : 0;
+    // The meta data write completion comes through the write op, with the
+    // op as the data.
+    const int status = data == &mWriteOp ? mWriteOp.status :
+        (data ? *reinterpret_cast<int*>(data) : 0);
     mOwner->status = status >= 0 ? 0 : -1;
     if (status < 0) {
         KFS_LOG_STREAM_ERROR <<
@@ -78,6 +78,9 @@ public:
     void Start(RemoteSyncSMPtr &peer);
     // Handle the callback for a size request
     int HandleStartDone(int code, void *data);
+    // Handle the callback for the background io throttle: the read can
+    // be sent
+    int HandleThrottleDone(int code, void *data);
     // Handle the callback for a remote read request
     int HandleReadDone(int code, void *data);
     // Handle the callback for a write
@@ -102,6 +105,8 @@ private:
     ReplicateChunkOp *mOwner;
     // What is the offset we are currently reading at
     off_t mOffset;
+    // Chunk directory, for the background io throttle
+    std::string mDirName;
 
     // Handle to the peer from where we have to get data
     RemoteSyncSMPtr mPeer;
@@ -113,8 +118,10 @@ private:
     bool mDone;
     bool mCancelFlag;
 
-    // Send out a read request to the peer
+    // Send out a read request to the peer, once the background io
+    // throttle permits
     void Read();
+    void SendRead();
 
 };
 
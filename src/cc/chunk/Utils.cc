@@ -26,6 +26,8 @@
 #include "Utils.h"
 #include "common/log.h"
 
+#include <sys/time.h>
+
 using std::vector;
 using std::string;
 using namespace KFS;
@@ -73,3 +75,16 @@ float KFS::ComputeTimeDiff(const struct timeval &startTime, const struct timeval
         (startTime.tv_sec * 1e6 + startTime.tv_usec);
     return timeSpent / 1e6;
 }
+
+int64_t KFS::MicroSecs(const struct timeval &tv)
+{
+    return (int64_t(tv.tv_sec) * 1000000 + tv.tv_usec);
+}
+
+int64_t KFS::MicroSecsNow()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return MicroSecs(tv);
+}
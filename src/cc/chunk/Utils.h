@@ -27,6 +27,7 @@
 #define CHUNKSERVER_UTILS_H
 
 #include "libkfsIO/IOBuffer.h"
+#include <stdint.h>
 #include <string>
 #include <vector>
 
@@ -62,6 +63,16 @@ extern void split(std::vector<std::string> &component, const std::string &path,
 /// \retval  The time difference in seconds.
 ///
 extern float ComputeTimeDiff(const struct timeval &startTime, const struct timeval &endTime);
+
+///
+/// \brief convert time to microseconds
+/// \param[in] tv  time
+/// \retval  The time in microseconds.
+///
+extern int64_t MicroSecs(const struct timeval &tv);
+
+/// \retval  The current time in microseconds.
+extern int64_t MicroSecsNow();
 }
 
 #endif // CHUNKSERVER_UTILS_H
@@ -0,0 +1,294 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2010/11/02
+//
+// Copyright 2010 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \file FlatHashMap.h
+// \brief Open addressing (linear probing) hash table for integer keys.
+//
+// The entries are stored in a single flat array, therefore there is no per
+// entry node allocation, and the per entry overhead is one byte for the slot
+// state. Erase leaves a "tombstone" behind, so that erase does not
+// invalidate iterators, and the std::map like "erase(it++)" idiom works.
+// Insert can re-hash the table, and invalidate all iterators, just like
+// std::tr1::unordered_map insert.
+//
+//----------------------------------------------------------------------------
+
+#ifndef COMMON_FLAT_HASH_MAP_H
+#define COMMON_FLAT_HASH_MAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <algorithm>
+
+namespace KFS
+{
+
+template<typename KeyT, typename ValT>
+class FlatHashMap
+{
+public:
+    struct Entry
+    {
+        Entry()
+            : first(), second()
+            {}
+        KeyT first;
+        ValT second;
+    };
+    typedef KeyT   key_type;
+    typedef ValT   mapped_type;
+    typedef Entry  value_type;
+    typedef size_t size_type;
+
+    template<typename EntryT, typename MapT>
+    class IteratorT
+    {
+    public:
+        IteratorT()
+            : mMap(0), mIdx(0)
+            {}
+        template<typename OEntryT, typename OMapT>
+        IteratorT(const IteratorT<OEntryT, OMapT>& other)
+            : mMap(other.mMap), mIdx(other.mIdx)
+            {}
+        EntryT& operator*() const
+            { return mMap->mEntries[mIdx]; }
+        EntryT* operator->() const
+            { return &mMap->mEntries[mIdx]; }
+        IteratorT& operator++()
+        {
+            mIdx = mMap->Next(mIdx + 1);
+            return *this;
+        }
+        IteratorT operator++(int)
+        {
+            IteratorT const ret(*this);
+            ++(*this);
+            return ret;
+        }
+        template<typename OEntryT, typename OMapT>
+        bool operator==(const IteratorT<OEntryT, OMapT>& other) const
+            { return (mIdx == other.mIdx && mMap == other.mMap); }
+        template<typename OEntryT, typename OMapT>
+        bool operator!=(const IteratorT<OEntryT, OMapT>& other) const
+            { return ! (*this == other); }
+    private:
+        MapT*  mMap;
+        size_t mIdx;
+
+        IteratorT(MapT* map, size_t idx)
+            : mMap(map), mIdx(idx)
+            {}
+        template<typename, typename> friend class IteratorT;
+        friend class FlatHashMap;
+    };
+    typedef IteratorT<Entry, FlatHashMap>             iterator;
+    typedef IteratorT<const Entry, const FlatHashMap> const_iterator;
+
+    FlatHashMap()
+        : mEntries(0),
+          mStates(0),
+          mCapacity(0),
+          mBits(0),
+          mSize(0),
+          mUsed(0)
+        {}
+    ~FlatHashMap()
+        { Free(); }
+    size_t size() const
+        { return mSize; }
+    bool empty() const
+        { return (mSize == 0); }
+    /// Number of slots, for memory usage reporting.
+    size_t bucket_count() const
+        { return mCapacity; }
+    size_t GetMemoryUsage() const
+        { return (mCapacity * (sizeof(Entry) + sizeof(mStates[0]))); }
+    iterator begin()
+        { return iterator(this, Next(0)); }
+    iterator end()
+        { return iterator(this, mCapacity); }
+    const_iterator begin() const
+        { return const_iterator(this, Next(0)); }
+    const_iterator end() const
+        { return const_iterator(this, mCapacity); }
+    iterator find(const KeyT& key)
+        { return iterator(this, Find(key)); }
+    const_iterator find(const KeyT& key) const
+        { return const_iterator(this, Find(key)); }
+    size_t count(const KeyT& key) const
+        { return (Find(key) == mCapacity ? 0 : 1); }
+    ValT& operator[](const KeyT& key)
+    {
+        // Insert can re-allocate mEntries.
+        const size_t idx = Insert(key);
+        return mEntries[idx].second;
+    }
+    void erase(const const_iterator& it)
+    {
+        assert(it.mMap == this && it.mIdx < mCapacity &&
+            mStates[it.mIdx] == kStateFull);
+        Erase(it.mIdx);
+    }
+    size_t erase(const KeyT& key)
+    {
+        const size_t idx = Find(key);
+        if (idx == mCapacity) {
+            return 0;
+        }
+        Erase(idx);
+        return 1;
+    }
+    void clear()
+    {
+        Free();
+        mCapacity = 0;
+        mBits     = 0;
+        mSize     = 0;
+        mUsed     = 0;
+    }
+    void swap(FlatHashMap& other)
+    {
+        std::swap(mEntries,  other.mEntries);
+        std::swap(mStates,   other.mStates);
+        std::swap(mCapacity, other.mCapacity);
+        std::swap(mBits,     other.mBits);
+        std::swap(mSize,     other.mSize);
+        std::swap(mUsed,     other.mUsed);
+    }
+private:
+    enum
+    {
+        kStateEmpty   = 0,
+        kStateFull    = 1,
+        kStateDeleted = 2
+    };
+    enum { kMinBits = 4 };
+
+    Entry*   mEntries;
+    uint8_t* mStates;
+    size_t   mCapacity;
+    int      mBits;
+    size_t   mSize;
+    size_t   mUsed; // Full and deleted slots.
+
+    size_t Hash(const KeyT& key) const
+    {
+        // Fibonacci hashing: chunk and file ids are mostly sequential,
+        // multiplicative hash spreads them as well as any strided pattern.
+        return (size_t)((uint64_t(key) * uint64_t(0x9E3779B97F4A7C15ULL)) >>
+            (64 - mBits));
+    }
+    size_t Next(size_t idx) const
+    {
+        while (idx < mCapacity && mStates[idx] != kStateFull) {
+            ++idx;
+        }
+        return idx;
+    }
+    size_t Find(const KeyT& key) const
+    {
+        if (mSize <= 0) {
+            return mCapacity;
+        }
+        const size_t mask = mCapacity - 1;
+        for (size_t idx = Hash(key); ; idx = (idx + 1) & mask) {
+            if (mStates[idx] == kStateEmpty) {
+                return mCapacity;
+            }
+            if (mStates[idx] == kStateFull && mEntries[idx].first == key) {
+                return idx;
+            }
+        }
+    }
+    size_t Insert(const KeyT& key)
+    {
+        size_t idx = Find(key);
+        if (idx != mCapacity) {
+            return idx;
+        }
+        // Keep at least 1/4 of the slots empty, to bound the probe length.
+        if ((mUsed + 1) * 4 > mCapacity * 3) {
+            // Grow if more than half full, otherwise only purge tombstones.
+            Rehash(std::max(int(kMinBits),
+                (mSize + 1) * 2 > mCapacity ? mBits + 1 : mBits));
+        }
+        const size_t mask = mCapacity - 1;
+        for (idx = Hash(key); mStates[idx] == kStateFull;
+                idx = (idx + 1) & mask)
+            {}
+        if (mStates[idx] == kStateEmpty) {
+            mUsed++;
+        }
+        mStates[idx]         = kStateFull;
+        mEntries[idx].first  = key;
+        mEntries[idx].second = ValT();
+        mSize++;
+        return idx;
+    }
+    void Erase(size_t idx)
+    {
+        mStates[idx]         = kStateDeleted;
+        mEntries[idx].second = ValT();
+        mSize--;
+    }
+    void Rehash(int bits)
+    {
+        Entry* const   entries  = mEntries;
+        uint8_t* const states   = mStates;
+        const size_t   capacity = mCapacity;
+        mBits     = bits;
+        mCapacity = size_t(1) << bits;
+        mEntries  = new Entry[mCapacity];
+        mStates   = new uint8_t[mCapacity];
+        std::fill(mStates, mStates + mCapacity, uint8_t(kStateEmpty));
+        mUsed = mSize;
+        const size_t mask = mCapacity - 1;
+        for (size_t i = 0; i < capacity; i++) {
+            if (states[i] != kStateFull) {
+                continue;
+            }
+            size_t idx = Hash(entries[i].first);
+            while (mStates[idx] != kStateEmpty) {
+                idx = (idx + 1) & mask;
+            }
+            mStates[idx]  = kStateFull;
+            mEntries[idx] = entries[i];
+        }
+        delete [] entries;
+        delete [] states;
+    }
+    void Free()
+    {
+        delete [] mEntries;
+        delete [] mStates;
+        mEntries = 0;
+        mStates  = 0;
+    }
+private:
+    FlatHashMap(const FlatHashMap&);
+    FlatHashMap& operator=(const FlatHashMap&);
+};
+
+} // namespace KFS
+
+#endif // COMMON_FLAT_HASH_MAP_H
@@ -0,0 +1,6 @@
+//
+// This file is generated during compilation.  DO NOT EDIT!
+//
+#include "Version.h" 
+const std::string KFS::KFS_BUILD_VERSION_STRING="perforce1:1666/trunk@1000";
+const std::string KFS::KFS_SOURCE_REVISION_STRING="100";
@@ -55,6 +55,15 @@ namespace KFS
         void SetRebalancePlanOutFd(int fd) {
             mOutFd = fd;
         }
+        void SetDiskLoad(double load) {
+            mDiskLoad = load;
+        }
+        void SetIoPressure(int64_t queueDepth, int64_t writePendingBytes,
+                bool netOverloaded) {
+            mDiskQueueDepth    = queueDepth;
+            mWritePendingBytes = writePendingBytes;
+            mNetOverloaded     = netOverloaded;
+        }
     private:
         std::set<kfsChunkId_t> mChunks;
         int mOutFd;
@@ -308,6 +308,35 @@ LayoutEmulator::AddServer(const ServerLocation &loc, int rack, uint64_t totalSpa
         ri.addServer(c1);
         mRacks.push_back(ri);
     }
+    mPlacementIndex.Add(c1);
+    UpdateServerPlacement(c1.get());
+}
+
+int
+LayoutEmulator::ChooseAllocationServersLinear(MetaAllocate &r)
+{
+    vector<int> racks;
+    FindCandidateRacks(racks);
+    r.servers.clear();
+    if (racks.empty()) {
+        return -ENOSPC;
+    }
+    const size_t numServersPerRack =
+        (r.numReplicas + racks.size() - 1) / racks.size();
+    for (size_t i = 0;
+            i < racks.size() && r.servers.size() < (size_t)r.numReplicas;
+            i++) {
+        vector<ChunkServerPtr> candidates;
+        vector<ChunkServerPtr> excludes;
+        LayoutManager::FindCandidateServers(candidates, excludes, racks[i]);
+        for (size_t k = 0;
+                k < candidates.size() && k < numServersPerRack &&
+                r.servers.size() < (size_t)r.numReplicas;
+                k++) {
+            r.servers.push_back(candidates[k]);
+        }
+    }
+    return (r.servers.empty() ? -ENOSPC : 0);
 }
 
 int
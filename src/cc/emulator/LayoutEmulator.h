@@ -77,6 +77,26 @@ namespace KFS
         int GetNumBlksRebalanced() const {
             return mNumBlksRebalanced;
         }
+
+        const vector<ChunkServerPtr>& GetChunkServers() const {
+            return mChunkServers;
+        }
+
+        // Servers in the order the chunk allocation would use them.
+        void FindCandidateServers(vector<ChunkServerPtr> &result) {
+            vector<ChunkServerPtr> excludes;
+            LayoutManager::FindCandidateServers(result, excludes);
+        }
+
+        // Chunk allocation server selection only: the chunk is not created.
+        int ChooseAllocationServers(MetaAllocate &r) {
+            return LayoutManager::ChooseAllocationServers(&r);
+        }
+
+        // The same, with the per rack candidate lists built by scanning
+        // all servers, the way the allocation did before the placement
+        // index. Used as the baseline by the allocation benchmark.
+        int ChooseAllocationServersLinear(MetaAllocate &r);
     private:
         void Parse(const char *line, bool addChunksToReplicationChecker);
         bool mDoingRebalancePlanning;
@@ -0,0 +1,189 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2010/12/06
+//
+//
+// Copyright 2010 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Driver program to benchmark the chunk allocation server selection
+// with the emulated chunk servers: the placement index used by the layout
+// manager, and the per rack candidate lists built by scanning all servers.
+//
+// Each allocation places the chunk replicas on the chosen servers, and
+// updates their placement weights, the same way as the chunk allocation
+// does. The report has the allocations per second, and the min / average /
+// max number of chunks per server, and the same per free space terabyte.
+//----------------------------------------------------------------------------
+
+#include "LayoutEmulator.h"
+#include "ChunkServerEmulator.h"
+
+#include "common/log.h"
+#include "meta/request.h"
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+
+using std::string;
+using std::cout;
+using std::endl;
+using std::vector;
+using std::ostringstream;
+
+using namespace KFS;
+
+static double
+Now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return (tv.tv_sec + tv.tv_usec * 1e-6);
+}
+
+static void
+RunScenario(const char* name, bool linearFlag, int numAllocs, int numReplicas,
+    chunkId_t& chunkId)
+{
+    const vector<ChunkServerPtr>& servers = gLayoutEmulator.GetChunkServers();
+    vector<int> counts(servers.size(), 0);
+    vector<double> freeTb(servers.size(), 0);
+    for (size_t i = 0; i < servers.size(); i++) {
+        freeTb[i] = servers[i]->GetAvailSpace() / double(int64_t(1) << 40);
+    }
+    // Same random sequence for every scenario.
+    srand(1);
+    int    errors   = 0;
+    double selTime  = 0;
+    for (int i = 0; i < numAllocs; i++) {
+        MetaAllocate r(i, 0, 1, i * (chunkOff_t)CHUNKSIZE);
+        r.numReplicas = numReplicas;
+        r.chunkId     = ++chunkId;
+        const double start = Now();
+        const int status = linearFlag ?
+            gLayoutEmulator.ChooseAllocationServersLinear(r) :
+            gLayoutEmulator.ChooseAllocationServers(r);
+        selTime += Now() - start;
+        if (status != 0 || r.servers.empty()) {
+            errors++;
+            continue;
+        }
+        for (vector<ChunkServerPtr>::const_iterator it = r.servers.begin();
+                it != r.servers.end();
+                ++it) {
+            static_cast<ChunkServerEmulator*>(it->get())->HostingChunk(
+                r.chunkId, CHUNKSIZE);
+            gLayoutEmulator.UpdateServerPlacement(it->get());
+            const size_t idx = find(servers.begin(), servers.end(), *it) -
+                servers.begin();
+            if (idx < counts.size()) {
+                counts[idx]++;
+            }
+        }
+    }
+    int    minCnt   = numAllocs;
+    int    maxCnt   = 0;
+    double minPerTb = 1e30;
+    double maxPerTb = 0;
+    double total    = 0;
+    for (size_t i = 0; i < counts.size(); i++) {
+        minCnt = std::min(minCnt, counts[i]);
+        maxCnt = std::max(maxCnt, counts[i]);
+        total += counts[i];
+        if (freeTb[i] > 0) {
+            minPerTb = std::min(minPerTb, counts[i] / freeTb[i]);
+            maxPerTb = std::max(maxPerTb, counts[i] / freeTb[i]);
+        }
+    }
+    printf("%-16s %8d allocs %8.3f sec %10.1f allocs/sec errors: %d"
+        " chunks per server: min: %d avg: %.1f max: %d"
+        " per free TB: min: %.1f max: %.1f\n",
+        name, numAllocs, selTime,
+        selTime > 0 ? numAllocs / selTime : 0.,
+        errors,
+        minCnt, counts.empty() ? 0. : total / counts.size(), maxCnt,
+        minPerTb, maxPerTb);
+}
+
+int
+main(int argc, char **argv)
+{
+    KFS::MsgLogger::Init(NULL);
+    char optchar;
+    bool help        = false;
+    int  numServers  = 1000;
+    int  numRacks    = 20;
+    int  numAllocs   = 100000;
+    int  numReplicas = 3;
+
+    while ((optchar = getopt(argc, argv, "s:r:n:R:h")) != -1) {
+        switch (optchar) {
+            case 's':
+                numServers = atoi(optarg);
+                break;
+            case 'r':
+                numRacks = atoi(optarg);
+                break;
+            case 'n':
+                numAllocs = atoi(optarg);
+                break;
+            case 'R':
+                numReplicas = atoi(optarg);
+                break;
+            case 'h':
+                help = true;
+                break;
+            default:
+                KFS_LOG_VA_ERROR("Unrecognized flag %c", optchar);
+                help = true;
+                break;
+        }
+    }
+
+    if (help || numServers <= 0 || numRacks <= 0 || numAllocs <= 0 ||
+            numReplicas <= 0) {
+        cout << "Usage: " << argv[0] << " [-s <# servers>] [-r <# racks>] "
+             << "[-n <# allocations>] [-R <# replicas>]" << endl;
+        exit(-1);
+    }
+
+    MsgLogger::SetLevel(MsgLogger::kLogLevelINFO);
+
+    // 2 to 8 TB servers.
+    srand(1);
+    for (int i = 0; i < numServers; i++) {
+        ServerLocation loc;
+        ostringstream  os;
+        os << "cs" << i;
+        loc.hostname = os.str();
+        loc.port     = 30000;
+        gLayoutEmulator.AddServer(loc, i % numRacks,
+            (uint64_t(2) + rand() % 7) << 40, 0);
+    }
+    cout << "servers: " << numServers << " racks: " << numRacks <<
+        " replicas: " << numReplicas << endl;
+
+    chunkId_t chunkId = 0;
+    RunScenario("linear scan", true, numAllocs, numReplicas, chunkId);
+    RunScenario("placement index", false, numAllocs, numReplicas, chunkId);
+    return 0;
+}
@@ -0,0 +1,335 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2010/11/08
+//
+//
+// Copyright 2010 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Driver program to run the layout manager chunk placement against
+// emulated chunk servers with a few slow disks, and report the chunk write
+// latency percentiles with and without the load aware placement:
+// metaServer.maxDiskLoadForWrites, and the disk queue depth and write
+// pending bytes limits with hysteresis.
+//
+// Each emulated chunk server has a single fifo disk queue. A chunk write
+// takes the replication number of servers chosen by the chunk allocation,
+// and completes when the slowest replica completes. The servers report
+// their disk load every "heartbeat" the same way as the chunk server does:
+// queue depth / 8 + average io time / 50ms, along with the queue depth and
+// the bytes waiting to be written.
+//----------------------------------------------------------------------------
+
+#include "LayoutEmulator.h"
+#include "ChunkServerEmulator.h"
+
+#include "common/properties.h"
+#include "common/log.h"
+#include "meta/request.h"
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <math.h>
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <map>
+
+using std::string;
+using std::cout;
+using std::endl;
+using std::vector;
+using std::map;
+using std::ostringstream;
+
+using namespace KFS;
+
+struct EmulatedDisk
+{
+    EmulatedDisk()
+        : ioTimeMs(0), backlogMs(0), queueDepth(0), avgIoTimeMs(0)
+        {}
+    double ioTimeMs;
+    double backlogMs;
+    int    queueDepth;
+    double avgIoTimeMs;
+};
+
+static double
+Percentile(const vector<double>& sorted, double pct)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t idx = size_t(pct * sorted.size() / 100);
+    return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+struct Limits
+{
+    Limits(double dl = 0, int qd = 0, int64_t wp = 0, double h = 1)
+        : maxDiskLoad(dl), maxQueueDepth(qd), maxWritePending(wp),
+          hysteresis(h)
+        {}
+    double  maxDiskLoad;
+    int     maxQueueDepth;
+    int64_t maxWritePending;
+    double  hysteresis;
+};
+
+template<typename T> static string
+ToString(T val)
+{
+    ostringstream os;
+    os << val;
+    return os.str();
+}
+
+static void
+RunScenario(
+    const char*   name,
+    const Limits& limits,
+    int           numWritesPerTick,
+    int           numTicks,
+    int           numReplicas,
+    int           heartbeatTicks,
+    double        tickMs,
+    int64_t       writeBytes,
+    const vector<EmulatedDisk>& disks)
+{
+    Properties props;
+    props.setValue("metaServer.maxDiskLoadForWrites",
+        ToString(limits.maxDiskLoad));
+    props.setValue("metaServer.maxDiskQueueDepthPerDriveForWrites",
+        ToString(limits.maxQueueDepth));
+    props.setValue("metaServer.maxWritePendingBytesPerDriveForWrites",
+        ToString(limits.maxWritePending));
+    props.setValue("metaServer.loadedForWritesHysteresis",
+        ToString(limits.hysteresis));
+    gLayoutEmulator.SetParameters(props);
+
+    const vector<ChunkServerPtr>& servers = gLayoutEmulator.GetChunkServers();
+    map<const ChunkServer*, EmulatedDisk> state;
+    for (size_t i = 0; i < servers.size(); i++) {
+        state[servers[i].get()] = disks[i];
+        ChunkServerEmulator& cs =
+            *static_cast<ChunkServerEmulator*>(servers[i].get());
+        cs.SetDiskLoad(0);
+        cs.SetIoPressure(0, 0, false);
+        gLayoutEmulator.UpdateServerLoad(cs);
+    }
+    // Same random sequence for every scenario.
+    srand48(1);
+    srand(1);
+    vector<double> latencies;
+    latencies.reserve(size_t(numWritesPerTick) * numTicks);
+    int64_t   transitions = 0;
+    int64_t   loadedSum   = 0;
+    int64_t   heartbeats  = 0;
+    chunkId_t chunkId     = 0;
+    for (int tick = 0; tick < numTicks; tick++) {
+        for (int w = 0; w < numWritesPerTick; w++) {
+            MetaAllocate r(w, 0, 1, 0);
+            r.numReplicas = numReplicas;
+            r.chunkId     = ++chunkId;
+            if (gLayoutEmulator.ChooseAllocationServers(r) != 0) {
+                continue;
+            }
+            double latency = 0;
+            for (size_t i = 0; i < r.servers.size(); i++) {
+                EmulatedDisk& d = state[r.servers[i].get()];
+                // +-50% io time variation.
+                const double ioTime = d.ioTimeMs * (0.5 + drand48());
+                d.backlogMs += ioTime;
+                d.queueDepth++;
+                const double t = d.backlogMs;
+                d.avgIoTimeMs += (t - d.avgIoTimeMs) / 8;
+                latency = std::max(latency, t);
+            }
+            latencies.push_back(latency);
+        }
+        const bool heartbeat = (tick + 1) % heartbeatTicks == 0;
+        for (size_t i = 0; i < servers.size(); i++) {
+            EmulatedDisk& d = state[servers[i].get()];
+            if (d.backlogMs > 0) {
+                const double done = std::min(d.backlogMs, tickMs);
+                d.backlogMs -= done;
+                // Writes still queued, the average write takes io time.
+                d.queueDepth = int(ceil(d.backlogMs / d.ioTimeMs));
+            }
+            if (! heartbeat) {
+                continue;
+            }
+            ChunkServerEmulator& cs =
+                *static_cast<ChunkServerEmulator*>(servers[i].get());
+            const bool wasLoaded = cs.IsLoadedForWrites();
+            cs.SetDiskLoad(d.queueDepth / 8. + d.avgIoTimeMs / 50.);
+            cs.SetIoPressure(d.queueDepth, d.queueDepth * writeBytes, false);
+            gLayoutEmulator.UpdateServerLoad(cs);
+            if (cs.IsLoadedForWrites() != wasLoaded) {
+                transitions++;
+            }
+            if (cs.IsLoadedForWrites()) {
+                loadedSum++;
+            }
+            heartbeats++;
+        }
+    }
+    std::sort(latencies.begin(), latencies.end());
+    cout << name <<
+        " writes: " << latencies.size() <<
+        " latency ms: p50: " << Percentile(latencies, 50) <<
+        " p90: "   << Percentile(latencies, 90) <<
+        " p99: "   << Percentile(latencies, 99) <<
+        " p99.9: " << Percentile(latencies, 99.9) <<
+        " max: "   << (latencies.empty() ? 0. : latencies.back()) <<
+        " loaded: " << (heartbeats > 0 ? 100. * loadedSum / heartbeats : 0.) <<
+            "%" <<
+        " transitions: " << transitions <<
+    endl;
+}
+
+int
+main(int argc, char **argv)
+{
+    KFS::MsgLogger::Init(NULL);
+    char   optchar;
+    bool   help             = false;
+    int    numServers       = 100;
+    int    numRacks         = 10;
+    double slowFraction     = 0.1;
+    double ioTimeMs         = 5;
+    double slowIoTimeMs     = 25;
+    int    numWritesPerTick = 20;
+    int    numTicks         = 10000;
+    int    numReplicas      = 3;
+    int    heartbeatTicks   = 100;
+    double tickMs           = 10;
+    double maxDiskLoad      = 4;
+    int    maxQueueDepth    = 16;
+    int    writeKb          = 1024;
+    double hysteresis       = 0.5;
+
+    while ((optchar = getopt(argc, argv, "s:r:f:i:I:w:t:R:b:l:q:W:H:h")) != -1) {
+        switch (optchar) {
+            case 's':
+                numServers = atoi(optarg);
+                break;
+            case 'r':
+                numRacks = atoi(optarg);
+                break;
+            case 'f':
+                slowFraction = atof(optarg);
+                break;
+            case 'i':
+                ioTimeMs = atof(optarg);
+                break;
+            case 'I':
+                slowIoTimeMs = atof(optarg);
+                break;
+            case 'w':
+                numWritesPerTick = atoi(optarg);
+                break;
+            case 't':
+                numTicks = atoi(optarg);
+                break;
+            case 'R':
+                numReplicas = atoi(optarg);
+                break;
+            case 'b':
+                heartbeatTicks = atoi(optarg);
+                break;
+            case 'l':
+                maxDiskLoad = atof(optarg);
+                break;
+            case 'q':
+                maxQueueDepth = atoi(optarg);
+                break;
+            case 'W':
+                writeKb = atoi(optarg);
+                break;
+            case 'H':
+                hysteresis = atof(optarg);
+                break;
+            case 'h':
+                help = true;
+                break;
+            default:
+                KFS_LOG_VA_ERROR("Unrecognized flag %c", optchar);
+                help = true;
+                break;
+        }
+    }
+
+    if (help || numServers <= 0 || numRacks <= 0 || numTicks <= 0 ||
+            heartbeatTicks <= 0 || numReplicas <= 0 || maxQueueDepth <= 0 ||
+            writeKb <= 0) {
+        cout << "Usage: " << argv[0] << " [-s <# servers>] [-r <# racks>] "
+             << "[-f <fraction of slow servers>] [-i <io time ms>] "
+             << "[-I <slow io time ms>] [-w <writes per 10ms tick>] "
+             << "[-t <# ticks>] [-R <# replicas>] "
+             << "[-b <heartbeat interval ticks>] "
+             << "[-l <max disk load for writes>] "
+             << "[-q <max disk queue depth for writes>] "
+             << "[-W <write size KB>] "
+             << "[-H <loaded for writes hysteresis>]" << endl;
+        exit(-1);
+    }
+
+    MsgLogger::SetLevel(MsgLogger::kLogLevelWARN);
+
+    vector<EmulatedDisk> disks(numServers);
+    const int numSlow = int(numServers * slowFraction);
+    for (int i = 0; i < numServers; i++) {
+        ServerLocation loc;
+        ostringstream  os;
+        os << "cs" << i;
+        loc.hostname = os.str();
+        loc.port     = 30000;
+        gLayoutEmulator.AddServer(loc, i % numRacks, uint64_t(1) << 40, 0);
+        // Spread the slow servers across the racks.
+        disks[i].ioTimeMs = i < numSlow ? slowIoTimeMs : ioTimeMs;
+    }
+    cout << "servers: " << numServers << " slow: " << numSlow <<
+        " io time ms: " << ioTimeMs << " slow: " << slowIoTimeMs <<
+        " writes per tick: " << numWritesPerTick <<
+        " replicas: " << numReplicas << endl;
+
+    const int64_t writeBytes = int64_t(writeKb) << 10;
+    RunScenario("space only   ", Limits(),
+        numWritesPerTick, numTicks, numReplicas,
+        heartbeatTicks, tickMs, writeBytes, disks);
+    RunScenario("disk load    ", Limits(maxDiskLoad),
+        numWritesPerTick, numTicks, numReplicas,
+        heartbeatTicks, tickMs, writeBytes, disks);
+    // The same queue depth limit with and without hysteresis: the number of
+    // the loaded state transitions shows the oscillation.
+    RunScenario("queue depth  ",
+        Limits(0, maxQueueDepth, maxQueueDepth * writeBytes),
+        numWritesPerTick, numTicks, numReplicas,
+        heartbeatTicks, tickMs, writeBytes, disks);
+    RunScenario("q hysteresis ",
+        Limits(0, maxQueueDepth, maxQueueDepth * writeBytes, hysteresis),
+        numWritesPerTick, numTicks, numReplicas,
+        heartbeatTicks, tickMs, writeBytes, disks);
+    RunScenario("all limits   ",
+        Limits(maxDiskLoad, maxQueueDepth, maxQueueDepth * writeBytes,
+            hysteresis),
+        numWritesPerTick, numTicks, numReplicas,
+        heartbeatTicks, tickMs, writeBytes, disks);
+    return 0;
+}
@@ -18,71 +18,246 @@
 // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
 // implied. See the License for the specific language governing
 // permissions and limitations under the License.
-// 
+//
+// \brief KFS fuse mount.
+//
+// Every open creates its own KFS file descriptor, kept in the fuse file
+// handle, and reads and writes are positioned (PRead / PWrite) on that
+// descriptor. The KFS client serializes the I/O with a per client mutex,
+// therefore the handles are spread round robin over a pool of clients
+// (-o kfs_clients=N) to let the fuse worker threads run I/O in parallel.
+//
+// The attributes returned by readdir are cached for kfs_attr_timeout
+// seconds, and used by the getattr calls that follow readdir (ls -l, find)
+// instead of a metaserver lookup per entry. The same timeout is used for
+// the kernel attribute and entry caches. Files opened read only keep the
+// kernel page cache across opens.
+//
+// Requires fuse 2.8 or later (big_writes).
 //----------------------------------------------------------------------------
 
 #include "libkfsClient/KfsClient.h"
+#include "common/properties.h"
 
 extern "C" {
-#define FUSE_USE_VERSION	25
+#define FUSE_USE_VERSION	26
 #define _FILE_OFFSET_BITS	64
 #include <fuse.h>
+#include <fuse_opt.h>
 #include <sys/stat.h>
+#include <sys/statvfs.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <pthread.h>
 }
 
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+using std::max;
+using std::map;
+using std::string;
 using std::vector;
 using namespace KFS;
 
-static char *FUSE_KFS_PROPERTIES = "./kfs.prp";
-static KFS::KfsClientPtr client;
+struct KfsFuseConfig {
+	char	*propFile;
+	int	numClients;
+	int	attrTimeout;
+	int	maxRead;
+};
+
+static KfsFuseConfig config = {
+	(char *)"./kfs.prp",
+	4,	/* numClients */
+	30,	/* attrTimeout */
+	1 << 20	/* maxRead */
+};
+
+static struct fuse_opt kfsFuseOpts[] = {
+	{ "kfs_prp=%s",		offsetof(KfsFuseConfig, propFile),	0 },
+	{ "kfs_clients=%d",	offsetof(KfsFuseConfig, numClients),	0 },
+	{ "kfs_attr_timeout=%d", offsetof(KfsFuseConfig, attrTimeout),	0 },
+	{ "kfs_max_read=%d",	offsetof(KfsFuseConfig, maxRead),	0 },
+	FUSE_OPT_END
+};
+
+static vector<KfsClientPtr> clients;
+static unsigned int nextClient = 0;
+
+/// Per open state: the client the file was opened with, and its fd.
+struct FileHandle {
+	KfsClient	*client;
+	int		fd;
+	bool		writable;
+	string		path;
+};
+
+/// Attribute cache filled by readdir.
+struct CachedAttr {
+	struct stat	st;
+	time_t		expires;
+};
+typedef map<string, CachedAttr> AttrCache;
+static AttrCache attrCache;
+static pthread_mutex_t attrCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+static const size_t kMaxAttrCacheSize = 64 << 10;
+
+static KfsClient *
+getClient()
+{
+	const unsigned int i = __sync_fetch_and_add(&nextClient, 1);
+	return clients[i % clients.size()].get();
+}
+
+static FileHandle *
+getHandle(struct fuse_file_info *finfo)
+{
+	return reinterpret_cast<FileHandle *>(finfo->fh);
+}
+
+static void
+fillStat(struct stat &s)
+{
+	if (S_ISDIR(s.st_mode)) {
+		s.st_mode = S_IFDIR | 0755;
+		s.st_nlink = 2;
+	} else {
+		s.st_mode = S_IFREG | 0644;
+		s.st_nlink = 1;
+	}
+	s.st_uid = getuid();
+	s.st_gid = getgid();
+	s.st_blksize = 1 << 20;
+	s.st_blocks = (s.st_size + 511) / 512;
+}
+
+static bool
+lookupAttr(const string &path, struct stat &s)
+{
+	const time_t now = time(0);
+	pthread_mutex_lock(&attrCacheMutex);
+	AttrCache::iterator it = attrCache.find(path);
+	bool found = false;
+	if (it != attrCache.end()) {
+		if (it->second.expires >= now) {
+			s = it->second.st;
+			found = true;
+		} else {
+			attrCache.erase(it);
+		}
+	}
+	pthread_mutex_unlock(&attrCacheMutex);
+	return found;
+}
+
+static void
+invalidateAttr(const char *path)
+{
+	pthread_mutex_lock(&attrCacheMutex);
+	if (path)
+		attrCache.erase(path);
+	else
+		attrCache.clear();
+	pthread_mutex_unlock(&attrCacheMutex);
+}
 
 void *
-fuse_init()
+fuse_init(struct fuse_conn_info *conn)
 {
-	client = getKfsClientFactory()->GetClient(FUSE_KFS_PROPERTIES);
-	return client->IsInitialized() ? client.get() : NULL;
+	// Create the clients here, after fuse has daemonized, as the clients
+	// have their own threads.
+	Properties props;
+	if (props.loadProperties(config.propFile, '=', false) != 0) {
+		fprintf(stderr, "unable to read %s\n", config.propFile);
+		exit(1);
+	}
+	const string host = props.getValue("metaServer.name", "");
+	const int port = props.getValue("metaServer.port", -1);
+	for (int i = 0; i < config.numClients; i++) {
+		KfsClientPtr client(new KfsClient());
+		if (client->Init(host, port) != 0 || !client->IsInitialized()) {
+			fprintf(stderr, "unable to connect to %s:%d\n",
+				host.c_str(), port);
+			break;
+		}
+		clients.push_back(client);
+	}
+	if (clients.empty())
+		exit(1);
+	conn->max_readahead = config.maxRead;
+	return NULL;
 }
 
 void
 fuse_destroy(void *cookie)
 {
-	client.reset();
+	clients.clear();
 }
 
 static int
 fuse_getattr(const char *path, struct stat *s)
 {
-	return client->Stat(path, *s);
+	if (lookupAttr(path, *s))
+		return 0;
+	int status = getClient()->Stat(path, *s);
+	if (status == 0)
+		fillStat(*s);
+	return status;
+}
+
+static int
+fuse_fgetattr(const char *path, struct stat *s, struct fuse_file_info *finfo)
+{
+	FileHandle *fh = getHandle(finfo);
+	// Use the client with the file open: it knows the size of the data
+	// that is not yet flushed.
+	int status = fh->client->Stat(path, *s);
+	if (status == 0)
+		fillStat(*s);
+	return status;
 }
 
 static int
 fuse_mkdir(const char *path, mode_t mode)
 {
-	return client->Mkdir(path);
+	invalidateAttr(path);
+	return getClient()->Mkdir(path);
 }
 
 static int
 fuse_unlink(const char *path)
 {
-	return client->Remove(path);
+	invalidateAttr(path);
+	return getClient()->Remove(path);
 }
 
 static int
 fuse_rmdir(const char *path)
 {
-	return client->Rmdir(path);
+	invalidateAttr(path);
+	return getClient()->Rmdir(path);
 }
 
 static int
 fuse_rename(const char *src, const char *dst)
 {
-	return client->Rename(src, dst, false);
+	// Directory rename moves the whole subtree.
+	invalidateAttr(NULL);
+	return getClient()->Rename(src, dst, false);
 }
 
 static int
 fuse_truncate(const char *path, off_t size)
 {
+	invalidateAttr(path);
+	KfsClient *client = getClient();
 	int fd = client->Open(path, O_WRONLY);
 	if (fd < 0)
 		return fd;
@@ -91,68 +266,106 @@ fuse_truncate(const char *path, off_t size)
 	return status;
 }
 
+static int
+fuse_ftruncate(const char *path, off_t size, struct fuse_file_info *finfo)
+{
+	invalidateAttr(path);
+	FileHandle *fh = getHandle(finfo);
+	return fh->client->Truncate(fh->fd, size);
+}
+
+static int
+openHandle(const char *path, int flags, struct fuse_file_info *finfo)
+{
+	KfsClient *client = getClient();
+	int fd = client->Open(path, flags);
+	if (fd < 0)
+		return fd;
+	FileHandle *fh = new FileHandle();
+	fh->client = client;
+	fh->fd = fd;
+	fh->writable = (flags & O_ACCMODE) != O_RDONLY;
+	fh->path = path;
+	finfo->fh = reinterpret_cast<uint64_t>(fh);
+	// Read only files are not expected to change while open: keep the
+	// kernel page cache from the previous open.
+	finfo->keep_cache = fh->writable ? 0 : 1;
+	if (fh->writable)
+		invalidateAttr(path);
+	return 0;
+}
+
 static int
 fuse_open(const char *path, struct fuse_file_info *finfo)
 {
-	int res = client->Open(path, finfo->flags);
-	if (res >= 0)
-		return 0;
-	return res;
+	return openHandle(path, finfo->flags, finfo);
 }
 
 static int
 fuse_create(const char *path, mode_t mode, struct fuse_file_info *finfo)
 {
-	int res = client->Create(path);
-	if (res >= 0)
-		return 0;
-	return res;
+	return openHandle(path, finfo->flags | O_CREAT, finfo);
 }
 
 static int
 fuse_read(const char *path, char *buf, size_t nread, off_t off,
 		struct fuse_file_info *finfo)
 {
-	int fd = client->Open(path, O_RDONLY);
-	if (fd < 0)
-		return fd;
-	int status = client->Seek(fd, off, SEEK_SET);
-	if (status == 0)
-		status = client->Read(fd, buf, nread);
-	client->Close(fd);
-	return status;
+	FileHandle *fh = getHandle(finfo);
+	return fh->client->PRead(fh->fd, off, buf, nread);
 }
 
 static int
 fuse_write(const char *path, const char *buf, size_t nwrite, off_t off,
 		struct fuse_file_info *finfo)
 {
-	int fd = client->Open(path, O_WRONLY);
-	if (fd < 0)
-		return fd;
-	int status = client->Seek(fd, off, SEEK_SET);
-	if (status == 0)
-		status = client->Write(fd, buf, nwrite);
-	client->Close(fd);
-	return status;
+	FileHandle *fh = getHandle(finfo);
+	return fh->client->PWrite(fh->fd, off, buf, nwrite);
 }
 
 static int
 fuse_flush(const char *path, struct fuse_file_info *finfo)
 {
-	int fd = client->Fileno(path);
-	if (fd < 0)
-		return fd;
-	return client->Sync(fd);
+	FileHandle *fh = getHandle(finfo);
+	if (!fh->writable)
+		return 0;
+	return fh->client->Sync(fh->fd);
+}
+
+static int
+fuse_release(const char *path, struct fuse_file_info *finfo)
+{
+	FileHandle *fh = getHandle(finfo);
+	int status = fh->client->Close(fh->fd);
+	if (fh->writable)
+		invalidateAttr(fh->path.c_str());
+	delete fh;
+	return status;
 }
 
 static int
 fuse_fsync(const char *path, int flags, struct fuse_file_info *finfo)
 {
-	int fd = client->Open(path, O_RDONLY);
-	if (fd < 0)
-		return fd;
-	return client->Sync(fd);
+	FileHandle *fh = getHandle(finfo);
+	return fh->client->Sync(fh->fd);
+}
+
+static int
+fuse_statfs(const char *path, struct statvfs *s)
+{
+	uint64_t total = 0, used = 0;
+	int status = getClient()->GetFsSpace(total, used);
+	if (status < 0)
+		return status;
+	const unsigned long bsize = 1 << 20;
+	memset(s, 0, sizeof(*s));
+	s->f_bsize = bsize;
+	s->f_frsize = bsize;
+	s->f_blocks = total / bsize;
+	s->f_bfree = total > used ? (total - used) / bsize : 0;
+	s->f_bavail = s->f_bfree;
+	s->f_namemax = 255;
+	return 0;
 }
 
 static int
@@ -161,61 +374,88 @@ fuse_readdir(const char *path, void *buf,
 		struct fuse_file_info *finfo)
 {
 	vector <KfsFileAttr> contents;
-	int status = client->ReaddirPlus(path, contents);
+	int status = getClient()->ReaddirPlus(path, contents);
 	if (status < 0)
 		return status;
+	string prefix(path);
+	if (prefix.empty() || prefix[prefix.size() - 1] != '/')
+		prefix += '/';
+	const time_t expires = time(0) + config.attrTimeout;
 	int n = contents.size();
+	vector<struct stat> attrs(n);
 	for (int i = 0; i != n; i++) {
-		struct stat s;
+		struct stat &s = attrs[i];
 		memset(&s, 0, sizeof s);
 		s.st_ino = contents[i].fileId;
 		s.st_mode = contents[i].isDirectory ? S_IFDIR : S_IFREG;
-		if (filler(buf, contents[i].filename.c_str(), &s, 0) != 0)
+		s.st_size = contents[i].isDirectory ? 0 :
+			max(off_t(0), contents[i].fileSize);
+		s.st_atime = contents[i].crtime.tv_sec;
+		s.st_mtime = contents[i].mtime.tv_sec;
+		s.st_ctime = contents[i].ctime.tv_sec;
+		fillStat(s);
+	}
+	if (config.attrTimeout > 0) {
+		pthread_mutex_lock(&attrCacheMutex);
+		if (attrCache.size() + n > kMaxAttrCacheSize)
+			attrCache.clear();
+		for (int i = 0; i != n; i++) {
+			const string &name = contents[i].filename;
+			if (name == "." || name == ".." ||
+					contents[i].fileSize < 0)
+				continue;
+			CachedAttr &a = attrCache[prefix + name];
+			a.st = attrs[i];
+			a.expires = expires;
+		}
+		pthread_mutex_unlock(&attrCacheMutex);
+	}
+	for (int i = 0; i != n; i++) {
+		if (filler(buf, contents[i].filename.c_str(), &attrs[i], 0) != 0)
 			break;
 	}
 	return 0;
 }
 
-struct fuse_operations ops = {
-	fuse_getattr,
-	NULL,			/* readlink */
-	NULL,			/* getdir */
-	NULL,			/* mknod */
-	fuse_mkdir,
-	fuse_unlink,
-	fuse_rmdir,
-	NULL,			/* symlink */
-	fuse_rename,
-	NULL,			/* link */
-	NULL,			/* chmod */
-	NULL,			/* chown */
-	fuse_truncate,
-	NULL,			/* utime */
-	fuse_open,
-	fuse_read,
-	fuse_write,
-	NULL,			/* statfs */
-	fuse_flush,		/* flush */
-	NULL,			/* release */
-	fuse_fsync,		/* fsync */
-	NULL,			/* setxattr */
-	NULL,			/* getxattr */
-	NULL,			/* listxattr */
-	NULL,			/* removexattr */
-	NULL,			/* opendir */
-	fuse_readdir,
-	NULL,			/* releasedir */
-	NULL,			/* fsyncdir */
-	fuse_init,
-	fuse_destroy,
-	NULL,			/* access */
-	fuse_create,		/* create */
-	NULL,			/* ftruncate */
-	NULL			/* fgetattr */
-};
+static struct fuse_operations ops;
 
 int
 main(int argc, char **argv)
 {
-	return fuse_main(argc, argv, &ops);
+	struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+	if (fuse_opt_parse(&args, &config, kfsFuseOpts, NULL) != 0)
+		return 1;
+	if (config.numClients <= 0)
+		config.numClients = 1;
+
+	// Defaults first, the options given on the command line override them.
+	char defaults[256];
+	snprintf(defaults, sizeof(defaults),
+		"-obig_writes,max_read=%d,entry_timeout=%d,attr_timeout=%d",
+		config.maxRead, config.attrTimeout, config.attrTimeout);
+	fuse_opt_insert_arg(&args, 1, defaults);
+
+	ops.init	= fuse_init;
+	ops.destroy	= fuse_destroy;
+	ops.getattr	= fuse_getattr;
+	ops.fgetattr	= fuse_fgetattr;
+	ops.mkdir	= fuse_mkdir;
+	ops.unlink	= fuse_unlink;
+	ops.rmdir	= fuse_rmdir;
+	ops.rename	= fuse_rename;
+	ops.truncate	= fuse_truncate;
+	ops.ftruncate	= fuse_ftruncate;
+	ops.open	= fuse_open;
+	ops.create	= fuse_create;
+	ops.read	= fuse_read;
+	ops.write	= fuse_write;
+	ops.flush	= fuse_flush;
+	ops.release	= fuse_release;
+	ops.fsync	= fuse_fsync;
+	ops.statfs	= fuse_statfs;
+	ops.readdir	= fuse_readdir;
+
+	int status = fuse_main(args.argc, args.argv, &ops, NULL);
+	fuse_opt_free_args(&args);
+	return status;
 }
@@ -0,0 +1,171 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2010/11/29
+//
+// Copyright 2010 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+//
+// \brief Client chunk location cache implementation.
+//----------------------------------------------------------------------------
+
+#include "ChunkLocationCache.h"
+#include "KfsOps.h"
+
+namespace KFS {
+
+using std::vector;
+
+ChunkLocationCache::ChunkLocationCache(
+    size_t maxEntries,
+    time_t maxAgeSecs)
+    : mMaxEntries(maxEntries),
+      mMaxAgeSecs(maxAgeSecs),
+      mEntries(),
+      mLru(),
+      mStats()
+{
+}
+
+ChunkLocationCache::~ChunkLocationCache()
+{
+}
+
+bool
+ChunkLocationCache::Get(kfsFileId_t fid, off_t offset, ChunkAttr& attr)
+{
+    Entries::iterator const it = mEntries.find(Key(fid, offset));
+    if (it == mEntries.end()) {
+        mStats.mMisses++;
+        return false;
+    }
+    Entry& entry = it->second;
+    if (entry.mTime + mMaxAgeSecs < time(0)) {
+        mStats.mExpired++;
+        mStats.mMisses++;
+        Erase(it);
+        return false;
+    }
+    mStats.mHits++;
+    mLru.splice(mLru.begin(), mLru, entry.mLruIt);
+    attr.chunkId        = entry.mChunkId;
+    attr.chunkVersion   = entry.mChunkVersion;
+    attr.chunkServerLoc = entry.mServers;
+    return true;
+}
+
+void
+ChunkLocationCache::Put(kfsFileId_t fid, off_t offset, const ChunkAttr& attr)
+{
+    if (attr.chunkId < 0 || attr.chunkServerLoc.empty()) {
+        return;
+    }
+    Set(fid, offset, attr.chunkId, attr.chunkVersion, attr.chunkServerLoc,
+        time(0));
+    Trim();
+}
+
+void
+ChunkLocationCache::Put(kfsFileId_t fid, const vector<ChunkLayoutInfo>& layout)
+{
+    const time_t now = time(0);
+    for (vector<ChunkLayoutInfo>::const_iterator it = layout.begin();
+            it != layout.end();
+            ++it) {
+        if (it->chunkId < 0 || it->chunkServers.empty()) {
+            continue;
+        }
+        Set(fid, it->fileOffset, it->chunkId, it->chunkVersion,
+            it->chunkServers, now);
+        mStats.mPrefetched++;
+    }
+    Trim();
+}
+
+bool
+ChunkLocationCache::Has(kfsFileId_t fid) const
+{
+    Entries::const_iterator const it = mEntries.lower_bound(Key(fid, 0));
+    return (it != mEntries.end() && it->first.first == fid);
+}
+
+void
+ChunkLocationCache::Invalidate(kfsFileId_t fid, off_t offset,
+    int64_t chunkVersion)
+{
+    Entries::iterator const it = mEntries.find(Key(fid, offset));
+    if (it == mEntries.end() || it->second.mChunkVersion > chunkVersion) {
+        return;
+    }
+    mStats.mInvalidated++;
+    Erase(it);
+}
+
+void
+ChunkLocationCache::Invalidate(kfsFileId_t fid)
+{
+    Entries::iterator it = mEntries.lower_bound(Key(fid, 0));
+    while (it != mEntries.end() && it->first.first == fid) {
+        mLru.erase(it->second.mLruIt);
+        mEntries.erase(it++);
+    }
+}
+
+void
+ChunkLocationCache::SetMaxEntries(size_t maxEntries)
+{
+    mMaxEntries = maxEntries;
+    Trim();
+}
+
+void
+ChunkLocationCache::Set(kfsFileId_t fid, off_t offset, kfsChunkId_t chunkId,
+    int64_t chunkVersion, const vector<ServerLocation>& servers, time_t now)
+{
+    const Key key(fid, offset);
+    Entries::iterator it = mEntries.find(key);
+    if (it == mEntries.end()) {
+        it = mEntries.insert(Entries::value_type(key, Entry())).first;
+        mLru.push_front(key);
+        it->second.mLruIt = mLru.begin();
+    } else {
+        mLru.splice(mLru.begin(), mLru, it->second.mLruIt);
+    }
+    Entry& entry = it->second;
+    entry.mChunkId      = chunkId;
+    entry.mChunkVersion = chunkVersion;
+    entry.mServers      = servers;
+    entry.mTime         = now;
+}
+
+void
+ChunkLocationCache::Erase(Entries::iterator it)
+{
+    mLru.erase(it->second.mLruIt);
+    mEntries.erase(it);
+}
+
+void
+ChunkLocationCache::Trim()
+{
+    while (mEntries.size() > mMaxEntries) {
+        mStats.mEvicted++;
+        Erase(mEntries.find(mLru.back()));
+    }
+}
+
+}
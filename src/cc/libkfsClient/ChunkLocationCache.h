@@ -0,0 +1,146 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2010/11/29
+//
+// Copyright 2010 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+//
+// \brief Client chunk location cache: maps <file id, chunk offset> to the
+// chunk id, version, and the servers hosting the chunk.
+// The per open file chunk attributes are lost when the file is closed; the
+// cache keeps the locations across opens, and is filled with the whole
+// file layout on open, so that random access readers do not have to ask
+// the metaserver for each chunk location.
+// The cache is bounded, least recently used entries are evicted first.
+// Stale entries are detected by the readers: the chunk read or lease
+// acquisition fails, and the entry is invalidated. The entries also expire
+// after a while, as the chunk replicas move between the servers.
+//----------------------------------------------------------------------------
+
+#ifndef LIBKFSCLIENT_CHUNKLOCATIONCACHE_H
+#define LIBKFSCLIENT_CHUNKLOCATIONCACHE_H
+
+#include <sys/types.h>
+#include <time.h>
+#include <algorithm>
+#include <map>
+#include <list>
+#include <vector>
+
+#include "common/kfstypes.h"
+#include "KfsAttr.h"
+
+namespace KFS {
+
+struct ChunkLayoutInfo;
+
+class ChunkLocationCache {
+public:
+    enum
+    {
+        DEFAULT_MAX_ENTRIES  = 64 << 10,
+        DEFAULT_MAX_AGE_SECS = 5 * 60
+    };
+    struct Stats
+    {
+        Stats()
+            : mHits(0),
+              mMisses(0),
+              mPrefetched(0),
+              mInvalidated(0),
+              mEvicted(0),
+              mExpired(0)
+            {}
+        int64_t mHits;
+        int64_t mMisses;
+        int64_t mPrefetched;  ///< entries added from the file layouts
+        int64_t mInvalidated; ///< entries removed due to read failures
+        int64_t mEvicted;     ///< entries removed to make room
+        int64_t mExpired;     ///< entries removed due to age
+    };
+
+    ChunkLocationCache(
+        size_t maxEntries = DEFAULT_MAX_ENTRIES,
+        time_t maxAgeSecs = DEFAULT_MAX_AGE_SECS);
+    ~ChunkLocationCache();
+
+    /// Look up chunk location.
+    /// @param[in] fid  file id
+    /// @param[in] offset  chunk start offset in the file
+    /// @param[out] attr  on hit, the chunk id, version, and servers are set
+    /// @retval true on hit; false otherwise
+    bool Get(kfsFileId_t fid, off_t offset, ChunkAttr& attr);
+
+    /// Add or replace the chunk location.
+    void Put(kfsFileId_t fid, off_t offset, const ChunkAttr& attr);
+
+    /// Add the locations of all file chunks.
+    void Put(kfsFileId_t fid, const std::vector<ChunkLayoutInfo>& layout);
+
+    /// @retval true if the cache has at least one location for the file
+    bool Has(kfsFileId_t fid) const;
+
+    /// The read with the given chunk version failed: remove the entry,
+    /// unless it was already replaced with the newer version.
+    void Invalidate(kfsFileId_t fid, off_t offset, int64_t chunkVersion);
+
+    /// Remove all entries of the file: truncate, remove etc.
+    void Invalidate(kfsFileId_t fid);
+
+    void SetMaxEntries(size_t maxEntries);
+    size_t GetMaxEntries() const
+        { return mMaxEntries; }
+    size_t GetSize() const
+        { return mEntries.size(); }
+    const Stats& GetStats() const
+        { return mStats; }
+
+private:
+    typedef std::pair<kfsFileId_t, off_t> Key;
+    typedef std::list<Key>                Lru;
+    struct Entry
+    {
+        kfsChunkId_t                mChunkId;
+        int64_t                     mChunkVersion;
+        std::vector<ServerLocation> mServers;
+        time_t                      mTime;
+        Lru::iterator               mLruIt;
+    };
+    typedef std::map<Key, Entry> Entries;
+
+    size_t  mMaxEntries;
+    time_t  mMaxAgeSecs;
+    Entries mEntries;
+    Lru     mLru; ///< front is the most recently used
+    Stats   mStats;
+
+    void Set(kfsFileId_t fid, off_t offset, kfsChunkId_t chunkId,
+        int64_t chunkVersion, const std::vector<ServerLocation>& servers,
+        time_t now);
+    void Erase(Entries::iterator it);
+    void Trim();
+
+private:
+    // No copies.
+    ChunkLocationCache(const ChunkLocationCache&);
+    ChunkLocationCache& operator=(const ChunkLocationCache&);
+};
+
+}
+
+#endif // LIBKFSCLIENT_CHUNKLOCATIONCACHE_H
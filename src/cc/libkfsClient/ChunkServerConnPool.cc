@@ -0,0 +1,206 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2010/12/20
+//
+// Copyright 2010 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+//
+// \brief Client chunk server connection pool implementation.
+//----------------------------------------------------------------------------
+
+#include "ChunkServerConnPool.h"
+#include "qcdio/qcstutils.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <errno.h>
+
+namespace KFS {
+
+class ChunkServerConnPool::Release
+{
+public:
+    Release(ChunkServerConnPool& pool, const ServerLocation& location)
+        : mPool(pool),
+          mLocation(location)
+        {}
+    void operator()(TcpSocket* sock) const
+        { mPool.Put(mLocation, sock); }
+private:
+    ChunkServerConnPool& mPool;
+    ServerLocation       mLocation;
+};
+
+ChunkServerConnPool&
+ChunkServerConnPool::Instance()
+{
+    // Never deleted: the sockets can be released by the static destructors.
+    static ChunkServerConnPool* const sInstance = new ChunkServerConnPool();
+    return *sInstance;
+}
+
+ChunkServerConnPool::ChunkServerConnPool()
+    : mMutex(),
+      mMaxIdlePerServer(DEFAULT_MAX_IDLE_PER_SERVER),
+      mMaxIdleSecs(DEFAULT_MAX_IDLE_SECS),
+      mServers(),
+      mIdleCount(0),
+      mStats()
+{
+}
+
+ChunkServerConnPool::~ChunkServerConnPool()
+{
+    SetMaxIdlePerServer(0);
+}
+
+TcpSocketPtr
+ChunkServerConnPool::Get(const ServerLocation& location)
+{
+    TcpSocket* sock = 0;
+    {
+        QCStMutexLocker lock(mMutex);
+        const time_t now = time(0);
+        Expire(now);
+        Servers::iterator const it = mServers.find(location);
+        while (it != mServers.end() && ! it->second.empty()) {
+            TcpSocket* const idle = it->second.front().mSock;
+            it->second.pop_front();
+            mIdleCount--;
+            if (IsAlive(*idle)) {
+                sock = idle;
+                mStats.mReused++;
+                break;
+            }
+            mStats.mClosed++;
+            delete idle;
+        }
+        if (it != mServers.end() && it->second.empty()) {
+            mServers.erase(it);
+        }
+        if (! sock) {
+            mStats.mCreated++;
+        }
+    }
+    if (! sock) {
+        sock = new TcpSocket();
+    }
+    return TcpSocketPtr(sock, Release(*this, location));
+}
+
+void
+ChunkServerConnPool::Put(const ServerLocation& location, TcpSocket* sock)
+{
+    // A socket with the responses still in flight, for example a cancelled
+    // read ahead, is closed: the next user would get the stale response.
+    if (sock->GetPendingResponses() <= 0 && IsConnected(*sock)) {
+        QCStMutexLocker lock(mMutex);
+        if (mMaxIdlePerServer > 0) {
+            IdleList& idle = mServers[location];
+            if ((int)idle.size() < mMaxIdlePerServer) {
+                idle.push_front(Idle(sock, time(0)));
+                mIdleCount++;
+                mStats.mPooled++;
+                return;
+            }
+        }
+    }
+    delete sock;
+}
+
+void
+ChunkServerConnPool::Expire(time_t now)
+{
+    for (Servers::iterator it = mServers.begin(); it != mServers.end(); ) {
+        IdleList& idle = it->second;
+        while (! idle.empty() && idle.back().mTime + mMaxIdleSecs < now) {
+            delete idle.back().mSock;
+            idle.pop_back();
+            mIdleCount--;
+            mStats.mClosed++;
+        }
+        if (idle.empty()) {
+            mServers.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool
+ChunkServerConnPool::IsConnected(TcpSocket& sock)
+{
+    if (! sock.IsGood()) {
+        return false;
+    }
+    // The non blocking connect might have not completed, or failed.
+    const int               fd      = sock.GetFd();
+    int                     err     = 0;
+    socklen_t               errLen  = sizeof(err);
+    struct sockaddr_storage addr;
+    socklen_t               addrLen = sizeof(addr);
+    return (
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &errLen) == 0 &&
+        err == 0 &&
+        getpeername(fd, (struct sockaddr*)&addr, &addrLen) == 0
+    );
+}
+
+bool
+ChunkServerConnPool::IsAlive(TcpSocket& sock)
+{
+    if (! IsConnected(sock)) {
+        return false;
+    }
+    // The idle connection must have nothing to read: eof means that the
+    // server closed it, and the data is the stale response.
+    char buf;
+    return (recv(sock.GetFd(), &buf, 1, MSG_PEEK | MSG_DONTWAIT) < 0 &&
+        (errno == EAGAIN || errno == EWOULDBLOCK));
+}
+
+void
+ChunkServerConnPool::SetMaxIdlePerServer(int maxIdle)
+{
+    QCStMutexLocker lock(mMutex);
+    mMaxIdlePerServer = maxIdle;
+    for (Servers::iterator it = mServers.begin(); it != mServers.end(); ) {
+        IdleList& idle = it->second;
+        while (! idle.empty() && (int)idle.size() > mMaxIdlePerServer) {
+            delete idle.back().mSock;
+            idle.pop_back();
+            mIdleCount--;
+            mStats.mClosed++;
+        }
+        if (idle.empty()) {
+            mServers.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void
+ChunkServerConnPool::GetStats(Stats& stats, int64_t& idleCount) const
+{
+    QCStMutexLocker lock(mMutex);
+    stats     = mStats;
+    idleCount = mIdleCount;
+}
+
+}
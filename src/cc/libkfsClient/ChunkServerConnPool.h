@@ -0,0 +1,122 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2010/12/20
+//
+// Copyright 2010 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+//
+// \brief Client chunk server connection pool.
+// Each open file has its own chunk server connections, which are closed
+// when the file is closed, or moves to the next chunk. With many short
+// lived opens, every chunk read or write pays for the connection setup.
+// The sockets released by the files are kept in the pool instead, and
+// handed out to the next file that talks to the same chunk server. A
+// socket is only in use by one file at a time, thus the synchronous
+// request / response protocol is unchanged. The pool is shared by all
+// clients in the process. The number of idle sockets per server is
+// bounded, and the idle sockets are closed after a while. Only the
+// sockets with the completed connect are kept. The socket that the server
+// closed, or that has unread data, is not reused.
+//----------------------------------------------------------------------------
+
+#ifndef LIBKFSCLIENT_CHUNKSERVERCONNPOOL_H
+#define LIBKFSCLIENT_CHUNKSERVERCONNPOOL_H
+
+#include <time.h>
+#include <deque>
+#include <map>
+
+#include "common/kfsdecls.h"
+#include "libkfsIO/TcpSocket.h"
+#include "qcdio/qcmutex.h"
+
+namespace KFS {
+
+class ChunkServerConnPool {
+public:
+    enum
+    {
+        DEFAULT_MAX_IDLE_PER_SERVER = 4,
+        DEFAULT_MAX_IDLE_SECS       = 60
+    };
+    struct Stats
+    {
+        Stats()
+            : mCreated(0),
+              mReused(0),
+              mPooled(0),
+              mClosed(0)
+            {}
+        int64_t mCreated; ///< new sockets handed out
+        int64_t mReused;  ///< pooled sockets handed out
+        int64_t mPooled;  ///< released sockets kept in the pool
+        int64_t mClosed;  ///< pooled sockets closed: expired, or not usable
+    };
+
+    static ChunkServerConnPool& Instance();
+
+    /// @retval idle connected socket to the server if there is one in the
+    /// pool, or new unconnected socket. The socket is returned to the pool
+    /// when the last reference to it goes away, unless it has requests
+    /// with the responses not read yet: such socket is closed.
+    TcpSocketPtr Get(const ServerLocation& location);
+
+    /// Set the max # of idle sockets per server, 0 turns the pool off.
+    void SetMaxIdlePerServer(int maxIdle);
+    int GetMaxIdlePerServer() const
+        { return mMaxIdlePerServer; }
+    void GetStats(Stats& stats, int64_t& idleCount) const;
+
+private:
+    struct Idle
+    {
+        Idle(TcpSocket* sock = 0, time_t time = 0)
+            : mSock(sock),
+              mTime(time)
+            {}
+        TcpSocket* mSock;
+        time_t     mTime;
+    };
+    typedef std::deque<Idle>                 IdleList; ///< front is newest
+    typedef std::map<ServerLocation, IdleList> Servers;
+    class Release;
+    friend class Release;
+
+    mutable QCMutex mMutex;
+    int             mMaxIdlePerServer;
+    time_t          mMaxIdleSecs;
+    Servers         mServers;
+    int64_t         mIdleCount;
+    Stats           mStats;
+
+    ChunkServerConnPool();
+    ~ChunkServerConnPool();
+    void Put(const ServerLocation& location, TcpSocket* sock);
+    void Expire(time_t now);
+    static bool IsConnected(TcpSocket& sock);
+    static bool IsAlive(TcpSocket& sock);
+
+private:
+    // No copies.
+    ChunkServerConnPool(const ChunkServerConnPool&);
+    ChunkServerConnPool& operator=(const ChunkServerConnPool&);
+};
+
+}
+
+#endif // LIBKFSCLIENT_CHUNKSERVERCONNPOOL_H
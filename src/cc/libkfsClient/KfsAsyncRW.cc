@@ -239,7 +239,8 @@ AsyncWorker::GotHeader(IOBuffer *buffer, int *hdrLen, KfsOp *op)
     prop.loadProperties(is, kSeparator, false);
     seq = prop.getValue("Cseq", (kfsSeq_t) -1);
     if (seq != op->seq) {
-        KFS_LOG_VA_INFO("Seq # mismatch: expect = %d, got = %d", op->seq, seq);
+        KFS_LOG_VA_INFO("Seq # mismatch: expect = %lld, got = %lld",
+            (long long) op->seq, (long long) seq);
         op->status = -1;
         return true;
     }
@@ -267,8 +268,12 @@ AsyncReadWorker::AsyncReadWorker(Asyncer *p, AsyncReadReq *r) :
 void
 AsyncReadWorker::DoneSelf()
 {
-    if (mReadOp.status < 0)
+    if (mReadOp.status < 0) {
         mReq->numDone = -1;
+        // The response can still be in flight: do not let the connection
+        // be reused.
+        mReq->sock->Close();
+    }
 
     mReadOp.ReleaseContentBuf();
     mAsyncer->Done((AsyncReadReq* ) mReq);
@@ -450,8 +455,12 @@ AsyncWriteWorker::AsyncWriteWorker(Asyncer *p, AsyncWriteReq *r) :
 void
 AsyncWriteWorker::DoneSelf()
 {
-    if (mWriteSyncOp.status < 0)
+    if (mWriteSyncOp.status < 0) {
         mReq->numDone = -1;
+        // The response can still be in flight: do not let the connection
+        // be reused.
+        mReq->sock->Close();
+    }
 
     mWritePrepareOp.ReleaseContentBuf();
     mAsyncer->Done((AsyncWriteReq *) mReq);
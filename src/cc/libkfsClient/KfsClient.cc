@@ -34,6 +34,7 @@
 #include "meta/kfstypes.h"
 #include "libkfsIO/Checksum.h"
 #include "libkfsIO/Globals.h"
+#include "libkfsIO/LatencyHistogram.h"
 #include "Utils.h"
 #include "KfsProtocolWorker.h"
 
@@ -51,6 +52,7 @@ extern "C" {
 #include <string>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <sys/time.h>
 #include <boost/scoped_array.hpp>
 
 using std::string;
@@ -62,7 +64,6 @@ using std::map;
 using std::vector;
 using std::sort;
 using std::transform;
-using std::random_shuffle;
 
 using std::cout;
 using std::endl;
@@ -71,6 +72,8 @@ using namespace KFS;
 
 const int CMD_BUF_SIZE = 1024;
 
+static LatencyStats& GetRpcLatencyStats();
+
 // Set the default timeout for server I/O's to be 3 mins for now.
 // This is intentionally large so that we can do stuff in gdb and not
 // have the client timeout in the midst of a debug session.
@@ -161,6 +164,42 @@ KfsClientFactory::GetClient(const std::string metaServerHost, int metaServerPort
     return clnt;
 }
 
+KfsDirIterator::KfsDirIterator(KfsClient &client, const string &pathname,
+                               int pageSize, bool computeFilesize)
+    : mClient(client),
+      mPathname(pathname),
+      mPageSize(max(1, pageSize)),
+      mComputeFilesizeFlag(computeFilesize),
+      mEntries(),
+      mPos(0),
+      mFnameStart(),
+      mHasMoreEntriesFlag(true)
+{
+}
+
+int
+KfsDirIterator::Next(KfsFileAttr &entry)
+{
+    while (mPos >= mEntries.size()) {
+        if (! mHasMoreEntriesFlag) {
+            return 0;
+        }
+        mPos = 0;
+        const int res = mClient.ReaddirPlus(mPathname.c_str(), mFnameStart,
+            mPageSize, mEntries, mHasMoreEntriesFlag, mComputeFilesizeFlag);
+        if (res < 0) {
+            mEntries.clear();
+            return res;
+        }
+        if (mEntries.empty()) {
+            mHasMoreEntriesFlag = false;
+        } else {
+            mFnameStart = mEntries.back().filename;
+        }
+    }
+    entry = mEntries[mPos++];
+    return 1;
+}
 
 KfsClient::KfsClient()
 {
@@ -249,12 +288,27 @@ KfsClient::ReaddirPlus(const char *pathname, std::vector<KfsFileAttr> &result)
     return mImpl->ReaddirPlus(pathname, result);
 }
 
+int
+KfsClient::ReaddirPlus(const char *pathname, const std::string &fnameStart,
+                       int maxEntries, std::vector<KfsFileAttr> &result,
+                       bool &hasMoreEntries, bool computeFilesize)
+{
+    return mImpl->ReaddirPlus(pathname, fnameStart, maxEntries, result,
+        hasMoreEntries, computeFilesize);
+}
+
 int 
 KfsClient::GetDirSummary(const char *pathname, uint64_t &numFiles, uint64_t &numBytes)
 {
     return mImpl->GetDirSummary(pathname, numFiles, numBytes);
 }
 
+int
+KfsClient::GetFsSpace(uint64_t &totalSpace, uint64_t &usedSpace)
+{
+    return mImpl->GetFsSpace(totalSpace, usedSpace);
+}
+
 int 
 KfsClient::Stat(const char *pathname, struct stat &result, bool computeFilesize)
 {
@@ -327,6 +381,26 @@ KfsClient::Remove(const char *pathname)
     return mImpl->Remove(pathname);
 }
 
+int
+KfsClient::MultiStat(const vector<string> &pathnames,
+                     vector<KfsFileAttr> &attrs, vector<int> &result)
+{
+    return mImpl->MultiStat(pathnames, attrs, result);
+}
+
+int
+KfsClient::MultiCreate(const vector<string> &pathnames, vector<int> &result,
+                       int numReplicas, bool exclusive)
+{
+    return mImpl->MultiCreate(pathnames, result, numReplicas, exclusive);
+}
+
+int
+KfsClient::MultiRemove(const vector<string> &pathnames, vector<int> &result)
+{
+    return mImpl->MultiRemove(pathnames, result);
+}
+
 int 
 KfsClient::Rename(const char *oldpath, const char *newpath, bool overwrite)
 {
@@ -375,6 +449,18 @@ KfsClient::AtomicRecordAppend(int fd, const char *buf, int reclen)
     return mImpl->AtomicRecordAppend(fd, buf, reclen);
 }
 
+int
+KfsClient::SetAppendBatching(int maxBatchBytes, int maxDelayMs)
+{
+    return mImpl->SetAppendBatching(maxBatchBytes, maxDelayMs);
+}
+
+void
+KfsClient::GetAppendStats(AppendStats &stats) const
+{
+    mImpl->GetAppendStats(stats);
+}
+
 void
 KfsClient::EnableAsyncRW()
 {
@@ -405,6 +491,24 @@ KfsClient::Write(int fd, const char *buf, size_t numBytes)
     return mImpl->Write(fd, buf, numBytes);
 }
 
+ssize_t
+KfsClient::PRead(int fd, off_t offset, char *buf, size_t numBytes)
+{
+    return mImpl->PRead(fd, offset, buf, numBytes);
+}
+
+ssize_t
+KfsClient::PReadV(int fd, off_t offset, const struct iovec *iov, int iovcnt)
+{
+    return mImpl->PReadV(fd, offset, iov, iovcnt);
+}
+
+ssize_t
+KfsClient::PWrite(int fd, off_t offset, const char *buf, size_t numBytes)
+{
+    return mImpl->PWrite(fd, offset, buf, numBytes);
+}
+
 int
 KfsClient::WriteAsync(int fd, const char *buf, size_t numBytes)
 {
@@ -503,6 +607,36 @@ KfsClient::GetDefaultIOTimeout(struct timeval &timeout)
     timeout = gDefaultTimeout;
 }
 
+void
+KfsClient::GetLatencyStats(std::ostream &os) const
+{
+    GetRpcLatencyStats().Show(os);
+}
+
+void
+KfsClient::GetChunkLocationCacheStats(ChunkLocationCacheStats &stats) const
+{
+    mImpl->GetChunkLocationCacheStats(stats);
+}
+
+void
+KfsClient::SetChunkLocationCacheSize(size_t maxEntries)
+{
+    mImpl->SetChunkLocationCacheSize(maxEntries);
+}
+
+void
+KfsClient::GetChunkServerConnStats(ChunkServerConnStats &stats) const
+{
+    mImpl->GetChunkServerConnStats(stats);
+}
+
+void
+KfsClient::SetChunkServerConnPoolSize(int maxIdlePerServer)
+{
+    mImpl->SetChunkServerConnPoolSize(maxIdlePerServer);
+}
+
 size_t
 KfsClient::SetDefaultIoBufferSize(size_t size)
 {
@@ -557,6 +691,60 @@ KfsClient::GetReadAheadSize(int fd) const
     return mImpl->GetReadAheadSize(fd);
 }
 
+size_t
+KfsClient::SetDefaultAdaptiveReadAheadSize(size_t maxSize)
+{
+    return mImpl->SetDefaultAdaptiveReadAheadSize(maxSize);
+}
+
+size_t
+KfsClient::GetDefaultAdaptiveReadAheadSize() const
+{
+    return mImpl->GetDefaultAdaptiveReadAheadSize();
+}
+
+size_t
+KfsClient::SetAdaptiveReadAheadSize(int fd, size_t maxSize)
+{
+    return mImpl->SetAdaptiveReadAheadSize(fd, maxSize);
+}
+
+int
+KfsClient::GetReadAheadStats(int fd, ReadAheadStats &stats) const
+{
+    return mImpl->GetReadAheadStats(fd, stats);
+}
+
+void
+KfsClient::GetReadAheadStats(ReadAheadStats &stats) const
+{
+    mImpl->GetReadAheadStats(stats);
+}
+
+int
+KfsClient::SetDefaultWriteBehind(int maxPendingWrites)
+{
+    return mImpl->SetDefaultWriteBehind(maxPendingWrites);
+}
+
+int
+KfsClient::GetDefaultWriteBehind() const
+{
+    return mImpl->GetDefaultWriteBehind();
+}
+
+int
+KfsClient::SetWriteBehind(int fd, int maxPendingWrites)
+{
+    return mImpl->SetWriteBehind(fd, maxPendingWrites);
+}
+
+int
+KfsClient::GetWriteBehind(int fd) const
+{
+    return mImpl->GetWriteBehind(fd);
+}
+
 //
 // Now, the real work is done by the impl object....
 //
@@ -565,6 +753,8 @@ KfsClientImpl::KfsClientImpl()
     : mPendingOp(*this),
       mFileInstance(0),
       mProtocolWorker(0),
+      mAppendBatchBytes((int)CHECKSUM_BLOCKSIZE),
+      mAppendBatchDelayMs(-1),
       mMaxNumRetriesPerOp(DEFAULT_NUM_RETRIES_PER_OP)
 {
     pthread_mutexattr_t mutexAttr;
@@ -587,7 +777,11 @@ KfsClientImpl::KfsClientImpl()
 
     mCwd = "/";
     mIsInitialized = false;
-    mCmdSeqNum = 0;
+    // The chunk server connection pool is shared by all the clients in the
+    // process: give each client its own seq range, so that a stale
+    // response can never match another client's request.
+    static uint32_t sInstanceCount = 0;
+    mCmdSeqNum = (kfsSeq_t) __sync_fetch_and_add(&sInstanceCount, 1) << 32;
 
     // Setup the mutex to allow recursive locking calls.  This
     // simplifies things when a public method (eg., read) in KFS client calls
@@ -607,6 +801,8 @@ KfsClientImpl::KfsClientImpl()
     const size_t BUF_SIZE = min(KFS::CHUNKSIZE, size_t(4) << 20);
     mDefaultIoBufferSize  = BUF_SIZE;
     mDefaultReadAheadSize = min(BUF_SIZE, size_t(1) << 20);
+    mDefaultAdaptiveReadAheadSize = 0;
+    mDefaultWriteBehind   = 0;
     // for random # generation, seed it
     srand(getpid());
     // turn off the read-ahead thread for now
@@ -998,22 +1194,35 @@ KfsClientImpl::Readdir(const char *pathname, vector<string> &result)
 
     kfsFileId_t dirFid = mFileTable[fte]->fattr.fileId;
 
-    ReaddirOp op(nextSeq(), dirFid);
-    DoMetaOpWithRetry(&op);
-    int res = op.status;
-    if (res < 0)
-	return res;
+    // Get the directory one part at a time, to bound the size of the
+    // metaserver response.
+    string fnameStart;
+    int res;
+    result.clear();
+    for (; ;) {
+        ReaddirOp op(nextSeq(), dirFid, fnameStart, READDIR_MAX_ENTRIES);
+        DoMetaOpWithRetry(&op);
+        res = op.status;
+        if (res < 0)
+            return res;
 
-    istringstream ist;
-    char filename[MAX_FILENAME_LEN];
-    assert(op.contentBuf != NULL);
-    ist.str(op.contentBuf);
-    result.resize(op.numEntries);
-    for (int i = 0; i < op.numEntries; ++i) {
-	// ist >> result[i];
-	ist.getline(filename, MAX_FILENAME_LEN);
-	result[i] = filename;
-        // KFS_LOG_VA_DEBUG("Entry: %s", filename);
+        istringstream ist;
+        char filename[MAX_FILENAME_LEN];
+        const size_t prevSize = result.size();
+        if (op.numEntries > 0) {
+            assert(op.contentBuf != NULL);
+            ist.str(string(op.contentBuf, op.contentLength));
+        }
+        result.resize(prevSize + op.numEntries);
+        for (int i = 0; i < op.numEntries; ++i) {
+            // ist >> result[i];
+            ist.getline(filename, MAX_FILENAME_LEN);
+            result[prevSize + i] = filename;
+            // KFS_LOG_VA_DEBUG("Entry: %s", filename);
+        }
+        if (! op.hasMoreEntries || result.size() == prevSize)
+            break;
+        fnameStart = result.back();
     }
     sort(result.begin(), result.end());
     return res;
@@ -1046,25 +1255,141 @@ KfsClientImpl::ReaddirPlus(const char *pathname, vector<KfsFileAttr> &result,
     return ReaddirPlus(pathname, fa->fileId, result, computeFilesize);
 }
 
+int
+KfsClientImpl::ReaddirPlus(const char *pathname, const string &fnameStart,
+                           int maxEntries, vector<KfsFileAttr> &result,
+                           bool &hasMoreEntries, bool computeFilesize)
+{
+    MutexLock l(&mMutex);
+
+    int fte = LookupFileTableEntry(pathname);
+    if (fte < 0)	 // open the directory for reading
+	fte = Open(pathname, O_RDONLY);
+    if (fte < 0)
+	   return fte;
+
+    FileAttr *fa = FdAttr(fte);
+    if (!fa->isDirectory)
+	return -ENOTDIR;
+
+    const kfsFileId_t dirFid = fa->fileId;
+    vector<FileChunkInfo> fileChunkInfo;
+    result.clear();
+    hasMoreEntries = false;
+    const int res = ReaddirPlusPart(dirFid, fnameStart, max(1, maxEntries),
+        result, fileChunkInfo, hasMoreEntries);
+    if (res < 0) {
+        return res;
+    }
+    if (computeFilesize) {
+        ComputeFilesizes(dirFid, result, fileChunkInfo);
+    }
+    return res;
+}
+
 int
 KfsClientImpl::ReaddirPlus(const char *pathname, kfsFileId_t dirFid, 
                            vector<KfsFileAttr> &result, bool computeFilesize,
                            bool updateClientCache)
 {
-    ReaddirPlusOp op(nextSeq(), dirFid);
+    vector<FileChunkInfo> fileChunkInfo;
+    string fnameStart;
+    bool hasMoreEntries = true;
+    int res = 0;
+
+    // Get the directory one part at a time, to bound the size of the
+    // metaserver response.
+    while (hasMoreEntries) {
+        const size_t prevSize = result.size();
+        res = ReaddirPlusPart(dirFid, fnameStart, READDIR_MAX_ENTRIES,
+            result, fileChunkInfo, hasMoreEntries);
+        if (res < 0) {
+            return res;
+        }
+        if (result.size() == prevSize) {
+            break;
+        }
+        fnameStart = result.back().filename;
+    }
+
+    if (computeFilesize) {
+        ComputeFilesizes(dirFid, result, fileChunkInfo);
+    }
+
+    // if there are too many entries in the dir, then the caller is
+    // probably scanning the directory.  don't put it in the cache
+    if ((result.size() > 128) || (!updateClientCache)) {
+        sort(result.begin(), result.end());
+        return res;
+    }
+
+    string dirname = build_path(mCwd, pathname);
+    string::size_type len = dirname.size();
+    if ((len > 0) && (dirname[len - 1] == '/'))
+        dirname.erase(len - 1);
+    
+    for (uint32_t i = 0; i < result.size(); i++) {
+        int fte = LookupFileTableEntry(dirFid, result[i].filename.c_str());
+
+        if (fte >= 0) {
+            // if we computed the filesize, then we stash it; otherwise, we'll
+            // set the value to -1 and force a recompute later...
+            mFileTable[fte]->fattr.fileSize = result[i].fileSize;
+            continue;
+        }
+
+        if (fte < 0) {
+            string fullpath;
+            if ((result[i].filename == ".") || (result[i].filename == ".."))
+                fullpath = "";
+            else
+                fullpath = dirname + "/" + result[i].filename;
+
+            fte = AllocFileTableEntry(dirFid, result[i].filename.c_str(), fullpath);
+            if (fte < 0)
+                continue;
+        }
+
+        mFileTable[fte]->fattr.fileId = result[i].fileId;
+        mFileTable[fte]->fattr.mtime = result[i].mtime;
+        mFileTable[fte]->fattr.ctime = result[i].ctime;
+        mFileTable[fte]->fattr.ctime = result[i].crtime;
+        mFileTable[fte]->fattr.isDirectory = result[i].isDirectory;
+        mFileTable[fte]->fattr.chunkCount = fileChunkInfo[i].chunkCount;
+        mFileTable[fte]->fattr.numReplicas = fileChunkInfo[i].numReplicas;
+
+        mFileTable[fte]->openMode = 0;
+        // if we computed the filesize, then we stash it; otherwise, we'll
+        // set the value to -1 and force a recompute later...
+        mFileTable[fte]->fattr.fileSize = result[i].fileSize;
+    }
+
+    sort(result.begin(), result.end());
+
+    return res;
+}
+
+int
+KfsClientImpl::ReaddirPlusPart(kfsFileId_t dirFid, const string &fnameStart,
+                               int maxEntries, vector<KfsFileAttr> &result,
+                               vector<FileChunkInfo> &fileChunkInfo,
+                               bool &hasMoreEntries)
+{
+    ReaddirPlusOp op(nextSeq(), dirFid, fnameStart, maxEntries);
     (void)DoMetaOpWithRetry(&op);
     int res = op.status;
+    hasMoreEntries = false;
     if (res < 0) {
 	return res;
     }
+    hasMoreEntries = op.hasMoreEntries;
 
-    vector<FileChunkInfo> fileChunkInfo;
     istringstream ist;
     string entryInfo;
     boost::scoped_array<char> line;
     int count = 0, linelen = 1 << 20, numchars;
     const string entryDelim = "Begin-entry";
-    string s(op.contentBuf, op.contentLength);
+    string s(op.contentBuf ? op.contentBuf : "", op.contentLength);
 
     ist.str(s);
 
@@ -1158,79 +1483,32 @@ KfsClientImpl::ReaddirPlus(const char *pathname, kfsFileId_t dirFid,
         result.push_back(fattr);
     }
 
-    if (computeFilesize) {
-
-        for (uint32_t i = 0; i < result.size(); i++) {
-            if ((fileChunkInfo[i].chunkCount == 0) || (result[i].isDirectory)) {
-                result[i].fileSize = 0;
-                continue;
-            }
-
-            int fte = LookupFileTableEntry(dirFid, result[i].filename.c_str());
-
-            if (fte >= 0) {
-                result[i].fileSize = mFileTable[fte]->fattr.fileSize;
-            } 
-        }
-        ComputeFilesizes(result, fileChunkInfo);
-
-        for (uint32_t i = 0; i < result.size(); i++) 
-            if (result[i].fileSize < 0)
-                result[i].fileSize = 0;
-
-    }
-
-    // if there are too many entries in the dir, then the caller is
-    // probably scanning the directory.  don't put it in the cache
-    if ((result.size() > 128) || (!updateClientCache)) {
-        sort(result.begin(), result.end());
-        return res;
-    }
-
-    string dirname = build_path(mCwd, pathname);
-    string::size_type len = dirname.size();
-    if ((len > 0) && (dirname[len - 1] == '/'))
-        dirname.erase(len - 1);
-    
-    for (uint32_t i = 0; i < result.size(); i++) {
-        int fte = LookupFileTableEntry(dirFid, result[i].filename.c_str());
+    return res;
+}
 
-        if (fte >= 0) {
-            // if we computed the filesize, then we stash it; otherwise, we'll
-            // set the value to -1 and force a recompute later...
-            mFileTable[fte]->fattr.fileSize = result[i].fileSize;
+void
+KfsClientImpl::ComputeFilesizes(kfsFileId_t dirFid, vector<KfsFileAttr> &fattrs,
+                                vector<FileChunkInfo> &lastChunkInfo)
+{
+    for (uint32_t i = 0; i < fattrs.size(); i++) {
+        if ((lastChunkInfo[i].chunkCount == 0) || (fattrs[i].isDirectory)) {
+            fattrs[i].fileSize = 0;
             continue;
         }
 
-        if (fte < 0) {
-            string fullpath;
-            if ((result[i].filename == ".") || (result[i].filename == ".."))
-                fullpath = "";
-            else
-                fullpath = dirname + "/" + result[i].filename;
-
-            fte = AllocFileTableEntry(dirFid, result[i].filename.c_str(), fullpath);
-            if (fte < 0)
-                continue;
-        }
-
-        mFileTable[fte]->fattr.fileId = result[i].fileId;
-        mFileTable[fte]->fattr.mtime = result[i].mtime;
-        mFileTable[fte]->fattr.ctime = result[i].ctime;
-        mFileTable[fte]->fattr.ctime = result[i].crtime;
-        mFileTable[fte]->fattr.isDirectory = result[i].isDirectory;
-        mFileTable[fte]->fattr.chunkCount = fileChunkInfo[i].chunkCount;
-        mFileTable[fte]->fattr.numReplicas = fileChunkInfo[i].numReplicas;
+        int fte = LookupFileTableEntry(dirFid, fattrs[i].filename.c_str());
 
-        mFileTable[fte]->openMode = 0;
-        // if we computed the filesize, then we stash it; otherwise, we'll
-        // set the value to -1 and force a recompute later...
-        mFileTable[fte]->fattr.fileSize = result[i].fileSize;
+        // The metaserver does not know the size of the files that are
+        // being written: use the size from the file table, if any.
+        if (fte >= 0 && mFileTable[fte]->fattr.fileSize >= 0) {
+            fattrs[i].fileSize = mFileTable[fte]->fattr.fileSize;
+        } 
     }
+    ComputeFilesizes(fattrs, lastChunkInfo);
 
-    sort(result.begin(), result.end());
-
-    return res;
+    for (uint32_t i = 0; i < fattrs.size(); i++) 
+        if (fattrs[i].fileSize < 0)
+            fattrs[i].fileSize = 0;
 }
 
 ///
@@ -1268,6 +1546,21 @@ KfsClientImpl::GetDirSummary(const char *pathname, uint64_t &numFiles, uint64_t
     return 0;
 }
 
+int
+KfsClientImpl::GetFsSpace(uint64_t &totalSpace, uint64_t &usedSpace)
+{
+    MutexLock l(&mMutex);
+
+    PingOp op(nextSeq());
+    (void)DoMetaOpWithRetry(&op);
+    if (op.status < 0) {
+	return op.status;
+    }
+    totalSpace = op.totalSpace;
+    usedSpace = op.usedSpace;
+    return 0;
+}
+
 int
 KfsClientImpl::Stat(const char *pathname, struct stat &result, bool computeFilesize)
 {
@@ -1453,6 +1746,7 @@ KfsClientImpl::Create(const char *pathname, int numReplicas, bool exclusive)
     fa->Init(false);	// is an ordinary file
 
     FdInfo(fte)->openMode = O_RDWR;
+    FdInfo(fte)->writeBehind = mDefaultWriteBehind;
 
     return fte;
 }
@@ -1469,14 +1763,143 @@ KfsClientImpl::Remove(const char *pathname)
 	return res;
 
     int fte = LookupFileTableEntry(parentFid, filename.c_str());
-    if (fte > 0)
+    if (fte > 0) {
+	mChunkLocationCache.Invalidate(FdAttr(fte)->fileId);
 	ReleaseFileTableEntry(fte);
+    }
 
     RemoveOp op(nextSeq(), parentFid, filename.c_str(), pathname);
     (void)DoMetaOpWithRetry(&op);
     return op.status;
 }
 
+int
+KfsClientImpl::DoMultiPathOp(KfsOp_t cmd, const vector<string> &pathnames,
+                             vector<string> &lines, int numReplicas,
+                             bool exclusive)
+{
+    // Bound the request size, and the time the metaserver spends on a
+    // single request.
+    const size_t kMaxPathsPerOp = 1024;
+    const size_t kMaxBytesPerOp = 1 << 20;
+
+    lines.clear();
+    lines.reserve(pathnames.size());
+    for (size_t i = 0; i < pathnames.size(); ) {
+        MultiPathOp op(cmd, nextSeq(), numReplicas, exclusive);
+        size_t bytes = 0;
+        for (; i < pathnames.size() && op.paths.size() < kMaxPathsPerOp &&
+                (op.paths.empty() || bytes < kMaxBytesPerOp); i++) {
+            op.paths.push_back(build_path(mCwd, pathnames[i].c_str()));
+            bytes += op.paths.back().size() + 1;
+        }
+        (void)DoMetaOpWithRetry(&op);
+        if (op.status < 0) {
+            return op.status;
+        }
+        const char*       p   = op.contentBuf;
+        const char* const end = p + (p ? op.contentLength : 0);
+        while (p < end) {
+            const char* const eol = std::find(p, end, '\n');
+            lines.push_back(string(p, eol - p));
+            p = eol + 1;
+        }
+        if (op.numResults != (int)op.paths.size() ||
+                lines.size() != i) {
+            KFS_LOG_VA_ERROR("%s: invalid response: %d results",
+                             op.Show().c_str(), op.numResults);
+            return -EINVAL;
+        }
+        // Invalidate the cached attributes of the removed and re-created
+        // files.
+        for (size_t k = 0; cmd != CMD_MULTI_STAT && k < op.paths.size(); k++) {
+            const int fte = LookupFileTableEntry(op.paths[k].c_str());
+            if (fte > 0) {
+                ReleaseFileTableEntry(fte);
+            }
+        }
+    }
+    return 0;
+}
+
+int
+KfsClientImpl::MultiStat(const vector<string> &pathnames,
+                         vector<KfsFileAttr> &attrs, vector<int> &result)
+{
+    MutexLock l(&mMutex);
+
+    vector<string> lines;
+    const int res = DoMultiPathOp(CMD_MULTI_STAT, pathnames, lines);
+    if (res < 0) {
+        return res;
+    }
+    attrs.clear();
+    attrs.resize(pathnames.size());
+    result.resize(pathnames.size());
+    for (size_t i = 0; i < lines.size(); i++) {
+        // <status> <fid> <type> <chunk count> <size> <replication>
+        // <mtime sec usec> <ctime sec usec> <crtime sec usec>
+        istringstream is(lines[i]);
+        KfsFileAttr&  attr = attrs[i];
+        string        type;
+        long long     chunkCount;
+        is >> result[i];
+        attr.filename = pathnames[i];
+        if (result[i] != 0) {
+            continue;
+        }
+        is >> attr.fileId >> type >> chunkCount >> attr.fileSize >>
+            attr.numReplicas >>
+            attr.mtime.tv_sec >> attr.mtime.tv_usec >>
+            attr.ctime.tv_sec >> attr.ctime.tv_usec >>
+            attr.crtime.tv_sec >> attr.crtime.tv_usec;
+        attr.isDirectory = type == "dir";
+        if (! is) {
+            result[i] = -EINVAL;
+        }
+    }
+    return 0;
+}
+
+int
+KfsClientImpl::MultiCreate(const vector<string> &pathnames,
+                           vector<int> &result, int numReplicas,
+                           bool exclusive)
+{
+    MutexLock l(&mMutex);
+
+    vector<string> lines;
+    const int res = DoMultiPathOp(CMD_MULTI_CREATE, pathnames, lines,
+                                  numReplicas, exclusive);
+    if (res < 0) {
+        return res;
+    }
+    result.resize(pathnames.size());
+    for (size_t i = 0; i < lines.size(); i++) {
+        // <status> [<file id>]
+        result[i] = atoi(lines[i].c_str());
+    }
+    return 0;
+}
+
+int
+KfsClientImpl::MultiRemove(const vector<string> &pathnames,
+                           vector<int> &result)
+{
+    MutexLock l(&mMutex);
+
+    vector<string> lines;
+    const int res = DoMultiPathOp(CMD_MULTI_REMOVE, pathnames, lines);
+    if (res < 0) {
+        return res;
+    }
+    result.resize(pathnames.size());
+    for (size_t i = 0; i < lines.size(); i++) {
+        result[i] = atoi(lines[i].c_str());
+    }
+    return 0;
+}
+
 int
 KfsClientImpl::Rename(const char *oldpath, const char *newpath, bool overwrite)
 {
@@ -1607,10 +2030,19 @@ KfsClientImpl::Open(const char *pathname, int openMode, int numReplicas)
                 mFileTable[cachedFte]->fattr.fileSize;
     } else {
         if (entry->fattr.chunkCount > 0) {
+            // This also puts the file layout into the location cache.
             entry->fattr.fileSize =
                 ComputeFilesize(op.fattr.fileId);
         }
     }
+    // Prefetch the locations of all file chunks, unless the file is large.
+    if ((openMode & O_WRONLY) == 0 && ! entry->fattr.isDirectory &&
+            entry->fattr.chunkCount > 0 &&
+            entry->fattr.chunkCount <= CHUNK_LOCATION_PREFETCH_MAX_CHUNKS &&
+            ! mChunkLocationCache.Has(op.fattr.fileId)) {
+        GetLayoutOp lop(nextSeq(), op.fattr.fileId);
+        (void)GetLayout(lop);
+    }
 
     if (openMode & O_TRUNC)
 	Truncate(fte, 0);
@@ -1622,10 +2054,19 @@ KfsClientImpl::Open(const char *pathname, int openMode, int numReplicas)
     }
 
     if (! entry->fattr.isDirectory &&
-            ((openMode & O_RDWR) == O_RDWR || (openMode & O_RDONLY) == O_RDONLY) &&
-            mDefaultReadAheadSize > 0) {
-        entry->currPos.pendingChunkRead =
-            new PendingChunkRead(*this, mDefaultReadAheadSize);
+            ((openMode & O_RDWR) == O_RDWR || (openMode & O_RDONLY) == O_RDONLY)) {
+        if (mDefaultAdaptiveReadAheadSize > 0) {
+            entry->currPos.pendingChunkRead = new PendingChunkRead(
+                *this, mDefaultAdaptiveReadAheadSize, true);
+        } else if (mDefaultReadAheadSize > 0) {
+            entry->currPos.pendingChunkRead =
+                new PendingChunkRead(*this, mDefaultReadAheadSize);
+        }
+    }
+    if (! entry->fattr.isDirectory &&
+            (entry->openMode & (O_RDWR | O_WRONLY)) != 0 &&
+            (entry->openMode & O_APPEND) == 0) {
+        entry->writeBehind = mDefaultWriteBehind;
     }
 
     return fte;
@@ -1660,7 +2101,18 @@ KfsClientImpl::Close(int fd)
                 status = -EIO;
             }
         }
+        const int wbStatus = CompleteWriteBehind(fd);
+        if (status == 0 && wbStatus < 0) {
+            status = wbStatus;
+        }
         CloseChunk(fd);
+        // Give up the read leases acquired by PReadV().
+        for (map<int, ChunkAttr>::const_iterator it = entry.cattr.begin();
+                it != entry.cattr.end();
+                ++it) {
+            if (it->second.chunkId > 0)
+                RelinquishLease(it->second.chunkId);
+        }
         KFS_LOG_VA_DEBUG("Closing filetable entry: %d", fd);
         ReleaseFileTableEntry(fd);
     }
@@ -1700,6 +2152,12 @@ KfsClientImpl::Sync(int fd, bool flushOnlyIfHasFullChecksumBlock)
        if (status < 0)
 	   return status;
     }
+    if (! entry.writeBehindReqs.empty() || entry.writeBehindStatus < 0) {
+        const int status = CompleteWriteBehind(fd);
+        entry.writeBehindStatus = 0;
+        if (status < 0)
+            return status;
+    }
     if ((entry.openMode & O_APPEND) != 0 && entry.appendPending > 0 &&
             mProtocolWorker && entry.didAppend) {
         const KfsProtocolWorker::FileId       fileId       = entry.fattr.fileId;
@@ -1758,6 +2216,7 @@ KfsClientImpl::Truncate(int fd, off_t offset)
 	gettimeofday(&fa->mtime, NULL);
 	// force a re-lookup of locations
 	FdInfo(fd)->cattr.clear();
+	mChunkLocationCache.Invalidate(fa->fileId);
     }
     return res;
 }
@@ -1794,6 +2253,7 @@ KfsClientImpl::PruneFromHead(int fd, off_t offset)
 	gettimeofday(&fa->mtime, NULL);
 	// force a re-lookup of locations
 	FdInfo(fd)->cattr.clear();
+	mChunkLocationCache.Invalidate(fa->fileId);
     }
     return res;
 }
@@ -1964,7 +2424,7 @@ KfsClientImpl::Seek(int fd, off_t offset, int whence, bool flushIfBufDirty)
             }
         }
         // if there is an async write for this chunk, don't close it yet
-        if (mAsyncWrites.size() == 0)
+        if (mAsyncWrites.size() == 0 && ! HasWriteBehind(fd, pos->chunkNum))
             CloseChunk(fd);
         // Disconnect from all the servers we were connected for this chunk
 	pos->ResetServers();
@@ -2026,6 +2486,11 @@ KfsClientImpl::AllocChunk(int fd, bool append)
     chunk.chunkVersion = op.chunkVersion;
     chunk.chunkServerLoc = op.chunkServers;
     FdInfo(fd)->cattr[pos->chunkNum] = chunk;
+    if (append) {
+        mChunkLocationCache.Invalidate(fa->fileId);
+    } else {
+        mChunkLocationCache.Put(fa->fileId, op.fileOffset, chunk);
+    }
 
     FdPos(fd)->ResetServers();
     // for writes, [0] is the master; that is the preferred server
@@ -2083,12 +2548,24 @@ KfsClientImpl::LocateChunk(int fd, int chunkNum)
     map <int, ChunkAttr>::iterator c;
     c = mFileTable[fd]->cattr.find(chunkNum);
 
-    // Avoid unnecessary look ups.
-    if (c != mFileTable[fd]->cattr.end() && c->second.chunkId > 0)
-	return 0;
+    const kfsFileId_t fid = mFileTable[fd]->fattr.fileId;
+    const off_t offset = (off_t) chunkNum * KFS::CHUNKSIZE;
+    if (c != mFileTable[fd]->cattr.end()) {
+        // Avoid unnecessary look ups.
+        if (c->second.chunkId > 0)
+	    return 0;
+        // The chunk id is reset when the read fails: the cached location
+        // of this, or older version is stale.
+        mChunkLocationCache.Invalidate(fid, offset, c->second.chunkVersion);
+    }
 
-    GetAllocOp op(nextSeq(), mFileTable[fd]->fattr.fileId,
-		  (off_t) chunkNum * KFS::CHUNKSIZE);
+    ChunkAttr chunk;
+    if (mChunkLocationCache.Get(fid, offset, chunk)) {
+        mFileTable[fd]->cattr[chunkNum] = chunk;
+        return 0;
+    }
+
+    GetAllocOp op(nextSeq(), fid, offset);
     op.filename = mFileTable[fd]->pathname;
     (void)DoMetaOpWithRetry(&op);
     if (op.status < 0) {
@@ -2097,12 +2574,45 @@ KfsClientImpl::LocateChunk(int fd, int chunkNum)
 	return op.status;
     }
 
-    ChunkAttr chunk;
     chunk.chunkId = op.chunkId;
     chunk.chunkVersion = op.chunkVersion;
     chunk.chunkServerLoc = op.chunkServers;
     mFileTable[fd]->cattr[chunkNum] = chunk;
+    mChunkLocationCache.Put(fid, offset, chunk);
+
+    return 0;
+}
+
+///
+/// The chunk lease, or read failed: force the re-lookup of the current
+/// chunk location.
+///
+void
+KfsClientImpl::InvalidateCurrChunkLocation(int fd)
+{
+    ChunkAttr * const chunk = GetCurrChunk(fd);
+    mChunkLocationCache.Invalidate(FdAttr(fd)->fileId,
+        (off_t) FdPos(fd)->chunkNum * KFS::CHUNKSIZE, chunk->chunkVersion);
+    chunk->chunkId = -1;
+    FdPos(fd)->ResetServers();
+}
 
+///
+/// Get the file layout, and put the chunk locations into the chunk
+/// location cache.
+///
+int
+KfsClientImpl::GetLayout(GetLayoutOp &lop)
+{
+    (void)DoMetaOpWithRetry(&lop);
+    if (lop.status < 0) {
+        return lop.status;
+    }
+    if (lop.ParseLayoutInfo()) {
+	KFS_LOG_DEBUG("Unable to parse layout info");
+        return -EINVAL;
+    }
+    mChunkLocationCache.Put(lop.fid, lop.chunks);
     return 0;
 }
 
@@ -2113,6 +2623,49 @@ KfsClientImpl::IsCurrChunkAttrKnown(int fd)
     return c->find(FdPos(fd)->chunkNum) != c->end();
 }
 
+void
+KfsClientImpl::GetChunkLocationCacheStats(
+    KfsClient::ChunkLocationCacheStats &stats) const
+{
+    MutexLock lock(&const_cast<KfsClientImpl*>(this)->mMutex);
+    const ChunkLocationCache::Stats& cs = mChunkLocationCache.GetStats();
+    stats.hits        = cs.mHits;
+    stats.misses      = cs.mMisses;
+    stats.prefetched  = cs.mPrefetched;
+    stats.invalidated = cs.mInvalidated;
+    stats.evicted     = cs.mEvicted;
+    stats.expired     = cs.mExpired;
+    stats.entries     = mChunkLocationCache.GetSize();
+    stats.maxEntries  = mChunkLocationCache.GetMaxEntries();
+}
+
+void
+KfsClientImpl::SetChunkLocationCacheSize(size_t maxEntries)
+{
+    MutexLock lock(&mMutex);
+    mChunkLocationCache.SetMaxEntries(maxEntries);
+}
+
+void
+KfsClientImpl::GetChunkServerConnStats(
+    KfsClient::ChunkServerConnStats &stats) const
+{
+    const ChunkServerConnPool& pool = ChunkServerConnPool::Instance();
+    ChunkServerConnPool::Stats cs;
+    pool.GetStats(cs, stats.idle);
+    stats.created          = cs.mCreated;
+    stats.reused           = cs.mReused;
+    stats.pooled           = cs.mPooled;
+    stats.closed           = cs.mClosed;
+    stats.maxIdlePerServer = pool.GetMaxIdlePerServer();
+}
+
+void
+KfsClientImpl::SetChunkServerConnPoolSize(int maxIdlePerServer)
+{
+    ChunkServerConnPool::Instance().SetMaxIdlePerServer(maxIdlePerServer);
+}
+
 size_t
 KfsClientImpl::SetDefaultIoBufferSize(size_t size)
 {
@@ -2178,6 +2731,46 @@ KfsClientImpl::GetDefaultReadAheadSize() const
     return mDefaultReadAheadSize;
 }
 
+int
+KfsClientImpl::SetDefaultWriteBehind(int maxPendingWrites)
+{
+    MutexLock lock(&mMutex);
+    mDefaultWriteBehind = max(0, maxPendingWrites);
+    return mDefaultWriteBehind;
+}
+
+int
+KfsClientImpl::GetDefaultWriteBehind() const
+{
+    MutexLock lock(&const_cast<KfsClientImpl*>(this)->mMutex);
+    return mDefaultWriteBehind;
+}
+
+int
+KfsClientImpl::SetWriteBehind(int fd, int maxPendingWrites)
+{
+    MutexLock lock(&mMutex);
+    if (! valid_fd(fd)) {
+        return -EBADF;
+    }
+    FileTableEntry& entry = *mFileTable[fd];
+    entry.writeBehind = max(0, maxPendingWrites);
+    if (entry.writeBehindReqs.size() > size_t(entry.writeBehind)) {
+        CompleteWriteBehind(fd, entry.writeBehind);
+    }
+    return entry.writeBehind;
+}
+
+int
+KfsClientImpl::GetWriteBehind(int fd) const
+{
+    MutexLock lock(&const_cast<KfsClientImpl*>(this)->mMutex);
+    if (fd < 0 || size_t(fd) >= mFileTable.size() || ! mFileTable[fd]) {
+        return -EBADF;
+    }
+    return mFileTable[fd]->writeBehind;
+}
+
 size_t
 KfsClientImpl::SetReadAheadSize(int fd, size_t size)
 {
@@ -2214,6 +2807,88 @@ KfsClientImpl::GetReadAheadSize(int fd) const
     return (pos.pendingChunkRead ? pos.pendingChunkRead->GetReadAhead() : 0);
 }
 
+size_t
+KfsClientImpl::SetDefaultAdaptiveReadAheadSize(size_t maxSize)
+{
+    MutexLock lock(&mMutex);
+    mDefaultAdaptiveReadAheadSize = min(size_t(PendingChunkRead::kMaxReadRequest),
+        (maxSize + CHECKSUM_BLOCKSIZE - 1) /
+            CHECKSUM_BLOCKSIZE * CHECKSUM_BLOCKSIZE);
+    return mDefaultAdaptiveReadAheadSize;
+}
+
+size_t
+KfsClientImpl::GetDefaultAdaptiveReadAheadSize() const
+{
+    MutexLock lock(&const_cast<KfsClientImpl*>(this)->mMutex);
+    return mDefaultAdaptiveReadAheadSize;
+}
+
+size_t
+KfsClientImpl::SetAdaptiveReadAheadSize(int fd, size_t maxSize)
+{
+    MutexLock lock(&mMutex);
+    if (fd < 0 || size_t(fd) >= mFileTable.size() || ! mFileTable[fd]) {
+        return 0;
+    }
+    FilePosition& pos = *FdPos(fd);
+    const size_t readAhead = min(size_t(PendingChunkRead::kMaxReadRequest),
+        (maxSize + CHECKSUM_BLOCKSIZE - 1) /
+            CHECKSUM_BLOCKSIZE * CHECKSUM_BLOCKSIZE);
+    if (pos.pendingChunkRead) {
+        if (readAhead > 0) {
+            pos.pendingChunkRead->SetAdaptiveReadAhead(readAhead);
+        } else {
+            delete pos.pendingChunkRead;
+            pos.pendingChunkRead = 0;
+        }
+    } else if (readAhead > 0) {
+        pos.pendingChunkRead = new PendingChunkRead(*this, readAhead, true);
+    }
+    return readAhead;
+}
+
+static void
+SetReadAheadStats(const PendingChunkRead::Stats& st,
+    KfsClient::ReadAheadStats &stats)
+{
+    stats.usefulBytes     = st.mUsefulBytes;
+    stats.wastedBytes     = st.mWastedBytes;
+    stats.sequentialReads = st.mSequentialReads;
+    stats.randomReads     = st.mRandomReads;
+}
+
+int
+KfsClientImpl::GetReadAheadStats(int fd, KfsClient::ReadAheadStats &stats) const
+{
+    KfsClientImpl& mutableSelf = *const_cast<KfsClientImpl*>(this);
+    MutexLock lock(&mutableSelf.mMutex);
+    if (fd < 0 || size_t(fd) >= mFileTable.size() || ! mFileTable[fd]) {
+        return -EBADF;
+    }
+    const PendingChunkRead* const pcr = mutableSelf.FdPos(fd)->pendingChunkRead;
+    if (! pcr) {
+        return -EBADF;
+    }
+    SetReadAheadStats(pcr->GetStats(), stats);
+    stats.readAheadSize    = pcr->GetReadAhead();
+    stats.maxReadAheadSize = pcr->GetMaxReadAhead();
+    stats.adaptive         = pcr->IsAdaptive();
+    return 0;
+}
+
+void
+KfsClientImpl::GetReadAheadStats(KfsClient::ReadAheadStats &stats) const
+{
+    MutexLock lock(&const_cast<KfsClientImpl*>(this)->mMutex);
+    SetReadAheadStats(mReadAheadStats, stats);
+    stats.readAheadSize    = mDefaultAdaptiveReadAheadSize > 0 ?
+        0 : mDefaultReadAheadSize;
+    stats.maxReadAheadSize = mDefaultAdaptiveReadAheadSize > 0 ?
+        mDefaultAdaptiveReadAheadSize : mDefaultReadAheadSize;
+    stats.adaptive         = mDefaultAdaptiveReadAheadSize > 0;
+}
+
 ///
 /// Helper function that does the work for sending out an op to the
 /// server.
@@ -2223,6 +2898,91 @@ KfsClientImpl::GetReadAheadSize(int fd) const
 /// @retval 0 on success; -1 on failure
 /// (On failure, op->status contains error code.)
 ///
+static inline int64_t
+NowMicroSecs()
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return (int64_t(tv.tv_sec) * 1000000 + tv.tv_usec);
+}
+
+// Rpc latency histograms, shared by all clients in the process, and updated
+// with atomic increments. The phases are: send -- sending the request;
+// total -- send start to the end of the response.
+enum {
+    kLatencySend,
+    kLatencyTotal,
+    kLatencyPhaseCount
+};
+
+static LatencyStats*
+MakeRpcLatencyStats()
+{
+    static const char* const kPhaseNames[kLatencyPhaseCount] = {
+        "send",
+        "total"
+    };
+    static const struct { KfsOp_t op; const char* name; } kOpNames[] = {
+        { CMD_GETALLOC,                 "GETALLOC"                    },
+        { CMD_GETLAYOUT,                "GETLAYOUT"                   },
+        { CMD_ALLOCATE,                 "ALLOCATE"                    },
+        { CMD_TRUNCATE,                 "TRUNCATE"                    },
+        { CMD_LOOKUP,                   "LOOKUP"                      },
+        { CMD_MKDIR,                    "MKDIR"                       },
+        { CMD_RMDIR,                    "RMDIR"                       },
+        { CMD_READDIR,                  "READDIR"                     },
+        { CMD_READDIRPLUS,              "READDIRPLUS"                 },
+        { CMD_GETDIRSUMMARY,            "GETDIRSUMMARY"               },
+        { CMD_CREATE,                   "CREATE"                      },
+        { CMD_REMOVE,                   "REMOVE"                      },
+        { CMD_RENAME,                   "RENAME"                      },
+        { CMD_SETMTIME,                 "SET_MTIME"                   },
+        { CMD_LEASE_ACQUIRE,            "LEASE_ACQUIRE"               },
+        { CMD_LEASE_RENEW,              "LEASE_RENEW"                 },
+        { CMD_LEASE_RELINQUISH,         "LEASE_RELINQUISH"            },
+        { CMD_COALESCE_BLOCKS,          "COALESCE_BLOCKS"             },
+        { CMD_CHUNK_SPACE_RESERVE,      "CHUNK_SPACE_RESERVE"         },
+        { CMD_CHUNK_SPACE_RELEASE,      "CHUNK_SPACE_RELEASE"         },
+        { CMD_RECORD_APPEND,            "RECORD_APPEND"               },
+        { CMD_GET_RECORD_APPEND_STATUS, "GET_RECORD_APPEND_OP_STATUS" },
+        { CMD_CHANGE_FILE_REPLICATION,  "CHANGE_FILE_REPLICATION"     },
+        { CMD_PING,                     "PING"                        },
+        { CMD_MULTI_STAT,               "MULTI_STAT"                  },
+        { CMD_MULTI_CREATE,             "MULTI_CREATE"                },
+        { CMD_MULTI_REMOVE,             "MULTI_REMOVE"                },
+        { CMD_OPEN,                     "OPEN"                        },
+        { CMD_CLOSE,                    "CLOSE"                       },
+        { CMD_READ,                     "READ"                        },
+        { CMD_WRITE_ID_ALLOC,           "WRITE_ID_ALLOC"              },
+        { CMD_WRITE_PREPARE,            "WRITE_PREPARE"               },
+        { CMD_WRITE_SYNC,               "WRITE_SYNC"                  },
+        { CMD_SIZE,                     "SIZE"                        },
+        { CMD_GET_CHUNK_METADATA,       "GET_CHUNK_METADATA"          }
+    };
+    LatencyStats* const stats =
+        new LatencyStats(kPhaseNames, kLatencyPhaseCount);
+    for (size_t i = 0; i < sizeof(kOpNames) / sizeof(kOpNames[0]); i++) {
+        stats->SetOpName(kOpNames[i].op, kOpNames[i].name);
+    }
+    return stats;
+}
+
+static LatencyStats&
+GetRpcLatencyStats()
+{
+    static LatencyStats* const stats = MakeRpcLatencyStats();
+    return *stats;
+}
+
+static inline void
+UpdateRpcLatency(const KfsOp *op)
+{
+    if (op->sendTime > 0) {
+        GetRpcLatencyStats().AtomicUpdate(op->op, kLatencyTotal,
+            NowMicroSecs() - op->sendTime);
+    }
+}
+
 int
 KFS::DoOpSend(KfsOp *op, TcpSocket *sock)
 {
@@ -2234,6 +2994,7 @@ KFS::DoOpSend(KfsOp *op, TcpSocket *sock)
 	return -1;
     }
 
+    op->sendTime = NowMicroSecs();
     op->Request(os);
     int numIO = sock->DoSynchSend(os.str().c_str(), os.str().length());
     if (numIO <= 0) {
@@ -2251,6 +3012,9 @@ KFS::DoOpSend(KfsOp *op, TcpSocket *sock)
 	    return -1;
 	}
     }
+    sock->RequestSent();
+    GetRpcLatencyStats().AtomicUpdate(op->op, kLatencySend,
+        NowMicroSecs() - op->sendTime);
     return 0;
 }
 
@@ -2403,6 +3167,8 @@ KFS::DoOpResponse(KfsOp *op, TcpSocket *sock)
 	assert(len > 0);
 
 	GetSeqContentLen(buf, len, &resSeq, &contentLen, prop);
+	// The socket is closed if the response content can not be read.
+	sock->ResponseReceived();
 
 	if (resSeq == op->seq) {
             if (printMatchingResponse) {
@@ -2437,6 +3203,7 @@ KFS::DoOpResponse(KfsOp *op, TcpSocket *sock)
 	// op's status should get filled in; we shouldn't be stomping
 	// over content length.
 	op->contentLength = contentLen;
+	UpdateRpcLatency(op);
 	return numIO;
     }
 
@@ -2465,8 +3232,10 @@ KFS::DoOpResponse(KfsOp *op, TcpSocket *sock)
 
 	nread = sock->DoSynchRecv(op->contentBuf + navail, nleft, timeout);
 	if (nread == -ETIMEDOUT) {
-	    KFS_LOG_DEBUG("Recv timed out...");
+	    KFS_LOG_DEBUG("Recv timed out...closing socket");
 	    op->status = -ETIMEDOUT;
+	    // The rest of the response is still in flight.
+	    sock->Close();
 	} else if (nread <= 0) {
 	    KFS_LOG_DEBUG("Recv failed...closing socket");
 	    op->status = -EHOSTUNREACH;
@@ -2478,6 +3247,7 @@ KFS::DoOpResponse(KfsOp *op, TcpSocket *sock)
 	}
     }
 
+    UpdateRpcLatency(op);
     return nread + numIO;
 }
 
@@ -2609,17 +3379,11 @@ off_t
 KfsClientImpl::ComputeFilesize(kfsFileId_t kfsfid)
 {
     GetLayoutOp lop(nextSeq(), kfsfid);
-    (void)DoMetaOpWithRetry(&lop);
-    if (lop.status < 0) {
+    if (GetLayout(lop) < 0) {
         KFS_LOG_VA_INFO("Unable to compute filesize for: %lld", kfsfid);
 	return -1;
     }
 
-    if (lop.ParseLayoutInfo()) {
-	KFS_LOG_DEBUG("Unable to parse layout info");
-	return -1;
-    }
-
     if (lop.chunks.size() == 0)
 	return 0;
 
@@ -2817,8 +3581,8 @@ KfsClientImpl::OpenChunk(int fd, bool nonblockingConnect)
     }
 
   try_again:
-    // pick one at random avoiding slow nodes
-    random_shuffle(loc.begin(), loc.end());
+    // The metaserver lists the replicas in random order, with the servers
+    // loaded with I/O last; take the first one avoiding slow nodes.
 
     for (vector<ServerLocation>::size_type i = 0;
          (FdPos(fd)->GetPreferredServer() == NULL && i != loc.size());
@@ -2835,7 +3599,7 @@ KfsClientImpl::OpenChunk(int fd, bool nonblockingConnect)
 
         FdPos(fd)->SetPreferredServer(loc[i], nonblockingConnect);
         if (FdPos(fd)->GetPreferredServer() != NULL)
-            KFS_LOG_VA_DEBUG("For chunk %lld, randomly chose: %s", 
+            KFS_LOG_VA_DEBUG("For chunk %lld, chose: %s", 
                              chunk->chunkId, loc[i].ToString().c_str());
     }
     if (FdPos(fd)->GetPreferredServer() == NULL) {
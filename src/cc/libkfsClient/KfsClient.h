@@ -35,6 +35,7 @@
 
 #include <boost/shared_ptr.hpp>
 #include <sys/stat.h>
+#include <sys/uio.h>
 
 #include "KfsAttr.h"
 
@@ -128,6 +129,26 @@ public:
     ///
     int ReaddirPlus(const char *pathname, std::vector<KfsFileAttr> &result);
 
+    ///
+    /// Read a part of a directory's contents and retrieve the
+    /// attributes, so that a huge directory can be listed one part at a
+    /// time.  The entries are in the metaserver directory order.  The
+    /// file sizes are the ones the metaserver knows: the size of a file
+    /// that is being written is -1, unless computeFilesize is set.
+    /// @param[in] pathname	The full pathname such as /.../dir
+    /// @param[in] fnameStart	The last name of the previous part; empty
+    /// for the first part
+    /// @param[in] maxEntries	Max # of entries to return
+    /// @param[out] result	The files in the directory and their attributes.
+    /// @param[out] hasMoreEntries  Set if the listing continues
+    /// @param[in] computeFilesize  Get the sizes the metaserver does not
+    /// know from the chunkservers
+    /// @retval 0 if readdirplus is successful; -errno otherwise
+    ///
+    int ReaddirPlus(const char *pathname, const std::string &fnameStart,
+                    int maxEntries, std::vector<KfsFileAttr> &result,
+                    bool &hasMoreEntries, bool computeFilesize = false);
+
     ///
     /// Do a du on the metaserver side for pathname and return the #
     /// of files/bytes in the directory tree starting at pathname.
@@ -135,6 +156,13 @@ public:
     ///
     int GetDirSummary(const char *pathname, uint64_t &numFiles, uint64_t &numBytes);
 
+    ///
+    /// Get the file system total and used space, as reported by the
+    /// metaserver.
+    /// @retval 0 on success; -errno otherwise
+    ///
+    int GetFsSpace(uint64_t &totalSpace, uint64_t &usedSpace);
+
     ///
     /// Stat a file and get its attributes.
     /// @param[in] pathname	The full pathname such as /.../foo
@@ -215,6 +243,25 @@ public:
     ///
     int Remove(const char *pathname);
 
+    ///
+    /// Batched versions of Stat(), Create(), and Remove(): the paths are
+    /// sent to the metaserver in as few RPCs as possible, and the per
+    /// path results are returned in the same order as the paths.
+    /// MultiStat() does not compute file sizes, the size is -1 if the
+    /// metaserver does not know it. MultiCreate() does not open the
+    /// created files.
+    /// @param[in] pathnames  The full pathnames
+    /// @param[out] result  Per path status: 0 on success; -errno otherwise
+    /// @retval 0 if all the RPCs succeeded; -errno otherwise
+    ///
+    int MultiStat(const std::vector<std::string> &pathnames,
+                  std::vector<KfsFileAttr> &attrs, std::vector<int> &result);
+    int MultiCreate(const std::vector<std::string> &pathnames,
+                    std::vector<int> &result, int numReplicas = 3,
+                    bool exclusive = false);
+    int MultiRemove(const std::vector<std::string> &pathnames,
+                    std::vector<int> &result);
+
     ///
     /// Rename file/dir corresponding to oldpath to newpath
     /// @param[in] oldpath   path corresponding to the old name
@@ -274,6 +321,36 @@ public:
     ///
     int AtomicRecordAppend(int fd, const char *buf, int reclen);
 
+    ///
+    /// Set atomic record append batching of this client's files. The
+    /// buffered records (see SetIoBufferSize()) are sent in one append
+    /// once their size reaches maxBatchBytes, or once the oldest of them
+    /// waited maxDelayMs.
+    /// @param[in] maxBatchBytes the append write threshold, capped at the
+    /// checksum block size
+    /// @param[in] maxDelayMs max batch delay; -1 -- no limit, 0 -- send as
+    /// soon as no append is in flight
+    /// @retval 0 on success; -EINVAL if the parameters are not valid
+    ///
+    int SetAppendBatching(int maxBatchBytes, int maxDelayMs);
+
+    struct AppendStats {
+        AppendStats()
+            : records(0), committedRecords(0), appends(0),
+              committedBytes(0), batchTimeouts(0)
+            {}
+        int64_t records;          ///< records submitted
+        int64_t committedRecords; ///< records committed by chunk servers
+        int64_t appends;          ///< record append ops committed
+        int64_t committedBytes;   ///< bytes committed
+        int64_t batchTimeouts;    ///< appends sent due to the max delay
+    };
+    ///
+    /// Get the atomic record append statistics of all files, opened and
+    /// closed, of this client.
+    ///
+    void GetAppendStats(AppendStats &stats) const;
+
     void EnableAsyncRW();
     void DisableAsyncRW();
 
@@ -345,6 +422,29 @@ public:
     ssize_t Read(int fd, char *buf, size_t numBytes);
     ssize_t Write(int fd, const char *buf, size_t numBytes);
 
+    ///
+    /// Positioned read / write: Seek() followed by Read() / Write(),
+    /// done atomically with respect to other threads using the same fd.
+    /// @param[in] offset   The file offset to do the I/O at.
+    /// @retval same as Read() / Write()
+    ///
+    ssize_t PRead(int fd, off_t offset, char *buf, size_t numBytes);
+    ssize_t PWrite(int fd, off_t offset, const char *buf, size_t numBytes);
+
+    ///
+    /// Positioned vectored read: fills the buffers in order, starting
+    /// at the given file offset. Unlike PRead(), the file position is not
+    /// changed, and the data is read from the chunk servers over a
+    /// dedicated connection without holding the client lock, thus
+    /// multiple threads can read the same file concurrently.
+    /// The file read ahead and io buffer are not used.
+    /// @param[in] offset   The file offset to read at.
+    /// @param[in] iov      The buffers to read into.
+    /// @param[in] iovcnt   The number of buffers.
+    /// @retval # of bytes read; 0 at EOF; -errno on failure
+    ///
+    ssize_t PReadV(int fd, off_t offset, const struct iovec *iov, int iovcnt);
+
     /// If there are any holes in a file, such as those at the end of
     /// a chunk, skip over them.  
     void SkipHolesInFile(int fd);
@@ -431,6 +531,62 @@ public:
     ///
     void SetDefaultIOTimeout(int nsecs);
     void GetDefaultIOTimeout(struct timeval &timeout);
+
+    ///
+    /// Get the rpc latency histograms of all the clients in this process:
+    /// one "Latency-<rpc>-<phase>: <histogram>" line per rpc type and
+    /// phase, in the same form as the servers' STATS response.
+    /// @param[out] os  stream to write the histograms to
+    ///
+    void GetLatencyStats(std::ostream &os) const;
+
+    ///
+    /// Chunk location cache statistics: the cache maps file offset to
+    /// chunk location, and is shared by all files of the client.
+    ///
+    struct ChunkLocationCacheStats {
+        ChunkLocationCacheStats()
+            : hits(0), misses(0), prefetched(0), invalidated(0),
+              evicted(0), expired(0), entries(0), maxEntries(0)
+            {}
+        int64_t hits;        ///< lookups served from the cache
+        int64_t misses;      ///< lookups sent to the metaserver
+        int64_t prefetched;  ///< entries added from file layouts on open
+        int64_t invalidated; ///< stale entries removed on read failure
+        int64_t evicted;     ///< entries removed to make room
+        int64_t expired;     ///< entries removed due to age
+        int64_t entries;     ///< current # of entries
+        int64_t maxEntries;  ///< max # of entries
+    };
+    void GetChunkLocationCacheStats(ChunkLocationCacheStats &stats) const;
+    ///
+    /// Set the max # of entries in chunk location cache, 0 turns the
+    /// cache off.
+    ///
+    void SetChunkLocationCacheSize(size_t maxEntries);
+    ///
+    /// Chunk server connection pool statistics: the connections released
+    /// by the closed files are reused by the next files that talk to the
+    /// same chunk server. The pool is shared by all clients in the process.
+    ///
+    struct ChunkServerConnStats {
+        ChunkServerConnStats()
+            : created(0), reused(0), pooled(0), closed(0), idle(0),
+              maxIdlePerServer(0)
+            {}
+        int64_t created;          ///< new connections
+        int64_t reused;           ///< connections taken from the pool
+        int64_t pooled;           ///< released connections kept in the pool
+        int64_t closed;           ///< idle connections expired or broken
+        int64_t idle;             ///< current # of idle connections
+        int64_t maxIdlePerServer; ///< max # of idle connections per server
+    };
+    void GetChunkServerConnStats(ChunkServerConnStats &stats) const;
+    ///
+    /// Set the max # of idle connections per chunk server, 0 turns the
+    /// connection pool off.
+    ///
+    void SetChunkServerConnPoolSize(int maxIdlePerServer);
     ///
     /// Set default io buffer size.
     /// This has no effect on already opened files.
@@ -492,12 +648,140 @@ public:
     /// @retval read ahead size
     //
     size_t GetReadAheadSize(int fd) const;
+
+    ///
+    /// Set default adaptive read ahead max size. In adaptive mode the
+    /// read ahead is off until the file is read sequentially; each
+    /// sequential read doubles the read ahead size up to the max size,
+    /// and a read at any other offset turns the read ahead off again.
+    /// Zero turns adaptive mode off: the files are opened with the fixed
+    /// default read ahead size.
+    /// This has no effect on already opened files.
+    /// @param[in] desired max read ahead size
+    /// @retval actual default max read ahead size
+    //
+    size_t SetDefaultAdaptiveReadAheadSize(size_t maxSize);
+
+    ///
+    /// Get default adaptive read ahead max size.
+    /// @retval max read ahead size, 0 if adaptive mode is off
+    //
+    size_t GetDefaultAdaptiveReadAheadSize() const;
+
+    ///
+    /// Switch file into adaptive read ahead mode. SetReadAheadSize()
+    /// switches it back to the fixed read ahead size.
+    /// GetReadAheadSize() returns the current read ahead size.
+    /// @param[in] fd that corresponds to a previously opened file
+    /// @param[in] desired max read ahead size
+    /// @retval actual max read ahead size
+    //
+    size_t SetAdaptiveReadAheadSize(int fd, size_t maxSize);
+
+    struct ReadAheadStats {
+        ReadAheadStats()
+            : usefulBytes(0), wastedBytes(0), sequentialReads(0),
+              randomReads(0), readAheadSize(0), maxReadAheadSize(0),
+              adaptive(false)
+            {}
+        int64_t usefulBytes;      ///< read ahead bytes returned to the reader
+        int64_t wastedBytes;      ///< read ahead bytes discarded
+        int64_t sequentialReads;  ///< chunk server reads that were sequential
+        int64_t randomReads;      ///< chunk server reads that were not
+        int64_t readAheadSize;    ///< current read ahead size
+        int64_t maxReadAheadSize; ///< adaptive max, or fixed read ahead size
+        bool    adaptive;
+    };
+
+    ///
+    /// Get file read ahead statistics.
+    /// @param[in] fd that corresponds to a previously opened file
+    /// @param[out] stats read ahead statistics
+    /// @retval 0 on success; -EBADF if the file is not opened, or if
+    /// the read ahead is off
+    //
+    int GetReadAheadStats(int fd, ReadAheadStats &stats) const;
+
+    ///
+    /// Get the read ahead byte and read counts of all files, opened and
+    /// closed, of this client.
+    //
+    void GetReadAheadStats(ReadAheadStats &stats) const;
+
+    ///
+    /// Set default write behind: the max number of writes in flight per
+    /// file. With write behind on, the write returns once the data is
+    /// sent to the chunk servers, without waiting for the servers to
+    /// commit it; the writes are pipelined across the chunk boundaries.
+    /// Each write in flight keeps a copy of its data (at most the io
+    /// buffer size) to re-do the write should it fail. The write errors
+    /// are reported by the subsequent Write(), Sync(), or Close().
+    /// Zero turns write behind off. Append mode files do not use write
+    /// behind. This has no effect on already opened files.
+    /// @param[in] maxPendingWrites desired max # of writes in flight
+    /// @retval actual default max # of writes in flight
+    //
+    int SetDefaultWriteBehind(int maxPendingWrites);
+
+    ///
+    /// Get default write behind.
+    /// @retval max # of writes in flight, 0 if write behind is off
+    //
+    int GetDefaultWriteBehind() const;
+
+    ///
+    /// Set file write behind. Turning write behind off waits for the
+    /// writes in flight to complete.
+    /// @param[in] fd that corresponds to a previously opened file
+    /// @param[in] maxPendingWrites desired max # of writes in flight
+    /// @retval actual max # of writes in flight; -EBADF if the file is
+    /// not opened
+    //
+    int SetWriteBehind(int fd, int maxPendingWrites);
+
+    ///
+    /// Get file write behind.
+    /// @param[in] fd that corresponds to a previously opened file
+    /// @retval max # of writes in flight; -EBADF if the file is not opened
+    //
+    int GetWriteBehind(int fd) const;
 private:
     KfsClientImpl *mImpl;
 };
 
 typedef boost::shared_ptr<KfsClient> KfsClientPtr;
 
+///
+/// \brief Directory iterator: lists a directory with the paged
+/// ReaddirPlus(), thus the client and metaserver memory used by the
+/// listing is bounded by the page size, regardless of the directory size.
+/// The entries are returned in the metaserver directory order.  The entries
+/// created or removed while the listing is in progress might or might
+/// not be returned.
+///
+class KfsDirIterator {
+public:
+    KfsDirIterator(KfsClient &client, const std::string &pathname,
+                   int pageSize = 1024, bool computeFilesize = false);
+
+    ///
+    /// Get the next directory entry.
+    /// @param[out] entry  The entry name and attributes
+    /// @retval 1 if entry is set; 0 at the end of the directory;
+    /// -errno otherwise
+    ///
+    int Next(KfsFileAttr &entry);
+private:
+    KfsClient                &mClient;
+    const std::string        mPathname;
+    const int                mPageSize;
+    const bool               mComputeFilesizeFlag;
+    std::vector<KfsFileAttr> mEntries;
+    size_t                   mPos;
+    std::string              mFnameStart;
+    bool                     mHasMoreEntriesFlag;
+};
+
 class KfsClientFactory {
     // Make the constructor private to get a Singleton.
     KfsClientFactory();
@@ -28,6 +28,7 @@
 
 #include <string>
 #include <vector>
+#include <list>
 #include <tr1/unordered_map>
 #include <poll.h>
 #include "common/log.h"
@@ -39,9 +40,12 @@
 #include "libkfsIO/TelemetryClient.h"
 
 #include "KfsAttr.h"
+#include "KfsClient.h"
 
 #include "KfsOps.h"
 #include "LeaseClerk.h"
+#include "ChunkLocationCache.h"
+#include "ChunkServerConnPool.h"
  
 #include "concurrency.h"
 #include "KfsPendingOp.h"
@@ -72,6 +76,14 @@ const int LEASE_RETRY_DELAY_SECS = 5;
 /// after that force a revalidataion.
 const int FILE_CACHE_ENTRY_VALID_TIME = 30;
 
+/// Directories are read in parts of at most this many entries, to bound
+/// the metaserver response size for huge directories.
+const int READDIR_MAX_ENTRIES = 8 << 10;
+
+/// On open, the locations of all chunks of a file are fetched, unless the
+/// file has more chunks than this.
+const int CHUNK_LOCATION_PREFETCH_MAX_CHUNKS = 4 << 10;
+
 ///
 /// A KfsClient maintains a file-table that stores information about
 /// KFS files on that client.  Each file in the file-table is composed
@@ -124,8 +136,8 @@ struct ChunkServerConn {
     TcpSocketPtr   sock;
 
     ChunkServerConn(const ServerLocation &l) :
-        location(l) { 
-        sock.reset(new TcpSocket());
+        location(l),
+        sock(ChunkServerConnPool::Instance().Get(l)) {
     }
     
     void Connect(bool nonblockingConnect = false) {
@@ -152,7 +164,10 @@ struct ChunkServerConn {
             res = -EHOSTUNREACH;
         }
         if (res < 0) {
-            sock.reset(new TcpSocket());
+            // Do not let the pool keep the socket with the failed or
+            // still pending connect.
+            sock->Close();
+            sock = ChunkServerConnPool::Instance().Get(location);
         }
             
     }
@@ -167,28 +182,65 @@ class KfsClientImpl;
 /// The following class is used for chunk read ahead:
 /// Start() sends chunk read request to chunk server, and
 /// Read() retrieves the data.
-/// Reset() cancels read request by resetting chunk server connection.
+/// Reset() cancels read request by resetting chunk server connection: the
+/// connection pool closes the sockets with the responses in flight.
 ///
 class PendingChunkRead
 {
 public:
     enum { kMaxReadRequest = 1 << 20 };
-
-    PendingChunkRead(KfsClientImpl& impl, size_t readAhead);
+    enum { kMinAdaptiveReadAhead = CHECKSUM_BLOCKSIZE };
+
+    struct Stats
+    {
+        Stats()
+            : mUsefulBytes(0),
+              mWastedBytes(0),
+              mSequentialReads(0),
+              mRandomReads(0)
+            {}
+        int64_t mUsefulBytes;     ///< read ahead bytes returned to the reader
+        int64_t mWastedBytes;     ///< read ahead bytes discarded
+        int64_t mSequentialReads; ///< server reads at the previous read end
+        int64_t mRandomReads;     ///< server reads elsewhere
+    };
+
+    /// In adaptive mode readAhead is the max read ahead size, and the
+    /// read ahead is off until sequential access is detected.
+    PendingChunkRead(KfsClientImpl& impl, size_t readAhead,
+        bool adaptiveFlag = false);
     ~PendingChunkRead();
     bool Start(int fd, size_t off);
     ssize_t Read(char *buf, size_t numBytes);
     bool IsValid() const { return (mFd >= 0); }
     void Reset() { Start(-1, 0); }
-    void SetReadAhead(size_t readAhead) { mReadAhead = readAhead; }
+    void SetReadAhead(size_t readAhead)
+        { mReadAhead = readAhead; mMaxReadAhead = 0; }
+    void SetAdaptiveReadAhead(size_t maxReadAhead)
+        { mMaxReadAhead = maxReadAhead; mReadAhead = 0; }
+    bool IsAdaptive() const { return (mMaxReadAhead > 0); }
+    /// @retval the current read ahead size
     size_t GetReadAhead() const { return mReadAhead; }
+    size_t GetMaxReadAhead() const
+        { return (IsAdaptive() ? mMaxReadAhead : mReadAhead); }
     off_t GetChunkOffset() const { return (IsValid() ? mReadOp.offset : -1); }
+    /// Called before each read from the chunk server, with the file
+    /// offset and the read buffer size. In adaptive mode the read ahead
+    /// size is doubled with each sequential read, and set to 0 with a
+    /// non sequential read.
+    void Access(off_t fileOffset, size_t numBytes);
+    const Stats& GetStats() const { return mStats; }
 private:
     ReadOp         mReadOp;
     TcpSocket*     mSocket;
     KfsClientImpl& mImpl;
     int            mFd;
     size_t         mReadAhead;
+    size_t         mMaxReadAhead; ///< 0 -- fixed read ahead size
+    off_t          mNextFileOffset;
+    Stats          mStats;
+
+    void Account(int64_t useful, int64_t wasted);
 };
 
 ///
@@ -334,6 +386,32 @@ typedef std::tr1::unordered_map<std::string, int, Hsieh_hash_fcn> NameToFdMap;
 ///
 /// \brief A table of entries that describe each open KFS file.
 ///
+///
+/// \brief Write behind: a chunk write which data was sent to the chunk
+/// master, and which commit replies were not received yet.  The data is
+/// kept until then, to re-do the write if the commit fails.
+///
+struct WriteBehindReq {
+    WriteBehindReq()
+        : fileOffset(0), chunkId(-1), chunkVersion(-1), chunkServerLoc(),
+          writeId(), sock(), data(), syncOps(), numCommitsRecv(0), status(0)
+        {}
+    off_t                       fileOffset;
+    kfsChunkId_t                chunkId;
+    int64_t                     chunkVersion;
+    std::vector<ServerLocation> chunkServerLoc;
+    std::vector<WriteInfo>      writeId;
+    /// Connection to the chunk master used only for write behind: the
+    /// commit replies must not be consumed by the other ops.  Shared by
+    /// the writes in flight to the same chunk.
+    TcpSocketPtr                sock;
+    std::vector<char>           data;
+    std::vector<WriteSyncOp>    syncOps;
+    size_t                      numCommitsRecv;
+    int                         status;
+};
+typedef std::list<WriteBehindReq> WriteBehindReqs;
+
 struct FileTableEntry {
     // the fid of the parent dir in which this entry "resides"
     kfsFileId_t parentFid;
@@ -370,12 +448,18 @@ struct FileTableEntry {
     unsigned int instance;
     int appendPending;
     bool didAppend;
+    /// max # of writes in flight, 0 -- write behind is off
+    int writeBehind;
+    /// the first write behind failure, reported by sync and close
+    int writeBehindStatus;
+    WriteBehindReqs writeBehindReqs;
 
     FileTableEntry(kfsFileId_t p, const char *n, unsigned int instance):
 	parentFid(p), name(n), eofMark(-1), 
         lastAccessTime(0), validatedTime(0), 
         skipHoles(false), instance(instance), appendPending(0),
-        didAppend(false) { }
+        didAppend(false), writeBehind(0), writeBehindStatus(0),
+        writeBehindReqs() { }
 };
 
 class KfsProtocolWorker;
@@ -458,6 +542,18 @@ public:
     int ReaddirPlus(const char *pathname, std::vector<KfsFileAttr> &result,
                     bool computeFilesize = true);
 
+    ///
+    /// Read a part of a directory's contents and retrieve the attributes.
+    /// @param[in] fnameStart	Resume after this name; empty for the
+    /// first part
+    /// @param[in] maxEntries	Max # of entries to return
+    /// @param[out] hasMoreEntries  Set if the listing continues
+    /// @retval 0 if readdirplus is successful; -errno otherwise
+    ///
+    int ReaddirPlus(const char *pathname, const std::string &fnameStart,
+                    int maxEntries, std::vector<KfsFileAttr> &result,
+                    bool &hasMoreEntries, bool computeFilesize);
+
     ///
     /// Do a du on the metaserver side for pathname and return the #
     /// of files/bytes in the directory tree starting at pathname.
@@ -465,6 +561,13 @@ public:
     ///
     int GetDirSummary(const char *pathname, uint64_t &numFiles, uint64_t &numBytes);
 
+    ///
+    /// Get the file system total and used space, as reported by the
+    /// metaserver.
+    /// @retval 0 on success; -errno otherwise
+    ///
+    int GetFsSpace(uint64_t &totalSpace, uint64_t &usedSpace);
+
     ///
     /// Stat a file and get its attributes.
     /// @param[in] pathname	The full pathname such as /.../foo
@@ -525,6 +628,25 @@ public:
     ///
     int Remove(const char *pathname);
 
+    ///
+    /// Batched versions of Stat(), Create(), and Remove(): the paths are
+    /// sent to the metaserver in as few RPCs as possible, and the per
+    /// path results are returned in the same order as the paths.
+    /// MultiStat() does not compute file sizes, the size is -1 if the
+    /// metaserver does not know it. MultiCreate() does not open the
+    /// created files.
+    /// @param[in] pathnames  The full pathnames
+    /// @param[out] result  Per path status: 0 on success; -errno otherwise
+    /// @retval 0 if all the RPCs succeeded; -errno otherwise
+    ///
+    int MultiStat(const std::vector<std::string> &pathnames,
+                  std::vector<KfsFileAttr> &attrs, std::vector<int> &result);
+    int MultiCreate(const std::vector<std::string> &pathnames,
+                    std::vector<int> &result, int numReplicas = 3,
+                    bool exclusive = false);
+    int MultiRemove(const std::vector<std::string> &pathnames,
+                    std::vector<int> &result);
+
     ///
     /// Rename file/dir corresponding to oldpath to newpath
     /// @param[in] oldpath   path corresponding to the old name
@@ -581,6 +703,8 @@ public:
     ///
     int RecordAppend(int fd, const char *buf, int reclen);
     int AtomicRecordAppend(int fd, const char *buf, int reclen);
+    int SetAppendBatching(int maxBatchBytes, int maxDelayMs);
+    void GetAppendStats(KfsClient::AppendStats &stats) const;
 
     /// See the comments in KfsClient.h
     int ReadPrefetch(int fd, char *buf, size_t numBytes);
@@ -609,6 +733,22 @@ public:
     ssize_t Read(int fd, char *buf, size_t numBytes);
     ssize_t Write(int fd, const char *buf, size_t numBytes);
 
+    ///
+    /// Positioned read / write: Seek() followed by Read() / Write(),
+    /// done atomically with respect to other threads using the same fd.
+    /// @param[in] offset   The file offset to do the I/O at.
+    /// @retval same as Read() / Write()
+    ///
+    ssize_t PRead(int fd, off_t offset, char *buf, size_t numBytes);
+    ssize_t PWrite(int fd, off_t offset, const char *buf, size_t numBytes);
+
+    ///
+    /// Positioned vectored read, that does not change the file position,
+    /// and does not hold the client lock while reading from the chunk
+    /// servers.
+    ///
+    ssize_t PReadV(int fd, off_t offset, const struct iovec *iov, int iovcnt);
+
     /// If there are any holes in a file, such as those at the end of
     /// a chunk, skip over them.  
     void SkipHolesInFile(int fd);
@@ -700,8 +840,24 @@ public:
     size_t GetDefaultReadAheadSize() const;
     size_t SetReadAheadSize(int fd, size_t size);
     size_t GetReadAheadSize(int fd) const;
+    int SetDefaultWriteBehind(int maxPendingWrites);
+    int GetDefaultWriteBehind() const;
+    int SetWriteBehind(int fd, int maxPendingWrites);
+    int GetWriteBehind(int fd) const;
+    size_t SetDefaultAdaptiveReadAheadSize(size_t maxSize);
+    size_t GetDefaultAdaptiveReadAheadSize() const;
+    size_t SetAdaptiveReadAheadSize(int fd, size_t maxSize);
+    int GetReadAheadStats(int fd, KfsClient::ReadAheadStats &stats) const;
+    void GetReadAheadStats(KfsClient::ReadAheadStats &stats) const;
     pthread_mutex_t& GetMutex() { return mMutex; }
 
+    void GetChunkLocationCacheStats(
+        KfsClient::ChunkLocationCacheStats &stats) const;
+    void SetChunkLocationCacheSize(size_t maxEntries);
+    void GetChunkServerConnStats(
+        KfsClient::ChunkServerConnStats &stats) const;
+    void SetChunkServerConnPoolSize(int maxIdlePerServer);
+
     /// A read for an offset that is after the specified value will result in EOF
     void SetEOFMark(int fd, off_t offset);
 
@@ -730,6 +886,9 @@ private:
 
     LeaseClerk  mLeaseClerk;
 
+    /// chunk locations of all the files, open or closed
+    ChunkLocationCache mChunkLocationCache;
+
     /// a tcp socket that holds the connection with the server
     TcpSocket	mMetaServerSock;
     /// seq # that we send in each command
@@ -749,12 +908,21 @@ private:
     std::vector<struct in_addr> mSlowNodes;
     size_t mDefaultIoBufferSize;
     size_t mDefaultReadAheadSize;
+    /// max # of writes in flight of files opened for write, 0 -- off
+    int mDefaultWriteBehind;
+    /// max read ahead size of files opened in adaptive mode, 0 -- off
+    size_t mDefaultAdaptiveReadAheadSize;
+    /// read ahead statistics of all files, open and closed
+    PendingChunkRead::Stats mReadAheadStats;
     KfsPendingOp mPendingOp;
 
     Asyncer mAsyncer;
     std::vector<AsyncWriteReq *> mAsyncWrites;
     unsigned int mFileInstance;
     KfsProtocolWorker* mProtocolWorker;
+    /// atomic record append write threshold, and max batch delay
+    int mAppendBatchBytes;
+    int mAppendBatchDelayMs;
     int mMaxNumRetriesPerOp;
 
     /// Check that fd is in range
@@ -874,6 +1042,14 @@ private:
     /// @retval status code: 0 on success; < 0 => failure
     int LocateChunk(int fd, int chunkNum);
 
+    /// The read or lease acquisition failed: remove the current chunk
+    /// location from the cache, and force the location re-lookup.
+    void InvalidateCurrChunkLocation(int fd);
+
+    /// Get the file layout, and put the chunk locations into the cache.
+    /// @retval status code: 0 on success; < 0 => failure
+    int GetLayout(GetLayoutOp &lop);
+
 
     // Helper functions to deal with write and buffering at the client.
 
@@ -915,6 +1091,31 @@ private:
     /// Basically, break a write into smaller writes and pipeline them.
     ssize_t DoLargeWriteToServer(int fd, off_t offset, const char *buf, size_t numBytes);
 
+    /// Break a write into write prepare ops, aligned to checksum blocks.
+    void MakeWritePrepareOps(ChunkAttr *chunk, std::vector<WriteInfo> &writeId,
+                             off_t offset, const char *buf, size_t numBytes,
+                             std::vector<WritePrepareOp *> &ops);
+
+    /// Write behind: send the data and the commits to the chunk master,
+    /// and return without waiting for the commit replies.
+    /// @retval  # of bytes sent, at most the io buffer size; -errno
+    /// if the data could not be sent
+    ssize_t DoWriteBehind(int fd, off_t offset, const char *buf, size_t numBytes);
+
+    /// Receive the commit replies that are already available.
+    void PollWriteBehind(int fd);
+
+    /// Wait for the commit replies of the oldest writes in flight, until
+    /// no more than maxPending writes remain; re-do the failed writes.
+    /// @retval the first write behind failure status, or 0
+    int CompleteWriteBehind(int fd, size_t maxPending = 0);
+
+    /// Re-do the write synchronously.
+    int RedoWriteBehind(int fd, WriteBehindReq &req);
+
+    /// @retval true if writes to the chunk are in flight
+    bool HasWriteBehind(int fd, int32_t chunkNum);
+
     /// Request a chunk allocation with the metaserver if necessary.
     /// The 2nd argument "forces" an allocation with the server.
     int DoAllocation(int fd, bool force = false);
@@ -963,6 +1164,15 @@ private:
     /// submit a new one.
     int DoPipelinedRead(int fd, std::vector<ReadOp *> &ops, TcpSocket *sock);
 
+    /// Helpers for PReadV(): the chunk location, lease, and size look up
+    /// are done with the lock held; the chunk is read without the lock.
+    int PReadLocateChunk(int fd, int32_t chunkNum, ChunkAttr &chunk,
+                         off_t &fileSize, bool &needSize,
+                         kfsSeq_t &seq, int numSeqs);
+    void PReadChunkDone(int fd, int32_t chunkNum, const ChunkAttr &chunk,
+                        bool sizeFlag, int status);
+    int GetReadLease(kfsChunkId_t chunkId, const std::string &pathname);
+
     int DoPipelinedWrite(int fd, std::vector<WritePrepareOp *> &ops, TcpSocket *masterSock);
 
     /// Helpers for pipelined write
@@ -1037,9 +1247,27 @@ private:
                     std::vector<KfsFileAttr> &result, bool computeFilesize = true,
                     bool updateClientCache = true);
 
+    /// Get and parse one READDIRPLUS part: the entries, and the location
+    /// of the last chunk of each file are appended to the vectors.
+    int ReaddirPlusPart(kfsFileId_t dirFid, const std::string &fnameStart,
+                        int maxEntries, std::vector<KfsFileAttr> &result,
+                        std::vector<FileChunkInfo> &fileChunkInfo,
+                        bool &hasMoreEntries);
+
+    /// Set the sizes of the files the metaserver does not know the size
+    /// of: use the file table entry, or get the size of the last chunk.
+    void ComputeFilesizes(kfsFileId_t dirFid, vector<KfsFileAttr> &fattrs,
+                          vector<FileChunkInfo> &lastChunkInfo);
+
     int Rmdirs(const std::string &parentDir, kfsFileId_t parentFid, const std::string &dirname, kfsFileId_t dirFid);
     int Remove(const std::string &parentDir, kfsFileId_t parentFid, const std::string &entryName);
 
+    /// Run the batched op on the pathnames, and return the response
+    /// line for each path.
+    int DoMultiPathOp(KfsOp_t cmd, const std::vector<std::string> &pathnames,
+                      std::vector<std::string> &lines, int numReplicas = 1,
+                      bool exclusive = false);
+
     int AtomicRecordAppend(int fd, const char *buf, int reclen, MutexLock& lock);
 
     friend class PendingChunkRead;
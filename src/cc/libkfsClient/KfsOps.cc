@@ -33,6 +33,7 @@ extern "C" {
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <string.h>
+#include <stdlib.h>
 }
 #include "libkfsIO/Checksum.h"
 #include "Utils.h"
@@ -115,7 +116,14 @@ ReaddirOp::Request(ostream &os)
     os << "Cseq: " << seq << "\r\n";
     os << "Version: " << KFS_VERSION_STR << "\r\n";
     os << "Client-Protocol-Version: " << KFS_CLIENT_PROTO_VERS << "\r\n";
-    os << "Directory File-handle: " << fid << "\r\n\r\n";
+    os << "Directory File-handle: " << fid << "\r\n";
+    if (maxEntries > 0) {
+        os << "Max-entries: " << maxEntries << "\r\n";
+        if (! fnameStart.empty()) {
+            os << "Start-after: " << fnameStart << "\r\n";
+        }
+    }
+    os << "\r\n";
 }
 
 void
@@ -164,7 +172,46 @@ ReaddirPlusOp::Request(ostream &os)
     os << "Cseq: " << seq << "\r\n";
     os << "Client-Protocol-Version: " << KFS_CLIENT_PROTO_VERS << "\r\n";
     os << "Version: " << KFS_VERSION_STR << "\r\n";
-    os << "Directory File-handle: " << fid << "\r\n\r\n";
+    os << "Directory File-handle: " << fid << "\r\n";
+    if (maxEntries > 0) {
+        os << "Max-entries: " << maxEntries << "\r\n";
+        if (! fnameStart.empty()) {
+            os << "Start-after: " << fnameStart << "\r\n";
+        }
+    }
+    os << "\r\n";
+}
+
+void
+PingOp::Request(ostream &os)
+{
+    os << "PING" << "\r\n";
+    os << "Cseq: " << seq << "\r\n";
+    os << "Client-Protocol-Version: " << KFS_CLIENT_PROTO_VERS << "\r\n";
+    os << "Version: " << KFS_VERSION_STR << "\r\n";
+    os << "System-info-only: 1\r\n\r\n";
+}
+
+void
+MultiPathOp::Request(ostream &os)
+{
+    string body;
+    for (size_t i = 0; i < paths.size(); i++) {
+        body += paths[i];
+        body += "\n";
+    }
+    os << Name() << "\r\n";
+    os << "Cseq: " << seq << "\r\n";
+    os << "Version: " << KFS_VERSION_STR << "\r\n";
+    os << "Client-Protocol-Version: " << KFS_CLIENT_PROTO_VERS << "\r\n";
+    if (op == CMD_MULTI_CREATE) {
+        os << "Num-replicas: " << numReplicas << "\r\n";
+        os << "Exclusive: " << (exclusive ? 1 : 0) << "\r\n";
+    }
+    os << "Count: " << paths.size() << "\r\n";
+    // The body is sent along with the header.
+    os << "Content-length: " << body.size() << "\r\n\r\n";
+    os << body;
 }
 
 void
@@ -211,6 +258,33 @@ LookupPathOp::Request(ostream &os)
     os << "Pathname: " << filename << "\r\n\r\n";
 }
 
+// Our ip, sent to the metaserver with the allocation, and the chunk location
+// requests to order the replicas by proximity.
+static const char*
+GetClientIp()
+{
+    static const int MAXHOSTNAMELEN = 256;
+    static char myIpBuf[INET_ADDRSTRLEN];
+    static char *myIp = NULL;
+
+    if (! myIp) {
+        char hostname[MAXHOSTNAMELEN];
+        gethostname(hostname, MAXHOSTNAMELEN);
+        // Convert to IP: chunkserver location is tracked using IP not hostname;
+        // Providing IP helps metaserver to do locality
+        struct hostent *hent = gethostbyname(hostname);
+        if (hent) {
+            in_addr ipaddr;
+            memcpy(&ipaddr, hent->h_addr, hent->h_length);
+            // inet_ntoa() buffer is reused by the subsequent calls.
+            if (inet_ntop(AF_INET, &ipaddr, myIpBuf, sizeof(myIpBuf))) {
+                myIp = myIpBuf;
+            }
+        }
+    }
+    return myIp;
+}
+
 void
 GetAllocOp::Request(ostream &os)
 {
@@ -220,6 +294,9 @@ GetAllocOp::Request(ostream &os)
     os << "Cseq: " << seq << "\r\n";
     os << "Version: " << KFS_VERSION_STR << "\r\n";
     os << "Client-Protocol-Version: " << KFS_CLIENT_PROTO_VERS << "\r\n";
+    const char* const myIp = GetClientIp();
+    if (myIp)
+        os << "Client-host: " << myIp << "\r\n";
     os << "Pathname: " << filename << "\r\n";
     os << "File-handle: " << fid << "\r\n";
     os << "Chunk-offset: " << fileOffset << "\r\n\r\n";
@@ -232,6 +309,9 @@ GetLayoutOp::Request(ostream &os)
     os << "Cseq: " << seq << "\r\n";
     os << "Version: " << KFS_VERSION_STR << "\r\n";
     os << "Client-Protocol-Version: " << KFS_CLIENT_PROTO_VERS << "\r\n";
+    const char* const myIp = GetClientIp();
+    if (myIp)
+        os << "Client-host: " << myIp << "\r\n";
     os << "File-handle: " << fid << "\r\n\r\n";
 }
 
@@ -259,21 +339,7 @@ GetChunkMetadataOp::Request(ostream &os)
 void
 AllocateOp::Request(ostream &os)
 {
-    static const int MAXHOSTNAMELEN = 256;
-    static char *myIp = NULL;
-
-    if (! myIp) {
-        char hostname[MAXHOSTNAMELEN];
-        gethostname(hostname, MAXHOSTNAMELEN);
-        // Convert to IP: chunkserver location is tracked using IP not hostname;
-        // Providing IP helps metaserver to do locality
-        struct hostent *hent = gethostbyname(hostname);
-        if (hent) {
-            in_addr ipaddr;
-            memcpy(&ipaddr, hent->h_addr, hent->h_length);
-            myIp = inet_ntoa(ipaddr);
-        }
-    }
+    const char* const myIp = GetClientIp();
 
     os << "ALLOCATE\r\n";
     os << "Cseq: " << seq << "\r\n";
@@ -553,6 +619,12 @@ RecordAppendOp::Request(ostream &os)
     os << "Checksum: " << checksum << "\r\n";
     os << "Offset: " << offset << "\r\n";
     os << "File-offset: -1\r\n";
+    if (recordCount > 0) {
+        os << "Record-count: " << recordCount << "\r\n";
+    }
+    if (! recordLengths.empty()) {
+        os << "Record-lengths: " << recordLengths << "\r\n";
+    }
     os << "Num-servers: " << writeInfo.size() << "\r\n";
     os << "Servers:";
     for (vector<WriteInfo>::size_type i = 0; i < writeInfo.size(); ++i) {
@@ -662,6 +734,7 @@ void
 ReaddirOp::ParseResponseHeaderSelf(const Properties &prop)
 {
     numEntries = prop.getValue("Num-Entries", 0);
+    hasMoreEntries = prop.getValue("Has-more-entries", 0) != 0;
 }
 
 void
@@ -686,10 +759,33 @@ UpServersOp::ParseResponseHeaderSelf(const Properties &prop)
 {
 }
 
+void
+PingOp::ParseResponseHeaderSelf(const Properties &prop)
+{
+    // System Info: Up since= ...<tab>Total space= N<tab>Used space= M
+    const string info = prop.getValue("System Info", "");
+    const char* const kTotal = "Total space=";
+    const char* const kUsed  = "Used space=";
+    string::size_type pos;
+    if ((pos = info.find(kTotal)) != string::npos) {
+        totalSpace = strtoull(info.c_str() + pos + strlen(kTotal), 0, 10);
+    }
+    if ((pos = info.find(kUsed)) != string::npos) {
+        usedSpace = strtoull(info.c_str() + pos + strlen(kUsed), 0, 10);
+    }
+}
+
+void
+MultiPathOp::ParseResponseHeaderSelf(const Properties &prop)
+{
+    numResults = prop.getValue("Count", 0);
+}
+
 void
 ReaddirPlusOp::ParseResponseHeaderSelf(const Properties &prop)
 {
     numEntries = prop.getValue("Num-Entries", 0);
+    hasMoreEntries = prop.getValue("Has-more-entries", 0) != 0;
 }
 
 void
@@ -67,6 +67,10 @@ enum KfsOp_t {
     CMD_CHANGE_FILE_REPLICATION,
     CMD_DUMP_CHUNKTOSERVERMAP,
     CMD_UPSERVERS,
+    CMD_PING,
+    CMD_MULTI_STAT,
+    CMD_MULTI_CREATE,
+    CMD_MULTI_REMOVE,
     // Chunkserver RPCs
     CMD_OPEN,
     CMD_CLOSE,
@@ -89,10 +93,11 @@ struct KfsOp {
     size_t    contentBufLen;
     char      *contentBuf;
     std::string statusMsg; // optional, mostly for debugging
+    int64_t   sendTime; // usec, set by DoOpSend() for latency histograms
 
     KfsOp (KfsOp_t o, kfsSeq_t s) :
         op(o), seq(s), status(0), checksum(0), contentLength(0),
-        contentBufLen(0), contentBuf(NULL), statusMsg()
+        contentBufLen(0), contentBuf(NULL), statusMsg(), sendTime(0)
     {
 
     }
@@ -248,8 +253,15 @@ struct RenameOp : public KfsOp {
 struct ReaddirOp : public KfsOp {
     kfsFileId_t fid; // fid of the directory
     int numEntries; // # of entries in the directory
-    ReaddirOp(kfsSeq_t s, kfsFileId_t f):
-        KfsOp(CMD_READDIR, s), fid(f), numEntries(0)
+    // Optional listing range: resume after fnameStart, and return at most
+    // maxEntries; the server sets hasMoreEntries if the listing continues.
+    std::string fnameStart;
+    int maxEntries;
+    bool hasMoreEntries;
+    ReaddirOp(kfsSeq_t s, kfsFileId_t f,
+            const std::string &start = std::string(), int maxe = 0):
+        KfsOp(CMD_READDIR, s), fid(f), numEntries(0),
+        fnameStart(start), maxEntries(maxe), hasMoreEntries(false)
     {
 
     }
@@ -308,6 +320,48 @@ struct UpServersOp : public KfsOp {
     }
 };
 
+// Get the file system space totals; the chunk server lists are omitted.
+struct PingOp : public KfsOp {
+    uint64_t totalSpace; // output
+    uint64_t usedSpace; // output
+    PingOp(kfsSeq_t s):
+        KfsOp(CMD_PING, s), totalSpace(0), usedSpace(0)
+    {
+    }
+    void Request(std::ostream &os);
+    virtual void ParseResponseHeaderSelf(const Properties& prop);
+    std::string Show() const {
+        std::ostringstream os;
+        os << "ping";
+        return os.str();
+    }
+};
+
+// Batched stat, create, or remove: the paths are sent in the request body,
+// one per line; the response body has one result line per path, in the
+// same order, with the status first.
+struct MultiPathOp : public KfsOp {
+    std::vector<std::string> paths;
+    int16_t numReplicas; // create only
+    bool exclusive; // create only
+    int numResults; // output
+    MultiPathOp(KfsOp_t o, kfsSeq_t s, int16_t r = 1, bool e = false):
+        KfsOp(o, s), paths(), numReplicas(r), exclusive(e), numResults(0)
+    {
+    }
+    void Request(std::ostream &os);
+    virtual void ParseResponseHeaderSelf(const Properties& prop);
+    const char* Name() const {
+        return (op == CMD_MULTI_STAT ? "MULTI_STAT" :
+            (op == CMD_MULTI_CREATE ? "MULTI_CREATE" : "MULTI_REMOVE"));
+    }
+    std::string Show() const {
+        std::ostringstream os;
+        os << Name() << ": count = " << paths.size();
+        return os.str();
+    }
+};
+
 struct DumpChunkMapOp : public KfsOp {
 	DumpChunkMapOp(kfsSeq_t s):
 		KfsOp(CMD_DUMP_CHUNKMAP, s)
@@ -325,8 +379,15 @@ struct DumpChunkMapOp : public KfsOp {
 struct ReaddirPlusOp : public KfsOp {
     kfsFileId_t fid; // fid of the directory
     int numEntries; // # of entries in the directory
-    ReaddirPlusOp(kfsSeq_t s, kfsFileId_t f):
-        KfsOp(CMD_READDIRPLUS, s), fid(f), numEntries(0)
+    // Optional listing range: resume after fnameStart, and return at most
+    // maxEntries; the server sets hasMoreEntries if the listing continues.
+    std::string fnameStart;
+    int maxEntries;
+    bool hasMoreEntries;
+    ReaddirPlusOp(kfsSeq_t s, kfsFileId_t f,
+            const std::string &start = std::string(), int maxe = 0):
+        KfsOp(CMD_READDIRPLUS, s), fid(f), numEntries(0),
+        fnameStart(start), maxEntries(maxe), hasMoreEntries(false)
     {
 
     }
@@ -863,8 +924,11 @@ struct RecordAppendOp : public KfsOp {
     int64_t      chunkVersion; /* input */
     off_t	 offset; /* input: this client's view of where it is writing in the file */
     std::vector<WriteInfo> writeInfo; /* input */
+    int          recordCount; /* input: # of records in the append */
+    std::string  recordLengths; /* input: space separated record lengths */
     RecordAppendOp(kfsSeq_t s, kfsChunkId_t c, int64_t v, off_t o, std::vector<WriteInfo> &w) :
-        KfsOp(CMD_RECORD_APPEND, s), chunkId(c), chunkVersion(v), offset(o), writeInfo(w)
+        KfsOp(CMD_RECORD_APPEND, s), chunkId(c), chunkVersion(v), offset(o), writeInfo(w),
+        recordCount(0), recordLengths()
     {
 
     }
@@ -874,6 +938,7 @@ struct RecordAppendOp : public KfsOp {
 
         os << "record-append: chunkid=" << chunkId << " version=" << chunkVersion;
         os << " num-bytes: " << contentLength;
+        os << " records: " << recordCount;
         return os.str();
     }
 };
@@ -83,7 +83,8 @@ public:
         int         inIdleTimeoutSec              ,
         const char* inLogPrefixPtr                ,
         int64_t     inChunkServerInitialSeqNum    ,
-        bool        inPreAllocateFlag             )
+        bool        inPreAllocateFlag             ,
+        int         inMaxBatchDelayMs             )
         : QCRunnable(),
           ITimeout(),
           mNetManager(),
@@ -108,6 +109,11 @@ public:
           mIdleTimeoutSec(inIdleTimeoutSec),
           mLogPrefixPtr(inLogPrefixPtr ? inLogPrefixPtr : "PW"),
           mPreAllocateFlag(inPreAllocateFlag),
+          mMaxBatchDelayMs(inMaxBatchDelayMs),
+          mNewWriteThreshold(inWriteThreshold),
+          mNewMaxBatchDelayMs(inMaxBatchDelayMs),
+          mBatchingChangedFlag(false),
+          mStats(),
           mChunkServerInitialSeqNum(
             inChunkServerInitialSeqNum > 0 ? inChunkServerInitialSeqNum :
                 GetInitalSeqNum(0x19885a10)),
@@ -124,6 +130,7 @@ public:
         { Impl::Stop(); }
     virtual void Run()
     {
+        SetPollTimeout();
         mNetManager.RegisterTimeoutHandler(this);
         mNetManager.MainLoop();
         mNetManager.UnRegisterTimeoutHandler(this);
@@ -162,10 +169,26 @@ public:
     virtual void Timeout()
     {
         Request* theWorkQueue[1];
+        bool     theBatchingChangedFlag;
         {
             QCStMutexLocker theLock(mMutex);
             theWorkQueue[0] = mWorkQueue[0];
             WorkQueue::Init(mWorkQueue);
+            theBatchingChangedFlag = mBatchingChangedFlag;
+            mBatchingChangedFlag   = false;
+            mWriteThreshold        = mNewWriteThreshold;
+            mMaxBatchDelayMs       = mNewMaxBatchDelayMs;
+        }
+        if (theBatchingChangedFlag) {
+            SetPollTimeout();
+            for (Appenders::iterator theIt = mAppenders.begin();
+                    theIt != mAppenders.end();
+                    ++theIt) {
+                if (theIt->second) {
+                    theIt->second->SetBatching(
+                        mWriteThreshold, mMaxBatchDelayMs);
+                }
+            }
         }
         bool theShutdownFlag = false;
         Request* theReqPtr;
@@ -277,9 +300,31 @@ public:
             QCRTASSERT(inRequest.mState != Request::kStateInFlight);
             inRequest.mState = Request::kStateInFlight;
             WorkQueue::PushBack(mWorkQueue, inRequest);
+            if (IsAppend(inRequest) && inRequest.mSize > 0) {
+                mStats.mRecordCount++;
+            }
+        }
+        mNetManager.Wakeup();
+    }
+    void SetBatching(
+        int inWriteThreshold,
+        int inMaxBatchDelayMs)
+    {
+        {
+            QCStMutexLocker theLock(mMutex);
+            mNewWriteThreshold   = std::max(0,
+                std::min(mPreferredAppendSize, inWriteThreshold));
+            mNewMaxBatchDelayMs  = std::max(-1, inMaxBatchDelayMs);
+            mBatchingChangedFlag = true;
         }
         mNetManager.Wakeup();
     }
+    void GetStats(
+        Stats& outStats)
+    {
+        QCStMutexLocker theLock(mMutex);
+        outStats = mStats;
+    }
     static bool IsAppend(
         const Request& inRequest)
     {
@@ -520,10 +565,12 @@ private:
                 inOwner.mIdleTimeoutSec,
                 inLogPrefixPtr,
                 inOwner.mChunkServerInitialSeqNum,
-                inOwner.mPreAllocateFlag
+                inOwner.mPreAllocateFlag,
+                inOwner.mMaxBatchDelayMs
               ),
               mOwner(inOwner),
               mWriteThreshold(inOwner.mWriteThreshold),
+              mLastStats(),
               mPending(0),
               mCurPos(0),
               mDonePos(0),
@@ -536,6 +583,7 @@ private:
         }
         ~Appender()
         {
+            UpdateStats();
             Appender::Shutdown();
             QCRTASSERT(WorkQueue::IsEmpty(mWorkQueue));
             CleanupList::Remove(mOwner.mCleanupList, *this);
@@ -554,8 +602,19 @@ private:
             QCRTASSERT(&inAppender == &mWAppender && theRem <= mPending);
             const int theDone = mPending - theRem;
             mPending = theRem;
+            UpdateStats();
             Done(theDone, inStatusCode);
         }
+        void SetBatching(
+            int inWriteThreshold,
+            int inMaxBatchDelayMs)
+        {
+            mWriteThreshold = inWriteThreshold;
+            if (! mLastSyncReqPtr) {
+                mWAppender.SetWriteThreshold(mWriteThreshold);
+            }
+            mWAppender.SetMaxBatchDelay(inMaxBatchDelayMs);
+        }
         void Process(
             Request& inRequest)
         {
@@ -706,6 +765,23 @@ private:
                 mWAppender.SetWriteThreshold(mWriteThreshold);
             }
         }
+        void UpdateStats()
+        {
+            WriteAppender::Stats theStats;
+            KfsNetClient::Stats  theChunkServersStats;
+            mWAppender.GetStats(theStats, theChunkServersStats);
+            QCStMutexLocker theLock(mOwner.mMutex);
+            Stats& theTotals = mOwner.mStats;
+            theTotals.mAppendRecordCount +=
+                theStats.mAppendRecordCount - mLastStats.mAppendRecordCount;
+            theTotals.mAppendCount       +=
+                theStats.mAppendCount       - mLastStats.mAppendCount;
+            theTotals.mAppendByteCount   +=
+                theStats.mAppendByteCount   - mLastStats.mAppendByteCount;
+            theTotals.mBatchTimeoutCount +=
+                theStats.mBatchTimeoutCount - mLastStats.mBatchTimeoutCount;
+            mLastStats = theStats;
+        }
         void Shutdown()
         {
             mWAppender.Shutdown();
@@ -715,9 +791,10 @@ private:
             Done(thePending, kErrShutdown);
         }
     private:
-        WriteAppender       mWAppender;
-        Owner&              mOwner;
-        int                 mWriteThreshold;
+        WriteAppender        mWAppender;
+        Owner&               mOwner;
+        int                  mWriteThreshold;
+        WriteAppender::Stats mLastStats;
         int                 mPending;
         int64_t             mCurPos;
         int64_t             mDonePos;
@@ -735,7 +812,7 @@ private:
     MetaServer        mMetaServer;
     Appenders         mAppenders;
     const int         mMaxRetryCount;
-    const int         mWriteThreshold;
+    int               mWriteThreshold;
     const int         mTimeSecBetweenRetries;
     const int         mDefaultSpaceReservationSize;
     const int         mPreferredAppendSize;
@@ -743,6 +820,11 @@ private:
     const int         mIdleTimeoutSec;
     const char* const mLogPrefixPtr;
     const bool        mPreAllocateFlag;
+    int               mMaxBatchDelayMs;
+    int               mNewWriteThreshold;
+    int               mNewMaxBatchDelayMs;
+    bool              mBatchingChangedFlag;
+    Stats             mStats;
     int64_t           mChunkServerInitialSeqNum;
     DoNotDeallocate   mDoNotDeallocate;
     StopRequest       mStopRequest;
@@ -767,6 +849,15 @@ private:
     void Done(
         Request& inRequest)
         { Done(inRequest, inRequest.mStatus); }
+    void SetPollTimeout()
+    {
+        // The appenders' batch timers run on every poll loop iteration.
+        const int kDefaultPollTimeoutMs = 1000;
+        mNetManager.SetPollTimeoutMs(mMaxBatchDelayMs > 0 ?
+            std::min(kDefaultPollTimeoutMs, std::max(1, mMaxBatchDelayMs / 2)) :
+            kDefaultPollTimeoutMs
+        );
+    }
     bool NewAppender(
         Request&             inRequest,
         Appenders::iterator& inAppendersIt)
@@ -919,7 +1010,8 @@ KfsProtocolWorker::KfsProtocolWorker(
         int         inIdleTimeoutSec              /* = 5 * 30 */,
         const char* inLogPrefixPtr                /* = 0 */,
         int64_t     inChunkServerInitialSeqNum    /* = 0 */,
-        bool        inPreAllocateFlag             /* = false */)
+        bool        inPreAllocateFlag             /* = false */,
+        int         inMaxBatchDelayMs             /* = -1 */)
     : mImpl(*(new Impl(
         inMetaHost                    ,
         inMetaPort                    ,
@@ -938,7 +1030,8 @@ KfsProtocolWorker::KfsProtocolWorker(
         inIdleTimeoutSec              ,
         inLogPrefixPtr                ,
         inChunkServerInitialSeqNum    ,
-        inPreAllocateFlag
+        inPreAllocateFlag             ,
+        inMaxBatchDelayMs
     )))
 {
 }
@@ -981,4 +1074,19 @@ KfsProtocolWorker::Enqueue(
     mImpl.Enqueue(inRequest);
 }
 
+    void
+KfsProtocolWorker::SetBatching(
+    int inWriteThreshold,
+    int inMaxBatchDelayMs)
+{
+    mImpl.SetBatching(inWriteThreshold, inMaxBatchDelayMs);
+}
+
+    void
+KfsProtocolWorker::GetStats(
+    KfsProtocolWorker::Stats& outStats) const
+{
+    mImpl.GetStats(outStats);
+}
+
 } /* namespace KFS */
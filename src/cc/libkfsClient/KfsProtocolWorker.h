@@ -58,6 +58,21 @@ public:
     };
     typedef kfsFileId_t  FileId;
     typedef unsigned int FileInstance;
+    struct Stats
+    {
+        Stats()
+            : mRecordCount(0),
+              mAppendRecordCount(0),
+              mAppendCount(0),
+              mAppendByteCount(0),
+              mBatchTimeoutCount(0)
+            {}
+        int64_t mRecordCount;       // records submitted
+        int64_t mAppendRecordCount; // records committed by chunk servers
+        int64_t mAppendCount;       // record append ops committed
+        int64_t mAppendByteCount;
+        int64_t mBatchTimeoutCount; // appends issued by the max batch delay
+    };
     class Request
     {
     public:
@@ -126,7 +141,8 @@ public:
         int         inIdleTimeoutSec              = 5 * 30,
         const char* inLogPrefixPtr                = 0,
         int64_t     inChunkServerInitialSeqNum    = 0,
-        bool        inPreAllocateFlag             = false);
+        bool        inPreAllocateFlag             = false,
+        int         inMaxBatchDelayMs             = -1);
     ~KfsProtocolWorker();
     int Execute(
         RequestType  inRequestType,
@@ -140,6 +156,13 @@ public:
         Request& inRequest);
     void Start();
     void Stop();
+    // Set the write threshold, and the max batch delay of all appenders.
+    // See WriteAppender::SetMaxBatchDelay().
+    void SetBatching(
+        int inWriteThreshold,
+        int inMaxBatchDelayMs);
+    void GetStats(
+        Stats& outStats) const;
 private:
     Impl& mImpl;
 private:
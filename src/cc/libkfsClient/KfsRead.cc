@@ -32,10 +32,13 @@
 #include "Utils.h"
 
 #include <cerrno>
+#include <cstring>
 #include <iostream>
 #include <string>
 
 using std::string;
+using std::vector;
+using std::map;
 using std::ostringstream;
 using std::istringstream;
 using std::min;
@@ -83,6 +86,299 @@ IsChunkBufferDataValid(
         pos->chunkOffset < (off_t)(cb->start + cb->length));
 }
 
+ssize_t
+KfsClientImpl::PRead(int fd, off_t offset, char *buf, size_t numBytes)
+{
+    MutexLock l(&mMutex);
+
+    const off_t res = Seek(fd, offset, SEEK_SET);
+    if (res < 0)
+        return res;
+    return Read(fd, buf, numBytes);
+}
+
+namespace {
+///
+/// Position in the PReadV() io vector.
+///
+class IoVecCursor
+{
+public:
+    IoVecCursor(const struct iovec *iov, int iovcnt)
+        : mIov(iov),
+          mEnd(iov + iovcnt),
+          mOffset(0)
+        { Skip(); }
+    /// @retval the current buffer position; len is set to the # of bytes
+    /// in the current buffer
+    char *Get(size_t &len) const {
+        len = mIov->iov_len - mOffset;
+        return (static_cast<char *>(mIov->iov_base) + mOffset);
+    }
+    void Advance(size_t len) {
+        while (len > 0) {
+            const size_t n = min(len, mIov->iov_len - mOffset);
+            mOffset += n;
+            len     -= n;
+            Skip();
+        }
+    }
+    void Zero(size_t len) {
+        while (len > 0) {
+            size_t n;
+            char * const p = Get(n);
+            n = min(n, len);
+            memset(p, 0, n);
+            Advance(n);
+            len -= n;
+        }
+    }
+private:
+    const struct iovec *mIov;
+    const struct iovec *mEnd;
+    size_t              mOffset;
+
+    void Skip() {
+        while (mIov != mEnd && mOffset >= mIov->iov_len) {
+            ++mIov;
+            mOffset = 0;
+        }
+    }
+};
+}
+
+///
+/// Split the read of numBytes at chunkOffset into read ops, so that each
+/// op reads into one io vector buffer, and the reads that do not start on
+/// a checksum block boundary do not straddle checksum blocks.
+///
+static void
+MakePReadOps(const ChunkAttr &chunk, off_t chunkOffset, size_t numBytes,
+             IoVecCursor cursor, kfsSeq_t seq, vector<ReadOp *> &ops)
+{
+    size_t numRead = 0;
+    while (numRead < numBytes) {
+        ReadOp * const op = new ReadOp(seq++, chunk.chunkId, chunk.chunkVersion);
+        size_t len;
+        char * const buf = cursor.Get(len);
+        op->offset   = chunkOffset + numRead;
+        op->numBytes = min(MAX_BYTES_PER_READ_IO, min(len, numBytes - numRead));
+        if (OffsetToChecksumBlockStart(op->offset) != op->offset) {
+            op->numBytes = min(op->numBytes,
+                (size_t) (OffsetToChecksumBlockEnd(op->offset) - op->offset));
+        }
+        op->AttachContentBuf(buf, op->numBytes);
+        cursor.Advance(op->numBytes);
+        numRead += op->numBytes;
+        ops.push_back(op);
+    }
+}
+
+ssize_t
+KfsClientImpl::PReadV(int fd, off_t offset, const struct iovec *iov, int iovcnt)
+{
+    if (offset < 0 || iovcnt < 0 || (iovcnt > 0 && ! iov))
+        return -EINVAL;
+
+    size_t numBytes = 0;
+    for (int i = 0; i < iovcnt; i++)
+        numBytes += iov[i].iov_len;
+
+    IoVecCursor cursor(iov, iovcnt);
+    size_t      nread      = 0;
+    ssize_t     res        = 0;
+    int         retryCount = 0;
+
+    while (nread < numBytes) {
+        const off_t   fileOffset  = offset + nread;
+        const int32_t chunkNum    = fileOffset / KFS::CHUNKSIZE;
+        const off_t   chunkOffset = fileOffset % KFS::CHUNKSIZE;
+        const size_t  maxLen      = min(numBytes - nread,
+            (size_t) (KFS::CHUNKSIZE - chunkOffset));
+        // One size op, and the upper bound on the # of read ops.
+        const int     numSeqs     = 1 + 2 + 2 * iovcnt +
+            (int) (maxLen / MAX_BYTES_PER_READ_IO);
+        ChunkAttr     chunk;
+        off_t         fileSize    = 0;
+        bool          needSize    = false;
+        kfsSeq_t      seq         = 0;
+
+        res = PReadLocateChunk(fd, chunkNum, chunk, fileSize, needSize,
+            seq, numSeqs);
+        if (res < 0) {
+            if ((res == -EBUSY || res == -EAGAIN || res == -EHOSTUNREACH) &&
+                    ++retryCount < mMaxNumRetriesPerOp) {
+                Sleep(RETRY_DELAY_SECS);
+                continue;
+            }
+            break;
+        }
+        if (fileOffset >= fileSize)
+            break;
+
+        const size_t len = min(maxLen, (size_t) (fileSize - fileOffset));
+        const size_t numServers = chunk.chunkServerLoc.size();
+        // Keep the metaserver order: same host, same rack, then the other
+        // replicas. The next replica is tried only if the read fails.
+        res = -EHOSTUNREACH;
+        for (size_t i = 0; i < numServers; i++) {
+            const ServerLocation &loc = chunk.chunkServerLoc[i];
+            ChunkServerConn conn(loc);
+            conn.Connect();
+            if (! conn.sock->IsGood()) {
+                res = -EHOSTUNREACH;
+                continue;
+            }
+            off_t chunkSize = chunk.chunkSize;
+            if (needSize) {
+                SizeOp op(seq, chunk.chunkId, chunk.chunkVersion);
+                op.size = 0;
+                (void)DoOpCommon(&op, conn.sock.get());
+                if (op.status < 0) {
+                    res = op.status;
+                    if (NeedToChangeReplica(res))
+                        continue;
+                    break;
+                }
+                chunkSize = op.size;
+            }
+            // The data past the end of the chunk, but not past the end
+            // of file, reads as zeros.
+            const size_t numAvail = chunkOffset < chunkSize ?
+                min(len, (size_t) (chunkSize - chunkOffset)) : 0;
+            vector<ReadOp *> ops;
+            MakePReadOps(chunk, chunkOffset, numAvail, cursor, seq + 1, ops);
+            res = (! ops.empty() &&
+                    DoPipelinedRead(fd, ops, conn.sock.get()) < 0) ?
+                -EHOSTUNREACH : 0;
+            size_t numIO = 0;
+            for (size_t k = 0; k < ops.size(); k++) {
+                if (ops[k]->status < 0) {
+                    if (res >= 0)
+                        res = ops[k]->status;
+                } else if (res >= 0 && (off_t) numIO == ops[k]->offset - chunkOffset) {
+                    numIO += min((size_t) ops[k]->status, ops[k]->numBytes);
+                }
+                ops[k]->ReleaseContentBuf();
+                delete ops[k];
+            }
+            if (res >= 0) {
+                cursor.Advance(numIO);
+                cursor.Zero(len - numIO);
+                chunk.chunkSize = chunkSize;
+                res = len;
+                break;
+            }
+            KFS_LOG_STREAM_INFO <<
+                "PReadV: " << loc.ToString() <<
+                " chunk: "  << chunk.chunkId <<
+                " offset: " << chunkOffset <<
+                " error: "  << res <<
+            KFS_LOG_EOM;
+            if (! NeedToRetryRead(res))
+                break;
+        }
+        PReadChunkDone(fd, chunkNum, chunk, needSize, (int) res);
+        if (res < 0) {
+            if (NeedToRetryRead(res) && ++retryCount < mMaxNumRetriesPerOp) {
+                Sleep(RETRY_DELAY_SECS);
+                continue;
+            }
+            break;
+        }
+        nread += res;
+    }
+    if (nread == 0 && res < 0)
+        return res;
+    return nread;
+}
+
+int
+KfsClientImpl::PReadLocateChunk(int fd, int32_t chunkNum, ChunkAttr &chunk,
+                                off_t &fileSize, bool &needSize,
+                                kfsSeq_t &seq, int numSeqs)
+{
+    MutexLock l(&mMutex);
+
+    if (! valid_fd(fd) || mFileTable[fd]->openMode == O_WRONLY)
+        return -EBADF;
+    FileTableEntry &entry = *mFileTable[fd];
+    if (entry.fattr.isDirectory)
+        return -EISDIR;
+
+    // Make the written data visible to the chunk server reads.
+    if (entry.buffer.dirty)
+        FlushBuffer(fd);
+    if (! entry.writeBehindReqs.empty())
+        CompleteWriteBehind(fd);
+
+    fileSize = entry.fattr.fileSize;
+    if (entry.eofMark != -1)
+        fileSize = min(fileSize, entry.eofMark);
+    if ((off_t) chunkNum * (off_t) KFS::CHUNKSIZE >= fileSize)
+        return 0;
+
+    int res = LocateChunk(fd, chunkNum);
+    if (res < 0)
+        return res;
+    chunk = entry.cattr[chunkNum];
+    if (chunk.chunkId < 0 || chunk.chunkServerLoc.empty())
+        return -EAGAIN;
+
+    // As with GetLease(): re-compute the chunk size with the new lease.
+    needSize = chunk.chunkSize <= 0;
+    if (! mLeaseClerk.IsLeaseValid(chunk.chunkId)) {
+        if ((res = GetReadLease(chunk.chunkId, entry.pathname)) < 0)
+            return res;
+        needSize = true;
+    } else if (mLeaseClerk.ShouldRenewLease(chunk.chunkId)) {
+        RenewLease(chunk.chunkId, entry.pathname);
+    }
+
+    seq = mCmdSeqNum;
+    mCmdSeqNum += numSeqs;
+    return 0;
+}
+
+void
+KfsClientImpl::PReadChunkDone(int fd, int32_t chunkNum, const ChunkAttr &chunk,
+                              bool sizeFlag, int status)
+{
+    MutexLock l(&mMutex);
+
+    if (! valid_fd(fd))
+        return;
+    FileTableEntry &entry = *mFileTable[fd];
+    map<int, ChunkAttr>::iterator const it = entry.cattr.find(chunkNum);
+    if (it == entry.cattr.end() ||
+            it->second.chunkId != chunk.chunkId ||
+            it->second.chunkVersion != chunk.chunkVersion)
+        return;
+    if (status >= 0) {
+        if (sizeFlag && it->second.chunkSize < chunk.chunkSize)
+            it->second.chunkSize = chunk.chunkSize;
+        return;
+    }
+    if (! NeedToRetryRead(status) || chunkNum == entry.currPos.chunkNum)
+        return;
+    // The location might be stale, look it up again on retry. The current
+    // position chunk is left alone: the sequential reader has its own
+    // connection, and retry logic.
+    mChunkLocationCache.Invalidate(entry.fattr.fileId,
+        (off_t) chunkNum * KFS::CHUNKSIZE, chunk.chunkVersion);
+    entry.cattr.erase(it);
+}
+
+int
+KfsClientImpl::GetReadLease(kfsChunkId_t chunkId, const string &pathname)
+{
+    LeaseAcquireOp op(nextSeq(), chunkId, pathname.c_str());
+    (void)DoMetaOpWithRetry(&op);
+    if (op.status == 0)
+        mLeaseClerk.RegisterLease(op.chunkId, op.leaseId);
+    return op.status;
+}
+
 int
 KfsClientImpl::ReadPrefetch(int fd, char *buf, size_t numBytes)
 {
@@ -188,6 +484,9 @@ KfsClientImpl::Read(int fd, char *buf, size_t numBytes)
     ChunkBuffer *cb = FdBuffer(fd);
     if (cb->dirty)
 	FlushBuffer(fd);
+    // and make the written data visible to the chunk server reads
+    if (! FdInfo(fd)->writeBehindReqs.empty())
+        CompleteWriteBehind(fd);
 
     cb->allocate();
 
@@ -343,6 +642,11 @@ KfsClientImpl::IsChunkLeaseGood(int fd, kfsChunkId_t chunkId, const string &path
         if ((!mLeaseClerk.IsLeaseValid(chunkId)) &&
 	    ((leaseStatus = GetLease(fd, chunkId, pathname)) < 0)) {
 	    // couldn't get a valid lease
+            if (leaseStatus != -EBUSY && leaseStatus != -EHOSTUNREACH &&
+                    GetCurrChunk(fd)->chunkId == chunkId) {
+                // The chunk might no longer exist: the location is stale.
+                InvalidateCurrChunkLocation(fd);
+            }
 	    return false;
 	}
 	if (mLeaseClerk.ShouldRenewLease(chunkId)) {
@@ -477,12 +781,16 @@ KfsClientImpl::ReadChunk(int fd, char *buf, size_t numBytes)
 
 PendingChunkRead::PendingChunkRead(
     KfsClientImpl& impl,
-    size_t         readAhead)
+    size_t         readAhead,
+    bool           adaptiveFlag)
     : mReadOp(-1, -1, -1),
       mSocket(0),
       mImpl(impl),
       mFd(-1),
-      mReadAhead(readAhead)
+      mReadAhead(adaptiveFlag ? 0 : readAhead),
+      mMaxReadAhead(adaptiveFlag ? readAhead : 0),
+      mNextFileOffset(0),
+      mStats()
 {
 }
 
@@ -491,6 +799,42 @@ PendingChunkRead::~PendingChunkRead()
     PendingChunkRead::Reset();
 }
 
+void
+PendingChunkRead::Access(off_t fileOffset, size_t numBytes)
+{
+    const bool sequentialFlag = fileOffset == mNextFileOffset;
+    if (sequentialFlag) {
+        mStats.mSequentialReads++;
+        mImpl.mReadAheadStats.mSequentialReads++;
+    } else {
+        mStats.mRandomReads++;
+        mImpl.mReadAheadStats.mRandomReads++;
+    }
+    if (! IsAdaptive()) {
+        return;
+    }
+    if (! sequentialFlag) {
+        mReadAhead = 0;
+        return;
+    }
+    // Only one read ahead is in flight, and the data past the next read
+    // buffer is discarded: do not grow beyond the read size.
+    const size_t maxReadAhead = min(mMaxReadAhead,
+        max(size_t(kMinAdaptiveReadAhead),
+            numBytes / CHECKSUM_BLOCKSIZE * CHECKSUM_BLOCKSIZE));
+    mReadAhead = mReadAhead <= 0 ? size_t(kMinAdaptiveReadAhead) :
+        min(maxReadAhead, 2 * mReadAhead);
+}
+
+void
+PendingChunkRead::Account(int64_t useful, int64_t wasted)
+{
+    mStats.mUsefulBytes += useful;
+    mStats.mWastedBytes += wasted;
+    mImpl.mReadAheadStats.mUsefulBytes += useful;
+    mImpl.mReadAheadStats.mWastedBytes += wasted;
+}
+
 bool
 PendingChunkRead::Start(int fd, size_t off)
 {
@@ -501,8 +845,12 @@ PendingChunkRead::Start(int fd, size_t off)
         const int curFd = mFd;
         mFd = -1;
         mImpl.FdPos(curFd)->ResetServers();
+        Account(0, mReadOp.numBytes);
     }
     mFd = fd;
+    if (mFd >= 0) {
+        mNextFileOffset = mImpl.FdPos(mFd)->fileOffset + off;
+    }
     if (mFd < 0 || mReadAhead <= 0) {
         mFd = -1;
         return false;
@@ -538,6 +886,14 @@ PendingChunkRead::Start(int fd, size_t off)
             chunk.chunkId = -1;
             pos.ResetServers();
             mFd = -1;
+        } else if (IsAdaptive() &&
+                mReadOp.offset + (off_t)mReadOp.numBytes >= chunk.chunkSize &&
+                (off_t)(pos.chunkNum + 1) * (off_t)KFS::CHUNKSIZE <
+                    mImpl.FdAttr(mFd)->fileSize) {
+            // The sequential read reaches the chunk end: look up the next
+            // chunk location, while the chunk server is busy with the
+            // read ahead.
+            mImpl.LocateChunk(mFd, pos.chunkNum + 1);
         }
     } else {
         mFd = -1;
@@ -578,6 +934,8 @@ PendingChunkRead::Read(char *buf, size_t numBytes)
 
     gettimeofday(&readEnd, NULL);
 
+    Account(numRd, mReadOp.contentLength - numRd);
+
     if (! attachFlag) {
         memcpy(buf, mReadOp.contentBuf, numRd);
         delete [] mReadOp.contentBuf;
@@ -636,6 +994,7 @@ KfsClientImpl::ReadFromServer(int fd, char *buf, size_t numBytes)
                    numBytes);
 
     if (pos->pendingChunkRead) {
+        pos->pendingChunkRead->Access(pos->fileOffset, numBytes);
         if (pos->pendingChunkRead->IsValid() &&
                 pos->pendingChunkRead->GetChunkOffset() != pos->chunkOffset) {
             KFS_LOG_VA_ERROR("pending chunk read offset mismatch pos: %d offset: %d",
@@ -912,6 +1271,9 @@ KfsClientImpl::DoPipelinedRead(int fd, vector<ReadOp *> &ops, TcpSocket *sock)
     ReadOp *op;
     bool leaseExpired = false;
 
+    if (ops.empty())
+        return 0;
+
     // plumb the pipe with 1MB
     minOps = std::max(size_t(1),
         min((size_t) (MIN_BYTES_PIPELINE_IO / MAX_BYTES_PER_READ_IO), ops.size()));
@@ -1009,6 +1371,9 @@ KfsClientImpl::VerifyChecksum(ReadOp* op, TcpSocket* sock)
 
                 KFS_LOG_VA_INFO("Checksum mismatch from %s starting @pos = %lld: got = %d, computed = %d for %s",
                                 ipname, op->offset + pos, serverCksum, cksum, op->Show().c_str());
+                // PReadV() verifies without holding the client mutex; the
+                // mutex is recursive for the other callers.
+                MutexLock l(&mMutex);
                 mTelemetryReporter.publish(saddr.sin_addr, -1.0, "CHECKSUM_MISMATCH");
             }
             op->status = -KFS::EBADCKSUM;
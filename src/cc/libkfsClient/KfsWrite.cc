@@ -133,6 +133,7 @@ KfsClientImpl::AtomicRecordAppend(int fd, const char *buf, int reclen, MutexLock
     if (! mProtocolWorker) {
         mProtocolWorker = new KfsProtocolWorker(
             mMetaServerLoc.hostname, mMetaServerLoc.port);
+        mProtocolWorker->SetBatching(mAppendBatchBytes, mAppendBatchDelayMs);
         mProtocolWorker->Start();
     }
 
@@ -191,6 +192,36 @@ KfsClientImpl::AtomicRecordAppend(int fd, const char *buf, int reclen, MutexLock
     return reclen;
 }
 
+int
+KfsClientImpl::SetAppendBatching(int maxBatchBytes, int maxDelayMs)
+{
+    if (maxBatchBytes < 0 || maxDelayMs < -1) {
+        return -EINVAL;
+    }
+    MutexLock lock(&mMutex);
+    mAppendBatchBytes   = min(maxBatchBytes, (int)CHECKSUM_BLOCKSIZE);
+    mAppendBatchDelayMs = maxDelayMs;
+    if (mProtocolWorker) {
+        mProtocolWorker->SetBatching(mAppendBatchBytes, mAppendBatchDelayMs);
+    }
+    return 0;
+}
+
+void
+KfsClientImpl::GetAppendStats(KfsClient::AppendStats &stats) const
+{
+    MutexLock lock(&const_cast<KfsClientImpl*>(this)->mMutex);
+    KfsProtocolWorker::Stats ws;
+    if (mProtocolWorker) {
+        mProtocolWorker->GetStats(ws);
+    }
+    stats.records          = ws.mRecordCount;
+    stats.committedRecords = ws.mAppendRecordCount;
+    stats.appends          = ws.mAppendCount;
+    stats.committedBytes   = ws.mAppendByteCount;
+    stats.batchTimeouts    = ws.mBatchTimeoutCount;
+}
+
 int
 KfsClientImpl::WriteAsync(int fd, const char *buf, size_t numBytes)
 {
@@ -291,6 +322,17 @@ KfsClientImpl::WriteAsyncCompletionHandler(int fd)
     mAsyncWrites.clear();
     return 0;
 }
+
+ssize_t
+KfsClientImpl::PWrite(int fd, off_t offset, const char *buf, size_t numBytes)
+{
+    MutexLock l(&mMutex);
+
+    const off_t res = Seek(fd, offset, SEEK_SET);
+    if (res < 0)
+        return res;
+    return Write(fd, buf, numBytes);
+}
     
 ssize_t
 KfsClientImpl::Write(int fd, const char *buf, size_t numBytes)
@@ -313,6 +355,10 @@ KfsClientImpl::Write(int fd, const char *buf, size_t numBytes)
     if ((mFileTable[fd]->openMode & O_APPEND) != 0) {
         return AtomicRecordAppend(fd, buf, numBytes, l);
     }
+    if (mFileTable[fd]->writeBehindStatus < 0) {
+        // Report the write behind failure until sync or close.
+        return mFileTable[fd]->writeBehindStatus;
+    }
     //
     // Loop thru chunk after chunk until we write the desired #
     // of bytes.
@@ -626,7 +672,11 @@ KfsClientImpl::DoSmallWriteToServer(int fd, off_t offset, const char *buf, size_
 ssize_t
 KfsClientImpl::DoLargeWriteToServer(int fd, off_t offset, const char *buf, size_t numBytes)
 {
-    size_t numAvail, numWrote = 0;
+    if (FdInfo(fd)->writeBehind > 0) {
+        return DoWriteBehind(fd, offset, buf, numBytes);
+    }
+
+    size_t numAvail;
     ssize_t numIO;
     FilePosition *pos = FdPos(fd);
     ChunkAttr *chunk = GetCurrChunk(fd);
@@ -646,6 +696,67 @@ KfsClientImpl::DoLargeWriteToServer(int fd, off_t offset, const char *buf, size_
     if (numIO < 0)
         return numIO;
 
+    MakeWritePrepareOps(chunk, writeId, offset, buf, numAvail, ops);
+
+    // For pipelined data push to work, we break the write into a
+    // sequence of smaller ops and push them to the master; the master
+    // then forwards each op to one replica, who then forwards to
+    // next.
+
+    numIO = DoPipelinedWrite(fd, ops, masterSock);
+
+    if (numIO < 0) {
+        //
+        // the write failed; caller will do the retry
+        //
+        KFS_LOG_STREAM_INFO <<
+            "Write failed...chunk = " << ops[0]->chunkId <<
+            ", version = " << ops[0]->chunkVersion <<
+            ", offset = "  << ops[0]->offset <<
+            ", error = "   << numIO <<
+        KFS_LOG_EOM;
+    }
+
+    // figure out how much was committed
+    numIO = 0;
+    for (vector<KfsOp *>::size_type i = 0; i < ops.size(); ++i) {
+	WritePrepareOp *op = static_cast<WritePrepareOp *> (ops[i]);
+	if (op->status < 0)
+	    numIO = op->status;
+	else if (numIO >= 0)
+	    numIO += op->status;
+	op->ReleaseContentBuf();
+	delete op;
+    }
+
+    if (numIO >= 0 && (off_t)chunk->chunkSize < offset + numIO) {
+	// grow the chunksize only if we wrote past the last byte in the chunk
+	chunk->chunkSize = offset + numIO;
+
+	// if we wrote past the last byte of the file, then grow the
+	// file size.  Note that, chunks 0..chunkNum-1 are assumed to
+	// be full.  So, take the size of the last chunk and to that
+	// add the size of the "full" chunks to get the size
+	FileAttr *fa = FdAttr(fd);
+	off_t eow = chunk->chunkSize + (pos->chunkNum  * KFS::CHUNKSIZE);
+	fa->fileSize = max(fa->fileSize, eow);
+    }
+
+    KFS_LOG_STREAM_DEBUG <<
+        "Wrote to server (fd = " << fd << "), " << numIO <<
+        " bytes, was asked " << numBytes << " bytes" <<
+    KFS_LOG_EOM;
+
+    return numIO;
+}
+
+void
+KfsClientImpl::MakeWritePrepareOps(ChunkAttr *chunk, vector<WriteInfo> &writeId,
+                                   off_t offset, const char *buf, size_t numAvail,
+                                   vector<WritePrepareOp *> &ops)
+{
+    size_t numWrote = 0;
+
     // Split the write into a bunch of smaller ops
     while (numWrote < numAvail) {
 	WritePrepareOp *op = new WritePrepareOp(nextSeq(), chunk->chunkId,
@@ -690,57 +801,241 @@ KfsClientImpl::DoLargeWriteToServer(int fd, off_t offset, const char *buf, size_
 	numWrote += op->numBytes;
 	ops.push_back(op);
     }
+}
 
-    // For pipelined data push to work, we break the write into a
-    // sequence of smaller ops and push them to the master; the master
-    // then forwards each op to one replica, who then forwards to
-    // next.
+ssize_t
+KfsClientImpl::DoWriteBehind(int fd, off_t offset, const char *buf, size_t numBytes)
+{
+    FileTableEntry& entry = *FdInfo(fd);
+    FilePosition *pos = FdPos(fd);
+    ChunkAttr *chunk = GetCurrChunk(fd);
 
-    numIO = DoPipelinedWrite(fd, ops, masterSock);
+    assert(KFS::CHUNKSIZE - offset >= 0);
 
-    if (numIO < 0) {
-        //
-        // the write failed; caller will do the retry
-        //
+    // Each write in flight keeps a copy of its data: write at most the
+    // io buffer size, and end the write on a checksum block boundary.
+    size_t numAvail = min(numBytes, (size_t) (KFS::CHUNKSIZE - offset));
+    const size_t maxWrite = max(entry.buffer.bufsz, (size_t) CHECKSUM_BLOCKSIZE);
+    if (numAvail > maxWrite) {
+        const off_t end = OffsetToChecksumBlockStart(offset + maxWrite);
+        numAvail = end > offset ? (size_t) (end - offset) : maxWrite;
+    }
+
+    PollWriteBehind(fd);
+
+    const WriteBehindReq *prev = entry.writeBehindReqs.empty() ?
+        0 : &entry.writeBehindReqs.back();
+    entry.writeBehindReqs.push_back(WriteBehindReq());
+    WriteBehindReq &req = entry.writeBehindReqs.back();
+    req.fileOffset     = (off_t) pos->chunkNum * KFS::CHUNKSIZE + offset;
+    req.chunkId        = chunk->chunkId;
+    req.chunkVersion   = chunk->chunkVersion;
+    req.chunkServerLoc = chunk->chunkServerLoc;
+
+    int res = 0;
+    if (prev && prev->chunkId == req.chunkId &&
+            prev->chunkVersion == req.chunkVersion &&
+            prev->status >= 0 && prev->sock->IsGood()) {
+        // Use the connection and the write ids of the previous write to
+        // this chunk: a new write id allocation reply would have to wait
+        // for the commit replies of the previous write.
+        req.sock    = prev->sock;
+        req.writeId = prev->writeId;
+    } else {
+        ChunkServerConn conn(req.chunkServerLoc[0]);
+        conn.Connect();
+        req.sock = conn.sock;
+        res = req.sock->IsGood() ?
+            AllocateWriteId(fd, offset, numAvail, false, req.writeId, req.sock.get()) :
+            -EHOSTUNREACH;
+    }
+    if (res >= 0) {
+        vector<WritePrepareOp *> ops;
+        MakeWritePrepareOps(chunk, req.writeId, offset, buf, numAvail, ops);
+        req.syncOps.resize(ops.size());
+        for (size_t i = 0; i < ops.size(); i++) {
+            if (res >= 0 && (res = DoOpSend(ops[i], req.sock.get())) >= 0) {
+                res = SendCommit(fd, ops[i]->offset, ops[i]->numBytes,
+                    ops[i]->checksums, req.writeId, req.sock.get(),
+                    req.syncOps[i]);
+            }
+            if (res < 0 && ops[i]->status < 0) {
+                res = ops[i]->status;
+            }
+            ops[i]->ReleaseContentBuf();
+            delete ops[i];
+        }
+    }
+    if (res < 0) {
+        // Nothing is in flight; the caller will do the retry.
         KFS_LOG_STREAM_INFO <<
-            "Write failed...chunk = " << ops[0]->chunkId <<
-            ", version = " << ops[0]->chunkVersion <<
-            ", offset = "  << ops[0]->offset <<
-            ", error = "   << numIO <<
+            "Write behind failed...chunk = " << req.chunkId <<
+            ", version = " << req.chunkVersion <<
+            ", offset = "  << offset <<
+            ", error = "   << res <<
         KFS_LOG_EOM;
+        entry.writeBehindReqs.pop_back();
+        return res;
+    }
+    req.data.assign(buf, buf + numAvail);
+
+    if ((off_t)chunk->chunkSize < offset + (off_t)numAvail) {
+        // As with the synchronous write: assume that the write will
+        // succeed, the failed writes are re-done.
+        chunk->chunkSize = offset + numAvail;
+        FileAttr *fa = FdAttr(fd);
+        off_t eow = chunk->chunkSize + (pos->chunkNum  * KFS::CHUNKSIZE);
+        fa->fileSize = max(fa->fileSize, eow);
     }
 
-    // figure out how much was committed
-    numIO = 0;
-    for (vector<KfsOp *>::size_type i = 0; i < ops.size(); ++i) {
-	WritePrepareOp *op = static_cast<WritePrepareOp *> (ops[i]);
-	if (op->status < 0)
-	    numIO = op->status;
-	else if (numIO >= 0)
-	    numIO += op->status;
-	op->ReleaseContentBuf();
-	delete op;
+    KFS_LOG_STREAM_DEBUG <<
+        "Write behind (fd = " << fd << "), " << numAvail <<
+        " bytes, in flight: " << entry.writeBehindReqs.size() <<
+    KFS_LOG_EOM;
+
+    CompleteWriteBehind(fd, (size_t) entry.writeBehind);
+    return numAvail;
+}
+
+void
+KfsClientImpl::PollWriteBehind(int fd)
+{
+    WriteBehindReqs &reqs = FdInfo(fd)->writeBehindReqs;
+    for (WriteBehindReqs::iterator it = reqs.begin(); it != reqs.end(); ++it) {
+        char byte[1];
+        while (it->numCommitsRecv < it->syncOps.size() &&
+                it->sock->IsGood() &&
+                it->sock->Peek(byte, sizeof(byte)) > 0) {
+            const int res = GetCommitReply(
+                it->syncOps[it->numCommitsRecv++], it->sock.get());
+            if (res < 0 && it->status >= 0) {
+                it->status = res;
+            }
+        }
+        if (it->numCommitsRecv < it->syncOps.size()) {
+            break;
+        }
     }
+}
 
-    if (numIO >= 0 && (off_t)chunk->chunkSize < offset + numIO) {
-	// grow the chunksize only if we wrote past the last byte in the chunk
-	chunk->chunkSize = offset + numIO;
+int
+KfsClientImpl::CompleteWriteBehind(int fd, size_t maxPending)
+{
+    FileTableEntry &entry = *FdInfo(fd);
+    WriteBehindReqs &reqs = entry.writeBehindReqs;
 
-	// if we wrote past the last byte of the file, then grow the
-	// file size.  Note that, chunks 0..chunkNum-1 are assumed to
-	// be full.  So, take the size of the last chunk and to that
-	// add the size of the "full" chunks to get the size
-	FileAttr *fa = FdAttr(fd);
-	off_t eow = chunk->chunkSize + (pos->chunkNum  * KFS::CHUNKSIZE);
-	fa->fileSize = max(fa->fileSize, eow);
+    while (! reqs.empty()) {
+        WriteBehindReq &front = reqs.front();
+        if (reqs.size() <= maxPending &&
+                front.numCommitsRecv < front.syncOps.size()) {
+            break;
+        }
+        while (front.numCommitsRecv < front.syncOps.size()) {
+            const int res = GetCommitReply(
+                front.syncOps[front.numCommitsRecv++], front.sock.get());
+            if (res < 0 && front.status >= 0) {
+                front.status = res;
+            }
+        }
+        // Take the write out of the queue, before re-doing it.
+        WriteBehindReqs done;
+        done.splice(done.begin(), reqs, reqs.begin());
+        WriteBehindReq &req = done.front();
+        const int32_t chunkNum = req.fileOffset / KFS::CHUNKSIZE;
+        if (req.status < 0) {
+            const int res = RedoWriteBehind(fd, req);
+            if (res < 0 && entry.writeBehindStatus >= 0) {
+                entry.writeBehindStatus = res;
+            }
+        } else if (chunkNum != entry.currPos.chunkNum &&
+                ! HasWriteBehind(fd, chunkNum) &&
+                req.sock->IsGood()) {
+            // The last write to this chunk is done, and the writer moved
+            // onto the next chunk: close the chunk, as Seek() would.
+            CloseOp cop(nextSeq(), req.chunkId);
+            cop.chunkServerLoc = req.chunkServerLoc;
+            DoOpCommon(&cop, req.sock.get());
+        }
     }
+    return entry.writeBehindStatus;
+}
 
-    KFS_LOG_STREAM_DEBUG <<
-        "Wrote to server (fd = " << fd << "), " << numIO <<
-        " bytes, was asked " << numBytes << " bytes" <<
+int
+KfsClientImpl::RedoWriteBehind(int fd, WriteBehindReq &req)
+{
+    FileTableEntry &entry = *FdInfo(fd);
+    FilePosition &pos = entry.currPos;
+
+    KFS_LOG_STREAM_INFO <<
+        "Re-doing write behind: " << entry.pathname <<
+        " chunk: "   << req.chunkId <<
+        " version: " << req.chunkVersion <<
+        " offset: "  << req.fileOffset <<
+        " size: "    << req.data.size() <<
+        " status: "  << req.status <<
     KFS_LOG_EOM;
 
-    return numIO;
+    // Write the data synchronously at the write offset, then restore the
+    // current position, and its chunk server connections.
+    const off_t                fileOffset      = pos.fileOffset;
+    const int32_t              chunkNum        = pos.chunkNum;
+    const off_t                chunkOffset     = pos.chunkOffset;
+    TcpSocket * const          preferredServer = pos.preferredServer;
+    const ServerLocation       preferredLoc    = pos.preferredServerLocation;
+    const int                  writeBehind     = entry.writeBehind;
+    vector<ChunkServerConn>    chunkServers;
+    vector<WriteInfo>          writeId;
+
+    pos.CancelPendingRead();
+    chunkServers.swap(pos.chunkServers);
+    writeId.swap(pos.writeId);
+    pos.preferredServer = NULL;
+    pos.fileOffset      = req.fileOffset;
+    pos.chunkNum        = req.fileOffset / KFS::CHUNKSIZE;
+    pos.chunkOffset     = req.fileOffset % KFS::CHUNKSIZE;
+    entry.writeBehind   = 0;
+
+    // The failed write might have left the replicas inconsistent: force
+    // allocation, in order to get the chunk version bumped.
+    ssize_t res = DoAllocation(fd, true);
+    if (res >= 0) {
+        res = WriteToServer(fd, pos.chunkOffset, &req.data[0], req.data.size());
+        if (res >= 0 && (size_t) res < req.data.size()) {
+            res = -EIO;
+        }
+    }
+
+    entry.writeBehind = writeBehind;
+    chunkServers.swap(pos.chunkServers);
+    writeId.swap(pos.writeId);
+    pos.preferredServer         = preferredServer;
+    pos.preferredServerLocation = preferredLoc;
+    pos.fileOffset              = fileOffset;
+    pos.chunkNum                = chunkNum;
+    pos.chunkOffset             = chunkOffset;
+
+    if (res < 0) {
+        KFS_LOG_STREAM_ERROR <<
+            "Write behind failed: " << entry.pathname <<
+            " offset: " << req.fileOffset <<
+            " size: "   << req.data.size() <<
+            " error: "  << res <<
+        KFS_LOG_EOM;
+        return (int) res;
+    }
+    return 0;
+}
+
+bool
+KfsClientImpl::HasWriteBehind(int fd, int32_t chunkNum)
+{
+    const WriteBehindReqs &reqs = FdInfo(fd)->writeBehindReqs;
+    for (WriteBehindReqs::const_iterator it = reqs.begin(); it != reqs.end(); ++it) {
+        if (it->fileOffset / (off_t) KFS::CHUNKSIZE == chunkNum) {
+            return true;
+        }
+    }
+    return false;
 }
 
 int
@@ -62,7 +62,8 @@ public:
         int            inIdleTimeoutSec,
         bool           inPreAllocationFlag,
         std::string    inLogPrefix,
-        int64_t        inChunkServerInitialSeqNum)
+        int64_t        inChunkServerInitialSeqNum,
+        int            inMaxBatchDelayMs)
         : ITimeout(),
           KfsNetClient::OpOwner(),
           mOuter(inOuter),
@@ -103,12 +104,16 @@ public:
           mDefaultSpaceReservationSize(inDefaultSpaceReservationSize),
           mMaxPartialBuffersCount(inMaxPartialBuffersCount),
           mPreferredAppendSize(inPreferredAppendSize),
+          mMaxBatchDelayMs(-1),
+          mBatchStartMs(0),
           mPathNamePos(0),
           mOpStartTime(0),
           mCurOpPtr(0),
           mCompletionPtr(inCompletionPtr),
           mBuffer(),
           mWriteQueue(),
+          mRecordQueue(),
+          mRecordLengths(),
           mLookupOp(0, 0, ""),
           mMkdirOp(0, 0, ""),
           mCreateOp(0, 0, "", mNumReplicas, false),
@@ -125,10 +130,12 @@ public:
           mGetRecordAppendOpStatusIndex(0u),
           mLogPrefix(inLogPrefix),
           mStats(),
-          mNetManager(mMetaServer.GetNetManager())
+          mNetManager(mMetaServer.GetNetManager()),
+          mBatchTimer(*this)
     {
         Impl::Reset();
         mChunkServer.SetRetryConnectOnly(true);
+        Impl::SetMaxBatchDelay(inMaxBatchDelayMs);
     }
     ~Impl()
     {
@@ -138,6 +145,9 @@ public:
         if (mSleepingFlag) {
             mNetManager.UnRegisterTimeoutHandler(this);
         }
+        if (mMaxBatchDelayMs > 0) {
+            mNetManager.UnRegisterTimeoutHandler(&mBatchTimer);
+        }
     }
     int Open(
         const char* inFileNamePtr,
@@ -265,13 +275,25 @@ public:
                 mStats.mBufferCompactionCount++;
             }
         }
+        // Do not add to the entry that is being appended, in order to keep
+        // the record count of the append in flight. The append is in flight
+        // from Append() until Done() or Reset(), including the status
+        // recovery.
+        const bool theInFlightFlag =
+            mWriteQueue.size() == 1 && mAppendLength > 0;
+        if (mWriteQueue.empty() || theInFlightFlag) {
+            mBatchStartMs = ITimeout::NowMs();
+        }
         const int kMinWriteQueueEntrySize = 256;
-        if (mWriteQueue.empty() ||
+        if (mWriteQueue.empty() || theInFlightFlag ||
                 mWriteQueue.back() > kMinWriteQueueEntrySize) {
             mWriteQueue.push_back(inLength);
+            mRecordQueue.push_back(1);
         } else {
             mWriteQueue.back() += inLength;
+            mRecordQueue.back()++;
         }
+        mRecordLengths.push_back(inLength);
         if (! mCurOpPtr && mOpenFlag) {
             StartAppend();
         }
@@ -292,6 +314,8 @@ public:
         mOpenFlag     = false;
         mErrorCode    = 0;
         mWriteQueue.clear();
+        mRecordQueue.clear();
+        mRecordLengths.clear();
         mBuffer.Clear();
     }
     bool IsOpen() const
@@ -366,6 +390,25 @@ public:
     void SetForcedAllocationInterval(
         int inInterval)
         { mForcedAllocationInterval = inInterval; }
+    int SetMaxBatchDelay(
+        int inDelayMs)
+    {
+        const int theDelayMs = inDelayMs < 0 ? -1 : inDelayMs;
+        if (theDelayMs == mMaxBatchDelayMs) {
+            return mErrorCode;
+        }
+        if (mMaxBatchDelayMs > 0) {
+            mNetManager.UnRegisterTimeoutHandler(&mBatchTimer);
+        }
+        mMaxBatchDelayMs = theDelayMs;
+        if (mMaxBatchDelayMs > 0) {
+            mNetManager.RegisterTimeoutHandler(&mBatchTimer);
+        }
+        BatchTimeout();
+        return mErrorCode;
+    }
+    int GetMaxBatchDelay() const
+        { return mMaxBatchDelayMs; }
 
 protected:
     virtual void OpDone(
@@ -423,7 +466,26 @@ private:
     };
     enum { kAgainRetryMinTime  = 4  };
     enum { kGetStatusOpMinTime = 16 };
+    // The record lengths are sent in the append request header: bound the
+    // number of records per append to keep the header well below
+    // MAX_RPC_HEADER_LEN.
+    enum { kMaxRecordsPerAppend = 1024 };
 
+    // Flushes the pending records once the oldest of them is older than
+    // the max batch delay.
+    class BatchTimer : public ITimeout
+    {
+    public:
+        BatchTimer(
+            Impl& inOwner)
+            : ITimeout(),
+              mOwner(inOwner)
+            {}
+        virtual void Timeout()
+            { mOwner.BatchTimeout(); }
+    private:
+        Impl& mOwner;
+    };
     typedef KfsNetClient           ChunkServer;
     typedef std::vector<WriteInfo> WriteIds;
     typedef std::deque<int>        WriteQueue;
@@ -463,12 +525,16 @@ private:
     const int               mDefaultSpaceReservationSize;
     const int               mMaxPartialBuffersCount;
     const int               mPreferredAppendSize;
+    int                     mMaxBatchDelayMs;
+    int64_t                 mBatchStartMs;
     StringPos               mPathNamePos;
     time_t                  mOpStartTime;
     KfsOp*                  mCurOpPtr;
     Completion*             mCompletionPtr;
     IOBuffer                mBuffer;
     WriteQueue              mWriteQueue;
+    WriteQueue              mRecordQueue; // # of records in mWriteQueue entries
+    WriteQueue              mRecordLengths; // pending records lengths
     LookupOp                mLookupOp;
     MkdirOp                 mMkdirOp;
     CreateOp                mCreateOp;
@@ -486,6 +552,7 @@ private:
     std::string const       mLogPrefix;
     Stats                   mStats;
     NetManager&             mNetManager;
+    BatchTimer              mBatchTimer;
 
     template<typename T> bool Dispatch(
         T&        inObj,
@@ -839,9 +906,22 @@ private:
     {
         return (
             ! mWriteQueue.empty() &&
-            (mClosingFlag || mBuffer.BytesConsumable() >= mWriteThreshold)
+            (mClosingFlag || mBuffer.BytesConsumable() >= mWriteThreshold ||
+                (mMaxBatchDelayMs >= 0 &&
+                    mBatchStartMs + mMaxBatchDelayMs <= ITimeout::NowMs()))
         );
     }
+    void BatchTimeout()
+    {
+        if (mCurOpPtr || ! mOpenFlag || mSleepingFlag || mErrorCode ||
+                mWriteQueue.empty() || mMaxBatchDelayMs < 0 ||
+                mBuffer.BytesConsumable() >= mWriteThreshold ||
+                ITimeout::NowMs() < mBatchStartMs + mMaxBatchDelayMs) {
+            return;
+        }
+        mStats.mBatchTimeoutCount++;
+        StartAppend();
+    }
     bool ReserveSpace()
     {
         assert(mAllocOp.chunkId > 0 && ! mWriteIds.empty());
@@ -949,6 +1029,8 @@ private:
         while (! mWriteQueue.empty() && mWriteQueue.front() <= 0) {
             assert(! "invalid write queue");
             mWriteQueue.pop_front();
+            PopRecords(mRecordQueue.front());
+            mRecordQueue.pop_front();
         }
         if (mWriteQueue.empty()) {
             assert(mBuffer.IsEmpty());
@@ -970,9 +1052,13 @@ private:
         int theSum;
         while (mWriteQueue.size() > 1 &&
                 (theSum = mWriteQueue[0] + mWriteQueue[1]) <=
-                    thePreferredAppendSize) {
+                    thePreferredAppendSize &&
+                mRecordQueue[0] + mRecordQueue[1] <= kMaxRecordsPerAppend) {
             mWriteQueue.pop_front();
             mWriteQueue.front() = theSum;
+            const int theCount = mRecordQueue.front();
+            mRecordQueue.pop_front();
+            mRecordQueue.front() += theCount;
         }
         mAppendLength = mWriteQueue.front();
         KFS_LOG_STREAM_DEBUG << mLogPrefix <<
@@ -988,6 +1074,14 @@ private:
         mRecAppendOp.offset        = -1; // Let chunk server pick offset.
         mRecAppendOp.writeInfo     = mWriteIds;
         mRecAppendOp.contentLength = size_t(mAppendLength);
+        mRecAppendOp.recordCount   = mRecordQueue.front();
+        // The chunk server validates the record boundaries with the
+        // lengths.
+        std::ostringstream theLengths;
+        for (int i = 0; i < mRecAppendOp.recordCount; i++) {
+            theLengths << (i > 0 ? " " : "") << mRecordLengths[i];
+        }
+        mRecAppendOp.recordLengths = theLengths.str();
         mRecAppendOp.checksum      =
             ComputeBlockChecksum(&mBuffer, mAppendLength);
         mStats.mOpsRecAppendCount++;
@@ -1017,20 +1111,28 @@ private:
         // The queue can change in the case if it had only one record when
         // append started, and then the next record arrived and the two
         // (short) records were coalesced into one.
+        int theRecordCount = inOp.recordCount;
         while (mAppendLength > 0) {
             assert(! mWriteQueue.empty());
             int& theLen = mWriteQueue.front();
             if (mAppendLength >= theLen) {
                 mAppendLength -= theLen;
+                theRecordCount -= mRecordQueue.front();
                 mWriteQueue.pop_front();
+                mRecordQueue.pop_front();
             } else {
                 theLen -= mAppendLength;
                 mAppendLength = 0;
+                mRecordQueue.front() -= theRecordCount;
+                theRecordCount = 0;
+                QCRTASSERT(mRecordQueue.front() > 0);
             }
         }
+        PopRecords(inOp.recordCount);
         mPrevRecordAppendOpSeq = inOp.seq;
         mStats.mAppendCount++;
         mStats.mAppendByteCount += theConsumed;
+        mStats.mAppendRecordCount += inOp.recordCount;
         ReportCompletion();
         if (inResetFlag || (mForcedAllocationInterval > 0 &&
                 (mStats.mOpsRecAppendCount % mForcedAllocationInterval) == 0)) {
@@ -1038,6 +1140,13 @@ private:
         }
         StartAppend();
     }
+    void PopRecords(int inCount)
+    {
+        assert(inCount >= 0 && (size_t)inCount <= mRecordLengths.size());
+        mRecordLengths.erase(mRecordLengths.begin(),
+            mRecordLengths.begin() + std::min(inCount,
+                (int)mRecordLengths.size()));
+    }
     void SizeChunk()
     {
         Reset(mSizeOp);
@@ -1492,7 +1601,8 @@ WriteAppender::WriteAppender(
     int         inIdleTimeoutSec              /* = 5 * 30 */,
     const char* inLogPrefixPtr                /* = 0 */,
     int64_t     inChunkServerInitialSeqNum    /* = 1 */,
-    bool        inPreAllocationFlag           /* = true */)
+    bool        inPreAllocationFlag           /* = true */,
+    int         inMaxBatchDelayMs             /* = -1 */)
     : mImpl(*new WriteAppender::Impl(
         *this,
         inMetaServer,
@@ -1508,7 +1618,8 @@ WriteAppender::WriteAppender(
         inPreAllocationFlag,
         (inLogPrefixPtr && inLogPrefixPtr[0]) ?
             (inLogPrefixPtr + std::string(" ")) : std::string(),
-        inChunkServerInitialSeqNum
+        inChunkServerInitialSeqNum,
+        inMaxBatchDelayMs
     ))
 {
 }
@@ -1653,4 +1764,17 @@ WriteAppender::SetForcedAllocationInterval(
     return mImpl.SetForcedAllocationInterval(inInterval);
 }
 
+    int
+WriteAppender::SetMaxBatchDelay(
+    int inDelayMs)
+{
+    return mImpl.SetMaxBatchDelay(inDelayMs);
+}
+
+    int
+WriteAppender::GetMaxBatchDelay() const
+{
+    return mImpl.GetMaxBatchDelay();
+}
+
 }
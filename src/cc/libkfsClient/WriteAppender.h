@@ -73,7 +73,9 @@ public:
               mRetriesCount(0),
               mBufferCompactionCount(0),
               mAppendCount(0),
-              mAppendByteCount(0)
+              mAppendByteCount(0),
+              mAppendRecordCount(0),
+              mBatchTimeoutCount(0)
             {}
         void Clear()
             { *this = Stats(); }
@@ -92,6 +94,8 @@ public:
             mBufferCompactionCount   += inStats.mBufferCompactionCount;
             mAppendCount             += inStats.mAppendCount;
             mAppendByteCount         += inStats.mAppendByteCount;
+            mAppendRecordCount       += inStats.mAppendRecordCount;
+            mBatchTimeoutCount       += inStats.mBatchTimeoutCount;
             return *this;
         }
         std::ostream& Display(
@@ -127,7 +131,11 @@ public:
                 "AppendCount"                << theDelimiterPtr <<
                     mAppendCount             << theSeparatorPtr <<
                 "AppendByteCount"            << theDelimiterPtr <<
-                    mAppendByteCount
+                    mAppendByteCount         << theSeparatorPtr <<
+                "AppendRecordCount"          << theDelimiterPtr <<
+                    mAppendRecordCount       << theSeparatorPtr <<
+                "BatchTimeout"               << theDelimiterPtr <<
+                    mBatchTimeoutCount
             ;
             return inStream;
         }
@@ -143,6 +151,8 @@ public:
         Counter mBufferCompactionCount;
         Counter mAppendCount;
         Counter mAppendByteCount;
+        Counter mAppendRecordCount;
+        Counter mBatchTimeoutCount;
     };
     typedef KfsNetClient MetaServer;
     WriteAppender(
@@ -158,7 +168,8 @@ public:
         int         inIdleTimeoutSec              = 5 * 30,
         const char* inLogPrefixPtr                = 0,
         int64_t     inChunkServerInitialSeqNum    = 1,
-        bool        inPreAllocationFlag           = true);
+        bool        inPreAllocationFlag           = true,
+        int         inMaxBatchDelayMs             = -1);
     virtual ~WriteAppender();
     int Open(
         const char* inFileNamePtr,
@@ -194,6 +205,12 @@ public:
     bool GetPreAllocation() const;
     void SetForcedAllocationInterval(
         int inInterval);
+    // Max time in ms the appended records wait for the write threshold to
+    // be reached before the append is issued; -1 -- no limit, 0 -- the
+    // records are sent as soon as no append is in flight.
+    int SetMaxBatchDelay(
+        int inDelayMs);
+    int GetMaxBatchDelay() const;
 private:
     class Impl;
     Impl& mImpl;
@@ -38,7 +38,6 @@
 
 using std::min;
 using std::vector;
-using std::list;
 
 namespace KFS {
 
@@ -124,7 +123,13 @@ ComputeChecksums(const char *buf, size_t len)
 uint32_t
 ComputeBlockChecksum(const IOBuffer *data, size_t len)
 {
-    uint32_t res = kKfsNullChecksum;
+    return ComputeBlockChecksum(kKfsNullChecksum, data, len);
+}
+
+uint32_t
+ComputeBlockChecksum(uint32_t cksum, const IOBuffer *data, size_t len)
+{
+    uint32_t res = cksum;
     for (IOBuffer::iterator iter = data->begin();
          len > 0 && (iter != data->end()); ++iter) {
         size_t tlen = min((size_t) iter->BytesConsumable(), len);
@@ -47,6 +47,9 @@ extern uint32_t OffsetToChecksumBlockEnd(off_t offset);
 /// Call this function if you want checksum computed over CHECKSUM_BLOCKSIZE bytes
 extern uint32_t ComputeBlockChecksum(const IOBuffer *data, size_t len);
 extern uint32_t ComputeBlockChecksum(const char *data, size_t len);
+/// Continue the checksum of the preceding data with the next len bytes: the
+/// checksum can be computed piecewise, as the data arrives.
+extern uint32_t ComputeBlockChecksum(uint32_t cksum, const IOBuffer *data, size_t len);
 
 /// Call this function if you want a checksums for a sequence of CHECKSUM_BLOCKSIZE bytes
 extern std::vector<uint32_t> ComputeChecksums(const IOBuffer *data, size_t len);
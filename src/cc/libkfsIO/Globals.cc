@@ -73,7 +73,11 @@ Globals_t::getNetManager()
 {
     // Ensure that globals are constructed before net manager.
     NetManager*& netManager = Instance().mForGdbToFindNetManager;
-    static NetManager netManagerInstance;
+    // Never destroy the net manager: static objects, like client factory or
+    // global client pointers, might use it in their destructors at exit, and
+    // their destruction order relative to a function static net manager
+    // depends on the order of the first use.
+    static NetManager& netManagerInstance = *(new NetManager());
     if (! netManager) {
         netManager = &netManagerInstance;
     }
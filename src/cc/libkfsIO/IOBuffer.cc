@@ -32,12 +32,12 @@
 #include <stdlib.h>
 #include <iostream>
 #include <algorithm>
+#include <new>
 
 #include "IOBuffer.h"
 #include "Globals.h"
 
 using std::min;
-using std::list;
 
 using namespace KFS;
 using namespace KFS::libkfsio;
@@ -49,27 +49,6 @@ static libkfsio::IOBufferAllocator* sIOBufferAllocator = 0;
 static volatile bool sIsIOBufferAllocatorUsed = false;
 int IOBufferData::sDefaultBufferSize = 4 << 10;
 
-struct IOBufferArrayDeallocator
-{
-    void operator()(char* buf) { delete [] buf; }
-};
-
-struct IOBufferDeallocator
-{
-    void operator()(char* buf) { sIOBufferAllocator->Deallocate(buf); }
-};
-
-struct IOBufferDeallocatorCustom
-{
-    IOBufferDeallocatorCustom(
-        libkfsio::IOBufferAllocator& allocator)
-        : mAllocator(allocator)
-        {}
-    void operator()(char* buf) { mAllocator.Deallocate(buf); }
-private:
-    libkfsio::IOBufferAllocator& mAllocator;
-};
-
 // Call this function if you want to change the default allocator.
 bool libkfsio::SetIOBufferAllocator(libkfsio::IOBufferAllocator* allocator)
 {
@@ -91,11 +70,39 @@ inline int IOBufferData::MaxConsumable(int numBytes) const
     return std::max(0, std::min(BytesConsumable(), numBytes));
 }
 
+void IOBufferData::FreeBlock(IOBufferData::Block* block)
+{
+    char* const mem = reinterpret_cast<char*>(block);
+    if (block->mAllocator) {
+        block->mAllocator->Deallocate(block->mData);
+    } else if (block->mData != mem + kBlockHeaderSize) {
+        delete [] block->mData;
+    } else {
+        // Data is in the same allocation as the header.
+        delete [] mem;
+        return;
+    }
+    delete block;
+}
+
 inline void IOBufferData::Init(char* buf, int bufSize)
 {
-    // glibc malloc returns 2 * sizeof(size_t) aligned blocks.
     const int size = std::max(0, bufSize);
-    mData.reset(buf ? buf : new char [size], IOBufferArrayDeallocator());
+    Block* block;
+    if (buf) {
+        block = new Block();
+        block->mData = buf;
+    } else {
+        // Allocate the header and data with single new.
+        // glibc malloc returns 2 * sizeof(size_t) aligned blocks, the header
+        // size is rounded up to 16 to keep the data aligned the same way.
+        char* const mem = new char [kBlockHeaderSize + size];
+        block = new (mem) Block();
+        block->mData = mem + kBlockHeaderSize;
+    }
+    block->mRefCount  = 1;
+    block->mAllocator = 0;
+    mData.Reset(block);
     mProducer = mData.get();
     mEnd      = mProducer + size;
     mConsumer = mProducer;
@@ -108,12 +115,12 @@ inline void IOBufferData::Init(char* buf, libkfsio::IOBufferAllocator& allocator
             sDefaultBufferSize = sIOBufferAllocator->GetBufferSize();
         }
         sIsIOBufferAllocatorUsed = true;
-        mData.reset(buf ? buf : allocator.Allocate(),
-            IOBufferDeallocator());
-    } else {
-        mData.reset(buf ? buf : allocator.Allocate(),
-            IOBufferDeallocatorCustom(allocator));
     }
+    Block* const block = new Block();
+    block->mRefCount  = 1;
+    block->mAllocator = &allocator;
+    block->mData      = buf ? buf : allocator.Allocate();
+    mData.Reset(block);
     if (! (mProducer = mData.get())) {
         abort();
     }
@@ -27,17 +27,15 @@
 #define _LIBIO_IOBUFFER_H
 
 #include <stdio.h>
+#include <pthread.h>
 #include <cassert>
-#include <list>
+#include <cstddef>
 #include <exception>
 #include <streambuf>
 #include <ostream>
 #include <istream>
 #include <limits>
 
-#include <boost/shared_ptr.hpp>
-#include <boost/pool/pool_alloc.hpp> 
-
 namespace KFS
 {
 
@@ -53,6 +51,18 @@ namespace KFS
 /// In the current implementation, IOBufferData objects are single
 /// producer, multiple consumers.
 ///
+/// The data blocks are reference counted with non atomic reference
+/// counts: IOBuffer and IOBufferData are intended to be used by a single
+/// thread event loop. This is a hard invariant, not a performance hint: a
+/// data block can be handed off to another thread only while it has a
+/// single reference, and a shared block (IsShared()) must only be
+/// referenced, copied, and released by the thread that shared it. Two
+/// threads updating the reference count of the same block corrupt it, and
+/// the block is freed while still in use, or leaked. The debug builds
+/// assert that the reference count of a shared block is only updated by
+/// the thread that shared it. Other threads can read the data, as long as
+/// the owner does not release it while they do.
+///
 
 ///
 /// \class IOBufferData
@@ -190,9 +200,89 @@ public:
     }
 
 private:
-    /// Data buffer that is ref-counted for sharing.
-    typedef boost::shared_ptr<char> IOBufferBlockPtr;
-    IOBufferBlockPtr mData;
+    /// Reference counted data block header. If the block data is allocated
+    /// by IOBufferData, then the data immediately follows the header, and
+    /// the header and data are allocated and freed with single new / delete.
+    /// The small fragments are not stored inline in the buffer list nodes:
+    /// the fragments are shared by reference between buffers (Copy(),
+    /// partial Move(), Clone()), and the inline data would have to be copied
+    /// every time instead.
+    struct Block
+    {
+        int                          mRefCount;
+        char*                        mData;
+        libkfsio::IOBufferAllocator* mAllocator;
+#ifndef NDEBUG
+        /// The thread that made the block shared.
+        pthread_t                    mSharedThread;
+#endif
+        void Ref()
+        {
+#ifndef NDEBUG
+            if (mRefCount == 1) {
+                mSharedThread = pthread_self();
+            } else {
+                assert(pthread_equal(mSharedThread, pthread_self()));
+            }
+#endif
+            mRefCount++;
+        }
+        /// @retval true if the last reference was released
+        bool UnRef()
+        {
+            assert(mRefCount > 0);
+            assert(mRefCount == 1 ||
+                pthread_equal(mSharedThread, pthread_self()));
+            return (--mRefCount <= 0);
+        }
+    };
+    enum { kBlockHeaderSize = (sizeof(Block) + 15) / 16 * 16 };
+    /// Intrusive, non atomic reference counted data block pointer.
+    class BlockPtr
+    {
+    public:
+        BlockPtr()
+            : mBlock(0)
+            {}
+        BlockPtr(const BlockPtr& other)
+            : mBlock(other.mBlock)
+        {
+            if (mBlock) {
+                mBlock->Ref();
+            }
+        }
+        ~BlockPtr()
+            { Release(); }
+        BlockPtr& operator=(const BlockPtr& other)
+        {
+            if (other.mBlock) {
+                other.mBlock->Ref();
+            }
+            Release();
+            mBlock = other.mBlock;
+            return *this;
+        }
+        void Reset(Block* block)
+        {
+            Release();
+            mBlock = block;
+        }
+        char* get() const
+            { return (mBlock ? mBlock->mData : 0); }
+        bool unique() const
+            { return (mBlock && mBlock->mRefCount == 1); }
+    private:
+        Block* mBlock;
+
+        void Release()
+        {
+            if (mBlock && mBlock->UnRef()) {
+                IOBufferData::FreeBlock(mBlock);
+            }
+            mBlock = 0;
+        }
+    };
+    BlockPtr          mData;
     /// Pointers that correspond to the start/end of the buffer
     char             *mEnd;
     /// Pointers into mData that correspond to producer/consumer
@@ -206,6 +296,7 @@ private:
 
     inline int MaxAvailable(int numBytes) const;
     inline int MaxConsumable(int numBytes) const;
+    static void FreeBlock(Block* block);
 
     static int sDefaultBufferSize;
 };
@@ -220,10 +311,174 @@ private:
 class IOBuffer
 {
 private:
-    typedef std::list<
-        IOBufferData,
-        boost::fast_pool_allocator<IOBufferData>
-    > BList;
+    /// Doubly linked ring with sentinel, nodes embed the links and the
+    /// IOBufferData. The subset of std::list interface that IOBuffer uses,
+    /// with the same iterator invalidation rules, but without allocator
+    /// and size bookkeeping overhead.
+    class BList
+    {
+    private:
+        struct Link
+        {
+            Link* mPrev;
+            Link* mNext;
+        };
+        struct Node : public Link
+        {
+            Node(const IOBufferData& data)
+                : Link(), mData(data)
+                {}
+            IOBufferData mData;
+        };
+        template<typename T, typename LinkT>
+        class IteratorT
+        {
+        public:
+            IteratorT()
+                : mLink(0)
+                {}
+            template<typename OT, typename OLinkT>
+            IteratorT(const IteratorT<OT, OLinkT>& other)
+                : mLink(other.mLink)
+                {}
+            T& operator*() const
+                { return static_cast<Node*>(const_cast<Link*>(mLink))->mData; }
+            T* operator->() const
+                { return &**this; }
+            IteratorT& operator++()
+            {
+                mLink = mLink->mNext;
+                return *this;
+            }
+            IteratorT operator++(int)
+            {
+                IteratorT const ret(*this);
+                mLink = mLink->mNext;
+                return ret;
+            }
+            IteratorT& operator--()
+            {
+                mLink = mLink->mPrev;
+                return *this;
+            }
+            template<typename OT, typename OLinkT>
+            bool operator==(const IteratorT<OT, OLinkT>& other) const
+                { return (mLink == other.mLink); }
+            template<typename OT, typename OLinkT>
+            bool operator!=(const IteratorT<OT, OLinkT>& other) const
+                { return (mLink != other.mLink); }
+        private:
+            LinkT* mLink;
+
+            explicit IteratorT(LinkT* link)
+                : mLink(link)
+                {}
+            template<typename, typename> friend class IteratorT;
+            friend class BList;
+        };
+    public:
+        typedef IteratorT<IOBufferData, Link>             iterator;
+        typedef IteratorT<const IOBufferData, const Link> const_iterator;
+
+        BList()
+            : mHead()
+            { mHead.mPrev = mHead.mNext = &mHead; }
+        ~BList()
+            { clear(); }
+        bool empty() const
+            { return (mHead.mNext == &mHead); }
+        iterator begin()
+            { return iterator(mHead.mNext); }
+        iterator end()
+            { return iterator(&mHead); }
+        const_iterator begin() const
+            { return const_iterator(mHead.mNext); }
+        const_iterator end() const
+            { return const_iterator(&mHead); }
+        IOBufferData& front()
+            { return *begin(); }
+        IOBufferData& back()
+            { return *iterator(mHead.mPrev); }
+        const IOBufferData& back() const
+            { return *const_iterator(mHead.mPrev); }
+        iterator insert(const iterator& pos, const IOBufferData& data)
+        {
+            Node* const node = new Node(data);
+            LinkBefore(*node, pos.mLink);
+            return iterator(node);
+        }
+        void push_back(const IOBufferData& data)
+            { insert(end(), data); }
+        iterator erase(const iterator& pos)
+        {
+            Link* const next = pos.mLink->mNext;
+            Unlink(*pos.mLink);
+            delete static_cast<Node*>(pos.mLink);
+            return iterator(next);
+        }
+        iterator erase(iterator first, const iterator& last)
+        {
+            while (first != last) {
+                first = erase(first);
+            }
+            return first;
+        }
+        void pop_front()
+            { erase(begin()); }
+        void pop_back()
+            { erase(iterator(mHead.mPrev)); }
+        void clear()
+            { erase(begin(), end()); }
+        /// Move [first, last) from other before pos.
+        void splice(const iterator& pos, BList& /* other */,
+            const iterator& first, const iterator& last)
+        {
+            if (first == last) {
+                return;
+            }
+            Link* const f = first.mLink;
+            Link* const l = last.mLink->mPrev;
+            f->mPrev->mNext = last.mLink;
+            last.mLink->mPrev = f->mPrev;
+            Link* const p = pos.mLink;
+            f->mPrev = p->mPrev;
+            l->mNext = p;
+            p->mPrev->mNext = f;
+            p->mPrev = l;
+        }
+        void splice(const iterator& pos, BList& other, const iterator& it)
+        {
+            iterator next(it);
+            splice(pos, other, it, ++next);
+        }
+        void splice(const iterator& pos, BList& other)
+            { splice(pos, other, other.begin(), other.end()); }
+        void swap(BList& other)
+        {
+            BList tmp;
+            tmp.splice(tmp.end(), *this);
+            splice(end(), other);
+            other.splice(other.end(), tmp);
+        }
+    private:
+        Link mHead;
+
+        static void LinkBefore(Link& link, Link* pos)
+        {
+            link.mNext = pos;
+            link.mPrev = pos->mPrev;
+            pos->mPrev->mNext = &link;
+            pos->mPrev = &link;
+        }
+        static void Unlink(Link& link)
+        {
+            link.mPrev->mNext = link.mNext;
+            link.mNext->mPrev = link.mPrev;
+        }
+    private:
+        BList(const BList&);
+        BList& operator=(const BList&);
+    };
 public:
     typedef BList::const_iterator iterator;
 
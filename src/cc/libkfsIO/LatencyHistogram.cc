@@ -0,0 +1,154 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2010/11/16
+//
+// Copyright 2010 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Latency histogram text form and percentile estimates.
+//
+//----------------------------------------------------------------------------
+
+#include "LatencyHistogram.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace KFS
+{
+
+const char* const LatencyStats::kKeyPrefix = "Latency-";
+
+void
+LatencyHistogram::Clear()
+{
+    mCount      = 0;
+    mTotalUsecs = 0;
+    memset(mBuckets, 0, sizeof(mBuckets));
+}
+
+int64_t
+LatencyHistogram::GetPercentile(double pct) const
+{
+    if (mCount <= 0) {
+        return 0;
+    }
+    const double rank = mCount * (pct < 0 ? 0. : (pct > 100 ? 100. : pct)) /
+        100.;
+    int64_t cnt = 0;
+    for (int i = 0; i < kBucketCount; i++) {
+        if (mBuckets[i] <= 0) {
+            continue;
+        }
+        if (rank <= cnt + mBuckets[i]) {
+            const int64_t lo = BucketLowerBound(i);
+            const int64_t hi = i + 1 < kBucketCount ?
+                BucketLowerBound(i + 1) : lo * 2;
+            return (lo + int64_t((hi - lo) * (rank - cnt) / mBuckets[i]));
+        }
+        cnt += mBuckets[i];
+    }
+    return BucketLowerBound(kBucketCount - 1);
+}
+
+LatencyHistogram&
+LatencyHistogram::Subtract(const LatencyHistogram& other)
+{
+    mCount      -= other.mCount;
+    mTotalUsecs -= other.mTotalUsecs;
+    for (int i = 0; i < kBucketCount; i++) {
+        mBuckets[i] -= other.mBuckets[i];
+    }
+    return *this;
+}
+
+std::ostream&
+LatencyHistogram::Display(std::ostream& os) const
+{
+    os << mCount << "," << mTotalUsecs;
+    int last = kBucketCount - 1;
+    while (last >= 0 && mBuckets[last] == 0) {
+        --last;
+    }
+    for (int i = 0; i <= last; i++) {
+        os << "," << mBuckets[i];
+    }
+    return os;
+}
+
+bool
+LatencyHistogram::Parse(const char* str)
+{
+    Clear();
+    const char* p = str;
+    char*       end;
+    mCount = strtoll(p, &end, 10);
+    if (end == p || *end != ',') {
+        return false;
+    }
+    p = end + 1;
+    mTotalUsecs = strtoll(p, &end, 10);
+    if (end == p) {
+        return false;
+    }
+    for (int i = 0; *end == ',' && i < kBucketCount; i++) {
+        p = end + 1;
+        mBuckets[i] = strtoll(p, &end, 10);
+        if (end == p) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+LatencyStats::SetOpName(int op, const char* name)
+{
+    if (op < 0 || ! name || ! *name || HasOpName(op)) {
+        return;
+    }
+    if ((int)mOps.size() <= op) {
+        mOps.resize(op + 1);
+    }
+    mOps[op].mName = name;
+    mOps[op].mHist.resize(mPhaseNames.size());
+}
+
+void
+LatencyStats::Show(std::ostream& os, const char* name,
+    const LatencyHistogram& hist)
+{
+    os << kKeyPrefix << name << ": ";
+    hist.Display(os) << "\r\n";
+}
+
+void
+LatencyStats::Show(std::ostream& os) const
+{
+    for (size_t i = 0; i < mOps.size(); i++) {
+        const Op& op = mOps[i];
+        for (size_t k = 0; k < op.mHist.size(); k++) {
+            if (op.mHist[k].GetCount() <= 0) {
+                continue;
+            }
+            os << kKeyPrefix << op.mName << "-" << mPhaseNames[k] << ": ";
+            op.mHist[k].Display(os) << "\r\n";
+        }
+    }
+}
+
+}
@@ -0,0 +1,160 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2010/11/16
+//
+// Copyright 2010 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Log bucketed latency histograms, and per request type / phase
+// histogram tables for the STATS request.
+//
+// Text form of a histogram, as it appears in the STATS response:
+// Latency-<name>: <count>,<total usec>,<bucket 0>,<bucket 1>,...
+// Bucket 0 counts samples less than 1 usec, bucket i > 0 counts samples in
+// the [2^(i-1), 2^i) usec range, and the last bucket everything above.
+// Trailing empty buckets are omitted.
+//----------------------------------------------------------------------------
+
+#ifndef LIBKFSIO_LATENCY_HISTOGRAM_H
+#define LIBKFSIO_LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <ostream>
+
+namespace KFS
+{
+
+class LatencyHistogram
+{
+public:
+    enum { kBucketCount = 32 };
+
+    LatencyHistogram()
+        { Clear(); }
+    void Clear();
+    /// Event loop (single writer) update.
+    void Update(int64_t usecs)
+    {
+        const int idx = BucketIdx(usecs);
+        mBuckets[idx]++;
+        mCount++;
+        mTotalUsecs += usecs > 0 ? usecs : 0;
+    }
+    /// Lock free update for histograms shared between threads.
+    void AtomicUpdate(int64_t usecs)
+    {
+        const int idx = BucketIdx(usecs);
+        __sync_fetch_and_add(&mBuckets[idx], int64_t(1));
+        __sync_fetch_and_add(&mCount, int64_t(1));
+        __sync_fetch_and_add(&mTotalUsecs, usecs > 0 ? usecs : int64_t(0));
+    }
+    int64_t GetCount() const
+        { return mCount; }
+    int64_t GetTotalUsecs() const
+        { return mTotalUsecs; }
+    /// Percentile estimate in usec, linear interpolation within the bucket.
+    int64_t GetPercentile(double pct) const;
+    LatencyHistogram& Subtract(const LatencyHistogram& other);
+    std::ostream& Display(std::ostream& os) const;
+    /// Parse the text form produced by Display().
+    /// @retval true on success
+    bool Parse(const char* str);
+    static int64_t BucketLowerBound(int idx)
+        { return (idx <= 0 ? 0 : (int64_t(1) << (idx - 1))); }
+    static int BucketIdx(int64_t usecs)
+    {
+        if (usecs <= 0) {
+            return 0;
+        }
+        const int idx = 64 - __builtin_clzll((unsigned long long)usecs);
+        return (idx < kBucketCount ? idx : kBucketCount - 1);
+    }
+private:
+    int64_t mCount;
+    int64_t mTotalUsecs;
+    int64_t mBuckets[kBucketCount];
+};
+
+///
+/// Latency histogram table indexed by request (op) type and request
+/// processing phase. Request types without a name set are not tracked.
+///
+class LatencyStats
+{
+public:
+    /// Prefix of the STATS response histogram keys.
+    static const char* const kKeyPrefix;
+
+    LatencyStats(const char* const* phaseNames, int phaseCount)
+        : mPhaseNames(phaseNames, phaseNames + phaseCount),
+          mOps()
+        {}
+    /// Name the request type, and start tracking it. The first name set
+    /// sticks. Not thread safe: for multi threaded users all names must be
+    /// set before the first Update().
+    void SetOpName(int op, const char* name);
+    bool HasOpName(int op) const
+        { return (op >= 0 && op < (int)mOps.size() && ! mOps[op].empty()); }
+    void Update(int op, int phase, int64_t usecs)
+    {
+        LatencyHistogram* const h = Get(op, phase);
+        if (h) {
+            h->Update(usecs);
+        }
+    }
+    void AtomicUpdate(int op, int phase, int64_t usecs)
+    {
+        LatencyHistogram* const h = Get(op, phase);
+        if (h) {
+            h->AtomicUpdate(usecs);
+        }
+    }
+    /// Emit one "Latency-<op>-<phase>: <histogram>\r\n" line for every non
+    /// empty histogram.
+    void Show(std::ostream& os) const;
+    static void Show(std::ostream& os, const char* name,
+        const LatencyHistogram& hist);
+private:
+    struct Op
+    {
+        Op()
+            : mName(),
+              mHist()
+            {}
+        bool empty() const
+            { return mName.empty(); }
+        std::string                   mName;
+        std::vector<LatencyHistogram> mHist;
+    };
+    const std::vector<std::string> mPhaseNames;
+    std::vector<Op>                mOps;
+
+    LatencyHistogram* Get(int op, int phase)
+    {
+        if (! HasOpName(op) || phase < 0 ||
+                phase >= (int)mPhaseNames.size()) {
+            return 0;
+        }
+        return &mOps[op].mHist[phase];
+    }
+};
+
+}
+
+#endif // LIBKFSIO_LATENCY_HISTOGRAM_H
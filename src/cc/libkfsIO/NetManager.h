@@ -94,10 +94,24 @@ public:
         { return (mNow - mStartTime); }
     bool IsRunning() const
         { return mRunFlag; }
+    /// The poll timeout bounds the timeout handlers invocation interval.
+    /// Must be called from the net manager thread.
+    void SetPollTimeoutMs(int timeoutMs)
+        { mTimeoutMs = timeoutMs; }
+    int GetPollTimeoutMs() const
+        { return mTimeoutMs; }
     int64_t GetTimerOverrunCount() const
         { return mTimerOverrunCount; }
     int64_t GetTimerOverrunSec() const
         { return mTimerOverrunSec; }
+    /// Outgoing network backlog, and the overload state with hysteresis:
+    /// set when the backlog exceeds the max, and cleared at half of it.
+    int64_t GetNumBytesToSend() const
+        { return mNumBytesToSend; }
+    bool IsNetworkOverloaded() const
+        { return mNetworkOverloaded; }
+    bool IsOverloaded() const
+        { return mIsOverloaded; }
 
     // Primarily for debugging, to simulate network failures.
     class PollEventHook
@@ -198,7 +212,7 @@ private:
     bool                mTimerRunningFlag;
     bool                mIsForkedChild;
     /// timeout interval specified in the call to select().
-    const int           mTimeoutMs;
+    int                 mTimeoutMs;
     const time_t        mStartTime;
     time_t              mNow;
     int64_t		mMaxOutgoingBacklog;
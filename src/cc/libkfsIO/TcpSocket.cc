@@ -283,6 +283,7 @@ bool TcpSocket::IsGood() const
 
 void TcpSocket::Close()
 {
+    mPendingResponses = 0;
     if (mSockFd < 0) {
         return;
     }
@@ -63,11 +63,13 @@ class TcpSocket {
 public:
     TcpSocket() {
         mSockFd = -1;
+        mPendingResponses = 0;
     }
     /// Wrap the passed in file descriptor in a TcpSocket
     /// @param[in] fd file descriptor corresponding to a TCP socket.
     TcpSocket(int fd) {
         mSockFd = fd;
+        mPendingResponses = 0;
     }
 
     ~TcpSocket();
@@ -133,8 +135,19 @@ public:
 
     /// Get and clear pending socket error: getsockopt(SO_ERROR)
     int GetSocketError() const;
+
+    /// Request / response accounting for the synchronous rpcs: the # of
+    /// requests sent, whose responses have not been read yet. Only the
+    /// sockets with no pending responses can be reused.
+    void RequestSent() { mPendingResponses++; }
+    void ResponseReceived() {
+        if (mPendingResponses > 0)
+            mPendingResponses--;
+    }
+    int GetPendingResponses() const { return mPendingResponses; }
 private:
     int mSockFd;
+    int mPendingResponses;
 
     void SetupSocket();
 };
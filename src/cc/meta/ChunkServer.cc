@@ -84,7 +84,10 @@ ChunkServer::ChunkServer() :
 	mCanBeChunkMaster(false),
 	mIsRetiring(false), mRackId(-1), 
 	mNumCorruptChunks(0), mTotalSpace(0), mUsedSpace(0), mAllocSpace(0), 
-	mNumChunks(0), mCpuLoadAvg(0.0), mNumDrives(0), mNumChunkWrites(0),
+	mNumChunks(0), mCpuLoadAvg(0.0), mDiskLoad(0.0),
+	mDiskQueueDepth(0), mWritePendingBytes(0), mNetBytesToSend(0),
+	mNetOverloaded(false), mLoadedForWrites(false),
+	mNumDrives(0), mNumChunkWrites(0),
         mNumAppendsWithWid(0),
 	mNumChunkWriteReplications(0), mNumChunkReadReplications(0),
 	mLostChunks(0), mUptime(0), mHeartbeatProperties(),
@@ -101,7 +104,10 @@ ChunkServer::ChunkServer(NetConnectionPtr &conn) :
 	mHeartbeatSkipped(false), mLastHeartbeatSent(TimeNow()),
 	mCanBeChunkMaster(false), mIsRetiring(false), mRackId(-1), 
 	mNumCorruptChunks(0), mTotalSpace(0), mUsedSpace(0), mAllocSpace(0), 
-	mNumChunks(0), mCpuLoadAvg(0.0), mNumDrives(0), mNumChunkWrites(0), 
+	mNumChunks(0), mCpuLoadAvg(0.0), mDiskLoad(0.0),
+	mDiskQueueDepth(0), mWritePendingBytes(0), mNetBytesToSend(0),
+	mNetOverloaded(false), mLoadedForWrites(false),
+	mNumDrives(0), mNumChunkWrites(0),
         mNumAppendsWithWid(0),
 	mNumChunkWriteReplications(0), mNumChunkReadReplications(0),
         mLostChunks(0), mUptime(0), mHeartbeatProperties(),
@@ -528,6 +534,11 @@ ChunkServer::HandleReply(IOBuffer *iobuf, int msgLen)
 		mUsedSpace         = prop.getValue("Used-space",      (long long) 0);
 		mNumChunks         = prop.getValue("Num-chunks",                  0);
 		mCpuLoadAvg        = prop.getValue("CPU-load-avg",              0.0);
+		mDiskLoad          = prop.getValue("Disk-load-avg",             0.0);
+		mDiskQueueDepth    = prop.getValue("Disk-queue-depth", (long long) 0);
+		mWritePendingBytes = prop.getValue("Disk-write-pending-bytes", (long long) 0);
+		mNetBytesToSend    = prop.getValue("Net-bytes-to-send", (long long) 0);
+		mNetOverloaded     = prop.getValue("Net-overloaded",              0) != 0;
 		mNumDrives         = prop.getValue("Num-drives",                  0);
                 mUptime            = prop.getValue("Uptime",          (long long) 0);
                 mLostChunks        = prop.getValue("Chunk-corrupted", (long long) 0);
@@ -538,6 +549,7 @@ ChunkServer::HandleReply(IOBuffer *iobuf, int msgLen)
 		mHeartbeatSent     = false;
 		mHeartbeatSkipped = mLastHeartbeatSent + sHeartbeatInterval < TimeNow();
                 mHeartbeatProperties.swap(prop);
+		gLayoutManager.UpdateServerLoad(*this);
                 if (sHeartbeatLogInterval > 0 &&
                             mLastHeartBeatLoggedTime +
                                 sHeartbeatLogInterval <= mLastHeard) {
@@ -929,6 +941,11 @@ ChunkServer::Ping(string &result)
 		<< ", ncorrupt=" << mNumCorruptChunks
 		<< ", nchunksToMove=" << mChunksToMove.size()
 		<< ", numDrives=" << mNumDrives
+		<< ", diskLoad=" << mDiskLoad
+		<< ", diskQueueDepth=" << mDiskQueueDepth
+		<< ", writePending=" << mWritePendingBytes
+		<< ", netBacklog=" << mNetBytesToSend
+		<< (mLoadedForWrites ? ", loaded=1" : "")
                 << (isOverloaded ? ", overloaded=1" : "")
 		<< "\t"
 	;
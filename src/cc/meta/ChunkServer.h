@@ -313,6 +313,44 @@ namespace KFS
 			return mCpuLoadAvg;
 		}
 
+		/// Average disk load of the usable chunk directories, as
+		/// reported by the chunkserver: 1.0 means that the disks are
+		/// as busy as configured on the chunkserver (queue depth and
+		/// io time).
+		double GetDiskLoad() const {
+			return mDiskLoad;
+		}
+
+		/// I/O pressure reported by the chunkserver: the number of
+		/// queued disk requests, the bytes waiting to be written to
+		/// disk, and the network send backlog.
+		int64_t GetDiskQueueDepth() const {
+			return mDiskQueueDepth;
+		}
+		int64_t GetWritePendingBytes() const {
+			return mWritePendingBytes;
+		}
+		int64_t GetNetBytesToSend() const {
+			return mNetBytesToSend;
+		}
+		bool IsNetOverloaded() const {
+			return mNetOverloaded;
+		}
+		int GetNumDrives() const {
+			return mNumDrives;
+		}
+
+		/// The layout manager sets this on every heartbeat from the
+		/// reported I/O pressure. Loaded servers are used for new
+		/// chunks only if there are not enough other servers, and
+		/// are the last choice for reads.
+		bool IsLoadedForWrites() const {
+			return mLoadedForWrites;
+		}
+		void SetLoadedForWrites(bool flag) {
+			mLoadedForWrites = flag;
+		}
+
 		/// Available space is defined as the difference
 		/// between the total storage space available
 		/// on the server and the amount of space that
@@ -477,6 +515,15 @@ namespace KFS
 		/// the nodes.
 		double mCpuLoadAvg;
 
+		/// Disk load estimate, see GetDiskLoad().
+		double mDiskLoad;
+		/// I/O pressure, see GetDiskQueueDepth().
+		int64_t mDiskQueueDepth;
+		int64_t mWritePendingBytes;
+		int64_t mNetBytesToSend;
+		bool    mNetOverloaded;
+		bool    mLoadedForWrites;
+
 		/// Chunkserver returns the # of drives on the node in a
 		/// heartbeat response; we can then show this value on the UI
 		int mNumDrives;
@@ -68,6 +68,7 @@ int ClientSM::sMaxPendingLength   = 16;
 int ClientSM::sMaxReadAhead       = 3 << 10;
 int ClientSM::sInactivityTimeout  = 8 * 60;
 int ClientSM::sMaxWriteBehind     = 3 << 10;
+int ClientSM::sMaxContentLength   = 8 << 20;
 
 /* static */ void
 ClientSM::SetParameters(const Properties& prop)
@@ -84,6 +85,9 @@ ClientSM::SetParameters(const Properties& prop)
 	sMaxWriteBehind = prop.getValue(
 		"metaServer.clientSM.maxWriteBehind",
 		sMaxWriteBehind);
+	sMaxContentLength = prop.getValue(
+		"metaServer.clientSM.maxContentLength",
+		sMaxContentLength);
 }
 
 ClientSM::ClientSM(NetConnectionPtr &conn)
@@ -92,7 +96,8 @@ ClientSM::ClientSM(NetConnectionPtr &conn)
       mPending(),
       mPendingLength(0),
       mRecursionCnt(0),
-      mClientProtoVers(KFS_CLIENT_PROTO_VERS)
+      mClientProtoVers(KFS_CLIENT_PROTO_VERS),
+      mContentOp(0)
 {
 	mNetConnection->SetInactivityTimeout(sInactivityTimeout);
         mNetConnection->SetMaxReadAhead(sMaxReadAhead);
@@ -102,6 +107,7 @@ ClientSM::ClientSM(NetConnectionPtr &conn)
 ClientSM::~ClientSM()
 {
 	delete mOp;
+	delete mContentOp;
 	DeleteAll(mPending);
 }
 
@@ -197,6 +203,7 @@ ClientSM::SendResponse(MetaRequest *op)
         	KFS_LOG_EOM; 
 	}
 	sReqStatsGatherer.OpDone(*op);
+	UpdateRequestLatency(*op);
 	IOBuffer::OStream os;
 	op->response(os);
 	mNetConnection->Write(&os);
@@ -226,10 +233,19 @@ ClientSM::HandleRequest(int code, void *data)
 		// We read something from the network.  Run the RPC that
 		// came in.
 		iobuf = (IOBuffer *) data;
-		while (IsMsgAvail(iobuf, &cmdLen)) {
-                    HandleClientCmd(iobuf, cmdLen);
-                }
-                if ((hdrsz = iobuf->BytesConsumable()) > MAX_RPC_HEADER_LEN) {
+		for (; ;) {
+			if (mContentOp) {
+				if (! HandleClientContent(iobuf)) {
+					break;
+				}
+			} else if (IsMsgAvail(iobuf, &cmdLen)) {
+				HandleClientCmd(iobuf, cmdLen);
+			} else {
+				break;
+			}
+		}
+                if (! mContentOp &&
+			(hdrsz = iobuf->BytesConsumable()) > MAX_RPC_HEADER_LEN) {
                     KFS_LOG_STREAM_ERROR << PeerName(mNetConnection) <<
                         " exceeded max request header size: " << hdrsz <<
                         " > " << MAX_RPC_HEADER_LEN <<
@@ -346,8 +362,65 @@ ClientSM::HandleClientCmd(IOBuffer *iobuf, int cmdLen)
 			" Command with old protocol version: " <<
 			op->clientProtoVers << ' ' << op->Show() << KFS_LOG_EOM;
 	}
+	op->recvTime = microseconds();
 	// Command is ready to be pushed down.  So remove the cmd from the buffer.
 	iobuf->Consume(cmdLen);
+	const int contentLength = op->requestContentLength();
+	if (contentLength > 0) {
+		if (contentLength > sMaxContentLength) {
+			KFS_LOG_STREAM_ERROR << PeerName(mNetConnection) <<
+				" request content length: " << contentLength <<
+				" exceeds max: " << sMaxContentLength <<
+				" " << op->Show() <<
+			KFS_LOG_EOM;
+			delete op;
+			iobuf->Clear();
+			HandleRequest(EVENT_NET_ERROR, NULL);
+			return;
+		}
+		// Wait for the request body, see HandleClientContent().
+		mContentOp = op;
+		return;
+	}
+	QueueOp(op);
+}
+
+bool
+ClientSM::HandleClientContent(IOBuffer *iobuf)
+{
+	const int contentLength = mContentOp->requestContentLength();
+	const int avail         = iobuf->BytesConsumable();
+	if (avail < contentLength) {
+		if (mNetConnection) {
+			mNetConnection->SetMaxReadAhead(
+				max(sMaxReadAhead, contentLength - avail));
+		}
+		return false;
+	}
+	MetaRequest * const op = mContentOp;
+	mContentOp = 0;
+	IOBuffer::IStream is(*iobuf, contentLength);
+	const bool ok = op->parseRequestContent(is);
+	iobuf->Consume(contentLength);
+	if (! ok) {
+		KFS_LOG_STREAM_ERROR << PeerName(mNetConnection) <<
+			" invalid request content: " << op->Show() <<
+		KFS_LOG_EOM;
+		delete op;
+		iobuf->Clear();
+		HandleRequest(EVENT_NET_ERROR, NULL);
+		return false;
+	}
+	if (mNetConnection) {
+		mNetConnection->SetMaxReadAhead(sMaxReadAhead);
+	}
+	QueueOp(op);
+	return true;
+}
+
+void
+ClientSM::QueueOp(MetaRequest *op)
+{
 	KFS_LOG_STREAM_DEBUG << PeerName(mNetConnection) <<
 		" "       << mPendingLength <<
             	" +seq: " << op->opSeqno <<
@@ -379,6 +452,7 @@ ClientSM::SubmitOp()
 		" pending: "     << mPendingLength <<
 	KFS_LOG_EOM;
 	mOp->clnt = this;
+	mOp->submitTime = microseconds();
 	// send it on its merry way
 	submit_request(mOp);
 }
@@ -72,9 +72,16 @@ namespace KFS
         int             mRecursionCnt;
 	/// used to print message about old protocol version once
 	int		mClientProtoVers;
+	/// The op (if any) that waits for its request body to arrive
+	MetaRequest	*mContentOp;
 
         /// Given a (possibly) complete op in a buffer, run it.
         void		HandleClientCmd(IOBuffer *iobuf, int cmdLen);
+	/// Parse the request body of mContentOp, if all of it has arrived.
+	/// @retval true if the op was queued for execution
+	bool		HandleClientContent(IOBuffer *iobuf);
+	/// Queue a parsed op for execution
+	void		QueueOp(MetaRequest *op);
 
         /// Op has finished execution.  Send a response to the client.
         void		SendResponse(MetaRequest *op);
@@ -86,6 +93,7 @@ namespace KFS
 	static int sMaxReadAhead;
 	static int sInactivityTimeout;
         static int sMaxWriteBehind;
+	static int sMaxContentLength;
     };
 
 }
@@ -28,6 +28,7 @@
 #include <algorithm>
 #include <functional>
 #include <sstream>
+#include <cmath>
 #include <boost/lexical_cast.hpp>
 #include <openssl/rand.h>
 
@@ -46,6 +47,7 @@ using std::bind2nd;
 using std::sort;
 using std::random_shuffle;
 using std::remove_if;
+using std::stable_sort;
 using std::set;
 using std::vector;
 using std::map;
@@ -61,6 +63,10 @@ using std::pop_heap;
 using namespace KFS;
 using namespace KFS::libkfsio;
 
+// One slot per second; covers the lease interval, so that the most leases
+// come due within one turn of the wheel.
+static const size_t kLeaseTimerWheelSlots = 512;
+
 LayoutManager KFS::gLayoutManager;
 
 /// Max # of concurrent read/write replications per node
@@ -169,11 +175,20 @@ inline bool
 ARAChunkCache::Invalidate(fid_t fid, chunkId_t chunkId)
 {
 	iterator const it = mMap.find(fid);
-	if (it == mMap.end() || it->second.chunkId != chunkId) {
+	if (it == mMap.end()) {
 		return false;
 	}
-	mMap.erase(it);
-	return true;
+	Entries& entries = it->second;
+	for (Entries::iterator ei = entries.begin(); ei != entries.end(); ++ei) {
+		if (ei->chunkId == chunkId) {
+			entries.erase(ei);
+			if (entries.empty()) {
+				mMap.erase(it);
+			}
+			return true;
+		}
+	}
+	return false;
 }
 
 void
@@ -189,13 +204,31 @@ ARAChunkCache::RequestNew(MetaAllocate& req)
 	while (last->next) {
 		last = last->next;
 	}
-	mMap[req.fid] = Entry(
+	const Entry entry(
 		req.chunkId,
 		req.chunkVersion,
 		req.offset,
 		TimeNow(),
-		last
+		last,
+		req.master
 	);
+	Entries& entries = mMap[req.fid];
+	if ((int)entries.size() < mMaxEntriesPerFile) {
+		entries.push_back(entry);
+		return;
+	}
+	// Replace the chunk that is the closest to full: the one with the
+	// most space reserved, with no allocation in progress, if possible.
+	Entries::iterator victim = entries.begin();
+	for (Entries::iterator it = entries.begin(); it != entries.end(); ++it) {
+		if (victim->IsAllocationPending() != it->IsAllocationPending() ?
+				victim->IsAllocationPending() :
+				victim->spaceReservationSize <
+					it->spaceReservationSize) {
+			victim = it;
+		}
+	}
+	*victim = entry;
 }
 
 bool
@@ -232,15 +265,23 @@ ARAChunkCache::RequestDone(const MetaAllocate& req)
 	if (it == mMap.end()) {
 		return;
 	}
-	Entry& entry = it->second;
-	if (entry.chunkId != req.chunkId) {
+	Entries& entries = it->second;
+	Entries::iterator ei = entries.begin();
+	while (ei != entries.end() && ei->chunkId != req.chunkId) {
+		++ei;
+	}
+	if (ei == entries.end()) {
 		return;
 	}
 	if (req.status != 0) {
-		// Failure, invalidate the cache.
-		mMap.erase(it);
+		// Failure, invalidate the cache entry.
+		entries.erase(ei);
+		if (entries.empty()) {
+			mMap.erase(it);
+		}
 		return;
 	}
+	Entry& entry = *ei;
 	entry.offset             = req.offset;
 	entry.lastPendingRequest = 0;
 	entry.lastAccessedTime   = TimeNow();
@@ -250,12 +291,20 @@ void
 ARAChunkCache::Timeout(time_t minTime)
 {
 	for (iterator it = mMap.begin(); it != mMap.end(); ) {
-		const Entry& entry = it->second;
-		if (entry.lastAccessedTime >= minTime ||
-				entry.lastPendingRequest) {
-			++it; // valid entry; keep going
-		} else {
+		Entries& entries = it->second;
+		for (Entries::iterator ei = entries.begin();
+				ei != entries.end(); ) {
+			if (ei->lastAccessedTime >= minTime ||
+					ei->lastPendingRequest) {
+				++ei; // valid entry; keep going
+			} else {
+				ei = entries.erase(ei);
+			}
+		}
+		if (entries.empty()) {
 			mMap.erase(it++);
+		} else {
+			++it;
 		}
 	}
 }
@@ -281,10 +330,18 @@ LayoutManager::LayoutManager() :
 	mAssignMasterByIpFlag(false),
 	mLeaseOwnerDownExpireDelay(30),
 	mPercentLoadedNodesToAvoidForWrites(0.3),
+	mMaxDiskLoadForWrites(4.0),
+	mMaxDiskQueueDepthPerDriveForWrites(32),
+	mMaxWritePendingBytesPerDriveForWrites(64 << 20),
+	mAvoidNetOverloadedServersForWrites(true),
+	mLoadedForWritesHysteresis(0.8),
+	mReplicationLoadPacingFlag(true),
+	mReplicationPacingMinDiskLoad(1.0),
 	mMaxReservationSize(4 << 20),
 	mReservationDecayStep(4), // decrease by factor of 2 every 4 sec
 	mChunkReservationThreshold(KFS::CHUNKSIZE),
 	mReservationOvercommitFactor(.25),
+	mRackPrefixes(),
 	mServerDownReplicationDelay(10 * 60),
 	mMaxDownServersHistorySize(4 << 10),
         mChunkServersProps(),
@@ -299,12 +356,19 @@ LayoutManager::LayoutManager() :
 {
 	// pthread_mutex_init(&mChunkServersMutex, NULL);
 
+	mLeaseTimerWheel.resize(kLeaseTimerWheelSlots);
+	mLeaseTimerTime = TimeNow();
+
 	mReplicationTodoStats = new Counter("Num Replications Todo");
 	mChunksWithOneReplicaStats = new Counter("Chunks with one replica");
 	mOngoingReplicationStats = new Counter("Num Ongoing Replications");
 	mTotalReplicationStats = new Counter("Total Num Replications");
 	mFailedReplicationStats = new Counter("Num Failed Replications");
 	mStaleChunkCount = new Counter("Num Stale Chunks");
+	mChunksWithLeasesStats = new Counter("Chunks with leases");
+	mExpiredLeasesStats = new Counter("Num Expired Leases");
+	mLeaseCleanupTimeStats = new Counter("Lease cleanup usec");
+	mLeaseCleanupMaxTimeStats = new Counter("Lease cleanup max usec");
 	// how much to be done before we are done
 	globals().counterManager.AddCounter(mReplicationTodoStats);
 	// how many chunks are "endangered"
@@ -314,6 +378,10 @@ LayoutManager::LayoutManager() :
 	globals().counterManager.AddCounter(mTotalReplicationStats);
 	globals().counterManager.AddCounter(mFailedReplicationStats);
 	globals().counterManager.AddCounter(mStaleChunkCount);
+	globals().counterManager.AddCounter(mChunksWithLeasesStats);
+	globals().counterManager.AddCounter(mExpiredLeasesStats);
+	globals().counterManager.AddCounter(mLeaseCleanupTimeStats);
+	globals().counterManager.AddCounter(mLeaseCleanupMaxTimeStats);
 }
 
 void
@@ -349,6 +417,9 @@ LayoutManager::SetParameters(const Properties& props)
 	mReservationOvercommitFactor = max(0., props.getValue(
 		"metaServer.wappend.reservationOvercommitFactor",
 		mReservationOvercommitFactor));
+	mARAChunkCache.SetMaxEntriesPerFile(props.getValue(
+		"metaServer.wappend.maxChunksPerFile",
+		mARAChunkCache.GetMaxEntriesPerFile()));
 	/// On a startup, the # of secs to wait before we are open for reads/writes
 	mRecoveryIntervalSecs = props.getValue(
 		"metaServer.recoveryInterval", mRecoveryIntervalSecs);
@@ -381,6 +452,39 @@ LayoutManager::SetParameters(const Properties& props)
 			mPercentLoadedNodesToAvoidForWrites <<
 		KFS_LOG_EOM;
         }
+	mMaxDiskLoadForWrites = props.getValue(
+		"metaServer.maxDiskLoadForWrites",
+		mMaxDiskLoadForWrites);
+	mMaxDiskQueueDepthPerDriveForWrites = props.getValue(
+		"metaServer.maxDiskQueueDepthPerDriveForWrites",
+		mMaxDiskQueueDepthPerDriveForWrites);
+	mMaxWritePendingBytesPerDriveForWrites = props.getValue(
+		"metaServer.maxWritePendingBytesPerDriveForWrites",
+		mMaxWritePendingBytesPerDriveForWrites);
+	mAvoidNetOverloadedServersForWrites = props.getValue(
+		"metaServer.avoidNetOverloadedServersForWrites",
+		mAvoidNetOverloadedServersForWrites ? 1 : 0) != 0;
+	mLoadedForWritesHysteresis = max(0.0, min(1.0, props.getValue(
+		"metaServer.loadedForWritesHysteresis",
+		mLoadedForWritesHysteresis)));
+	mReplicationLoadPacingFlag = props.getValue(
+		"metaServer.replicationLoadPacing",
+		mReplicationLoadPacingFlag ? 1 : 0) != 0;
+	mReplicationPacingMinDiskLoad = props.getValue(
+		"metaServer.replicationPacingMinDiskLoad",
+		mReplicationPacingMinDiskLoad);
+	// "prefix rack prefix rack ...", for example: "10.6.1. 1 10.6.2. 2"
+	const string rackPrefixes = props.getValue(
+		"metaServer.rackPrefixes", string());
+	if (! rackPrefixes.empty()) {
+		mRackPrefixes.clear();
+		istringstream is(rackPrefixes);
+		string prefix;
+		int    rack;
+		while ((is >> prefix >> rack)) {
+			mRackPrefixes.push_back(make_pair(prefix, rack));
+		}
+	}
 
 	SetChunkServersProperties(props);
 }
@@ -485,17 +589,6 @@ public:
 // Try to match servers by hostname: for write allocation, we'd like to place
 // one copy of the block on the same host on which the client is running.
 //
-class MatchServerByHost {
-	string host;
-public:
-	MatchServerByHost(const string &s) : host(s) { }
-	bool operator() (ChunkServerPtr &s) {
-		ServerLocation l = s->GetServerLocation();
-
-		return l.hostname == host;
-	}
-};
-
 
 /// Add the newly joined server to the list of servers we have.  Also,
 /// update our state to include the chunks hosted on this server.
@@ -722,6 +815,7 @@ LayoutManager::AddNewServer(MetaHello *r)
 		ri.addServer(r->server);
 		mRacks.push_back(ri);
 	}
+	mPlacementIndex.Add(r->server);
 
 	// Update the list since a new server is in
 	CheckHibernatingServersStatus();
@@ -761,6 +855,7 @@ LayoutManager::AddNewServer(MetaHello *r)
 		" uptime: "         << srv.Uptime() <<
 		" restart: "        << srv.IsRestartScheduled() <<
 	KFS_LOG_EOM;
+	UpdateServerPlacement(&srv);
 }
 
 const char*
@@ -929,12 +1024,14 @@ struct ExpireLeaseIfOwner
 {
 	const ChunkServer * const target;
 	const time_t              expire;
+	int                       count;
 	ExpireLeaseIfOwner(const ChunkServer *t)
-		: target(t), expire(TimeNow() - 1)
+		: target(t), expire(TimeNow() - 1), count(0)
 	{}
 	void operator () (LeaseInfo& li) {
 		if (li.chunkServer.get() == target) {
 			li.expires = expire;
+			count++;
 			li.ownerWasDownFlag = li.ownerWasDownFlag ||
 				(target && target->IsDown());
 		}
@@ -944,10 +1041,12 @@ struct ExpireLeaseIfOwner
 class MapPurger {
 	ReplicationCandidates&   crset;
         ARAChunkCache&           araChunkCache;
+	vector<chunkId_t>&       expiredLeases;
 	const ChunkServer* const target;
 public:
-	MapPurger(ReplicationCandidates &c, ARAChunkCache& ac, const ChunkServer *t)
-		: crset(c), araChunkCache(ac), target(t)
+	MapPurger(ReplicationCandidates &c, ARAChunkCache& ac,
+			vector<chunkId_t>& el, const ChunkServer *t)
+		: crset(c), araChunkCache(ac), expiredLeases(el), target(t)
 		{}
 	void operator () (CSMap::value_type& p) {
 		ChunkPlacementInfo& c = p.second;
@@ -962,8 +1061,10 @@ public:
 		if (i == c.chunkServers.end()) {
 			return;
 		}
-		for_each(c.chunkLeases.begin(), c.chunkLeases.end(),
-			ExpireLeaseIfOwner(target));
+		if (for_each(c.chunkLeases.begin(), c.chunkLeases.end(),
+				ExpireLeaseIfOwner(target)).count > 0) {
+			expiredLeases.push_back(p.first);
+		}
 		EraseReallocIfNeeded(c.chunkServers, i, c.chunkServers.end());
                 // Chunk replication chain has changed: invalidate write append
                 // cache entry, if any. It is an error to attempt to append to
@@ -1148,6 +1249,7 @@ LayoutManager::ServerDown(ChunkServer *server)
 	if (! server->IsDown()) {
 		server->ForceDown();
 	}
+	mPlacementIndex.Remove(server);
 	vector<RackInfo>::iterator rackIter;
 
 	rackIter = find_if(mRacks.begin(), mRacks.end(), RackMatcher(server->GetRack()));
@@ -1169,12 +1271,14 @@ LayoutManager::ServerDown(ChunkServer *server)
 	server->FailPendingOps();
 
 	// check if this server was sent to hibernation
-	bool isHibernating = false;
+	bool              isHibernating = false;
+	vector<chunkId_t> expiredLeases;
 	for (uint32_t j = 0; j < mHibernatingServers.size(); j++) {
 		if (mHibernatingServers[j].location == server->GetServerLocation()) {
 			// record all the blocks that need to be checked for
 			// re-replication later
-			MapPurger purge(mHibernatingServers[j].blocks, mARAChunkCache, server);
+			MapPurger purge(mHibernatingServers[j].blocks,
+				mARAChunkCache, expiredLeases, server);
 			for_each(mChunkToServerMap.begin(), mChunkToServerMap.end(), purge);
 			isHibernating = true;
 			break;
@@ -1191,10 +1295,12 @@ LayoutManager::ServerDown(ChunkServer *server)
 			hsi.location     = server->GetServerLocation();
 			hsi.sleepEndTime = TimeNow() + replicationDelay;
 			mHibernatingServers.push_back(hsi);
-			MapPurger purge(mHibernatingServers.back().blocks, mARAChunkCache, server);
+			MapPurger purge(mHibernatingServers.back().blocks,
+				mARAChunkCache, expiredLeases, server);
 			for_each(mChunkToServerMap.begin(), mChunkToServerMap.end(), purge);
 		} else {
-			MapPurger purge(mChunkReplicationCandidates, mARAChunkCache, server);
+			MapPurger purge(mChunkReplicationCandidates,
+				mARAChunkCache, expiredLeases, server);
 			for_each(mChunkToServerMap.begin(), mChunkToServerMap.end(), purge);
 		}
 		RebuildPriorityReplicationList();
@@ -1202,6 +1308,13 @@ LayoutManager::ServerDown(ChunkServer *server)
 
 	// for reporting purposes, record when it went down
 	const time_t now = TimeNow();
+	// Let the lease cleanup pick up the leases owned by this server on
+	// the next run, rather than at their original expiration time.
+	for (vector<chunkId_t>::const_iterator it = expiredLeases.begin();
+			it != expiredLeases.end();
+			++it) {
+		ScheduleLeaseCheck(*it, now);
+	}
 	const ServerLocation loc = server->GetServerLocation();
 
 	string reason = server->DownReason();
@@ -1248,6 +1361,7 @@ LayoutManager::ServerDown(ChunkServer *server)
 		mSlavesCount--;
 		mMastersCount++;
 		mChunkServers.front()->SetCanBeChunkMaster(true);
+		UpdateServerPlacement(mChunkServers.front().get());
 	}
 	
 }
@@ -1265,6 +1379,7 @@ LayoutManager::RetireServer(const ServerLocation &loc, int downtime)
 	retiringServer = *i;
 
 	retiringServer->SetRetiring();
+	UpdateServerPlacement(retiringServer.get());
 	if (downtime > 0) {
 		HibernatingServerInfo_t hsi;
 
@@ -1326,52 +1441,31 @@ LayoutManager::FindCandidateRacks(vector<int> &result)
 void
 LayoutManager::FindCandidateRacks(vector<int> &result, const set<int> &excludes)
 {
-	set<int>::const_iterator iter;
-	int32_t numRacksToChoose = mRacks.size() - excludes.size();
-	int32_t count = 0;
-	int rackId, nodeId;
-	set<int> chosenRacks;
-
 	result.clear();
-
-	if (numRacksToChoose == 0)
-		return;
-
+	// Order the racks at random, with the probability of a rack being
+	// ahead proportional to the # of nodes in the rack: sort by the
+	// exponential keys log(u) / weight, u uniform in (0, 1). This is
+	// the same as repeatedly choosing a rack proportional to the # of
+	// nodes among the racks not chosen yet, but in one pass.
+	vector<pair<double, int> > keys;
+	keys.reserve(mRacks.size());
 	for (uint32_t i = 0; i < mRacks.size(); i++) {
+		const size_t numServers = mRacks[i].getServers().size();
 		// paranoia: each candidate rack better have at least one node
-		if (!excludes.empty()) {
-			iter = excludes.find(mRacks[i].id());
-			if (iter != excludes.end())
-				continue;
-		}
-		if (mRacks[i].getServers().size() == 0) {
-			// there are no nodes in this rack
-			numRacksToChoose--;
-		}
-	}
-
-	if (numRacksToChoose == 0)
-		return;
-
-	count = 0;
-	// choose a rack proportional to the # of nodes that rack
-	while (count < numRacksToChoose) {
-		nodeId = rand() % mChunkServers.size();
-		rackId = mChunkServers[nodeId]->GetRack();
-		if (!excludes.empty()) {
-			iter = excludes.find(rackId);
-			if (iter != excludes.end())
-				// rack is in the exclude list
-				continue;
+		if (numServers == 0) {
+			continue;
 		}
-		iter = chosenRacks.find(rackId);
-		if (iter != chosenRacks.end()) {
-			// we have chosen this rack already
+		if (! excludes.empty() &&
+				excludes.find(mRacks[i].id()) != excludes.end()) {
 			continue;
 		}
-		chosenRacks.insert(rackId);
-		result.push_back(rackId);
-		count++;
+		const double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+		keys.push_back(make_pair(-log(u) / numServers, (int)mRacks[i].id()));
+	}
+	sort(keys.begin(), keys.end());
+	result.reserve(keys.size());
+	for (size_t i = 0; i < keys.size(); i++) {
+		result.push_back(keys[i].second);
 	}
 }
 
@@ -1431,10 +1525,10 @@ LayoutManager::FindCandidateServers(vector<ChunkServerPtr> &result,
 }
 
 static bool
-IsCandidateServer(const ChunkServerPtr &c)
+IsCandidateServer(const ChunkServer &c)
 {
-	if ((c->GetAvailSpace() < ((int64_t) CHUNKSIZE)) || (!c->IsResponsiveServer())
-		|| (c->IsRetiring()) || (c->IsRestartScheduled())) {
+	if ((c.GetAvailSpace() < ((int64_t) CHUNKSIZE)) || (!c.IsResponsiveServer())
+		|| (c.IsRetiring()) || (c.IsRestartScheduled())) {
 		// one of: no space, non-responsive, retiring...we leave
 		// the server alone
 		return false;
@@ -1442,6 +1536,158 @@ IsCandidateServer(const ChunkServerPtr &c)
 	return true;
 }
 
+static bool
+IsCandidateServer(const ChunkServerPtr &c)
+{
+	return IsCandidateServer(*c);
+}
+
+static bool
+IsPlacementCandidate(const ChunkServer &c)
+{
+	// XXX: temporary measure: take only under-utilized servers
+	return (IsCandidateServer(c) &&
+		c.GetSpaceUtilization() <= MAX_SERVER_SPACE_UTIL_THRESHOLD);
+}
+
+/// Chunk placement weight: proportional to the free space in chunks, and
+/// scaled down by the number of chunks being written to, so that the
+/// servers with more space get more new chunks, but not all of them.
+static int64_t
+PlacementWeight(const ChunkServer &c)
+{
+	if (! IsPlacementCandidate(c)) {
+		return 0;
+	}
+	const int64_t kWriteScale = 8;
+	const int64_t freeChunks  =
+		max(int64_t(1), c.GetAvailSpace() / (int64_t)CHUNKSIZE);
+	return max(int64_t(1),
+		freeChunks * kWriteScale / (kWriteScale + c.GetNumChunkWrites()));
+}
+
+void
+LayoutManager::UpdateServerPlacement(const ChunkServer *server)
+{
+	mPlacementIndex.Update(server, PlacementWeight(*server),
+		server->CanBeChunkMaster(), server->IsLoadedForWrites());
+}
+
+/// @retval true if the value is over the limit; the limit is lowered by the
+/// hysteresis factor for the server that is already loaded.
+static inline bool
+IsOverLimit(double val, double limit, bool loadedFlag, double hysteresis)
+{
+	return (limit > 0 && val > (loadedFlag ? limit * hysteresis : limit));
+}
+
+void
+LayoutManager::UpdateServerLoad(ChunkServer &server)
+{
+	const bool   wasLoaded = server.IsLoadedForWrites();
+	const double drives    = max(1, server.GetNumDrives());
+	const bool   loaded    =
+		IsOverLimit(server.GetDiskLoad(),
+			mMaxDiskLoadForWrites,
+			wasLoaded, mLoadedForWritesHysteresis) ||
+		IsOverLimit(server.GetDiskQueueDepth() / drives,
+			mMaxDiskQueueDepthPerDriveForWrites,
+			wasLoaded, mLoadedForWritesHysteresis) ||
+		IsOverLimit(server.GetWritePendingBytes() / drives,
+			(double)mMaxWritePendingBytesPerDriveForWrites,
+			wasLoaded, mLoadedForWritesHysteresis) ||
+		// The chunk server's network overload state already has
+		// hysteresis.
+		(mAvoidNetOverloadedServersForWrites &&
+			server.IsNetOverloaded());
+	if (loaded != wasLoaded) {
+		server.SetLoadedForWrites(loaded);
+		KFS_LOG_STREAM_INFO << server.ServerID() <<
+			(loaded ? " loaded" : " no longer loaded") <<
+			" disk load: "     << server.GetDiskLoad() <<
+			" queue depth: "   << server.GetDiskQueueDepth() <<
+			" write pending: " << server.GetWritePendingBytes() <<
+			" net backlog: "   << server.GetNetBytesToSend() <<
+			" drives: "        << server.GetNumDrives() <<
+		KFS_LOG_EOM;
+	}
+	UpdateServerPlacement(&server);
+}
+
+int
+LayoutManager::GetMaxReplications(const ChunkServer &server,
+	int maxCount) const
+{
+	if (! mReplicationLoadPacingFlag || maxCount <= 1) {
+		return maxCount;
+	}
+	if (server.IsLoadedForWrites()) {
+		return 1;
+	}
+	// Scale down linearly from the max count at the min disk load, to 1
+	// at the disk load where the server is considered loaded for writes.
+	const double minLoad = max(0.0, mReplicationPacingMinDiskLoad);
+	const double maxLoad = mMaxDiskLoadForWrites > minLoad ?
+		mMaxDiskLoadForWrites : minLoad * 2;
+	const double load    = server.GetDiskLoad();
+	if (load <= minLoad) {
+		return maxCount;
+	}
+	if (load >= maxLoad) {
+		return 1;
+	}
+	return max(1, (int)(maxCount -
+		(maxCount - 1) * (load - minLoad) / (maxLoad - minLoad)));
+}
+
+int
+LayoutManager::GetMaxWriteReplications(const ChunkServer &server) const
+{
+	return GetMaxReplications(server,
+		MAX_CONCURRENT_WRITE_REPLICATIONS_PER_NODE);
+}
+
+int
+LayoutManager::GetMaxReadReplications(const ChunkServer &server) const
+{
+	return GetMaxReplications(server,
+		MAX_CONCURRENT_READ_REPLICATIONS_PER_NODE);
+}
+
+size_t
+LayoutManager::PickCandidateServers(vector<ChunkServerPtr> &result,
+				size_t count, int rackId,
+				PlacementIndex::Role role,
+				const vector<ChunkServerPtr>& excludes)
+{
+	size_t picked = 0;
+	while (picked < count) {
+		const size_t start = result.size();
+		if (mPlacementIndex.Pick(
+				rackId, count - picked, role, excludes, result) <= 0) {
+			break;
+		}
+		// The weights are updated on heartbeat, the server might have
+		// been retired, or scheduled for restart since then. Drop such
+		// servers, and pick again.
+		for (size_t i = start; i < result.size(); ) {
+			const ChunkServer& c = *result[i];
+			if (IsPlacementCandidate(c) &&
+					(role != PlacementIndex::kMasterRole ||
+						c.CanBeChunkMaster()) &&
+					(role != PlacementIndex::kSlaveRole ||
+						! c.CanBeChunkMaster())) {
+				i++;
+				picked++;
+				continue;
+			}
+			UpdateServerPlacement(&c);
+			result.erase(result.begin() + i);
+		}
+	}
+	return picked;
+}
+
 #if 0
 static void
 SortServersByCPULoad(vector<ChunkServerPtr> &servers)
@@ -1477,6 +1723,7 @@ LayoutManager::FindCandidateServers(vector<ChunkServerPtr> &result,
 		return;
 
 	vector<ChunkServerPtr> candidates;
+	vector<ChunkServerPtr> diskLoaded;
 	vector<ChunkServerPtr>::size_type i;
 	vector<ChunkServerPtr>::const_iterator iter;
 
@@ -1499,9 +1746,15 @@ LayoutManager::FindCandidateServers(vector<ChunkServerPtr> &result,
 		// under-utilized servers
 		if (c->GetSpaceUtilization() > MAX_SERVER_SPACE_UTIL_THRESHOLD)
 			continue;
+		// Servers with busy disks go to the end of the list, and
+		// are only used if there isn't enough other servers.
+		if (c->IsLoadedForWrites()) {
+			diskLoaded.push_back(c);
+			continue;
+		}
 		candidates.push_back(c);
 	}
-	if (candidates.size() == 0)
+	if (candidates.size() == 0 && diskLoaded.size() == 0)
 		return;
 #if 0
 	// do this on a heartbeat; not here
@@ -1517,6 +1770,10 @@ LayoutManager::FindCandidateServers(vector<ChunkServerPtr> &result,
 	for (i = 0; i < candidates.size(); i++) {
 		result.push_back(candidates[i]);
 	}
+	random_shuffle(diskLoaded.begin(), diskLoaded.end());
+	for (i = 0; i < diskLoaded.size(); i++) {
+		result.push_back(diskLoaded[i]);
+	}
 }
 
 #if 0
@@ -1611,9 +1868,8 @@ LayoutManager::SortServersByUtilization(vector<ChunkServerPtr> &servers)
 /// chunk server has lot of space available).
 ///
 int
-LayoutManager::AllocateChunk(MetaAllocate *r)
+LayoutManager::ChooseAllocationServers(MetaAllocate *r)
 {
-	vector<ChunkServerPtr>::size_type i;
 	vector<int> racks;
 
 	r->servers.clear();
@@ -1649,58 +1905,85 @@ LayoutManager::AllocateChunk(MetaAllocate *r)
 	// a chunk master is never made a slave.
 	ChunkServerPtr localserver;
 	int replicaCnt = 0;
-	vector <ChunkServerPtr>::iterator const li = find_if(
-            mChunkServers.begin(), mChunkServers.end(), MatchServerByHost(r->clientHost));
-	if ((li != mChunkServers.end()) && (IsCandidateServer(*li)) &&
-			(! r->appendChunk || (*li)->CanBeChunkMaster())) {
-		localserver = *li;
-		replicaCnt++;
+	vector<ChunkServerPtr> local;
+	if (! r->clientHost.empty()) {
+		mPlacementIndex.FindByHost(r->clientHost, local);
+	}
+	// Place the file's open append chunks on different masters.
+	vector<ChunkServerPtr> masters;
+	const ARAChunkCache::Entries* const araEntries = r->appendChunk ?
+		mARAChunkCache.Get(r->fid) : 0;
+	if (araEntries) {
+		for (ARAChunkCache::Entries::const_iterator it =
+				araEntries->begin();
+				it != araEntries->end();
+				++it) {
+			if (it->master) {
+				masters.push_back(it->master);
+			}
+		}
+	}
+	for (vector<ChunkServerPtr>::const_iterator li = local.begin();
+			li != local.end();
+			++li) {
+		if (IsCandidateServer(*li) &&
+				(! r->appendChunk || ((*li)->CanBeChunkMaster() &&
+				find(masters.begin(), masters.end(), *li) ==
+					masters.end()))) {
+			localserver = *li;
+			replicaCnt++;
+			break;
+		}
 	}
 	if (r->appendChunk || localserver) {
 		r->servers.push_back(localserver);
 	}
-	int    mastersSkipped = 0;
-	int    slavesSkipped  = 0;
 	size_t numCandidates = 0;
 	for (uint32_t idx = 0;
 			replicaCnt < r->numReplicas && idx < numRacks;
 			idx++) {
-		vector<ChunkServerPtr> candidates, dummy;
-		FindCandidateServers(candidates, dummy, racks[idx]);
-		numCandidates += candidates.size();
+		const int rackId = racks[idx];
+		numCandidates += mPlacementIndex.GetCandidateCount(rackId);
 		// take as many as we can from this rack
-		uint32_t n = (localserver && (racks[idx] == localserver->GetRack())) ? 1 : 0;
-		for (vector<ChunkServerPtr>::const_iterator i = candidates.begin();
-				i != candidates.end() && n < numServersPerRack &&
-				replicaCnt < r->numReplicas;
-                                ++i) {
-			const ChunkServerPtr& cs = *i;
-			if (r->appendChunk) {
-				// for record appends, to avoid deadlocks for
-				// buffer allocation during atomic record
-				// appends, use hierarchical chunkserver
-				// selection
-				if (cs->CanBeChunkMaster()) {
-					if (r->servers.front()) {
-						mastersSkipped++;
-						continue;
-					}
-					r->servers.front() = cs;
-				} else {
-					if (r->servers.size() >= (size_t)r->numReplicas) {
-						slavesSkipped++;
-						continue;
-					}
-					r->servers.push_back(cs);
-				}
-			} else {
-				if (cs == localserver) {
-					continue;
-				}
-				r->servers.push_back(cs);
+		uint32_t n = (localserver && (rackId == localserver->GetRack())) ? 1 : 0;
+		if (r->appendChunk) {
+			// for record appends, to avoid deadlocks for
+			// buffer allocation during atomic record
+			// appends, use hierarchical chunkserver
+			// selection
+			if (! r->servers.front() && n < numServersPerRack &&
+					(PickCandidateServers(r->servers, 1, rackId,
+						PlacementIndex::kMasterRole,
+						masters) > 0 ||
+					(! masters.empty() &&
+					PickCandidateServers(r->servers, 1, rackId,
+						PlacementIndex::kMasterRole) > 0))) {
+				r->servers.front() = r->servers.back();
+				r->servers.pop_back();
+				n++;
+				replicaCnt++;
+			}
+			const int numSlaves = min(
+				min((int)numServersPerRack - (int)n,
+					r->numReplicas - replicaCnt),
+				r->numReplicas - (int)r->servers.size());
+			if (numSlaves > 0) {
+				const int cnt = (int)PickCandidateServers(
+					r->servers, numSlaves, rackId,
+					PlacementIndex::kSlaveRole);
+				n          += cnt;
+				replicaCnt += cnt;
+			}
+		} else {
+			// The local server, if any, is already in the list, and
+			// will not be picked again.
+			const int cnt = min((int)numServersPerRack - (int)n,
+				r->numReplicas - replicaCnt);
+			if (cnt > 0) {
+				replicaCnt += (int)PickCandidateServers(
+					r->servers, cnt, rackId,
+					PlacementIndex::kAnyRole);
 			}
-			n++;
-			replicaCnt++;
 		}
 	}
 	bool noMaster = false;
@@ -1751,10 +2034,8 @@ LayoutManager::AllocateChunk(MetaAllocate *r)
 				"/" << restartingCount[1] <<
                         " racks: "      << numRacks <<
 			" candidates: " << numCandidates <<
-			" masters: "    << mastersSkipped <<
-				"/" << mMastersCount <<
-			" slaves: "     << slavesSkipped <<
-				"/" << mSlavesCount <<
+			" masters: "    << mMastersCount <<
+			" slaves: "     << mSlavesCount <<
 			" to restart: " << mCSToRestartCount <<
 				"/"    << mMastersToRestartCount <<
 			" request: "    << r->Show() <<
@@ -1762,6 +2043,18 @@ LayoutManager::AllocateChunk(MetaAllocate *r)
 	    	r->statusMsg = noMaster ? "no master" : "no servers";
 		return -ENOSPC;
 	}
+	return 0;
+}
+
+int
+LayoutManager::AllocateChunk(MetaAllocate *r)
+{
+	vector<ChunkServerPtr>::size_type i;
+
+	const int status = ChooseAllocationServers(r);
+	if (status != 0) {
+		return status;
+	}
 
 	const LeaseInfo l(WRITE_LEASE, mLeaseId, r->servers[0], r->pathname, r->appendChunk);
 	mLeaseId++;
@@ -1779,13 +2072,15 @@ LayoutManager::AllocateChunk(MetaAllocate *r)
 
 	mChunkToServerMap[r->chunkId] = v;
 
-	mChunksWithLeases.insert(r->chunkId);
+	ScheduleLeaseCheck(r->chunkId, l.expires);
 
 	if (r->servers.size() < (uint32_t) r->numReplicas)
 		ChangeChunkReplication(r->chunkId);
 
 	for (i = r->servers.size(); i-- > 0; ) {
 		r->servers[i]->AllocateChunk(r, i == 0 ? l.leaseId : -1);
+		// The chunk write count has changed.
+		UpdateServerPlacement(r->servers[i].get());
 	}
 	if (! r->servers.empty() && r->appendChunk) {
 		mARAChunkCache.RequestNew(*r);
@@ -1891,7 +2186,7 @@ LayoutManager::GetChunkWriteLease(MetaAllocate *r, bool &isNewLease)
 
 	v.chunkLeases.push_back(lease);
 
-	mChunksWithLeases.insert(r->chunkId);
+	ScheduleLeaseCheck(r->chunkId, lease.expires);
 
 	r->master = r->servers[0];
 	KFS_LOG_STREAM_INFO <<
@@ -1918,93 +2213,128 @@ LayoutManager::GetChunkWriteLease(MetaAllocate *r, bool &isNewLease)
 int
 LayoutManager::AllocateChunkForAppend(MetaAllocate *req)
 {
-	ARAChunkCache::Entry* const entry = mARAChunkCache.Get(req->fid);
-	if (! entry) {
+	ARAChunkCache::Entries* const entries = mARAChunkCache.Get(req->fid);
+	if (! entries) {
 		return -1;
 	}
 
-	KFS_LOG_STREAM_DEBUG << "Append on file " << req->fid <<
-		" with offset " << req->offset <<
-                " max offset  " << entry->offset <<
-		(entry->IsAllocationPending() ?
-			" allocation in progress" : "") <<
-	KFS_LOG_EOM;
-
-	if (entry->offset < 0 || (entry->offset % CHUNKSIZE) != 0) {
-		assert(! "invalid offset");
-		mARAChunkCache.Invalidate(req->fid);
-		return -1;
-	}
-	// The client is providing an offset hint in the case when it needs a
-	// new chunk: space allocation failed because chunk is full, or it can
-	// not talk to the chunk server.
-	// 
-	// If allocation has already finished, then cache entry offset is valid,
-	// otherwise the offset is equal to EOF at the time the initial request
-	// has started. The client specifies offset just to indicate that it
-	// wants a new chunk, and when the allocation finishes it will get the
-	// new chunk.
-	if (entry->offset < req->offset && ! entry->IsAllocationPending()) {
-		return -1;
-	}
-
-       	CSMapConstIter const iter = mChunkToServerMap.find(entry->chunkId);
-       	if (iter == mChunkToServerMap.end()) {
-		return -1;
+	// Pick the file's open append chunk with the least space reserved.
+	const time_t                       now             = TimeNow();
+	const int                          reservationSize = (int)(min(
+		double(mMaxReservationSize),
+		mReservationOvercommitFactor *
+		max(1, req->spaceReservationSize)));
+	ARAChunkCache::Entry*              entry           = 0;
+	const ChunkPlacementInfo*          placement       = 0;
+	vector<LeaseInfo>::const_iterator  lease;
+	bool                               pendingFlag     = false;
+	for (ARAChunkCache::Entries::iterator it = entries->begin();
+			it != entries->end(); ) {
+		ARAChunkCache::Entry& e = *it;
+		KFS_LOG_STREAM_DEBUG << "Append on file " << req->fid <<
+			" with offset " << req->offset <<
+			" chunk: " << e.chunkId <<
+			" max offset  " << e.offset <<
+			(e.IsAllocationPending() ?
+				" allocation in progress" : "") <<
+		KFS_LOG_EOM;
+		if (e.offset < 0 || (e.offset % CHUNKSIZE) != 0) {
+			assert(! "invalid offset");
+			it = entries->erase(it);
+			continue;
+		}
+		++it;
+		pendingFlag = pendingFlag || e.IsAllocationPending();
+		// The client is providing an offset hint in the case when it
+		// needs a new chunk: space allocation failed because chunk is
+		// full, or it can not talk to the chunk server.
+		//
+		// If allocation has already finished, then cache entry offset
+		// is valid, otherwise the offset is equal to EOF at the time
+		// the initial request has started. The client specifies offset
+		// just to indicate that it wants a new chunk, and when the
+		// allocation finishes it will get the new chunk.
+		if (e.offset < req->offset && ! e.IsAllocationPending()) {
+			continue;
+		}
+		CSMapConstIter const iter = mChunkToServerMap.find(e.chunkId);
+		if (iter == mChunkToServerMap.end()) {
+			continue;
+		}
+		const ChunkPlacementInfo& v = iter->second;
+		if ((v.chunkServers.empty()) || (v.ongoingReplications > 0)) {
+			continue;
+		}
+		vector<LeaseInfo>::const_iterator const l =
+			find_if(v.chunkLeases.begin(), v.chunkLeases.end(),
+				ptr_fun(LeaseInfo::IsValidWriteLease));
+		if (l == v.chunkLeases.end()) {
+			continue;
+		}
+		// Since there is no un-reservation mechanism, decay reservation
+		// by factor of 2 every mReservationDecayStep sec.
+		// The goal is primarily to decrease # or rtt and meta server
+		// cpu consumption due to chunk space reservation contention
+		// between multiple concurrent appenders, while keeping chunk
+		// size as large as possible.
+		if (mReservationDecayStep > 0 &&
+				e.lastDecayTime +
+				mReservationDecayStep <= now) {
+			const size_t exp = (now - e.lastDecayTime) /
+				mReservationDecayStep;
+			if (exp >= sizeof(e.spaceReservationSize) * 8) {
+				e.spaceReservationSize = 0;
+			} else {
+				e.spaceReservationSize >>= exp;
+			}
+			e.lastDecayTime = now;
+		}
+		if (e.spaceReservationSize + reservationSize >
+				mChunkReservationThreshold) {
+			continue;
+		}
+		if (! entry ||
+				e.spaceReservationSize < entry->spaceReservationSize) {
+			entry     = &e;
+			placement = &v;
+			lease     = l;
+		}
 	}
-	const ChunkPlacementInfo& v = iter->second;
-	if ((v.chunkServers.empty()) || (v.ongoingReplications > 0)) {
+	if (entries->empty()) {
+		mARAChunkCache.Invalidate(req->fid);
 		return -1;
 	}
-	vector<LeaseInfo>::const_iterator const l =
-		find_if(v.chunkLeases.begin(), v.chunkLeases.end(),
-			ptr_fun(LeaseInfo::IsValidWriteLease));
-	if (l == v.chunkLeases.end()) {
+	if (! entry) {
 		return -1;
 	}
-	// Since there is no un-reservation mechanism, decay reservation by
-	// factor of 2 every mReservationDecayStep sec.
-	// The goal is primarily to decrease # or rtt and meta server cpu
-	// consumption due to chunk space reservation contention between
-	// multiple concurrent appenders, while keeping chunk size as large as
-	// possible.
-	const time_t now = TimeNow();
-	if (mReservationDecayStep > 0 &&
-			entry->lastDecayTime +
-			mReservationDecayStep <= now) {
-		const size_t exp = (now - entry->lastDecayTime) /
-			mReservationDecayStep;
-		if (exp >= sizeof(entry->spaceReservationSize) * 8) {
-			entry->spaceReservationSize = 0;
-		} else {
-			entry->spaceReservationSize >>= exp;
-		}
-		entry->lastDecayTime = now;
-	}
-	const int reservationSize = (int)(min(double(mMaxReservationSize),
-		mReservationOvercommitFactor *
-		max(1, req->spaceReservationSize)));
-	if (entry->spaceReservationSize + reservationSize >
-			mChunkReservationThreshold) {
+	// Open one more chunk, with a different master, if the file has less
+	// than the max # of chunks open, and all of them are in use.
+	if ((int)entries->size() < mARAChunkCache.GetMaxEntriesPerFile() &&
+			! pendingFlag && entry->numAppendersInChunk > 0) {
+		KFS_LOG_STREAM_DEBUG << "Append on file " << req->fid <<
+			" open append chunks: " << entries->size() <<
+			" allocating new chunk" <<
+		KFS_LOG_EOM;
 		return -1;
 	}
 	// valid write lease; so, tell the client where to go
 	req->chunkId = entry->chunkId;
 	req->offset = entry->offset;
 	req->chunkVersion = entry->chunkVersion;
-	req->servers = v.chunkServers;
-	req->master = l->chunkServer;
+	req->servers = placement->chunkServers;
+	req->master = lease->chunkServer;
 	entry->numAppendersInChunk++;
 	entry->lastAccessedTime = now;
 	entry->spaceReservationSize += reservationSize;
 	const bool pending = entry->AddPending(*req);
 	KFS_LOG_STREAM_DEBUG <<
 		"Valid write lease exists for " << req->chunkId <<
-		" expires in " << (l->expires - TimeNow()) << " sec" <<
+		" expires in " << (lease->expires - TimeNow()) << " sec" <<
 		" space: " << entry->spaceReservationSize <<
 		" (+" << reservationSize <<
 		"," << req->spaceReservationSize << ")" <<
 		" num appenders: " << entry->numAppendersInChunk <<
+		" open chunks: " << entries->size() <<
 		(pending ? " allocation in progress" : "") <<
 	KFS_LOG_EOM;
 	return 0;
@@ -2093,7 +2423,7 @@ LayoutManager::GetChunkReadLease(MetaLeaseAcquire *req)
 	v.chunkLeases.push_back(lease);
 	req->leaseId = lease.leaseId;
 
-	mChunksWithLeases.insert(req->chunkId);
+	ScheduleLeaseCheck(req->chunkId, lease.expires);
 
 	return 0;
 }
@@ -2162,7 +2492,9 @@ LayoutManager::LeaseRenew(MetaLeaseRenew *req)
 		return -ELEASEEXPIRED;
 	}
 	l->expires = now + LEASE_INTERVAL_SECS;
-	mChunksWithLeases.insert(req->chunkId);
+	// No-op if the expiration check is already scheduled, the check will
+	// be pushed out when it comes due.
+	ScheduleLeaseCheck(req->chunkId, l->expires);
 	return 0;
 }
 
@@ -2185,11 +2517,13 @@ LayoutManager::ChunkCorrupt(MetaChunkCorrupt *r)
 	EraseReallocIfNeeded(v.chunkServers, remove_if(
 		v.chunkServers.begin(), v.chunkServers.end(),
 		ChunkServerMatcher(r->server.get())), v.chunkServers.end());
-	for_each(v.chunkLeases.begin(), v.chunkLeases.end(),
-		ExpireLeaseIfOwner(r->server.get()));
+	if (for_each(v.chunkLeases.begin(), v.chunkLeases.end(),
+			ExpireLeaseIfOwner(r->server.get())).count > 0) {
+		ScheduleLeaseCheck(r->chunkId, TimeNow());
+	}
         if (prevNumSrv != v.chunkServers.size()) {
             // Invalidate cache.
-            mARAChunkCache.Invalidate(r->fid);
+            mARAChunkCache.Invalidate(v.fid, r->chunkId);
 	    // check the replication state when the replicaiton checker gets to it
 	    ChangeChunkReplication(r->chunkId);
         }
@@ -2351,6 +2685,72 @@ LayoutManager::GetChunkToServerMapping(chunkId_t chunkId, vector<ChunkServerPtr>
         return 0;
 }
 
+/// Read replica preference: same host, same rack, then the rest; the
+/// servers loaded with I/O last in each group.
+class ReadServerOrder {
+public:
+	ReadServerOrder(const string &host, int rack)
+		: mHost(host), mRack(rack)
+		{}
+	bool operator()(const ChunkServerPtr &a, const ChunkServerPtr &b) const {
+		return (Key(*a) < Key(*b));
+	}
+private:
+	const string &mHost;
+	const int     mRack;
+
+	int Key(const ChunkServer &c) const {
+		const int dist =
+			(! mHost.empty() &&
+				c.GetServerLocation().hostname == mHost) ? 0 :
+			((mRack >= 0 && c.GetRack() == mRack) ? 1 : 2);
+		return (dist * 2 + (c.IsLoadedForWrites() ? 1 : 0));
+	}
+};
+
+int
+LayoutManager::GetChunkReadServers(chunkId_t chunkId, vector<ChunkServerPtr> &c,
+	const string &clientHost, int clientRack)
+{
+	if (GetChunkToServerMapping(chunkId, c) != 0) {
+		return -1;
+	}
+	random_shuffle(c.begin(), c.end());
+	stable_sort(c.begin(), c.end(),
+		ReadServerOrder(clientHost, clientRack));
+	return 0;
+}
+
+int
+LayoutManager::GetClientRack(const string &clientHost) const
+{
+	if (clientHost.empty()) {
+		return -1;
+	}
+	vector<ChunkServerPtr> local;
+	mPlacementIndex.FindByHost(clientHost, local);
+	for (vector<ChunkServerPtr>::const_iterator it = local.begin();
+			it != local.end();
+			++it) {
+		if ((*it)->GetRack() >= 0) {
+			return (*it)->GetRack();
+		}
+	}
+	int    rack = -1;
+	size_t len  = 0;
+	for (RackPrefixes::const_iterator it = mRackPrefixes.begin();
+			it != mRackPrefixes.end();
+			++it) {
+		if (it->first.size() > len &&
+				clientHost.compare(0, it->first.size(),
+					it->first) == 0) {
+			rack = it->second;
+			len  = it->first.size();
+		}
+	}
+	return rack;
+}
+
 /// Wrapper class due to silly template/smart-ptr madness
 class Dispatcher {
 public:
@@ -2547,14 +2947,10 @@ bool
 LayoutManager::ExpiredLeaseCleanup(
 	chunkId_t                 chunkId,
 	time_t                    now,
-	int                       ownerDownExpireDelay /* = 0 */,
-	const CRCandidateSetIter* chunksWithLeasesIt   /* = 0 */)
+	int                       ownerDownExpireDelay /* = 0 */)
 {
 	CSMapIter const iter = mChunkToServerMap.find(chunkId);
 	if (iter == mChunkToServerMap.end()) {
-		if (chunksWithLeasesIt) {
-			mChunksWithLeases.erase(*chunksWithLeasesIt);
-		}
 		return true;
 	}
 	ChunkPlacementInfo& c = iter->second;
@@ -2579,18 +2975,61 @@ LayoutManager::ExpiredLeaseCleanup(
 	// trim the list
 	const bool retVal = EraseReallocIfNeeded(
 		c.chunkLeases, i, c.chunkLeases.end()).empty();
-	if (retVal && chunksWithLeasesIt) {
-		mChunksWithLeases.erase(*chunksWithLeasesIt);
-	}
+	mExpiredLeasesStats->Update((int)leases.size());
 	for_each(leases.begin(), leases.end(),
 		DecChunkWriteCount(mChunkToServerMap, c.fid, chunkId));
-	// If the chunk disappeared or cleaned up in the process then most likely
-	// mChunksWithLeases is already cleaned up, if not then it will be
-	// cleaned on the next timer run. mChunksWithLeases is only used for
-	// lease cleanup, stale entry should not cause a problem.
+	// If the chunk disappeared or cleaned up in the process then
+	// mChunksWithLeases entry will be removed when its timer comes due.
+	// mChunksWithLeases is only used for lease cleanup, stale entry should
+	// not cause a problem.
 	return retVal;
 }
 
+void
+LayoutManager::ScheduleLeaseCheck(chunkId_t chunkId, time_t when)
+{
+	// Slots up to and including mLeaseTimerTime are already processed.
+	const time_t t = max(when, mLeaseTimerTime + 1);
+	pair<LeaseExpiryIndex::iterator, bool> const res =
+		mChunksWithLeases.insert(make_pair(chunkId, t));
+	if (! res.second) {
+		if (res.first->second <= t) {
+			return;
+		}
+		res.first->second = t;
+	}
+	mLeaseTimerWheel[t % kLeaseTimerWheelSlots].push_back(make_pair(chunkId, t));
+}
+
+void
+LayoutManager::LeaseTimerExpired(chunkId_t chunkId, time_t now)
+{
+	ExpiredLeaseCleanup(chunkId, now, mLeaseOwnerDownExpireDelay);
+	CSMapIter const iter = mChunkToServerMap.find(chunkId);
+	if (iter == mChunkToServerMap.end() ||
+			iter->second.chunkLeases.empty()) {
+		mChunksWithLeases.erase(chunkId);
+		return;
+	}
+	// Check again when the first remaining lease expires. Write leases of
+	// the servers that went down are kept for the extra owner down delay.
+	const vector<LeaseInfo>& leases = iter->second.chunkLeases;
+	time_t next = leases.front().expires;
+	for (vector<LeaseInfo>::const_iterator it = leases.begin();
+			it != leases.end();
+			++it) {
+		time_t expires = it->expires;
+		if (it->ownerWasDownFlag && LeaseInfo::IsWriteLease(*it)) {
+			expires += mLeaseOwnerDownExpireDelay;
+		}
+		next = min(next, expires);
+	}
+	// Erase, and re-insert to move the entry: the timer entry that is
+	// being processed is no longer valid.
+	mChunksWithLeases.erase(chunkId);
+	ScheduleLeaseCheck(chunkId, max(next, now + 1));
+}
+
 bool
 LayoutManager::ExpiredLeaseCleanup(chunkId_t chunkId)
 {
@@ -2612,11 +3051,48 @@ struct UptimeLess :
 void
 LayoutManager::LeaseCleanup()
 {
-	const time_t now = TimeNow();
-	for (CRCandidateSetIter citer = mChunksWithLeases.begin();
-		citer != mChunksWithLeases.end(); ) {
-		CRCandidateSetIter it = citer++;
-		ExpiredLeaseCleanup(*it, now, mLeaseOwnerDownExpireDelay, &it);
+	const int64_t start = microseconds();
+	const time_t  now   = TimeNow();
+	if (now < mLeaseTimerTime) {
+		// Time went backwards; the scheduled entries still come due
+		// as the wheel turns.
+		mLeaseTimerTime = now - 1;
+	}
+	// Visit only the slots that came due since the last run, at most one
+	// full turn of the wheel. The entries scheduled for a later turn stay
+	// in the slot.
+	const time_t end = min(now,
+		mLeaseTimerTime + (time_t)kLeaseTimerWheelSlots);
+	LeaseTimerSlot due;
+	for (time_t t = mLeaseTimerTime + 1; t <= end; t++) {
+		LeaseTimerSlot& slot = mLeaseTimerWheel[t % kLeaseTimerWheelSlots];
+		if (slot.empty()) {
+			continue;
+		}
+		due.clear();
+		due.swap(slot);
+		for (LeaseTimerSlot::const_iterator it = due.begin();
+				it != due.end();
+				++it) {
+			LeaseExpiryIndex::const_iterator const ci =
+				mChunksWithLeases.find(it->first);
+			if (ci == mChunksWithLeases.end() ||
+					ci->second != it->second) {
+				continue; // Stale entry, rescheduled or removed.
+			}
+			if (now < it->second) {
+				slot.push_back(*it);
+				continue;
+			}
+			LeaseTimerExpired(it->first, now);
+		}
+	}
+	mLeaseTimerTime = now;
+	const int64_t elapsed = microseconds() - start;
+	mChunksWithLeasesStats->Set((int)mChunksWithLeases.size());
+	mLeaseCleanupTimeStats->Set((int)elapsed);
+	if ((uint64_t)elapsed > mLeaseCleanupMaxTimeStats->GetValue()) {
+		mLeaseCleanupMaxTimeStats->Set((int)elapsed);
 	}
 	// also clean out the ARACache of old entries
 	mARAChunkCache.Timeout(now - ARA_CHUNK_CACHE_EXPIRE_INTERVAL);
@@ -2682,6 +3158,7 @@ void LayoutManager::ScheduleChunkServersRestart()
 				srv.ScheduleRestart(
 					mCSGracefulRestartTimeout,
 					mCSGracefulRestartAppendWithWidTimeout)) {
+			UpdateServerPlacement(&srv);
 			KFS_LOG_STREAM_INFO <<
 				"initiated restart sequence for: " <<
 				servers.front()->ServerID() <<
@@ -2709,6 +3186,7 @@ LayoutManager::InvalidateWriteLease(chunkId_t chunkId)
 	if (l != v.chunkLeases.end()) {
 		// Invalidate the lease; the normal cleanup will fix things up.
 		l->expires = 0;
+		ScheduleLeaseCheck(chunkId, TimeNow());
 	}
 }
 
@@ -2735,6 +3213,7 @@ LayoutManager::LeaseRelinquish(MetaLeaseRelinquish *req)
 	// the owner of the lease is giving up the lease; update the expires so
 	// that the normal lease cleanup will work out.
 	l->expires = 0;
+	ScheduleLeaseCheck(req->chunkId, now);
 	if (l->leaseType == WRITE_LEASE && hadLeaseFlag) {
 		// For write append lease checksum and size always have to be
 		// specified for make chunk stable, otherwise run begin make
@@ -3895,7 +4374,7 @@ LayoutManager::ReplicateChunk(chunkId_t chunkId, ChunkPlacementInfo &clli,
 		// Don't send too many replications to a server
 		if (c->IsDown() ||
 				c->GetNumChunkReplications() >
-				MAX_CONCURRENT_WRITE_REPLICATIONS_PER_NODE)
+				GetMaxWriteReplications(*c))
 			continue;
 		// verify that we got good candidates
 		assert(
@@ -3913,7 +4392,7 @@ LayoutManager::ReplicateChunk(chunkId_t chunkId, ChunkPlacementInfo &clli,
 		if (iter != clli.chunkServers.end()) {
 			reason = " evacuating chunk ";
 			if (((*iter)->GetReplicationReadLoad() <
-				MAX_CONCURRENT_READ_REPLICATIONS_PER_NODE) &&
+				GetMaxReadReplications(**iter)) &&
 				(*iter)->IsResponsiveServer())
 				dataServer = *iter;
 		} else {
@@ -3924,7 +4403,7 @@ LayoutManager::ReplicateChunk(chunkId_t chunkId, ChunkPlacementInfo &clli,
 		for (uint32_t j = 0; (!dataServer) &&
 				(j < clli.chunkServers.size()); j++) {
 			if ((clli.chunkServers[j]->GetReplicationReadLoad() >=
-				MAX_CONCURRENT_READ_REPLICATIONS_PER_NODE) ||
+				GetMaxReadReplications(*clli.chunkServers[j])) ||
 				(!(clli.chunkServers[j]->IsResponsiveServer())))
 				continue;
 			dataServer = clli.chunkServers[j];
@@ -4158,7 +4637,7 @@ LayoutManager::IsAnyServerAvailForReReplication() const
 		const ChunkServerPtr c = mChunkServers[i];
 		if (c->GetSpaceUtilization() > MAX_SERVER_SPACE_UTIL_THRESHOLD)
 			continue;
-		if (c->GetNumChunkReplications() > MAX_CONCURRENT_WRITE_REPLICATIONS_PER_NODE)
+		if (c->GetNumChunkReplications() > GetMaxWriteReplications(*c))
 			continue;
 		anyAvail++;
 	}
@@ -4364,7 +4843,8 @@ LayoutManager::FindReplicationWorkForServer(ChunkServerPtr &server, chunkId_t ch
 			CancelPendingMakeStable(iter->second.fid, iter->first);
 		}
 
-		if (server->GetNumChunkReplications() > MAX_CONCURRENT_WRITE_REPLICATIONS_PER_NODE)
+		if (server->GetNumChunkReplications() >
+				GetMaxWriteReplications(*server))
 			break;
 	}
 	// if there is any room left to do more work...
@@ -4700,7 +5180,7 @@ LayoutManager::RebalanceServers()
 		allbusy = true;
 		for (uint32_t i = 0; i < nonloadedServers.size(); i++) {
 			if (nonloadedServers[i]->GetNumChunkReplications() <
-				MAX_CONCURRENT_WRITE_REPLICATIONS_PER_NODE) {
+				GetMaxWriteReplications(*nonloadedServers[i])) {
 				allbusy = false;
 				break;
 			}
@@ -4906,7 +5386,7 @@ LayoutManager::ExecuteRebalancePlan(ChunkServerPtr &c)
 	for (ChunkIdSet::const_iterator citer = chunksToMove.begin();
 		citer != chunksToMove.end(); citer++) {
 		if (c->GetNumChunkReplications() >
-			MAX_CONCURRENT_WRITE_REPLICATIONS_PER_NODE)
+			GetMaxWriteReplications(*c))
 			return;
 
 		const chunkId_t cid = *citer;
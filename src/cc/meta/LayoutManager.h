@@ -45,6 +45,7 @@
 #include "LeaseCleaner.h"
 #include "ChunkReplicator.h"
 #include "ChunkServer.h"
+#include "PlacementIndex.h"
 
 #include "libkfsIO/Counter.h"
 #include "common/properties.h"
@@ -443,6 +444,14 @@ namespace KFS
 	typedef CRCandidateSet::iterator CRCandidateSetIter;
         typedef CRCandidateSet ReplicationCandidates;
 
+	// Lease expiration index: chunk id -> time of the next lease check, and
+	// the timer wheel with one slot per second. A wheel entry is valid only
+	// while its time matches the time in the index; the entries superseded
+	// by rescheduling are discarded when their slot comes up.
+	typedef std::tr1::unordered_map<chunkId_t, time_t> LeaseExpiryIndex;
+	typedef std::vector<std::pair<chunkId_t, time_t> > LeaseTimerSlot;
+	typedef std::vector<LeaseTimerSlot> LeaseTimerWheel;
+
 	//
 	// For maintenance reasons, we'd like to schedule downtime for a server.
 	// When the server is taken down, a promise is made---the server will go
@@ -478,6 +487,12 @@ namespace KFS
 	// If this structure works out, we'll need to extend this to hold a list
 	// of blocks that can be re-used for allocation (and thereby avoid the
 	// non-full problem).
+	//
+	// A very hot file can have more than one chunk open for append, each
+	// with its own master, to spread the appenders over more than one
+	// replication chain. The allocations are distributed across the
+	// file's open append chunks; each chunk is dropped from the cache,
+	// and its lease expires on its own.
 
 	class ARAChunkCache
 	{
@@ -488,7 +503,8 @@ namespace KFS
 				seq_t         cv  = -1,
 				off_t         co  = -1,
 				time_t        lat = 0,
-				MetaAllocate* req = 0)
+				MetaAllocate* req = 0,
+				const ChunkServerPtr& m = ChunkServerPtr())
 				: chunkId(cid),
 				  chunkVersion(cv),
 				  offset(co),
@@ -496,6 +512,7 @@ namespace KFS
 				  lastDecayTime(lat),
 				  spaceReservationSize(0),
 				  numAppendersInChunk(0),
+				  master(m),
 				  lastPendingRequest(req)
 				{}
 			bool AddPending(MetaAllocate& req);
@@ -514,22 +531,29 @@ namespace KFS
 			int  spaceReservationSize;
 			// # of appenders to which this chunk was used for allocation
 			int  numAppendersInChunk;
+			// chunk master at the time of allocation
+			ChunkServerPtr master;
 		private:
 			MetaAllocate* lastPendingRequest;
 			friend class ARAChunkCache;
         	};
-		typedef std::map <fid_t, Entry, std::less<fid_t>,
+		typedef std::vector<Entry> Entries;
+		typedef std::map <fid_t, Entries, std::less<fid_t>,
 			boost::fast_pool_allocator<
-		    		std::pair<const fid_t, Entry> >
+		    		std::pair<const fid_t, Entries> >
 		> Map;
 		typedef Map::const_iterator const_iterator;
 		typedef Map::iterator       iterator;
 
 		ARAChunkCache()
-			: mMap()
+			: mMap(),
+			  mMaxEntriesPerFile(1)
 			{}
 		~ARAChunkCache()
 			{ mMap.empty(); }
+		/// Add the new chunk to the file's open append chunks. If the
+		/// file has the max # of chunks, the one with the most space
+		/// reserved is replaced.
 		void RequestNew(MetaAllocate& req);
 		void RequestDone(const MetaAllocate& req);
 		void Timeout(time_t now);
@@ -542,20 +566,28 @@ namespace KFS
 		const_iterator Find(fid_t fid) const {
 			return mMap.find(fid);
 		}
-		const Entry* Get(const_iterator it) const {
+		const Entries* Get(const_iterator it) const {
 			return (it == mMap.end() ? 0 : &it->second);
 		}
-		Entry* Get(iterator it) {
+		Entries* Get(iterator it) {
 			return (it == mMap.end() ? 0 : &it->second);
 		}
-		const Entry* Get(fid_t fid) const {
+		const Entries* Get(fid_t fid) const {
 			return Get(Find(fid));
 		}
-		Entry* Get(fid_t fid) {
+		Entries* Get(fid_t fid) {
 			return Get(Find(fid));
 		}
+		/// Max # of open append chunks per file.
+		void SetMaxEntriesPerFile(int count) {
+			mMaxEntriesPerFile = std::max(1, count);
+		}
+		int GetMaxEntriesPerFile() const {
+			return mMaxEntriesPerFile;
+		}
 	private:
 		Map mMap;
+		int mMaxEntriesPerFile;
 	};
 	typedef std::set<ServerLocation, std::less<ServerLocation>,
             boost::fast_pool_allocator<ServerLocation>
@@ -759,6 +791,29 @@ namespace KFS
                 ///
 		int GetChunkToServerMapping(chunkId_t chunkId, std::vector<ChunkServerPtr> &c);
 
+		/// Get the servers to read the chunk from, in the order of
+		/// preference: the server on the client's host, then the
+		/// servers in the client's rack, then the rest; within each
+		/// group the servers not loaded with I/O go first, in random
+		/// order to spread the reads.
+		/// @param[in] clientHost  the client's ip, empty if unknown
+		/// @param[in] clientRack  GetClientRack(clientHost)
+		/// @retval 0 if a mapping was found; -1 otherwise
+		int GetChunkReadServers(chunkId_t chunkId,
+			std::vector<ChunkServerPtr> &c,
+			const std::string &clientHost, int clientRack);
+		int GetChunkReadServers(chunkId_t chunkId,
+			std::vector<ChunkServerPtr> &c,
+			const std::string &clientHost = std::string()) {
+			return GetChunkReadServers(chunkId, c, clientHost,
+				GetClientRack(clientHost));
+		}
+
+		/// The client's rack is the rack of a chunk server on the
+		/// same host, or is set by metaServer.rackPrefixes.
+		/// @retval the rack id, or -1 if unknown
+		int GetClientRack(const std::string &clientHost) const;
+
                 /// Get the mapping from chunkId -> file id.
                 /// @param[in] chunkId  chunkId
                 /// @param[out] fileId  file id the chunk belongs to
@@ -900,6 +955,19 @@ namespace KFS
 		void AllocateChunkForAppendDone(MetaAllocate& req) {
 			mARAChunkCache.RequestDone(req);
 		}
+
+		/// Recompute the server's chunk placement weight, from its
+		/// space, write load, and state. Invoked on every heartbeat,
+		/// and when the server state changes.
+		void UpdateServerPlacement(const ChunkServer* server);
+		/// Update the server's "loaded for writes" state from the I/O
+		/// pressure reported with the heartbeat, then its placement
+		/// weight.
+		void UpdateServerLoad(ChunkServer& server);
+		/// Max # of concurrent chunk replications to, and from the
+		/// server, scaled down with the server's reported disk load.
+		int GetMaxWriteReplications(const ChunkServer &server) const;
+		int GetMaxReadReplications(const ChunkServer &server) const;
         protected:
 		/// A rolling counter for tracking leases that are issued to
 		/// to clients/chunkservers for reading/writing chunks
@@ -989,14 +1057,22 @@ namespace KFS
 		/// the rest that needs replication
 		CRCandidateSet mPriorityChunkReplicationCandidates;
 
-		/// chunks to which a lease has been handed out; whenever we
-		/// cleanup the leases, this set is walked 
-		CRCandidateSet mChunksWithLeases;
+		/// chunks to which a lease has been handed out, indexed by the
+		/// time of the next lease expiration check. The lease cleanup
+		/// only visits the timer wheel slots that are due, instead of
+		/// walking all chunks with leases.
+		LeaseExpiryIndex mChunksWithLeases;
+		LeaseTimerWheel  mLeaseTimerWheel;
+		/// the last second processed by the lease cleanup
+		time_t           mLeaseTimerTime;
 
 		/// For files that are being atomic record appended to, track the last
 		/// chunk of the file that we can use for subsequent allocations
 		ARAChunkCache mARAChunkCache;
 
+		/// Weighted server selection for the chunk allocation.
+		PlacementIndex mPlacementIndex;
+
 		/// Set of chunks that are in the process being made stable: a
 		/// message has been sent to the associated chunkservers which are
 		/// flushing out data to disk.
@@ -1016,16 +1092,43 @@ namespace KFS
 		Counter *mFailedReplicationStats;
 		/// Track the # of stale chunks we have seen so far
 		Counter *mStaleChunkCount;
+		/// Lease cleanup: # of chunks with leases, # of leases expired
+		/// so far, and the last / max cleanup run time in usec.
+		Counter *mChunksWithLeasesStats;
+		Counter *mExpiredLeasesStats;
+		Counter *mLeaseCleanupTimeStats;
+		Counter *mLeaseCleanupMaxTimeStats;
                 size_t mMastersCount;
                 size_t mSlavesCount;
                 bool   mAssignMasterByIpFlag;
                 int    mLeaseOwnerDownExpireDelay;
                 double mPercentLoadedNodesToAvoidForWrites;
+                // Chunk servers with disk load above this are used for
+                // writes only if no other servers are available; 0 -- off.
+                double mMaxDiskLoadForWrites;
+                // The same for the disk queue depth and the write pending
+                // bytes per drive, and the chunk server network send
+                // backlog overload; 0 -- off. The server stays loaded until
+                // all of these fall below the limit times the hysteresis.
+                int    mMaxDiskQueueDepthPerDriveForWrites;
+                int64_t mMaxWritePendingBytesPerDriveForWrites;
+                bool   mAvoidNetOverloadedServersForWrites;
+                double mLoadedForWritesHysteresis;
+                // Replication pacing: the max # of concurrent replications
+                // per server goes down as the server's disk load goes up
+                // from the min load to the max disk load for writes, and
+                // is 1 for the servers loaded for writes.
+                bool   mReplicationLoadPacingFlag;
+                double mReplicationPacingMinDiskLoad;
                 // Write append space reservation accounting.
                 int    mMaxReservationSize;
                 int    mReservationDecayStep;
                 int    mChunkReservationThreshold;
                 double mReservationOvercommitFactor;
+		// Client ip prefix -> rack id, for the read replica ordering
+		// on the hosts with no chunk server; the longest prefix wins.
+		typedef std::vector<std::pair<std::string, int> > RackPrefixes;
+		RackPrefixes mRackPrefixes;
 		// Delay replication when connection breaks.
 		int    mServerDownReplicationDelay;
                 uint64_t mMaxDownServersHistorySize;
@@ -1046,8 +1149,15 @@ namespace KFS
 		bool ExpiredLeaseCleanup(
 	            chunkId_t                 chunkId,
 	            time_t                    now,
-	            int                       ownerDownExpireDelay = 0,
-	            const CRCandidateSetIter* chunksWithLeasesIt   = 0);
+	            int                       ownerDownExpireDelay = 0);
+		/// Schedule the chunk lease expiration check no later than at
+		/// the specified time. O(1): if the check is already scheduled
+		/// earlier, nothing is done; the lease renewals are picked up
+		/// when the earlier check comes due, and finds nothing expired.
+		void ScheduleLeaseCheck(chunkId_t chunkId, time_t when);
+		/// Process the expired leases of the chunk, and reschedule the
+		/// next check if the chunk still has leases.
+		void LeaseTimerExpired(chunkId_t chunkId, time_t now);
 		/// Find a set of racks to place a chunk on; the racks are
 		/// ordered by space.
 		void FindCandidateRacks(std::vector<int> &result);
@@ -1083,6 +1193,28 @@ namespace KFS
 					const std::vector<ChunkServerPtr> &excludes,
 					int rackId = -1);
 
+		/// Choose the servers for the new chunk: the client's local
+		/// server first, if any, then the servers picked from the
+		/// placement index, spread across the racks.
+		/// @param[in/out] r  the allocation request; r->servers is set
+		/// on success
+		/// @retval 0 on success; -errno otherwise
+		int ChooseAllocationServers(MetaAllocate *r);
+
+		/// Pick up to count candidate servers from the placement index,
+		/// in addition to the ones already in the result.
+		/// O(log n) per server picked.
+		/// @param[in/out] result  The set of picked servers
+		/// @param[in] rackId  The rack to restrict the selection to; if
+		/// rackId = -1, then all servers are fair game
+		/// @retval the number of servers added to the result
+		/// @param[in] excludes  The servers not to pick
+		size_t PickCandidateServers(std::vector<ChunkServerPtr> &result,
+					size_t count, int rackId,
+					PlacementIndex::Role role,
+					const std::vector<ChunkServerPtr>& excludes =
+						std::vector<ChunkServerPtr>());
+
 		/// Helper function that takes a set of servers and sorts
 		/// them by space utilization.  The list of servers returned is
 		/// ordered on increasing space utilization (i.e., decreasing
@@ -1157,6 +1289,8 @@ namespace KFS
 		/// Does any server have space/write-b/w available for
 		/// re-replication
 		bool IsAnyServerAvailForReReplication() const;
+		int GetMaxReplications(const ChunkServer &server,
+			int maxCount) const;
 
 		/// Periodically, rebalance servers by moving chunks around from
 		/// "over utilized" servers to "under utilized" servers.
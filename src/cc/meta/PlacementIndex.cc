@@ -0,0 +1,417 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2010/12/06
+//
+// Copyright 2010 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Chunk server placement index implementation.
+//
+//----------------------------------------------------------------------------
+
+#include "PlacementIndex.h"
+
+#include <stdlib.h>
+#include <cassert>
+
+using std::vector;
+using std::string;
+using std::pair;
+
+using namespace KFS;
+
+struct PlacementIndex::Entry {
+	Entry(const ChunkServerPtr& s)
+		: server(s),
+		  host(s->GetServerLocation().hostname),
+		  rackId(s->GetRack()),
+		  cls(GetClass(s->CanBeChunkMaster(), false)),
+		  weight(0)
+	{
+		slot[0] = 0;
+		slot[1] = 0;
+	}
+	const ChunkServerPtr server;
+	const string         host;
+	const int            rackId;
+	int                  cls;
+	int64_t              weight;
+	/// Slots in the rack and in the "all" groups.
+	size_t               slot[2];
+};
+
+/// Fenwick tree of the weights: the weight updates and the search by the
+/// weight prefix sum are O(log n).
+class PlacementIndex::Tree {
+public:
+	Tree()
+		: mSums(2, 0),
+		  mWeights(),
+		  mEntries(),
+		  mFree(),
+		  mTotal(0),
+		  mCount(0)
+		{}
+	size_t Add(Entry* entry) {
+		if (! mFree.empty()) {
+			const size_t slot = mFree.back();
+			mFree.pop_back();
+			mEntries[slot] = entry;
+			return slot;
+		}
+		const size_t slot = mEntries.size();
+		mEntries.push_back(entry);
+		mWeights.push_back(0);
+		if (mSums.size() <= mEntries.size()) {
+			Grow();
+		}
+		return slot;
+	}
+	void Remove(size_t slot) {
+		Set(slot, 0);
+		mEntries[slot] = 0;
+		mFree.push_back(slot);
+	}
+	void Set(size_t slot, int64_t weight) {
+		const int64_t delta = weight - mWeights[slot];
+		if (delta == 0) {
+			return;
+		}
+		if (mWeights[slot] == 0) {
+			mCount++;
+		} else if (weight == 0) {
+			mCount--;
+		}
+		mWeights[slot] = weight;
+		mTotal += delta;
+		for (size_t i = slot + 1; i < mSums.size(); i += i & (0 - i)) {
+			mSums[i] += delta;
+		}
+	}
+	int64_t Get(size_t slot) const {
+		return mWeights[slot];
+	}
+	/// @param val  0 <= val < GetTotal()
+	/// @retval the slot where the weight prefix sum exceeds val
+	size_t Find(int64_t val) const {
+		assert(0 <= val && val < mTotal);
+		size_t pos = 0;
+		for (size_t step = mSums.size() - 1; step > 0; step >>= 1) {
+			const size_t next = pos + step;
+			if (next < mSums.size() && mSums[next] <= val) {
+				pos = next;
+				val -= mSums[next];
+			}
+		}
+		return pos;
+	}
+	Entry* GetEntry(size_t slot) const {
+		return mEntries[slot];
+	}
+	int64_t GetTotal() const {
+		return mTotal;
+	}
+	size_t GetCount() const {
+		return mCount;
+	}
+private:
+	/// 1 based sums; size - 1 is a power of 2.
+	vector<int64_t> mSums;
+	vector<int64_t> mWeights;
+	vector<Entry*>  mEntries;
+	vector<size_t>  mFree;
+	int64_t         mTotal;
+	size_t          mCount;
+
+	void Grow() {
+		const size_t size = (mSums.size() - 1) * 2;
+		mSums.assign(size + 1, 0);
+		for (size_t i = 1; i <= size; i++) {
+			if (i <= mWeights.size()) {
+				mSums[i] += mWeights[i - 1];
+			}
+			const size_t j = i + (i & (0 - i));
+			if (j <= size) {
+				mSums[j] += mSums[i];
+			}
+		}
+	}
+};
+
+struct PlacementIndex::Group {
+	Tree trees[kNumClasses];
+};
+
+static int64_t
+Random(int64_t n)
+{
+	const uint64_t r = ((uint64_t)rand() << 31) ^ (uint64_t)rand();
+	return (int64_t)(r % (uint64_t)n);
+}
+
+PlacementIndex::PlacementIndex()
+	: mEntries(),
+	  mRacks(),
+	  mHosts(),
+	  mAll(new Group()),
+	  mHeld()
+{
+}
+
+PlacementIndex::~PlacementIndex()
+{
+	Clear();
+	delete mAll;
+}
+
+void
+PlacementIndex::Clear()
+{
+	for (Entries::iterator it = mEntries.begin();
+			it != mEntries.end();
+			++it) {
+		delete it->second;
+	}
+	mEntries.clear();
+	for (Racks::iterator it = mRacks.begin(); it != mRacks.end(); ++it) {
+		delete it->second;
+	}
+	mRacks.clear();
+	mHosts.clear();
+	delete mAll;
+	mAll = new Group();
+}
+
+void
+PlacementIndex::Add(const ChunkServerPtr& server)
+{
+	Entry*& entry = mEntries[server.get()];
+	if (entry) {
+		return;
+	}
+	entry = new Entry(server);
+	Link(*entry);
+	mHosts.insert(make_pair(entry->host, entry));
+}
+
+bool
+PlacementIndex::Update(const ChunkServer* server, int64_t weight,
+	bool masterFlag, bool loadedFlag)
+{
+	Entries::const_iterator const it = mEntries.find(server);
+	if (it == mEntries.end()) {
+		return false;
+	}
+	Entry& entry = *it->second;
+	const int cls = GetClass(masterFlag, loadedFlag);
+	if (cls != entry.cls) {
+		Unlink(entry);
+		entry.cls    = cls;
+		entry.weight = weight;
+		Link(entry);
+		return true;
+	}
+	if (weight != entry.weight) {
+		entry.weight = weight;
+		mRacks[entry.rackId]->trees[cls].Set(entry.slot[0], weight);
+		mAll->trees[cls].Set(entry.slot[1], weight);
+	}
+	return true;
+}
+
+void
+PlacementIndex::Remove(const ChunkServer* server)
+{
+	Entries::iterator const it = mEntries.find(server);
+	if (it == mEntries.end()) {
+		return;
+	}
+	Entry* const entry = it->second;
+	pair<Hosts::iterator, Hosts::iterator> const range =
+		mHosts.equal_range(entry->host);
+	for (Hosts::iterator hi = range.first; hi != range.second; ++hi) {
+		if (hi->second == entry) {
+			mHosts.erase(hi);
+			break;
+		}
+	}
+	Unlink(*entry);
+	delete entry;
+	mEntries.erase(it);
+}
+
+PlacementIndex::Group*
+PlacementIndex::GetGroup(int rackId) const
+{
+	if (rackId < 0) {
+		return mAll;
+	}
+	Racks::const_iterator const it = mRacks.find(rackId);
+	return (it == mRacks.end() ? 0 : it->second);
+}
+
+void
+PlacementIndex::Link(Entry& entry)
+{
+	// Servers with no rack assigned have their own group, as the rack
+	// groups are only used for the rack aware placement.
+	Group*& rack = mRacks[entry.rackId];
+	if (! rack) {
+		rack = new Group();
+	}
+	Tree& rackTree = rack->trees[entry.cls];
+	entry.slot[0] = rackTree.Add(&entry);
+	rackTree.Set(entry.slot[0], entry.weight);
+	Tree& allTree = mAll->trees[entry.cls];
+	entry.slot[1] = allTree.Add(&entry);
+	allTree.Set(entry.slot[1], entry.weight);
+}
+
+void
+PlacementIndex::Unlink(Entry& entry)
+{
+	mRacks[entry.rackId]->trees[entry.cls].Remove(entry.slot[0]);
+	mAll->trees[entry.cls].Remove(entry.slot[1]);
+}
+
+void
+PlacementIndex::Hold(Group& group, const ChunkServer* server)
+{
+	Entries::const_iterator const it = mEntries.find(server);
+	if (it == mEntries.end()) {
+		return;
+	}
+	const Entry& entry = *it->second;
+	const int    idx   = &group == mAll ? 1 : 0;
+	if (idx == 0 && mRacks[entry.rackId] != &group) {
+		return;
+	}
+	Tree&         tree   = group.trees[entry.cls];
+	const size_t  slot   = entry.slot[idx];
+	const int64_t weight = tree.Get(slot);
+	if (weight <= 0) {
+		return;
+	}
+	Held held;
+	held.tree   = &tree;
+	held.slot   = slot;
+	held.weight = weight;
+	mHeld.push_back(held);
+	tree.Set(slot, 0);
+}
+
+void
+PlacementIndex::Release()
+{
+	while (! mHeld.empty()) {
+		const Held& held = mHeld.back();
+		held.tree->Set(held.slot, held.weight);
+		mHeld.pop_back();
+	}
+}
+
+size_t
+PlacementIndex::Pick(int rackId, size_t count, Role role,
+	const vector<ChunkServerPtr>& excludes, vector<ChunkServerPtr>& result)
+{
+	Group* const group = GetGroup(rackId);
+	if (! group || count <= 0) {
+		return 0;
+	}
+	// Sampling without replacement: set the weight of the excluded and
+	// picked servers to 0 for the duration of the call.
+	for (vector<ChunkServerPtr>::const_iterator it = excludes.begin();
+			it != excludes.end();
+			++it) {
+		Hold(*group, it->get());
+	}
+	for (vector<ChunkServerPtr>::const_iterator it = result.begin();
+			it != result.end();
+			++it) {
+		Hold(*group, it->get());
+	}
+	size_t picked = 0;
+	for (int loaded = 0; loaded < 2 && picked < count; loaded++) {
+		Tree* trees[2];
+		int   numTrees = 0;
+		if (role != kSlaveRole) {
+			trees[numTrees++] =
+				&group->trees[GetClass(true, loaded != 0)];
+		}
+		if (role != kMasterRole) {
+			trees[numTrees++] =
+				&group->trees[GetClass(false, loaded != 0)];
+		}
+		while (picked < count) {
+			int64_t total = 0;
+			for (int i = 0; i < numTrees; i++) {
+				total += trees[i]->GetTotal();
+			}
+			if (total <= 0) {
+				break;
+			}
+			int64_t val = Random(total);
+			int     i   = 0;
+			while (trees[i]->GetTotal() <= val) {
+				val -= trees[i]->GetTotal();
+				i++;
+			}
+			Tree&         tree   = *trees[i];
+			const size_t  slot   = tree.Find(val);
+			Held held;
+			held.tree   = &tree;
+			held.slot   = slot;
+			held.weight = tree.Get(slot);
+			mHeld.push_back(held);
+			tree.Set(slot, 0);
+			result.push_back(tree.GetEntry(slot)->server);
+			picked++;
+		}
+	}
+	Release();
+	return picked;
+}
+
+size_t
+PlacementIndex::FindByHost(const string& host,
+	vector<ChunkServerPtr>& result) const
+{
+	pair<Hosts::const_iterator, Hosts::const_iterator> const range =
+		mHosts.equal_range(host);
+	size_t count = 0;
+	for (Hosts::const_iterator it = range.first;
+			it != range.second;
+			++it) {
+		result.push_back(it->second->server);
+		count++;
+	}
+	return count;
+}
+
+size_t
+PlacementIndex::GetCandidateCount(int rackId) const
+{
+	const Group* const group = GetGroup(rackId);
+	if (! group) {
+		return 0;
+	}
+	size_t count = 0;
+	for (int i = 0; i < kNumClasses; i++) {
+		count += group->trees[i].GetCount();
+	}
+	return count;
+}
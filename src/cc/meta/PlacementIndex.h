@@ -0,0 +1,129 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2010/12/06
+//
+// Copyright 2010 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Chunk server placement index: weighted random selection of the
+// chunk servers for new chunks.
+//
+// Each rack, and the whole cluster, has a Fenwick (binary indexed) tree of
+// the server weights per server class: chunk master or slave, with or
+// without the disk load over the write threshold. The layout manager sets
+// the weights from the server's free space and write load, when the
+// server's state changes, and on every heartbeat. Selecting a server, and
+// updating its weight are O(log n), instead of building, filtering and
+// shuffling the candidate list of all servers on every chunk allocation.
+//
+//----------------------------------------------------------------------------
+
+#ifndef META_PLACEMENTINDEX_H
+#define META_PLACEMENTINDEX_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <tr1/unordered_map>
+
+#include "ChunkServer.h"
+
+namespace KFS
+{
+	class PlacementIndex {
+	public:
+		enum Role {
+			kAnyRole,
+			kMasterRole,
+			kSlaveRole
+		};
+
+		PlacementIndex();
+		~PlacementIndex();
+
+		/// Add the server with 0 weight; no-op if already added.
+		void Add(const ChunkServerPtr& server);
+		/// Set the server weight and class. 0 weight means the server
+		/// is not a placement candidate.
+		/// @retval false if the server is not in the index
+		bool Update(const ChunkServer* server, int64_t weight,
+			bool masterFlag, bool loadedFlag);
+		void Remove(const ChunkServer* server);
+		void Clear();
+
+		/// Pick up to count distinct servers from the rack, or from all
+		/// racks if rackId < 0, with the probability proportional to
+		/// the server weight, and append them to the result. The
+		/// servers already in the result, and in the excludes are not
+		/// picked. The servers with the disk load over the threshold
+		/// are picked only if there are not enough other servers.
+		/// @retval the number of servers appended to the result
+		size_t Pick(int rackId, size_t count, Role role,
+			const std::vector<ChunkServerPtr>& excludes,
+			std::vector<ChunkServerPtr>& result);
+
+		/// Find the servers running on the host.
+		/// @retval the number of servers appended to the result
+		size_t FindByHost(const std::string& host,
+			std::vector<ChunkServerPtr>& result) const;
+
+		/// @retval the number of servers with non 0 weight
+		size_t GetCandidateCount(int rackId) const;
+		size_t GetSize() const {
+			return mEntries.size();
+		}
+
+	private:
+		enum {
+			kNumClasses = 4 // master, slave; x2 loaded
+		};
+		struct Entry;
+		class Tree;
+		struct Group;
+		struct Held {
+			Tree*   tree;
+			size_t  slot;
+			int64_t weight;
+		};
+		typedef std::tr1::unordered_map<const ChunkServer*, Entry*> Entries;
+		typedef std::map<int, Group*> Racks;
+		typedef std::tr1::unordered_multimap<std::string, Entry*> Hosts;
+
+		Entries           mEntries;
+		Racks             mRacks;
+		Hosts             mHosts;
+		Group*            mAll;
+		std::vector<Held> mHeld;
+
+		Group* GetGroup(int rackId) const;
+		void Link(Entry& entry);
+		void Unlink(Entry& entry);
+		void Hold(Group& group, const ChunkServer* server);
+		void Release();
+		static int GetClass(bool masterFlag, bool loadedFlag) {
+			return ((loadedFlag ? 2 : 0) + (masterFlag ? 0 : 1));
+		}
+
+	private:
+		// No copies.
+		PlacementIndex(const PlacementIndex&);
+		PlacementIndex& operator=(const PlacementIndex&);
+	};
+}
+
+#endif // META_PLACEMENTINDEX_H
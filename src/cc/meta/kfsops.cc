@@ -381,14 +381,20 @@ Tree::getFattr(fid_t fid)
 MetaDentry *
 Tree::getDentry(fid_t dir, const string &fname)
 {
-	vector <MetaDentry *> v;
-
-	if (readdir(dir, v) != 0)
+	const Key dkey(KFS_DENTRY, dir, MetaDentry::nameHash(fname));
+	Node * const l = findLeaf(dkey);
+	if (l == NULL)
 		return NULL;
-
-	vector <MetaDentry *>::iterator d;
-	d = find_if(v.begin(), v.end(), DirMatch(fname));
-	return (d == v.end()) ? NULL : *d;
+	// Only the entries with the same name hash need to be looked at.
+	for (LeafIter li(l, l->findplace(dkey));
+			li.parent() != NULL &&
+			li.parent()->getkey(li.index()) == dkey;
+			li.next()) {
+		MetaDentry * const d = refine<MetaDentry>(li.current());
+		if (d->compareName(fname) == 0)
+			return d;
+	}
+	return NULL;
 }
 
 /*
@@ -801,7 +807,7 @@ Tree::updateSpaceUsageForPath(const string &path, off_t nbytes)
 int
 Tree::readdir(fid_t dir, vector <MetaDentry *> &v)
 {
-	const Key dkey(KFS_DENTRY, dir);
+	const Key dkey(KFS_DENTRY, dir, Key::MATCH_ANY);
 	Node *l = findLeaf(dkey);
 	if (l == NULL)
 		return -ENOENT;
@@ -810,6 +816,56 @@ Tree::readdir(fid_t dir, vector <MetaDentry *> &v)
 	return 0;
 }
 
+/*!
+ * \brief read a part of the contents of a directory
+ * \param[in] dir		file id of directory
+ * \param[in] fnameStart	resume after the entry with this name; empty
+ *				to start at the beginning of the directory
+ * \param[in] maxEntries	# of entries to return; 0 means no limit
+ * \param[out] v		vector of directory entries
+ * \param[out] hasMore		set if the directory has more entries
+ * \return			status code
+ *
+ * The entries are in the name hash order, therefore the listing can be
+ * resumed with the last name returned, even if that entry was removed
+ * in the meantime.  The entries with the same name hash are never split
+ * between parts, thus the part might be slightly larger than maxEntries.
+ * Nothing is copied, besides the entry pointers of the part.
+ */
+int
+Tree::readdir(fid_t dir, const string &fnameStart, int maxEntries,
+		vector <MetaDentry *> &v, bool &hasMore)
+{
+	const Key dkey(KFS_DENTRY, dir, Key::MATCH_ANY);
+	const Key start = fnameStart.empty() ? dkey :
+		Key(KFS_DENTRY, dir, MetaDentry::nameHash(fnameStart) + 1);
+
+	hasMore = false;
+	// Find the leaf with the first key that is not less than start.
+	Node *n = root;
+	int p = n->findplace(start);
+	while (!n->hasleaves()) {
+		if (p == n->children())
+			return 0;
+		n = n->child(p);
+		p = n->findplace(start);
+	}
+	Key last;
+	for (LeafIter li(n, p); li.parent() != NULL; li.next()) {
+		const Key &k = li.parent()->getkey(li.index());
+		if (k != dkey)
+			break;
+		if (maxEntries > 0 && (int)v.size() >= maxEntries &&
+				k != last) {
+			hasMore = true;
+			break;
+		}
+		v.push_back(refine<MetaDentry>(li.current()));
+		last = k;
+	}
+	return ((v.empty() && fnameStart.empty()) ? -ENOENT : 0);
+}
+
 /*!
  * \brief return a file's chunk information (if any)
  * \param[in] file	file id for the file
@@ -279,6 +279,8 @@ public:
 	int mkdir(fid_t dir, const string &dname, fid_t *newFid);
 	int rmdir(fid_t dir, const string &dname, const string &pathname);
 	int readdir(fid_t dir, vector <MetaDentry *> &result);
+	int readdir(fid_t dir, const string &fnameStart, int maxEntries,
+			vector <MetaDentry *> &result, bool &hasMore);
 	int getalloc(fid_t file, vector <MetaChunkInfo *> &result);
 	int getalloc(fid_t file, chunkOff_t offset, MetaChunkInfo **c);
 	int rename(fid_t dir, const string &oldname, string &newname, 
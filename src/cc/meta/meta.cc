@@ -68,6 +68,23 @@ Key::compare(const Key &test) const
 	return d;
 }
 
+/*!
+ * \brief directory entry name hash: 64 bit FNV-1a, with the two most
+ * significant bits cleared, so that the hash is never negative, and thus
+ * never equals to Key::MATCH_ANY. The hash is part of the b-tree key,
+ * and is not persistent: the tree is re-built from the checkpoint.
+ */
+KeyData
+MetaDentry::nameHash(const string &fname)
+{
+	unsigned long long h = 14695981039346656037ULL;
+	for (string::const_iterator i = fname.begin(); i != fname.end(); ++i) {
+		h ^= (unsigned char)*i;
+		h *= 1099511628211ULL;
+	}
+	return (KeyData)(h & 0x3FFFFFFFFFFFFFFFULL);
+}
+
 const string
 MetaDentry::show() const
 {
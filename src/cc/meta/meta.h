@@ -98,7 +98,11 @@ public:
 	MetaDentry(const MetaDentry *other) :
 		Meta(KFS_DENTRY, other->id()), dir(other->dir), name(other->name) { }
 
-	const Key key() const { return Key(KFS_DENTRY, dir); }
+	//! the name hash orders the entries within the directory, and
+	//! makes name lookup and resuming partial directory listing
+	//! O(log n) in the directory size
+	const Key key() const { return Key(KFS_DENTRY, dir, nameHash(name)); }
+	static KeyData nameHash(const string &fname);
 	const string show() const;
 	//!< accessor that returns the name of this Dentry
 	const string getName() const { return name; }
@@ -38,6 +38,7 @@
 #include "ChildProcessTracker.h"
 
 #include "libkfsIO/Globals.h"
+#include "libkfsIO/LatencyHistogram.h"
 #include "common/log.h"
 
 using std::map;
@@ -61,6 +62,9 @@ static int parseHandlerRename(Properties &prop, MetaRequest **r);
 static int parseHandlerMkdir(Properties &prop, MetaRequest **r);
 static int parseHandlerRmdir(Properties &prop, MetaRequest **r);
 static int parseHandlerReaddir(Properties &prop, MetaRequest **r);
+static int parseHandlerMultiStat(Properties &prop, MetaRequest **r);
+static int parseHandlerMultiCreate(Properties &prop, MetaRequest **r);
+static int parseHandlerMultiRemove(Properties &prop, MetaRequest **r);
 static int parseHandlerReaddirPlus(Properties &prop, MetaRequest **r);
 static int parseHandlerGetalloc(Properties &prop, MetaRequest **r);
 static int parseHandlerGetlayout(Properties &prop, MetaRequest **r);
@@ -108,6 +112,22 @@ OpCounterMap gCounters;
 Counter *gNumFiles, *gNumDirs, *gNumChunks;
 Counter *gPathToFidCacheHit, *gPathToFidCacheMiss;
 
+// Client request latency histograms, see UpdateRequestLatency().
+enum {
+	kLatencyQueue,
+	kLatencyExec,
+	kLatencyLog,
+	kLatencyTotal,
+	kLatencyPhaseCount
+};
+static const char* const kLatencyPhaseNames[kLatencyPhaseCount] = {
+	"queue",
+	"exec",
+	"log",
+	"total"
+};
+static LatencyStats gRequestLatency(kLatencyPhaseNames, kLatencyPhaseCount);
+
 // see the comments in setClusterKey()
 string gClusterKey;
 string gMD5SumFn;
@@ -201,6 +221,27 @@ UpdateCounter(MetaOp opName)
 	c->Update(1);
 }
 
+/*!
+ * \brief Update the client request latency histograms, invoked before the
+ * response is sent. The request processing phases are:
+ * queue -- waiting for the previous request from the same client to finish;
+ * exec -- handle(); log -- waiting for the log write, and, for allocation
+ * and such, the chunk server rpcs; total -- receive to response.
+ */
+void
+UpdateRequestLatency(const MetaRequest &r)
+{
+	if (r.recvTime <= 0)
+		return;
+
+	const int64_t now = microseconds();
+	const int64_t submit = max(r.recvTime, r.submitTime);
+	gRequestLatency.Update(r.op, kLatencyQueue, submit - r.recvTime);
+	gRequestLatency.Update(r.op, kLatencyExec, r.processTime);
+	gRequestLatency.Update(r.op, kLatencyLog, now - submit - r.processTime);
+	gRequestLatency.Update(r.op, kLatencyTotal, now - r.recvTime);
+}
+
 void
 UpdateNumDirs(int count)
 {
@@ -400,6 +441,115 @@ MetaRmdir::handle()
 	status = metatree.rmdir(dir, name, pathname);
 }
 
+/*!
+ * \brief parse the request body: one path name per line.
+ */
+bool
+MetaMultiPathRequest::parseRequestContent(std::istream &is)
+{
+	string path;
+
+	while (getline(is, path)) {
+		if (! path.empty() && path[path.size() - 1] == '\r')
+			path.erase(path.size() - 1);
+		paths.push_back(path);
+	}
+	return ((int)paths.size() == count);
+}
+
+int
+MetaMultiPathRequest::lookupParent(const string &path, fid_t &dir,
+	string &name)
+{
+	const string::size_type slash = path.rfind('/');
+	if (slash == string::npos || path[0] != '/')
+		return -EINVAL;
+	MetaFattr * const fa = metatree.lookupPath(ROOTFID,
+		slash == 0 ? string("/") : path.substr(0, slash));
+	if (fa == NULL)
+		return -ENOENT;
+	if (fa->type != KFS_DIR)
+		return -ENOTDIR;
+	dir = fa->id();
+	name.assign(path, slash + 1, string::npos);
+	return 0;
+}
+
+/* virtual */ void
+MetaMultiStat::handle()
+{
+	static const char* const fname[] = { "empty", "file", "dir" };
+	ostringstream os;
+
+	for (size_t i = 0; i < paths.size(); i++) {
+		MetaFattr * const fa = metatree.lookupPath(ROOTFID, paths[i]);
+		if (fa == NULL) {
+			os << -ENOENT << "\n";
+			continue;
+		}
+		os << 0 <<
+			" " << fa->id() <<
+			" " << fname[fa->type] <<
+			" " << fa->chunkcount <<
+			" " << fa->filesize <<
+			" " << fa->numReplicas;
+		sendtime(os, "", fa->mtime, "");
+		sendtime(os, "", fa->ctime, "");
+		sendtime(os, "", fa->crtime, "\n");
+	}
+	result = os.str();
+	status = 0;
+}
+
+/* virtual */ void
+MetaMultiCreate::handle()
+{
+	ostringstream os;
+
+	for (size_t i = 0; i < paths.size(); i++) {
+		fid_t  dir = -1;
+		fid_t  fid = 0;
+		string name;
+		int    res = lookupParent(paths[i], dir, name);
+		if (res == 0)
+			res = metatree.create(dir, name, &fid,
+				numReplicas, exclusive);
+		if (res != 0) {
+			os << res << "\n";
+			continue;
+		}
+		dirs.push_back(dir);
+		names.push_back(name);
+		fids.push_back(fid);
+		os << res << " " << fid << "\n";
+	}
+	result = os.str();
+	status = 0;
+}
+
+/* virtual */ void
+MetaMultiRemove::handle()
+{
+	ostringstream os;
+
+	for (size_t i = 0; i < paths.size(); i++) {
+		fid_t  dir = -1;
+		string name;
+		int    res = lookupParent(paths[i], dir, name);
+		if (res == 0 && gWormMode && ! isWormMutationAllowed(name))
+			res = -EPERM;
+		if (res == 0)
+			res = metatree.remove(dir, name, paths[i]);
+		if (res == 0) {
+			dirs.push_back(dir);
+			names.push_back(name);
+		}
+		os << res << "\n";
+	}
+	result = os.str();
+	status = 0;
+}
+
 /* virtual */ void
 MetaReaddir::handle()
 {
@@ -407,7 +557,7 @@ MetaReaddir::handle()
         // This piece of code was changed with svn version 75.
 	MetaFattr * const fa = metatree.getFattr(dir);
         status = (! fa) ? -ENOENT : (fa->type != KFS_DIR ? -ENOTDIR :
-            metatree.readdir(dir, v));
+            metatree.readdir(dir, fnameStart, maxEntries, v, hasMoreEntries));
 }
 
 class EnumerateLocations {
@@ -458,6 +608,16 @@ public:
 		if (fa->type == KFS_DIR) {
 			return;
 		}
+		if (fa->chunkcount == 0 || fa->filesize >= 0) {
+			// The size is known, no need to look up the last
+			// chunk.
+			os << "Chunk-count: " << toString(fa->chunkcount) << "\r\n";
+			os << "File-size: " <<
+				toString(fa->chunkcount == 0 ? 0 : fa->filesize) <<
+				"\r\n";
+			os << "Replication: " << toString(fa->numReplicas) << "\r\n";
+			return;
+		}
 		// for a file, get the layout and provide location of last chunk
 		// so that the client can compute filesize
 		vector<MetaChunkInfo*> chunkInfo;
@@ -515,7 +675,8 @@ MetaReaddirPlus::handle()
 		status = -ENOTDIR;
 	} else {
 		vector<MetaDentry *> res;
-		status = metatree.readdir(dir, res);
+		status = metatree.readdir(dir, fnameStart, maxEntries, res,
+			hasMoreEntries);
 		if (status == 0) {
 			// now that we have the entire directory read, for each entry in the
 			// directory, get the attributes out.
@@ -551,7 +712,7 @@ MetaGetalloc::handle()
 	chunkId = chunkInfo->chunkId;
 	chunkVersion = chunkInfo->chunkVersion;
 	vector<ChunkServerPtr> c;
-	if (gLayoutManager.GetChunkToServerMapping(chunkId, c) != 0) {
+	if (gLayoutManager.GetChunkReadServers(chunkId, c, clientHost) != 0) {
 		KFS_LOG_STREAM_DEBUG <<
 			"handle_getalloc(" << fid << "," << chunkId << "," << offset <<
 			"): no chunkservers" <<
@@ -582,13 +743,15 @@ MetaGetlayout::handle()
 	if (status != 0)
 		return;
 
+	const int clientRack = gLayoutManager.GetClientRack(clientHost);
 	for (vector<MetaChunkInfo*>::size_type i = 0; i < chunkInfo.size(); i++) {
 		ChunkLayoutInfo l;
 
 		l.offset = chunkInfo[i]->offset;
 		l.chunkId = chunkInfo[i]->chunkId;
 		l.chunkVersion = chunkInfo[i]->chunkVersion;
-		if (gLayoutManager.GetChunkToServerMapping(l.chunkId, c) != 0) {
+		if (gLayoutManager.GetChunkReadServers(
+				l.chunkId, c, clientHost, clientRack) != 0) {
 			status = -EHOSTUNREACH;
 			return;
 		}
@@ -1252,6 +1415,8 @@ MetaStats::handle()
 	ostringstream os;
 	status = 0;
 	globals().counterManager.Show(os);
+	if (latencyFlag)
+		gRequestLatency.Show(os);
 	stats = os.str();
 
 }
@@ -1291,6 +1456,9 @@ setup_handlers()
 	gParseHandlers["RMDIR"] = parseHandlerRmdir;
 	gParseHandlers["READDIR"] = parseHandlerReaddir;
 	gParseHandlers["READDIRPLUS"] = parseHandlerReaddirPlus;
+	gParseHandlers["MULTI_STAT"] = parseHandlerMultiStat;
+	gParseHandlers["MULTI_CREATE"] = parseHandlerMultiCreate;
+	gParseHandlers["MULTI_REMOVE"] = parseHandlerMultiRemove;
 	gParseHandlers["GETALLOC"] = parseHandlerGetalloc;
 	gParseHandlers["GETLAYOUT"] = parseHandlerGetlayout;
 	gParseHandlers["ALLOCATE"] = parseHandlerAllocate;
@@ -1349,7 +1517,9 @@ MetaRequest::handle()
 void
 process_request(MetaRequest *r)
 {
+	const int64_t start = microseconds();
         r->handle();
+	r->processTime += microseconds() - start;
 	if (!r->suspended) {
 		UpdateCounter(r->op);
 		oplog.dispatch(r);
@@ -1463,6 +1633,44 @@ MetaRmdir::log(ofstream &file) const
 	return file.fail() ? -EIO : 0;
 }
 
+/*!
+ * \brief log multi stat request (nop)
+ */
+int
+MetaMultiStat::log(ofstream &file) const
+{
+	return 0;
+}
+
+/*!
+ * \brief log the files created by a batch, one create entry per file
+ */
+int
+MetaMultiCreate::log(ofstream &file) const
+{
+	struct timeval t;
+	gettimeofday(&t, NULL);
+
+	for (size_t i = 0; i < fids.size(); i++) {
+		file << "create/dir/" << dirs[i] << "/name/" << names[i] <<
+			"/id/" << fids[i] << "/numReplicas/" << (int) numReplicas <<
+			"/ctime/" << showtime(t) << '\n';
+	}
+	return file.fail() ? -EIO : 0;
+}
+
+/*!
+ * \brief log the files removed by a batch, one remove entry per file
+ */
+int
+MetaMultiRemove::log(ofstream &file) const
+{
+	for (size_t i = 0; i < names.size(); i++) {
+		file << "remove/dir/" << dirs[i] << "/name/" << names[i] << '\n';
+	}
+	return file.fail() ? -EIO : 0;
+}
+
 /*!
  * \brief log directory read (nop)
  */
@@ -1898,7 +2106,10 @@ ParseCommand(std::istream& is, MetaRequest **res)
 
 	prop.loadProperties(is, separator, false);
 
-	return (*handler)(prop, res);
+	const int ret = (*handler)(prop, res);
+	if (ret == 0 && *res && ! gRequestLatency.HasOpName((*res)->op))
+		gRequestLatency.SetOpName((*res)->op, cmdStr.c_str());
+	return ret;
 }
 
 /*!
@@ -2047,6 +2258,80 @@ parseHandlerRmdir(Properties &prop, MetaRequest **r)
 	return 0;
 }
 
+/*!
+ * \brief common header fields of the batched requests; the paths are in
+ * the request body.
+ */
+static bool
+parseMultiPathHeader(Properties &prop, seq_t &seq, int &protoVers,
+	int &len, int &count)
+{
+	seq = prop.getValue("Cseq", (seq_t) -1);
+	protoVers = prop.getValue("Client-Protocol-Version", (int) 0);
+	len = prop.getValue("Content-length", (int) 0);
+	count = prop.getValue("Count", (int) 0);
+	return (len > 0 && count > 0);
+}
+
+static int
+parseHandlerMultiStat(Properties &prop, MetaRequest **r)
+{
+	seq_t seq;
+	int protoVers, len, count;
+
+	if (! parseMultiPathHeader(prop, seq, protoVers, len, count))
+		return -1;
+	*r = new MetaMultiStat(seq, protoVers, len, count);
+	return 0;
+}
+
+static int
+parseHandlerMultiCreate(Properties &prop, MetaRequest **r)
+{
+	seq_t seq;
+	int protoVers, len, count;
+
+	if (! parseMultiPathHeader(prop, seq, protoVers, len, count))
+		return -1;
+	const int16_t numReplicas = min(
+		(int16_t) prop.getValue("Num-replicas", 1), gMaxReplicasPerFile);
+	if (numReplicas <= 0)
+		return -1;
+	const bool exclusive = (prop.getValue("Exclusive", 1)) == 1;
+	*r = new MetaMultiCreate(seq, protoVers, len, count,
+		numReplicas, exclusive);
+	return 0;
+}
+
+static int
+parseHandlerMultiRemove(Properties &prop, MetaRequest **r)
+{
+	seq_t seq;
+	int protoVers, len, count;
+
+	if (! parseMultiPathHeader(prop, seq, protoVers, len, count))
+		return -1;
+	*r = new MetaMultiRemove(seq, protoVers, len, count);
+	return 0;
+}
+
+/*!
+ * \brief parse the optional READDIR / READDIRPLUS listing range: the
+ * name to resume after, and the max # of entries to return.
+ */
+static string
+parseReaddirRange(Properties &prop, int &maxEntries)
+{
+	maxEntries = max(0, prop.getValue("Max-entries", 0));
+	if (maxEntries > 0 && maxEntries < 2) {
+		// The root directory "/" entry is not returned: return at
+		// least two entries, so that the client always has a name
+		// to resume after.
+		maxEntries = 2;
+	}
+	return prop.getValue("Start-after", string());
+}
+
 static int
 parseHandlerReaddir(Properties &prop, MetaRequest **r)
 {
@@ -2059,7 +2344,9 @@ parseHandlerReaddir(Properties &prop, MetaRequest **r)
 	dir = prop.getValue("Directory File-handle", (fid_t) -1);
 	if (dir < 0)
 		return -1;
-	*r = new MetaReaddir(seq, protoVers, dir);
+	int maxEntries;
+	const string fnameStart = parseReaddirRange(prop, maxEntries);
+	*r = new MetaReaddir(seq, protoVers, dir, fnameStart, maxEntries);
 	return 0;
 }
 
@@ -2075,7 +2362,9 @@ parseHandlerReaddirPlus(Properties &prop, MetaRequest **r)
 	dir = prop.getValue("Directory File-handle", (fid_t) -1);
 	if (dir < 0)
 		return -1;
-	*r = new MetaReaddirPlus(seq, protoVers, dir);
+	int maxEntries;
+	const string fnameStart = parseReaddirRange(prop, maxEntries);
+	*r = new MetaReaddirPlus(seq, protoVers, dir, fnameStart, maxEntries);
 	return 0;
 }
 
@@ -2093,7 +2382,9 @@ parseHandlerGetalloc(Properties &prop, MetaRequest **r)
 	offset = prop.getValue("Chunk-offset", (chunkOff_t) -1);
 	if ((fid < 0) || (offset < 0))
 		return -1;
-	*r = new MetaGetalloc(seq, protoVers, fid, offset, prop.getValue("Pathname", string()));
+	*r = new MetaGetalloc(seq, protoVers, fid, offset,
+		prop.getValue("Pathname", string()),
+		prop.getValue("Client-host", string()));
 	return 0;
 }
 
@@ -2109,7 +2400,8 @@ parseHandlerGetlayout(Properties &prop, MetaRequest **r)
 	fid = prop.getValue("File-handle", (fid_t) -1);
 	if (fid < 0)
 		return -1;
-	*r = new MetaGetlayout(seq, protoVers, fid);
+	*r = new MetaGetlayout(seq, protoVers, fid,
+		prop.getValue("Client-host", string()));
 	return 0;
 }
 
@@ -2482,7 +2774,9 @@ parseHandlerPing(Properties &prop, MetaRequest **r)
 	seq_t seq = prop.getValue("Cseq", (seq_t) -1);
 	int protoVers = prop.getValue("Client-Protocol-Version", (int) 0);
 
-	*r = new MetaPing(seq, protoVers);
+	bool systemInfoOnly = prop.getValue("System-info-only", 0) != 0;
+
+	*r = new MetaPing(seq, protoVers, systemInfoOnly);
 	return 0;
 }
 
@@ -2524,8 +2818,9 @@ parseHandlerStats(Properties &prop, MetaRequest **r)
 {
 	seq_t seq = prop.getValue("Cseq", (seq_t) -1);
 	int protoVers = prop.getValue("Client-Protocol-Version", (int) 0);
+	bool latencyFlag = prop.getValue("Latency-histograms", 0) != 0;
 
-	*r = new MetaStats(seq, protoVers);
+	*r = new MetaStats(seq, protoVers, latencyFlag);
 	return 0;
 }
 
@@ -2712,6 +3007,17 @@ MetaRmdir::response(ostream &os)
 	PutHeader(this, os) << "\r\n";
 }
 
+void
+MetaMultiPathRequest::response(ostream &os)
+{
+	if (! OkHeader(this, os)) {
+		return;
+	}
+	os << "Count: " << paths.size() << "\r\n";
+	os << "Content-length: " << result.length() << "\r\n\r\n";
+	os << result;
+}
+
 void
 MetaReaddir::response(ostream &os)
 {
@@ -2738,6 +3044,8 @@ MetaReaddir::response(ostream &os)
 		++numEntries;
 	}
 	os << "Num-Entries: " << numEntries << "\r\n";
+	if (hasMoreEntries)
+		os << "Has-more-entries: 1\r\n";
 	os << "Content-length: " << entries.str().length() << "\r\n\r\n";
 	if (entries.str().length() > 0)
 		os << entries.str();
@@ -2750,6 +3058,8 @@ MetaReaddirPlus::response(ostream &os)
 		return;
 	}
 	os << "Num-Entries: " << numEntries << "\r\n";
+	if (hasMoreEntries)
+		os << "Has-more-entries: 1\r\n";
 	os << "Content-length: " << v.str().length() << "\r\n\r\n";
 	os << v.str();
 }
@@ -2931,6 +3241,11 @@ MetaPing::response(ostream &os)
 	else
 		os << "WORM: " << 0 << "\r\n";
 	os << "System Info: " << systemInfo << "\r\n";
+	if (systemInfoOnly) {
+		// Short response that fits into the client's rpc header buffer.
+		os << "\r\n";
+		return;
+	}
 	os << "Servers: " << servers << "\r\n";
 	os << "Retiring Servers: " << retiringServers << "\r\n";
 	os << "Down Servers: " << downServers << "\r\n\r\n";
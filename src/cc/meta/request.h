@@ -36,6 +36,7 @@
 #include "thread.h"
 #include "util.h"
 #include <deque>
+#include <boost/shared_ptr.hpp>
 #include <istream>
 #include <fstream>
 #include <sstream>
@@ -125,6 +126,10 @@ enum MetaOp {
         META_CHUNK_SERVER_RESTART,
         META_CHUNK_SET_PROPERTIES,
         META_GET_CHUNK_SERVERS_COUNTERS,
+	//!< Batched client requests, the paths are in the request body
+	META_MULTI_STAT,
+	META_MULTI_CREATE,
+	META_MULTI_REMOVE,
 
         META_NUM_OPS_COUNT // must be the last one
 };
@@ -142,9 +147,13 @@ struct MetaRequest {
 	const bool mutation; //!< mutates metatree
 	bool suspended;  //!< is this request suspended somewhere
 	KfsCallbackObj *clnt; //!< a handle to the client that generated this request.
+	int64_t recvTime; //!< usec, when the client request was received
+	int64_t submitTime; //!< usec, when the request was submitted
+	int64_t processTime; //!< usec spent in handle()
 	MetaRequest(MetaOp o, seq_t ops, int pv, bool mu):
 		op(o), status(0), clientProtoVers(pv), statusMsg(), opSeqno(ops), seqno(0), mutation(mu),
-		suspended(false), clnt(NULL) { }
+		suspended(false), clnt(NULL), recvTime(0), submitTime(0),
+		processTime(0) { }
 	virtual ~MetaRequest() { }
 
         virtual void handle();
@@ -157,6 +166,10 @@ struct MetaRequest {
 	};
 	virtual int log(ofstream &file) const = 0; //!< write request to log
 	virtual string Show() const { return ""; }
+	//!< length of the request body that follows the request header
+	virtual int requestContentLength() const { return 0; }
+	//!< parse the request body, invoked before the request is submitted
+	virtual bool parseRequestContent(std::istream &is) { return true; }
 };
 
 extern void process_request(MetaRequest *r);
@@ -304,9 +317,13 @@ struct MetaRmdir: public MetaRequest {
  */
 struct MetaReaddir: public MetaRequest {
 	fid_t dir;	//!< directory to read
+	string fnameStart; //!< resume after this name, if not empty
+	int maxEntries;	//!< max # of entries to return, 0 means no limit
+	bool hasMoreEntries; //!< set if the listing is not complete
 	vector <MetaDentry *> v; //!< vector of results
-	MetaReaddir(seq_t s, int pv, fid_t d):
-		MetaRequest(META_READDIR, s, pv, false), dir(d) { }
+	MetaReaddir(seq_t s, int pv, fid_t d, const string &start, int maxe):
+		MetaRequest(META_READDIR, s, pv, false), dir(d),
+		fnameStart(start), maxEntries(maxe), hasMoreEntries(false) { }
         virtual void handle();
 	virtual int log(ofstream &file) const;
 	virtual void response(ostream &os);
@@ -315,6 +332,9 @@ struct MetaReaddir: public MetaRequest {
 		ostringstream os;
 
 		os << "readdir: dir fid = " << dir;
+		if (maxEntries > 0)
+			os << " start after: " << fnameStart <<
+				" max entries: " << maxEntries;
 		return os.str();
 	}
 };
@@ -324,10 +344,16 @@ struct MetaReaddir: public MetaRequest {
  */
 struct MetaReaddirPlus: public MetaRequest {
 	fid_t dir;	//!< directory to read
+	string fnameStart; //!< resume after this name, if not empty
+	int maxEntries;	//!< max # of entries to return, 0 means no limit
+	bool hasMoreEntries; //!< set if the listing is not complete
 	ostringstream v; //!< results built out into a string
 	int numEntries; //!< # of entries in the directory
-	MetaReaddirPlus(seq_t s, int pv, fid_t d):
-		MetaRequest(META_READDIRPLUS, s, pv, false), dir(d) { }
+	MetaReaddirPlus(seq_t s, int pv, fid_t d, const string &start,
+			int maxe):
+		MetaRequest(META_READDIRPLUS, s, pv, false), dir(d),
+		fnameStart(start), maxEntries(maxe), hasMoreEntries(false),
+		numEntries(0) { }
         virtual void handle();
 	virtual int log(ofstream &file) const;
 	virtual void response(ostream &os);
@@ -336,10 +362,87 @@ struct MetaReaddirPlus: public MetaRequest {
 		ostringstream os;
 
 		os << "readdir plus: dir fid = " << dir;
+		if (maxEntries > 0)
+			os << " start after: " << fnameStart <<
+				" max entries: " << maxEntries;
 		return os.str();
 	}
 };
 
+/*!
+ * \brief base for the batched path name requests: the request body has
+ * one absolute path name per line, and the response body has one result
+ * line per path in the same order, with the per path status first.
+ * The batch is executed as a single request, and all its mutations are
+ * written into the log as a single group.
+ */
+struct MetaMultiPathRequest: public MetaRequest {
+	int bodyLength;	//!< request body length
+	int count;	//!< # of paths declared in the request header
+	vector<string> paths; //!< paths from the request body
+	std::string result; //!< response body
+	MetaMultiPathRequest(MetaOp o, seq_t s, int pv, bool mu, int len,
+		int cnt):
+		MetaRequest(o, s, pv, mu), bodyLength(len), count(cnt) { }
+	virtual int requestContentLength() const { return bodyLength; }
+	virtual bool parseRequestContent(std::istream &is);
+	virtual void response(ostream &os);
+protected:
+	//!< split path into the parent directory fid and the last component
+	static int lookupParent(const string &path, fid_t &dir, string &name);
+	string showCount(const char *name) const
+	{
+		ostringstream os;
+
+		os << name << ": count = " << count;
+		return os.str();
+	}
+};
+
+/*!
+ * \brief get attributes of a number of paths
+ */
+struct MetaMultiStat: public MetaMultiPathRequest {
+	MetaMultiStat(seq_t s, int pv, int len, int cnt):
+		MetaMultiPathRequest(META_MULTI_STAT, s, pv, false, len, cnt)
+		{ }
+        virtual void handle();
+	virtual int log(ofstream &file) const;
+	virtual string Show() const { return showCount("multi stat"); }
+};
+
+/*!
+ * \brief create a number of files
+ */
+struct MetaMultiCreate: public MetaMultiPathRequest {
+	int16_t numReplicas; //!< desired degree of replication
+	bool exclusive;  //!< model the O_EXCL flag
+	vector<fid_t> dirs; //!< parent directory fids of the created files
+	vector<string> names; //!< names of the created files
+	vector<fid_t> fids; //!< file IDs of the created files
+	MetaMultiCreate(seq_t s, int pv, int len, int cnt, int16_t r,
+		bool e):
+		MetaMultiPathRequest(META_MULTI_CREATE, s, pv, true, len, cnt),
+		numReplicas(r), exclusive(e) { }
+        virtual void handle();
+	virtual int log(ofstream &file) const;
+	virtual string Show() const { return showCount("multi create"); }
+};
+
+/*!
+ * \brief remove a number of files
+ */
+struct MetaMultiRemove: public MetaMultiPathRequest {
+	vector<fid_t> dirs; //!< parent directory fids of the removed files
+	vector<string> names; //!< names of the removed files
+	MetaMultiRemove(seq_t s, int pv, int len, int cnt):
+		MetaMultiPathRequest(META_MULTI_REMOVE, s, pv, true, len, cnt)
+		{ }
+        virtual void handle();
+	virtual int log(ofstream &file) const;
+	virtual string Show() const { return showCount("multi remove"); }
+};
+
 /*!
  * \brief get allocation info. a chunk for a file
  */
@@ -350,8 +453,11 @@ struct MetaGetalloc: public MetaRequest {
 	seq_t chunkVersion; //!< version # assigned to this chunk
 	vector<ServerLocation> locations; //!< where the copies of the chunks are
 	std::string pathname; //!< pathname of the file (useful to print in debug msgs)
-	MetaGetalloc(seq_t s, int pv, fid_t f, chunkOff_t o, std::string n):
-		MetaRequest(META_GETALLOC, s, pv, false), fid(f), offset(o), pathname(n)
+	std::string clientHost; //!< the client's ip, to order the locations
+	MetaGetalloc(seq_t s, int pv, fid_t f, chunkOff_t o, std::string n,
+			std::string h = std::string()):
+		MetaRequest(META_GETALLOC, s, pv, false), fid(f), offset(o),
+		pathname(n), clientHost(h)
 	{}
         virtual void handle();
 	virtual int log(ofstream &file) const;
@@ -394,8 +500,11 @@ struct ChunkLayoutInfo {
 struct MetaGetlayout: public MetaRequest {
 	fid_t fid;	//!< file for layout info is needed
 	vector <ChunkLayoutInfo> v; //!< vector of results
-	MetaGetlayout(seq_t s, int pv, fid_t f):
-		MetaRequest(META_GETLAYOUT, s, pv, false), fid(f) { }
+	std::string clientHost; //!< the client's ip, to order the locations
+	MetaGetlayout(seq_t s, int pv, fid_t f,
+			std::string h = std::string()):
+		MetaRequest(META_GETLAYOUT, s, pv, false), fid(f),
+		clientHost(h) { }
         virtual void handle();
 	virtual int log(ofstream &file) const;
 	virtual void response(ostream &os);
@@ -1185,12 +1294,13 @@ struct MetaChunkServerRestart : public MetaChunkRequest {
  * about each of those servers.
  */
 struct MetaPing: public MetaRequest {
+	bool systemInfoOnly; //!< input: omit the chunk server lists
 	string systemInfo; //!< result that describes system info (space etc)
 	string servers; //!< result that contains info about chunk servers
 	string retiringServers; //!< info about servers that are being retired
 	string downServers; //!< info about servers that have gone down
-	MetaPing(seq_t s, int pv):
-		MetaRequest(META_PING, s, pv, false) { }
+	MetaPing(seq_t s, int pv, bool sio):
+		MetaRequest(META_PING, s, pv, false), systemInfoOnly(sio) { }
         virtual void handle();
 	virtual int log(ofstream &file) const;
 	virtual void response(ostream &os);
@@ -1242,9 +1352,10 @@ struct MetaToggleWORM: public MetaRequest {
  * counters it keeps.
  */
 struct MetaStats: public MetaRequest {
+	bool latencyFlag; //!< input: include the request latency histograms
 	string stats; //!< result
-	MetaStats(seq_t s, int pv):
-		MetaRequest(META_STATS, s, pv, false) { }
+	MetaStats(seq_t s, int pv, bool lf):
+		MetaRequest(META_STATS, s, pv, false), latencyFlag(lf) { }
         virtual void handle();
 	virtual int log(ofstream &file) const;
 	virtual void response(ostream &os);
@@ -1546,6 +1657,7 @@ extern void printleaves();
 
 extern void ChangeIncarnationNumber(MetaRequest *r);
 extern void RegisterCounters();
+extern void UpdateRequestLatency(const MetaRequest &r);
 extern void setClusterKey(const char *key);
 extern void setMD5SumFn(const char *md5sumFn);
 extern void setWORMMode(bool value);
@@ -26,6 +26,7 @@ extern "C" {
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 }
 
 #include <iostream>
@@ -227,3 +228,11 @@ float KFS::ComputeTimeDiff(const struct timeval &startTime,
 		(startTime.tv_sec * 1e6 + startTime.tv_usec);
 	return timeSpent / 1e6;
 }
+
+int64_t KFS::microseconds()
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (int64_t(tv.tv_sec) * 1000000 + tv.tv_usec);
+}
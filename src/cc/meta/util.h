@@ -62,6 +62,7 @@ extern string timeToStr(time_t val);
 extern bool IsMsgAvail(IOBuffer *iobuf, int *msgLen);
 
 extern float ComputeTimeDiff(const struct timeval &start, const struct timeval &end);
+extern int64_t microseconds();
 
 }
 #endif // !defined(KFS_UTIL_H)
@@ -66,6 +66,7 @@ public:
           mIoVecPerThreadCount(0),
           mFreeFdHead(kFreeFdEnd),
           mReqWaitersCount(0),
+          mForegroundRunCount(0),
           mRunFlag(false)
         {}
     virtual ~Queue()
@@ -91,7 +92,8 @@ public:
         InputIterator* inBufferIteratorPtr,
         int            inBufferCount,
         IoCompletion*  inIoCompletionPtr,
-        Time           inTimeWaitNanoSec);
+        Time           inTimeWaitNanoSec,
+        bool           inBackgroundFlag);
     bool Cancel(
         RequestId inRequestId);
     IoCompletion* CancelOrSetCompletionIfInFlight(
@@ -306,14 +308,19 @@ private:
     int             mIoVecPerThreadCount;
     int             mFreeFdHead;
     int             mReqWaitersCount;
+    int             mForegroundRunCount;
     bool            mRunFlag;
 
     enum
     {
-        kFreeQueueIdx = 0,
-        kIoQueueIdx   = 1,
+        kFreeQueueIdx         = 0,
+        kIoQueueIdx           = 1,
+        kBackgroundIoQueueIdx = 2,
         kRequestQueueCount
     };
+    // Max # of foreground requests dispatched in a row while background
+    // requests are waiting.
+    enum { kMaxForegroundRunCount = 8 };
     enum
     {
         kFreeFdOffset = 2,
@@ -454,9 +461,11 @@ private:
         }
     }
     void Enqueue(
-        Request& inReq)
+        Request& inReq,
+        bool     inBackgroundFlag)
     {
-        Insert(mRequestsPtr[kIoQueueIdx], inReq);
+        Insert(mRequestsPtr[
+            inBackgroundFlag ? kBackgroundIoQueueIdx : kIoQueueIdx], inReq);
         mPendingCount++;
         mFilePendingReqCountPtr[inReq.mFileIdx]++;
         if (inReq.mReqType == kReqTypeRead) {
@@ -469,7 +478,22 @@ private:
     }
     Request* Dequeue()
     {
-        Request* const theReqPtr = PopFront(kIoQueueIdx);
+        // Foreground requests first. The background requests are
+        // dispatched when the foreground queue is empty, or after
+        // kMaxForegroundRunCount foreground requests, so that they do not
+        // starve.
+        const bool theBackgroundWaitingFlag = Front(kBackgroundIoQueueIdx) != 0;
+        RequestIdx theQueueIdx              = kIoQueueIdx;
+        if (! theBackgroundWaitingFlag) {
+            mForegroundRunCount = 0;
+        } else if (! Front(kIoQueueIdx) ||
+                mForegroundRunCount >= kMaxForegroundRunCount) {
+            theQueueIdx         = kBackgroundIoQueueIdx;
+            mForegroundRunCount = 0;
+        } else {
+            mForegroundRunCount++;
+        }
+        Request* const theReqPtr = PopFront(theQueueIdx);
         if (! theReqPtr) {
             return 0;
         }
@@ -477,7 +501,7 @@ private:
         // buffer count larger than request max buffers per request.
         int theBufCount = theReqPtr->mBufferCount;
         while ((theBufCount -= mRequestBufferCount) > 0) {
-            Request* const thePtr = PopFront(kIoQueueIdx);
+            Request* const thePtr = PopFront(theQueueIdx);
             QCASSERT(thePtr);
             Insert(*theReqPtr, *thePtr);
         }
@@ -694,7 +718,7 @@ QCDiskQueue::Queue::Start(
     mRequestBufferCount = inMaxBuffersPerRequestCount;
     const int theReqCnt = kRequestQueueCount + inMaxQueueDepth;
     mRequestsPtr = new Request[theReqCnt];
-    // Init list heads: kFreeQueueIdx kIoQueueIdx.
+    // Init list heads: kFreeQueueIdx kIoQueueIdx kBackgroundIoQueueIdx.
     for (mTotalCount = 0; mTotalCount < kRequestQueueCount; mTotalCount++) {
         Init(mRequestsPtr[mTotalCount]);
     }
@@ -727,7 +751,8 @@ QCDiskQueue::Queue::Enqueue(
     QCDiskQueue::InputIterator* inBufferIteratorPtr,
     int                         inBufferCount,
     QCDiskQueue::IoCompletion*  inIoCompletionPtr,
-    QCDiskQueue::Time           inTimeWaitNanoSec)
+    QCDiskQueue::Time           inTimeWaitNanoSec,
+    bool                        inBackgroundFlag)
 {
     if ((inReqType != kReqTypeRead && inReqType != kReqTypeWrite) ||
             inBufferCount <= 0 ||
@@ -796,7 +821,7 @@ QCDiskQueue::Queue::Enqueue(
         Put(theReq);
         return EnqueueStatus(kRequestIdNone, kErrorBlockCountOutOfRange);
     }
-    Enqueue(theReq);
+    Enqueue(theReq, inBackgroundFlag);
     mWorkCond.Notify();
     return GetRequestId(theReq);
 }
@@ -1283,7 +1308,8 @@ QCDiskQueue::Enqueue(
     QCDiskQueue::InputIterator* inBufferIteratorPtr,
     int                         inBufferCount,
     QCDiskQueue::IoCompletion*  inIoCompletionPtr,
-    QCDiskQueue::Time           inTimeWaitNanoSec)
+    QCDiskQueue::Time           inTimeWaitNanoSec,
+    bool                        inBackgroundFlag)
 {
     if (! mQueuePtr) {
         return EnqueueStatus(kRequestIdNone, kErrorParameter);
@@ -1295,7 +1321,8 @@ QCDiskQueue::Enqueue(
         inBufferIteratorPtr,
         inBufferCount,
         inIoCompletionPtr,
-        inTimeWaitNanoSec);
+        inTimeWaitNanoSec,
+        inBackgroundFlag);
 }
 
     bool
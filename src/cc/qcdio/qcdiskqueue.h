@@ -187,14 +187,16 @@ public:
         InputIterator* inBufferIteratorPtr,
         int            inBufferCount,
         IoCompletion*  inIoCompletionPtr,
-        Time           inTimeWaitNanoSec = -1);
+        Time           inTimeWaitNanoSec = -1,
+        bool           inBackgroundFlag  = false);
     EnqueueStatus Read(
         FileIdx        inFileIdx,
         BlockIdx       inStartBlockIdx,
         InputIterator* inBufferIteratorPtr,
         int            inBufferCount,
         IoCompletion*  inIoCompletionPtr,
-        Time           inTimeWaitNanoSec = -1)
+        Time           inTimeWaitNanoSec = -1,
+        bool           inBackgroundFlag  = false)
     {
         return Enqueue(
             kReqTypeRead,
@@ -203,7 +205,8 @@ public:
             inBufferIteratorPtr,
             inBufferCount,
             inIoCompletionPtr,
-            inTimeWaitNanoSec);
+            inTimeWaitNanoSec,
+            inBackgroundFlag);
     }
     EnqueueStatus Write(
         FileIdx        inFileIdx,
@@ -211,7 +214,8 @@ public:
         InputIterator* inBufferIteratorPtr,
         int            inBufferCount,
         IoCompletion*  inIoCompletionPtr,
-        Time           inTimeWaitNanoSec = -1)
+        Time           inTimeWaitNanoSec = -1,
+        bool           inBackgroundFlag  = false)
     {
         return Enqueue(
             kReqTypeWrite,
@@ -220,7 +224,8 @@ public:
             inBufferIteratorPtr,
             inBufferCount,
             inIoCompletionPtr,
-            inTimeWaitNanoSec);
+            inTimeWaitNanoSec,
+            inBackgroundFlag);
     }
     CompletionStatus SyncIo(
         ReqType         inReqType,
@@ -20,6 +20,8 @@
 // permissions and limitations under the License.
 //
 // \brief Test that evaluates readdirplus() followed by calls to get attributes.
+// With -n, the directory is listed with the paged directory iterator
+// instead, with the specified page size.
 //----------------------------------------------------------------------------
 
 #include <iostream>    
@@ -40,6 +42,7 @@ using namespace KFS;
 KfsClientPtr gKfsClient;
 
 void dirListPlusAttr(const string &kfspathname);
+void dirListPaged(const string &kfspathname, int pageSize);
 
 int
 main(int argc, char **argv)
@@ -49,10 +52,11 @@ main(int argc, char **argv)
     int port = -1;
     string kfspathname = "";
     bool help = false;
+    int pageSize = 0;
 
     KFS::MsgLogger::Init(NULL);
 
-    while ((optchar = getopt(argc, argv, "m:p:d:")) != -1) {
+    while ((optchar = getopt(argc, argv, "m:p:d:n:")) != -1) {
         switch (optchar) {
             case 'm':
                 metaserver = optarg;
@@ -63,6 +67,9 @@ main(int argc, char **argv)
             case 'd':
                 kfspathname = optarg;
                 break;
+            case 'n':
+                pageSize = atoi(optarg);
+                break;
             default:
                 cout << "Unrecognized flag: " << optchar << endl;
                 help = true;
@@ -71,7 +78,8 @@ main(int argc, char **argv)
     }
     
     if (help || !metaserver || (port < 0)) {
-        cout << "Usage: " << argv[0] << " -m <metaserver host> -p <port> -d <path>" << endl;
+        cout << "Usage: " << argv[0] << " -m <metaserver host> -p <port> -d <path>"
+            " [-n <page size>]" << endl;
         exit(-1);
     }
 
@@ -80,10 +88,37 @@ main(int argc, char **argv)
         cout << "KFS client failed to initialize...exiting" << endl;
         exit(-1);
     }
-    dirListPlusAttr(kfspathname);
+    if (pageSize > 0) {
+        dirListPaged(kfspathname, pageSize);
+    } else {
+        dirListPlusAttr(kfspathname);
+    }
     exit(0);
 }
 
+void dirListPaged(const string &kfspathname, int pageSize)
+{
+    KfsDirIterator it(*gKfsClient, kfspathname, pageSize);
+    KfsFileAttr attr;
+    uint64_t numEntries = 0;
+    uint64_t dirsz = 0;
+    int res;
+
+    while ((res = it.Next(attr)) > 0) {
+        numEntries++;
+        if (!attr.isDirectory && attr.fileSize > 0)
+            dirsz += attr.fileSize;
+    }
+    if (res < 0) {
+        cout << "unable to list " << kfspathname << ": " << res << endl;
+        exit(-1);
+    }
+    KFS_LOG_VA_INFO("Done paged listing of %s (%lu entries)",
+        kfspathname.c_str(), (unsigned long)numEntries);
+    KFS_LOG_VA_INFO("Dirsize on %s: %lu", kfspathname.c_str(),
+        (unsigned long)dirsz);
+}
+
 void dirListPlusAttr(const string &kfspathname)
 {
     if (gKfsClient->IsFile(kfspathname.c_str())) {
@@ -0,0 +1,237 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2010/11/15
+//
+// Copyright 2010 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief IOBuffer micro benchmark: append (copy in), move, split (partial
+// move, copy, clone, replace), and readv / writev through a pipe.
+// Each test verifies the data it moves around, and reports the time per
+// iteration.
+//
+//----------------------------------------------------------------------------
+
+#include <iostream>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/time.h>
+
+#include "libkfsIO/IOBuffer.h"
+#include "common/log.h"
+
+using std::cout;
+using std::endl;
+
+using namespace KFS;
+
+static int64_t
+Now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return (int64_t(tv.tv_sec) * 1000 * 1000 + tv.tv_usec);
+}
+
+static void
+Report(const char* name, int64_t start, int iterations, int64_t bytes)
+{
+    const int64_t usec = std::max(int64_t(1), Now() - start);
+    cout << name <<
+        " iterations: " << iterations <<
+        " ns/iteration: " << usec * 1000 / std::max(1, iterations) <<
+        " MB/sec: " << (bytes / double(usec)) <<
+    endl;
+}
+
+static void
+Check(bool flag, const char* msg)
+{
+    if (! flag) {
+        cout << "error: " << msg << endl;
+        exit(1);
+    }
+}
+
+// Small messages copied in, and consumed: rpc header and response path.
+static void
+TestAppend(int iterations, int msgSize, const char* data)
+{
+    IOBuffer     buf;
+    const int    nMsgs = 64;
+    int64_t      bytes = 0;
+    char         out[4 << 10];
+    const int64_t start = Now();
+    for (int i = 0; i < iterations; i++) {
+        for (int k = 0; k < nMsgs; k++) {
+            buf.CopyIn(data + k, msgSize);
+        }
+        for (int k = 0; k < nMsgs; k++) {
+            Check(buf.CopyOut(out, msgSize) == msgSize &&
+                memcmp(out, data + k, msgSize) == 0, "append: copy out");
+            buf.Consume(msgSize);
+        }
+        bytes += nMsgs * msgSize;
+    }
+    Check(buf.IsEmpty(), "append: not empty");
+    Report("append ", start, iterations, bytes);
+}
+
+// Buffer boundary moves: client / chunk server write forwarding path.
+static void
+TestMove(int iterations, int size, const char* data)
+{
+    IOBuffer src;
+    IOBuffer dst;
+    src.CopyIn(data, size);
+    const int step  = 64 << 10;
+    int64_t   bytes = 0;
+    const int64_t start = Now();
+    for (int i = 0; i < iterations; i++) {
+        while (! src.IsEmpty()) {
+            dst.Move(&src, step);
+        }
+        src.Move(&dst);
+        bytes += size;
+    }
+    Check(src.BytesConsumable() == size && dst.IsEmpty(), "move: size");
+    Report("move   ", start, iterations, bytes);
+}
+
+// Partial moves, copies, and replace at non buffer boundaries: record
+// append and checksum block alignment paths.
+static void
+TestSplit(int iterations, int size, const char* data)
+{
+    IOBuffer src;
+    src.CopyIn(data, size);
+    const int step = 1000;
+    int64_t bytes = 0;
+    char    out[1 << 10];
+    const int64_t start = Now();
+    for (int i = 0; i < iterations; i++) {
+        IOBuffer dst;
+        IOBuffer cpy;
+        IOBuffer piece;
+        while (! src.IsEmpty()) {
+            const int off = size - src.BytesConsumable();
+            const int nb  = piece.Move(&src, step);
+            cpy.Copy(&piece, nb);
+            Check(cpy.CopyOut(out, nb) == nb &&
+                memcmp(out, data + off, nb) == 0, "split: data");
+            cpy.Clear();
+            dst.Move(&piece);
+        }
+        IOBuffer* const clone = dst.Clone();
+        IOBuffer  rep;
+        rep.Move(clone, size / 2);
+        dst.Replace(&rep, size / 4, size / 2);
+        delete clone;
+        Check(dst.BytesConsumable() == size, "split: replace size");
+        cpy.Copy(&dst, size / 4 + (int)sizeof(out));
+        cpy.Consume(size / 4);
+        Check(cpy.CopyOut(out, sizeof(out)) == (int)sizeof(out) &&
+            memcmp(out, data, sizeof(out)) == 0, "split: replace data");
+        // Restore the original content.
+        src.CopyIn(data, size);
+        bytes += size;
+    }
+    Report("split  ", start, iterations, bytes);
+}
+
+// Network read / write path.
+static void
+TestReadWrite(int iterations, int size, const char* data)
+{
+    int fds[2];
+    Check(pipe(fds) == 0, "pipe");
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    IOBuffer wr;
+    IOBuffer rd;
+    const int chunk = std::min(size, 32 << 10);
+    int64_t   bytes = 0;
+    char      out[1 << 10];
+    const int64_t start = Now();
+    for (int i = 0; i < iterations; i++) {
+        wr.CopyIn(data, chunk);
+        while (! wr.IsEmpty()) {
+            const int nw = wr.Write(fds[1]);
+            Check(nw > 0, "write");
+            while (rd.BytesConsumable() < chunk - wr.BytesConsumable()) {
+                Check(rd.Read(fds[0]) > 0, "read");
+            }
+        }
+        const int nb = std::min(int(sizeof(out)), chunk);
+        Check(rd.CopyOut(out, nb) == nb && memcmp(out, data, nb) == 0,
+            "read: data");
+        rd.Consume(chunk);
+        bytes += chunk;
+    }
+    close(fds[0]);
+    close(fds[1]);
+    Report("readv  ", start, iterations, bytes);
+}
+
+int
+main(int argc, char **argv)
+{
+    int  iterations = 20000;
+    int  size       = 1 << 20;
+    int  msgSize    = 100;
+    bool help       = false;
+    char optchar;
+
+    while ((optchar = getopt(argc, argv, "n:s:m:h")) != -1) {
+        switch (optchar) {
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            case 's':
+                size = atoi(optarg);
+                break;
+            case 'm':
+                msgSize = atoi(optarg);
+                break;
+            default:
+                help = true;
+                break;
+        }
+    }
+    if (help || iterations <= 0 || size <= 4 || msgSize <= 0 ||
+            msgSize > (4 << 10)) {
+        cout << "Usage: " << argv[0] <<
+            " [-n <iterations>] [-s <buffer size>] [-m <message size>]" <<
+        endl;
+        return 1;
+    }
+    MsgLogger::Init(0);
+
+    char* const data = new char[size + 64];
+    srand(1);
+    for (int i = 0; i < size + 64; i++) {
+        data[i] = (char)rand();
+    }
+    TestAppend(iterations * 16, msgSize, data);
+    TestMove(iterations, size, data);
+    TestSplit(std::max(1, iterations / 10), size, data);
+    TestReadWrite(iterations, size, data);
+    delete [] data;
+    return 0;
+}
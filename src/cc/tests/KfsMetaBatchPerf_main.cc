@@ -0,0 +1,204 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2010/11/24
+//
+// Copyright 2010 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Compare per call Create / Stat / Remove with the batched
+// MultiCreate / MultiStat / MultiRemove meta server rpcs.
+//----------------------------------------------------------------------------
+
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include "libkfsClient/KfsClient.h"
+#include "common/log.h"
+
+using std::cout;
+using std::endl;
+using std::vector;
+using std::string;
+using std::ostringstream;
+using namespace KFS;
+
+static double
+Now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return (tv.tv_sec + tv.tv_usec * 1e-6);
+}
+
+static void
+Report(const char *name, size_t count, double start)
+{
+    const double t = Now() - start;
+    printf("%-14s %8d ops %8.3f sec %10.1f ops/sec\n",
+        name, (int)count, t, t > 0 ? count / t : 0.);
+}
+
+static int
+CountErrors(const vector<int> &result)
+{
+    int errors = 0;
+    for (size_t i = 0; i < result.size(); i++) {
+        if (result[i] != 0) {
+            errors++;
+        }
+    }
+    return errors;
+}
+
+int
+main(int argc, char **argv)
+{
+    int         optchar;
+    const char *metaserver = NULL;
+    int         port = -1;
+    string      dir = "/metabatchperf";
+    int         count = 10000;
+    int         numReplicas = 1;
+    int         filesPerDir = 100;
+    bool        help = false;
+
+    KFS::MsgLogger::Init(NULL);
+    KFS::MsgLogger::SetLevel(KFS::MsgLogger::kLogLevelINFO);
+
+    while ((optchar = getopt(argc, argv, "m:p:d:n:r:f:")) != -1) {
+        switch (optchar) {
+            case 'm':
+                metaserver = optarg;
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'd':
+                dir = optarg;
+                break;
+            case 'n':
+                count = atoi(optarg);
+                break;
+            case 'r':
+                numReplicas = atoi(optarg);
+                break;
+            case 'f':
+                filesPerDir = atoi(optarg);
+                break;
+            default:
+                help = true;
+                break;
+        }
+    }
+
+    if (help || ! metaserver || port < 0 || count <= 0 || filesPerDir <= 0) {
+        cout << "Usage: " << argv[0] << " -m <metaserver host> -p <port>"
+            " [-d <test dir>] [-n <# of files>] [-r <replication>]"
+            " [-f <files per sub directory>]" << endl;
+        exit(-1);
+    }
+
+    KfsClientPtr client = getKfsClientFactory()->GetClient(metaserver, port);
+    if (! client) {
+        cout << "KFS client failed to initialize...exiting" << endl;
+        exit(-1);
+    }
+    // Spread the files over sub directories: the meta server directory
+    // lookup cost grows with the directory size.
+    vector<string> paths;
+    for (int i = 0; i < count; i++) {
+        ostringstream os;
+        os << dir << "/d" << i / filesPerDir;
+        if (i % filesPerDir == 0 && client->Mkdirs(os.str().c_str()) < 0) {
+            cout << "unable to create " << os.str() << endl;
+            exit(-1);
+        }
+        os << "/f" << i;
+        paths.push_back(os.str());
+    }
+
+    int    errors = 0;
+    double start  = Now();
+    for (size_t i = 0; i < paths.size(); i++) {
+        const int fd = client->Create(paths[i].c_str(), numReplicas);
+        if (fd < 0) {
+            errors++;
+        } else {
+            client->Close(fd);
+        }
+    }
+    Report("create", paths.size(), start);
+
+    // Use a new client, to stat with cold attribute cache.
+    KfsClientPtr statClient(new KfsClient());
+    if (statClient->Init(metaserver, port) != 0) {
+        cout << "KFS client failed to initialize...exiting" << endl;
+        exit(-1);
+    }
+    struct stat st;
+    start = Now();
+    for (size_t i = 0; i < paths.size(); i++) {
+        if (statClient->Stat(paths[i].c_str(), st, false) != 0) {
+            errors++;
+        }
+    }
+    Report("stat", paths.size(), start);
+
+    start = Now();
+    for (size_t i = 0; i < paths.size(); i++) {
+        if (client->Remove(paths[i].c_str()) != 0) {
+            errors++;
+        }
+    }
+    Report("remove", paths.size(), start);
+
+    vector<int>         result;
+    vector<KfsFileAttr> attrs;
+    start = Now();
+    if (client->MultiCreate(paths, result, numReplicas) != 0) {
+        errors += paths.size();
+    } else {
+        errors += CountErrors(result);
+    }
+    Report("multi-create", paths.size(), start);
+
+    start = Now();
+    if (client->MultiStat(paths, attrs, result) != 0) {
+        errors += paths.size();
+    } else {
+        errors += CountErrors(result);
+    }
+    Report("multi-stat", paths.size(), start);
+
+    start = Now();
+    if (client->MultiRemove(paths, result) != 0) {
+        errors += paths.size();
+    } else {
+        errors += CountErrors(result);
+    }
+    Report("multi-remove", paths.size(), start);
+
+    client->Rmdirs(dir.c_str());
+    if (errors > 0) {
+        cout << "errors: " << errors << endl;
+        exit(1);
+    }
+    exit(0);
+}
@@ -0,0 +1,224 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2010/12/06
+//
+// Copyright 2010 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Positioned reads of short chunks: the data past the end of a
+// chunk, but not past the end of file, must read as zeros.
+// Writing at the start of the next chunk leaves the previous chunk short.
+//----------------------------------------------------------------------------
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include "libkfsClient/KfsClient.h"
+#include "common/kfstypes.h"
+#include "common/log.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+using namespace KFS;
+
+const int kDataSize = 8192;
+
+static int gErrors = 0;
+
+static void
+FillData(char *buf, int len, int seed)
+{
+    for (int i = 0; i < len; i++) {
+        buf[i] = (char) ('a' + (i + seed) % 26);
+    }
+}
+
+/// Read [offset, offset + len) with PReadV into two buffers, and compare
+/// against the expected file content: data in the written ranges, zeros
+/// elsewhere.
+static void
+CheckPRead(KfsClientPtr &client, int fd, off_t offset, size_t len,
+           off_t fileSize, const vector<off_t> &dataOffsets)
+{
+    vector<char> buf(len + 1, (char) 0xFF);
+    const ssize_t expected = offset >= fileSize ? 0 :
+        (ssize_t) std::min((off_t) len, fileSize - offset);
+    struct iovec iov[2];
+    iov[0].iov_base = &buf[0];
+    iov[0].iov_len  = len / 2;
+    iov[1].iov_base = &buf[len / 2];
+    iov[1].iov_len  = len - len / 2;
+    const ssize_t res = client->PReadV(fd, offset, iov, 2);
+    if (res != expected) {
+        cout << "pread offset: " << offset << " len: " << len <<
+            " returned: " << res << " expected: " << expected << endl;
+        gErrors++;
+        return;
+    }
+    for (ssize_t i = 0; i < res; i++) {
+        const off_t pos = offset + i;
+        char        exp = 0;
+        for (size_t k = 0; k < dataOffsets.size(); k++) {
+            if (dataOffsets[k] <= pos && pos < dataOffsets[k] + kDataSize) {
+                const int off = (int) (pos - dataOffsets[k]);
+                exp = (char) ('a' + (off + (int) k) % 26);
+                break;
+            }
+        }
+        if (buf[i] != exp) {
+            cout << "pread offset: " << offset << " len: " << len <<
+                " mismatch at: " << pos << endl;
+            gErrors++;
+            return;
+        }
+    }
+    if (buf[len] != (char) 0xFF) {
+        cout << "pread offset: " << offset << " len: " << len <<
+            " wrote past the buffer end" << endl;
+        gErrors++;
+    }
+}
+
+/// Write the data at the given offsets, and run the positioned reads with
+/// a new client, so that the chunk sizes come from the chunk servers.
+static void
+TestFile(KfsClientPtr &client, const char *metaserver, int port,
+         const string &path, const vector<off_t> &dataOffsets,
+         const vector<off_t> &readOffsets, size_t readLen)
+{
+    int fd = client->Create(path.c_str(), 1);
+    if (fd < 0) {
+        cout << "unable to create " << path << ": " << fd << endl;
+        exit(-1);
+    }
+    char buf[kDataSize];
+    for (size_t k = 0; k < dataOffsets.size(); k++) {
+        FillData(buf, kDataSize, (int) k);
+        if (client->Seek(fd, dataOffsets[k], SEEK_SET) != dataOffsets[k] ||
+                client->Write(fd, buf, kDataSize) != kDataSize) {
+            cout << "write failed " << path << endl;
+            exit(-1);
+        }
+    }
+    client->Close(fd);
+    const off_t fileSize = dataOffsets.back() + kDataSize;
+
+    KfsClientPtr reader(new KfsClient());
+    if (reader->Init(metaserver, port) != 0) {
+        cout << "KFS client failed to initialize...exiting" << endl;
+        exit(-1);
+    }
+    if ((fd = reader->Open(path.c_str(), O_RDONLY)) < 0) {
+        cout << "unable to open " << path << ": " << fd << endl;
+        exit(-1);
+    }
+    for (size_t i = 0; i < readOffsets.size(); i++) {
+        CheckPRead(reader, fd, readOffsets[i], readLen, fileSize, dataOffsets);
+    }
+    reader->Close(fd);
+    client->Remove(path.c_str());
+}
+
+int
+main(int argc, char **argv)
+{
+    int         optchar;
+    const char *metaserver = NULL;
+    int         port = -1;
+    string      dir = "/preadtest";
+    bool        help = false;
+
+    KFS::MsgLogger::Init(NULL);
+    KFS::MsgLogger::SetLevel(KFS::MsgLogger::kLogLevelINFO);
+
+    while ((optchar = getopt(argc, argv, "m:p:d:")) != -1) {
+        switch (optchar) {
+            case 'm':
+                metaserver = optarg;
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'd':
+                dir = optarg;
+                break;
+            default:
+                help = true;
+                break;
+        }
+    }
+
+    if (help || ! metaserver || port < 0) {
+        cout << "Usage: " << argv[0] << " -m <metaserver host> -p <port>"
+            " [-d <test dir>]" << endl;
+        exit(-1);
+    }
+
+    KfsClientPtr client = getKfsClientFactory()->GetClient(metaserver, port);
+    if (! client) {
+        cout << "KFS client failed to initialize...exiting" << endl;
+        exit(-1);
+    }
+    if (client->Mkdirs(dir.c_str()) < 0) {
+        cout << "unable to create " << dir << endl;
+        exit(-1);
+    }
+
+    const off_t   chunkSize = (off_t) KFS::CHUNKSIZE;
+    vector<off_t> dataOffsets;
+    vector<off_t> readOffsets;
+
+    // Short chunk followed by another chunk.
+    dataOffsets.push_back(0);
+    dataOffsets.push_back(chunkSize);
+    readOffsets.push_back(kDataSize + 100);     // past the chunk end
+    readOffsets.push_back(kDataSize);           // at the chunk end
+    readOffsets.push_back(kDataSize - 2048);    // straddles the chunk end
+    readOffsets.push_back(chunkSize - 2048);    // zeros, then the next chunk
+    readOffsets.push_back(chunkSize + 6144);    // straddles the end of file
+    readOffsets.push_back(chunkSize + kDataSize); // at the end of file
+    TestFile(client, metaserver, port, dir + "/shortchunk",
+        dataOffsets, readOffsets, 4096);
+
+    // Three short chunks, the reads span chunks.
+    dataOffsets.clear();
+    dataOffsets.push_back(0);
+    dataOffsets.push_back(chunkSize);
+    dataOffsets.push_back(2 * chunkSize);
+    readOffsets.clear();
+    readOffsets.push_back(chunkSize / 2);
+    readOffsets.push_back(chunkSize - 2 * kDataSize);
+    readOffsets.push_back(chunkSize + kDataSize / 2);
+    readOffsets.push_back(2 * chunkSize - kDataSize);
+    TestFile(client, metaserver, port, dir + "/shortchunks",
+        dataOffsets, readOffsets, 4 * kDataSize);
+
+    client->Rmdirs(dir.c_str());
+    if (gErrors > 0) {
+        cout << "errors: " << gErrors << endl;
+        exit(1);
+    }
+    cout << "Test passed" << endl;
+    exit(0);
+}
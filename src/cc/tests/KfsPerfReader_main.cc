@@ -43,7 +43,8 @@ using namespace KFS;
 KfsClientPtr gKfsClient;
 
 static off_t doRead(const string &kfspathname,
-    int numMBytes, int readSizeBytes, int cliBufSize, int readAhead, double sleepSec);
+    int numMBytes, int readSizeBytes, int cliBufSize, int readAhead,
+    int adaptiveReadAhead, double sleepSec);
 
 int
 main(int argc, char **argv)
@@ -56,9 +57,10 @@ main(int argc, char **argv)
     const char* logLevel = "INFO";
     int cliBufSize = -1;
     int readAhead = -1;
+    int adaptiveReadAhead = -1;
     double sleepSec = -1;
 
-    while ((optchar = getopt(argc, argv, "f:p:m:b:s:a:S:d")) != -1) {
+    while ((optchar = getopt(argc, argv, "f:p:m:b:s:a:A:S:d")) != -1) {
         switch (optchar) {
             case 'f':
                 kfspathname = optarg;
@@ -84,6 +86,9 @@ main(int argc, char **argv)
             case 'a':
                 readAhead = atoi(optarg);
                 break;
+            case 'A':
+                adaptiveReadAhead = atoi(optarg);
+                break;
             default:
                 cout << "Unrecognized flag: " << optchar << endl;
                 help = true;
@@ -95,6 +100,7 @@ main(int argc, char **argv)
         cout << "Usage: " << argv[0] << " -p <Kfs Client properties file>"
              " -m <# of MB to read> -b <read size in bytes> -f <Kfs file>"
              " -S <sleep sec. between reads> -d -s <kfs buffer size>"
+             " -a <read ahead size> -A <adaptive read ahead max size>"
         << endl;
         exit(0);
     }
@@ -126,7 +132,8 @@ main(int argc, char **argv)
 
     gettimeofday(&startTime, NULL);
 
-    bytesRead = doRead(kfspathname, numMBytes, readSizeBytes, cliBufSize, readAhead, sleepSec);
+    bytesRead = doRead(kfspathname, numMBytes, readSizeBytes, cliBufSize,
+        readAhead, adaptiveReadAhead, sleepSec);
 
     gettimeofday(&endTime, NULL);
 
@@ -136,12 +143,35 @@ main(int argc, char **argv)
     cout << "Read rate: " << (((double) bytesRead * 8.0) / timeTaken) / (1024.0 * 1024.0) << " (Mbps)" << endl;
     cout << "Read rate: " << ((double) (bytesRead) / timeTaken) / (1024.0 * 1024.0) << " (MBps)" << endl;
 
+    KfsClient::ChunkLocationCacheStats cacheStats;
+    gKfsClient->GetChunkLocationCacheStats(cacheStats);
+    cout << "Chunk location cache: hits: " << cacheStats.hits <<
+        " misses: " << cacheStats.misses <<
+        " prefetched: " << cacheStats.prefetched <<
+        " invalidated: " << cacheStats.invalidated << endl;
+
+    KfsClient::ReadAheadStats raStats;
+    gKfsClient->GetReadAheadStats(raStats);
+    cout << "Read ahead: useful bytes: " << raStats.usefulBytes <<
+        " wasted bytes: " << raStats.wastedBytes <<
+        " sequential reads: " << raStats.sequentialReads <<
+        " random reads: " << raStats.randomReads << endl;
+
+    KfsClient::ChunkServerConnStats connStats;
+    gKfsClient->GetChunkServerConnStats(connStats);
+    cout << "Chunk server connections: created: " << connStats.created <<
+        " reused: " << connStats.reused <<
+        " pooled: " << connStats.pooled <<
+        " closed: " << connStats.closed <<
+        " idle: " << connStats.idle << endl;
+
     return 0;
 }
 
 off_t
 doRead(const string &filename, int numMBytes,
-    int readSizeBytes, int cliBufSize, int readAhead, double sleepSec)
+    int readSizeBytes, int cliBufSize, int readAhead, int adaptiveReadAhead,
+    double sleepSec)
 {
     const int mByte = 1024 * 1024;
     boost::scoped_array<char> dataBuf;
@@ -165,6 +195,12 @@ doRead(const string &filename, int numMBytes,
         cout << "Setting kfs read ahead size to: "
             << readAhead << " got: " << size << endl;
     }
+    if (adaptiveReadAhead >= 0) {
+        const size_t size = gKfsClient->SetAdaptiveReadAheadSize(fd,
+            adaptiveReadAhead);
+        cout << "Setting kfs adaptive read ahead max size to: "
+            << adaptiveReadAhead << " got: " << size << endl;
+    }
     struct timespec sleepTm;
     const bool doSleep = sleepSec > 0;
     if (doSleep) {
@@ -30,6 +30,8 @@
 #include <stdlib.h>
 #include <fstream>
 #include <time.h>
+#include <vector>
+#include <algorithm>
 #include "libkfsClient/KfsClient.h"
 #include "common/log.h"
 
@@ -37,13 +39,14 @@ using std::cout;
 using std::endl;
 using std::ifstream;
 using std::string;
+using std::vector;
 
 using namespace KFS;
 
 int numReplicas = 3;
 KfsClientPtr gKfsClient;
 static bool doMkdirs(const char *dirname);
-static off_t doWrite(const string &kfspathname, int numMBytes, size_t writeSizeBytes, double sleepSec, int cliBufSize);
+static off_t doWrite(const string &kfspathname, int numMBytes, size_t writeSizeBytes, double sleepSec, int cliBufSize, int writeBehind, bool syncFlag);
 
 int
 main(int argc, char **argv)
@@ -57,8 +60,10 @@ main(int argc, char **argv)
     double sleepSec = -1;
     const char* logLevel = "INFO";
     int cliBufSize = -1;
+    int writeBehind = -1;
+    bool syncFlag = false;
 
-    while ((optchar = getopt(argc, argv, "f:p:m:b:r:S:l:s:")) != -1) {
+    while ((optchar = getopt(argc, argv, "f:p:m:b:r:S:l:s:w:L")) != -1) {
         switch (optchar) {
             case 'f':
                 kfspathname = optarg;
@@ -84,6 +89,12 @@ main(int argc, char **argv)
             case 's':
                 cliBufSize = atoi(optarg);
                 break;
+            case 'w':
+                writeBehind = atoi(optarg);
+                break;
+            case 'L':
+                syncFlag = true;
+                break;
             default:
                 cout << "Unrecognized flag: " << optchar << endl;
                 help = true;
@@ -95,6 +106,8 @@ main(int argc, char **argv)
         cout << "Usage: " << argv[0] << " -p <Kfs Client properties file> "
              << " -m <# of MB to write> -b <write size in bytes> -f <Kfs file> "
              << " -S <sleep between writes>"
+             << " -w <# of writes in flight>"
+             << " -L sync after each write, and report the write latency"
              << endl;
         exit(0);
     }
@@ -127,7 +140,7 @@ main(int argc, char **argv)
 
     gettimeofday(&startTime, NULL);
 
-    bytesWritten = doWrite(kfspathname, numMBytes, writeSizeBytes, sleepSec, cliBufSize);
+    bytesWritten = doWrite(kfspathname, numMBytes, writeSizeBytes, sleepSec, cliBufSize, writeBehind, syncFlag);
 
     gettimeofday(&endTime, NULL);
 
@@ -156,7 +169,7 @@ doMkdirs(const char *dirname)
 }
 
 off_t
-doWrite(const string &filename, int numMBytes, size_t writeSizeBytes, double sleepSec, int cliBufSize)
+doWrite(const string &filename, int numMBytes, size_t writeSizeBytes, double sleepSec, int cliBufSize, int writeBehind, bool syncFlag)
 {
     const size_t mByte = 1024 * 1024;
     char dataBuf[mByte];
@@ -184,6 +197,11 @@ doWrite(const string &filename, int numMBytes, size_t writeSizeBytes, double sle
         cout << "Setting kfs buffer size to: "
             << cliBufSize << " got: " << size << endl;
     }
+    if (writeBehind >= 0) {
+        const int wb = gKfsClient->SetWriteBehind(fd, writeBehind);
+        cout << "Setting write behind to: "
+            << writeBehind << " got: " << wb << endl;
+    }
     struct timespec sleepTm;
     const bool doSleep = sleepSec > 0;
     if (doSleep) {
@@ -194,14 +212,27 @@ doWrite(const string &filename, int numMBytes, size_t writeSizeBytes, double sle
     struct timeval s1, s2, startTime;
     double timediff;
     double relStartTime = 0.0;
+    vector<double> latencies;
     gettimeofday(&startTime, NULL);
     for (nMBytes = 0; nMBytes < numMBytes; nMBytes++) {
         for (bytesWritten = 0; bytesWritten < mByte; bytesWritten += writeSizeBytes) {
             gettimeofday(&s1, NULL);
             res = gKfsClient->Write(fd, dataBuf, writeSizeBytes);
+            if (syncFlag && res == (int) writeSizeBytes) {
+                // The write returns once the data is buffered; the sync
+                // returns once all the replicas have it.
+                const int ret = gKfsClient->Sync(fd);
+                if (ret < 0) {
+                    cout << "Sync failed: " << ret << endl;
+                    res = ret;
+                }
+            }
             gettimeofday(&s2, NULL);
             timediff = (s2.tv_sec * 1000000.0 + s2.tv_usec) - (s1.tv_sec * 1000000.0 + s1.tv_usec);
             timediff /= 1000000.0;
+            if (syncFlag) {
+                latencies.push_back(timediff);
+            }
             if (timediff > 0.001) {
                 relStartTime = (s1.tv_sec * 1000000.0 + s1.tv_usec) - 
                     (startTime.tv_sec * 1000000.0 + startTime.tv_usec);
@@ -216,8 +247,26 @@ doWrite(const string &filename, int numMBytes, size_t writeSizeBytes, double sle
             nanosleep(&sleepTm, 0);
         }
     }
+    if (! latencies.empty()) {
+        sort(latencies.begin(), latencies.end());
+        double total = 0;
+        for (size_t i = 0; i < latencies.size(); i++) {
+            total += latencies[i];
+        }
+        const size_t cnt = latencies.size();
+        cout << "Write latency (ms): writes: " << cnt <<
+            " min: " << latencies.front() * 1e3 <<
+            " avg: " << total / cnt * 1e3 <<
+            " median: " << latencies[cnt / 2] * 1e3 <<
+            " 99%: " << latencies[std::min(cnt - 1, cnt * 99 / 100)] * 1e3 <<
+            " max: " << latencies.back() * 1e3 << endl;
+    }
     //    cout << "write of " << nwrote / (1024 * 1024) << " (MB) is done" << endl;
-    gKfsClient->Close(fd);
+    res = gKfsClient->Close(fd);
+    if (res < 0) {
+        cout << "Close failed: " << res << endl;
+        return 0;
+    }
 
     return nwrote;
 }
@@ -21,6 +21,10 @@
 // permissions and limitations under the License.
 //
 // \brief Test atomic record append API in KFS.
+// With -t the test runs a number of writers, each with its own client, and
+// reports the aggregate write rate and the append latency percentiles.
+// -s sends every record in its own append, -B and -D set the client
+// append batching; the report includes the records per append.
 //
 //----------------------------------------------------------------------------
 
@@ -29,7 +33,12 @@
 #include <string.h>
 #include <stdlib.h>
 #include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
 #include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -40,14 +49,45 @@ using std::cout;
 using std::endl;
 using std::ifstream;
 using std::string;
+using std::vector;
+using std::ostringstream;
 
 using namespace KFS;
 
 int numReplicas = 3;
 KfsClientPtr gKfsClient;
 static bool doMkdirs(const char *dirname);
-static off_t doWrite(const string &kfspathname, int numMBytes, 
-                     size_t writeSizeBytes, double sleepSec, char record);
+static off_t doWrite(KfsClientPtr &kfsClient, const string &kfspathname,
+                     int numMBytes, size_t writeSizeBytes, double sleepSec,
+                     char record, bool syncFlag, vector<double> &latencies);
+static void *writerMain(void *arg);
+
+static double
+now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (tv.tv_sec + tv.tv_usec * 1e-6);
+}
+
+// Each writer thread has its own client, thus its own meta and chunk server
+// connections, and appends to the file writer # % # of files.
+struct Writer
+{
+    ServerLocation  metaLoc;
+    string          pathname;
+    int             numMBytes;
+    size_t          writeSizeBytes;
+    double          sleepSec;
+    char            record;
+    bool            syncFlag;
+    int             batchBytes;
+    int             batchDelayMs;
+    off_t           bytesWritten;
+    vector<double>  latencies;
+    KfsClient::AppendStats stats;
+    pthread_t       thread;
+};
 
 int
 main(int argc, char **argv)
@@ -60,8 +100,14 @@ main(int argc, char **argv)
     bool help = false;
     double sleepSec = -1;
     char record('x');
+    int numThreads = 1;
+    int numFiles = 1;
+    bool quiet = false;
+    bool syncFlag = false;
+    int batchBytes = 65536;
+    int batchDelayMs = -1;
 
-    while ((optchar = getopt(argc, argv, "f:p:m:b:r:S:c:")) != -1) {
+    while ((optchar = getopt(argc, argv, "f:p:m:b:r:S:c:t:F:qsB:D:")) != -1) {
         switch (optchar) {
             case 'c':
                 record = *optarg;
@@ -84,6 +130,24 @@ main(int argc, char **argv)
             case 'S':
                 sleepSec = atof(optarg);
                 break;
+            case 't':
+                numThreads = atoi(optarg);
+                break;
+            case 'F':
+                numFiles = atoi(optarg);
+                break;
+            case 'q':
+                quiet = true;
+                break;
+            case 's':
+                syncFlag = true;
+                break;
+            case 'B':
+                batchBytes = atoi(optarg);
+                break;
+            case 'D':
+                batchDelayMs = atoi(optarg);
+                break;
             default:
                 cout << "Unrecognized flag: " << optchar << endl;
                 help = true;
@@ -91,16 +155,32 @@ main(int argc, char **argv)
         }
     }
 
-    if (help || (kfsPropsFile == NULL) || (kfspathname == "")) {
+    if (help || (kfsPropsFile == NULL) || (kfspathname == "") ||
+            numThreads <= 0 || numFiles <= 0) {
         cout << "Usage: " << argv[0] << " -p <Kfs Client properties file> "
-             << " -m <# of MB to write> -b <write size in bytes> -f <Kfs file> "
+             << " -m <# of MB to write per writer> -b <write size in bytes>"
+             << " -f <Kfs file> "
              << " -S <sleep between writes> -c <char for the record>"
+             << " -t <# of writer threads> -F <# of files>"
+             << " [-q (log warnings only)]"
+             << " [-s (one append per record)]"
+             << " [-B <append batch bytes>] [-D <max batch delay ms>]"
              << endl;
         exit(0);
     }
+    if (numFiles > numThreads) {
+        numFiles = numThreads;
+    }
 
     cout << "Doing writes to: " << kfspathname << " # MB = " << numMBytes;
-    cout << " # of bytes per write: " << writeSizeBytes << endl;
+    cout << " # of bytes per write: " << writeSizeBytes;
+    cout << " # of writers: " << numThreads << " # of files: " << numFiles;
+    if (syncFlag) {
+        cout << " one append per record";
+    } else {
+        cout << " batch: " << batchBytes << " bytes " << batchDelayMs << " ms";
+    }
+    cout << endl;
 
     gKfsClient = getKfsClientFactory()->GetClient(kfsPropsFile);
     if (!gKfsClient) {
@@ -108,7 +188,8 @@ main(int argc, char **argv)
         exit(-1);
     }
 
-    KFS::MsgLogger::SetLevel(KFS::MsgLogger::kLogLevelDEBUG);
+    KFS::MsgLogger::SetLevel(quiet ? KFS::MsgLogger::kLogLevelWARN :
+        KFS::MsgLogger::kLogLevelDEBUG);
 
     string kfsdirname, kfsfilename;
     string::size_type slash = kfspathname.rfind('/');
@@ -122,24 +203,105 @@ main(int argc, char **argv)
     kfsfilename.assign(kfspathname, slash + 1, kfspathname.size());
     doMkdirs(kfsdirname.c_str());
 
-    struct timeval startTime, endTime;
-    double timeTaken;
-    off_t bytesWritten;
+    vector<Writer> writers(numThreads);
+    for (int i = 0; i < numThreads; i++) {
+        Writer& w = writers[i];
+        w.metaLoc        = gKfsClient->GetMetaserverLocation();
+        w.pathname       = kfspathname;
+        if (numFiles > 1) {
+            ostringstream os;
+            os << kfspathname << "." << (i % numFiles);
+            w.pathname = os.str();
+        }
+        w.numMBytes      = numMBytes;
+        w.writeSizeBytes = writeSizeBytes;
+        w.sleepSec       = sleepSec;
+        w.record         = record;
+        w.syncFlag       = syncFlag;
+        w.batchBytes     = batchBytes;
+        w.batchDelayMs   = batchDelayMs;
+        w.bytesWritten   = 0;
+        if (i < numFiles) {
+            const int fd = gKfsClient->Create(w.pathname.c_str(),
+                numReplicas);
+            if (fd < 0) {
+                cout << "Create " << w.pathname << " failed: " << fd << endl;
+                exit(-1);
+            }
+            gKfsClient->Close(fd);
+        }
+    }
 
-    gettimeofday(&startTime, NULL);
+    const double startTime = now();
 
-    bytesWritten = doWrite(kfspathname, numMBytes, writeSizeBytes, sleepSec, record);
+    for (int i = 0; i < numThreads; i++) {
+        if (pthread_create(&writers[i].thread, NULL, writerMain,
+                &writers[i]) != 0) {
+            cout << "failed to start writer thread " << i << endl;
+            exit(-1);
+        }
+    }
+    for (int i = 0; i < numThreads; i++) {
+        pthread_join(writers[i].thread, NULL);
+    }
 
-    gettimeofday(&endTime, NULL);
+    const double timeTaken = now() - startTime;
 
-    timeTaken = (endTime.tv_sec - startTime.tv_sec) +
-        (endTime.tv_usec - startTime.tv_usec) * 1e-6;
+    off_t          bytesWritten = 0;
+    vector<double> latencies;
+    KfsClient::AppendStats stats;
+    for (int i = 0; i < numThreads; i++) {
+        bytesWritten += writers[i].bytesWritten;
+        stats.records          += writers[i].stats.records;
+        stats.committedRecords += writers[i].stats.committedRecords;
+        stats.appends          += writers[i].stats.appends;
+        stats.batchTimeouts    += writers[i].stats.batchTimeouts;
+        latencies.insert(latencies.end(),
+            writers[i].latencies.begin(), writers[i].latencies.end());
+    }
 
     cout << "Write rate: " << (((double) bytesWritten * 8.0) / timeTaken) / (1024.0 * 1024.0) << " (Mbps)" << endl;
     cout << "Write rate: " << ((double) bytesWritten / timeTaken) / (1024.0 * 1024.0) << " (MBps)" << endl;
+    cout << "Records: " << stats.records <<
+        " committed: " << stats.committedRecords <<
+        " rate: " << stats.committedRecords / timeTaken << " (records/sec)" <<
+        " appends: " << stats.appends <<
+        " records per append: " << (stats.appends > 0 ?
+            (double)stats.committedRecords / stats.appends : 0.) <<
+        " batch timeouts: " << stats.batchTimeouts << endl;
+    if (! latencies.empty()) {
+        sort(latencies.begin(), latencies.end());
+        const double pct[] = { 50, 90, 99, 99.9, 100 };
+        cout << "Appends: " << latencies.size() << " latency (ms):";
+        for (size_t i = 0; i < sizeof(pct) / sizeof(pct[0]); i++) {
+            size_t idx = size_t(latencies.size() * pct[i] / 100);
+            if (idx >= latencies.size()) {
+                idx = latencies.size() - 1;
+            }
+            cout << " p" << pct[i] << ": " << latencies[idx] * 1e3;
+        }
+        cout << endl;
+    }
     return 0;
 }
 
+void *
+writerMain(void *arg)
+{
+    Writer& w = *reinterpret_cast<Writer*>(arg);
+    KfsClientPtr kfsClient(new KfsClient());
+    kfsClient->Init(w.metaLoc.hostname, w.metaLoc.port);
+    if (! kfsClient->IsInitialized()) {
+        cout << "kfs client failed to initialize" << endl;
+        return NULL;
+    }
+    kfsClient->SetAppendBatching(w.batchBytes, w.batchDelayMs);
+    w.bytesWritten = doWrite(kfsClient, w.pathname, w.numMBytes,
+        w.writeSizeBytes, w.sleepSec, w.record, w.syncFlag, w.latencies);
+    kfsClient->GetAppendStats(w.stats);
+    return NULL;
+}
+
 bool
 doMkdirs(const char *dirname)
 {
@@ -157,10 +319,13 @@ doMkdirs(const char *dirname)
 }
 
 off_t
-doWrite(const string &filename, int numMBytes, size_t writeSizeBytes, double sleepSec, char record)
+doWrite(KfsClientPtr &kfsClient, const string &filename, int numMBytes,
+    size_t writeSizeBytes, double sleepSec, char record, bool syncFlag,
+    vector<double> &latencies)
 {
     const size_t mByte = 1024 * 1024;
-    char dataBuf[mByte];
+    vector<char> buf(mByte);
+    char* const dataBuf = &buf[0];
     int res, fd;
     size_t bytesWritten = 0;
     int nMBytes = 0;
@@ -175,17 +340,18 @@ doWrite(const string &filename, int numMBytes, size_t writeSizeBytes, double sle
         dataBuf[bytesWritten] = record;
     }
 
-    // fd = gKfsClient->Open(filename.c_str(), O_CREAT|O_RDWR);
-    fd = gKfsClient->Create(filename.c_str(), numReplicas, true);
-    if (fd == -EEXIST) {
-        fd = gKfsClient->Open(filename.c_str(), O_RDWR);
-    } else {
-        sleep(2);
-    }
+    // Record append requires the file to be opened with O_APPEND. The file
+    // is created by main(), as concurrent non exclusive creates of the same
+    // file by the writers would replace each other's file.
+    fd = kfsClient->Open(filename.c_str(), O_WRONLY|O_APPEND, numReplicas);
     if (fd < 0) {
         cout << "Create failed: " << endl;
         exit(-1);
     }
+    if (syncFlag) {
+        // No buffering: each append waits for the record to be committed.
+        kfsClient->SetIoBufferSize(fd, 0);
+    }
 
     struct timespec sleepTm;
     const bool doSleep = sleepSec > 0;
@@ -193,12 +359,15 @@ doWrite(const string &filename, int numMBytes, size_t writeSizeBytes, double sle
         sleepTm.tv_sec = time_t(sleepSec);
         sleepTm.tv_nsec = long((sleepSec - (double)sleepTm.tv_sec) * 1e9);
     }
+    latencies.reserve(numMBytes * (mByte / writeSizeBytes + 1));
     int recordCount = 0;
     for (nMBytes = 0; nMBytes < numMBytes; nMBytes++) {
         for (bytesWritten = 0; bytesWritten < mByte; bytesWritten += writeSizeBytes) {
             snprintf(dataBuf, 4, "%d", recordCount);
             recordCount++;
-            res = gKfsClient->AtomicRecordAppend(fd, dataBuf, writeSizeBytes);
+            const double start = now();
+            res = kfsClient->AtomicRecordAppend(fd, dataBuf, writeSizeBytes);
+            latencies.push_back(now() - start);
             if (res != (int) writeSizeBytes)
                 return (bytesWritten + nMBytes * 1024 * 1024);
             nwrote += writeSizeBytes;
@@ -208,12 +377,11 @@ doWrite(const string &filename, int numMBytes, size_t writeSizeBytes, double sle
             nanosleep(&sleepTm, 0);
         }
     }
-    cout << "write of " << nwrote / (1024 * 1024) << " (MB) is done" << endl;
+    cout << "write of " << nwrote / (1024 * 1024) << " (MB) to " << filename
+         << " is done" << endl;
 
-    sleep(5);
-
-    gKfsClient->Close(fd);
+    // Close waits for the pending appends to complete.
+    kfsClient->Close(fd);
 
     return nwrote;
 }
-    
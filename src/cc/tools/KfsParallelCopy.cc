@@ -0,0 +1,805 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2010/11/22
+//
+// Copyright 2010 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Parallel copy engine implementation.
+//
+//----------------------------------------------------------------------------
+
+#include "KfsParallelCopy.h"
+
+#include <iostream>
+#include <cerrno>
+#include <algorithm>
+
+extern "C" {
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <dirent.h>
+}
+
+#include "libkfsClient/KfsClient.h"
+#include "qcdio/qcthread.h"
+#include "qcdio/qcstutils.h"
+
+namespace KFS
+{
+namespace tools
+{
+
+using std::string;
+using std::vector;
+using std::deque;
+using std::cerr;
+using std::endl;
+using std::min;
+using std::max;
+
+static int64_t
+NowMicroSecs()
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return (int64_t(tv.tv_sec) * 1000 * 1000 + tv.tv_usec);
+}
+
+static string
+BaseName(const string& path)
+{
+    const string::size_type slash = path.rfind('/');
+    return (slash == string::npos ? path : path.substr(slash + 1));
+}
+
+///
+/// File system interface for the copy engine: the local file system, or
+/// KFS through its own client. The KFS client serializes calls with its
+/// mutex, thus every copy thread has its own.
+///
+class ParallelCopier::Fs
+{
+public:
+    struct Entry
+    {
+        string  mName;
+        bool    mDirFlag;
+        int64_t mSize;
+    };
+    typedef vector<Entry> Entries;
+
+    static Fs* Create(const string& host, int port, int numReplicas);
+    virtual ~Fs()
+        {}
+    virtual int Stat(const string& path, bool& dirFlag, int64_t& size) = 0;
+    virtual int ReadDir(const string& path, Entries& entries) = 0;
+    virtual int Mkdirs(const string& path) = 0;
+    /// Create the file. With truncateFlag the existing file is truncated,
+    /// otherwise its content past the copied data is kept. With deleteFlag
+    /// the existing file is removed first.
+    virtual int Create(const string& path, int64_t size,
+        bool truncateFlag, bool deleteFlag) = 0;
+    /// @retval fd on success; -errno otherwise
+    virtual int Open(const string& path, bool writeFlag) = 0;
+    virtual ssize_t PRead(int fd, int64_t pos, char* buf, size_t len) = 0;
+    virtual ssize_t PWrite(int fd, int64_t pos, const char* buf,
+        size_t len) = 0;
+    virtual int Close(int fd) = 0;
+};
+
+class LocalFs : public ParallelCopier::Fs
+{
+public:
+    virtual int Stat(const string& path, bool& dirFlag, int64_t& size)
+    {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            return -errno;
+        }
+        dirFlag = S_ISDIR(st.st_mode);
+        size    = st.st_size;
+        return 0;
+    }
+    virtual int ReadDir(const string& path, Entries& entries)
+    {
+        DIR* const dirp = opendir(path.c_str());
+        if (! dirp) {
+            return -errno;
+        }
+        struct dirent* ent;
+        while ((ent = readdir(dirp)) != 0) {
+            if (strcmp(ent->d_name, ".") == 0 ||
+                    strcmp(ent->d_name, "..") == 0) {
+                continue;
+            }
+            struct stat st;
+            const string name = path + "/" + ent->d_name;
+            if (stat(name.c_str(), &st) != 0 ||
+                    (! S_ISDIR(st.st_mode) && ! S_ISREG(st.st_mode))) {
+                continue;
+            }
+            Entry entry;
+            entry.mName    = ent->d_name;
+            entry.mDirFlag = S_ISDIR(st.st_mode);
+            entry.mSize    = st.st_size;
+            entries.push_back(entry);
+        }
+        closedir(dirp);
+        return 0;
+    }
+    virtual int Mkdirs(const string& path)
+    {
+        for (string::size_type pos = 0; pos != string::npos; ) {
+            pos = path.find('/', pos + 1);
+            const string dir = path.substr(0, pos);
+            if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST) {
+                return -errno;
+            }
+        }
+        return 0;
+    }
+    virtual int Create(const string& path, int64_t size,
+        bool truncateFlag, bool deleteFlag)
+    {
+        if (deleteFlag && unlink(path.c_str()) != 0 && errno != ENOENT) {
+            return -errno;
+        }
+        const int fd = open(path.c_str(),
+            O_WRONLY | O_CREAT | (truncateFlag ? O_TRUNC : 0), 0644);
+        if (fd < 0) {
+            return -errno;
+        }
+        // Set the size upfront, the ranges can be written in any order.
+        struct stat st;
+        int res = fstat(fd, &st) == 0 ? 0 : -errno;
+        if (res == 0 && st.st_size < size && ftruncate(fd, size) != 0) {
+            res = -errno;
+        }
+        close(fd);
+        return res;
+    }
+    virtual int Open(const string& path, bool writeFlag)
+    {
+        const int fd = open(path.c_str(), writeFlag ? O_WRONLY : O_RDONLY);
+        return (fd < 0 ? -errno : fd);
+    }
+    virtual ssize_t PRead(int fd, int64_t pos, char* buf, size_t len)
+    {
+        const ssize_t res = pread(fd, buf, len, pos);
+        return (res < 0 ? -errno : res);
+    }
+    virtual ssize_t PWrite(int fd, int64_t pos, const char* buf, size_t len)
+    {
+        size_t done = 0;
+        while (done < len) {
+            const ssize_t res = pwrite(fd, buf + done, len - done, pos + done);
+            if (res < 0) {
+                return -errno;
+            }
+            done += res;
+        }
+        return done;
+    }
+    virtual int Close(int fd)
+        { return (close(fd) == 0 ? 0 : -errno); }
+};
+
+class KfsFs : public ParallelCopier::Fs
+{
+public:
+    KfsFs(int numReplicas)
+        : mClient(new KfsClient()),
+          mNumReplicas(numReplicas)
+        {}
+    int Init(const string& host, int port)
+    {
+        if (mClient->Init(host, port) != 0 || ! mClient->IsInitialized()) {
+            return -EHOSTUNREACH;
+        }
+        return 0;
+    }
+    virtual int Stat(const string& path, bool& dirFlag, int64_t& size)
+    {
+        struct stat st;
+        const int res = mClient->Stat(path.c_str(), st);
+        if (res < 0) {
+            return res;
+        }
+        dirFlag = S_ISDIR(st.st_mode);
+        size    = st.st_size;
+        return 0;
+    }
+    virtual int ReadDir(const string& path, Entries& entries)
+    {
+        // Use the paged listing: the directory might be huge.
+        KfsDirIterator it(*mClient, path, 4 << 10, true);
+        KfsFileAttr    attr;
+        int            res;
+        while ((res = it.Next(attr)) > 0) {
+            if (attr.filename == "." || attr.filename == "..") {
+                continue;
+            }
+            Entry entry;
+            entry.mName    = attr.filename;
+            entry.mDirFlag = attr.isDirectory;
+            entry.mSize    = max(off_t(0), attr.fileSize);
+            entries.push_back(entry);
+        }
+        return res;
+    }
+    virtual int Mkdirs(const string& path)
+    {
+        const int res = mClient->Mkdirs(path.c_str());
+        return (res == -EEXIST ? 0 : res);
+    }
+    virtual int Create(const string& path, int64_t size,
+        bool truncateFlag, bool deleteFlag)
+    {
+        if (deleteFlag) {
+            mClient->Remove(path.c_str());
+        }
+        const int fd = mClient->Open(path.c_str(),
+            O_CREAT | O_WRONLY | (truncateFlag ? O_TRUNC : 0), mNumReplicas);
+        if (fd < 0) {
+            return fd;
+        }
+        return mClient->Close(fd);
+    }
+    virtual int Open(const string& path, bool writeFlag)
+        { return mClient->Open(path.c_str(), writeFlag ? O_WRONLY : O_RDONLY); }
+    virtual ssize_t PRead(int fd, int64_t pos, char* buf, size_t len)
+        { return mClient->PRead(fd, pos, buf, len); }
+    virtual ssize_t PWrite(int fd, int64_t pos, const char* buf, size_t len)
+        { return mClient->PWrite(fd, pos, buf, len); }
+    virtual int Close(int fd)
+        { return mClient->Close(fd); }
+private:
+    KfsClientPtr mClient;
+    const int    mNumReplicas;
+};
+
+ParallelCopier::Fs*
+ParallelCopier::Fs::Create(const string& host, int port, int numReplicas)
+{
+    if (host.empty()) {
+        return new LocalFs();
+    }
+    KfsFs* const fs = new KfsFs(numReplicas);
+    if (fs->Init(host, port) != 0) {
+        cerr << "unable to connect to " << host << ":" << port << endl;
+        delete fs;
+        return 0;
+    }
+    return fs;
+}
+
+struct ParallelCopier::Task
+{
+    enum Type
+    {
+        kDir,
+        kFile,
+        kRange
+    };
+    Task(Type type, const string& src, const string& dst,
+            int64_t offset = 0, int64_t size = 0)
+        : mType(type),
+          mSrc(src),
+          mDst(dst),
+          mOffset(offset),
+          mSize(size)
+        {}
+    Type    mType;
+    string  mSrc;
+    string  mDst;
+    int64_t mOffset;
+    int64_t mSize;
+};
+
+///
+/// Reader and writer thread pair. The reader takes the tasks from the
+/// queue, and passes the data to the writer in one of the two buffers.
+///
+class ParallelCopier::Stream
+{
+public:
+    Stream(ParallelCopier& copier)
+        : mCopier(copier),
+          mSrcFs(0),
+          mDstFs(0),
+          mReader(this),
+          mWriter(this),
+          mReaderThread(),
+          mWriterThread(),
+          mBlocks(),
+          mFreeBufs(),
+          mBlockCond(),
+          mFreeCond()
+        {}
+    ~Stream()
+    {
+        for (size_t i = 0; i < mFreeBufs.size(); i++) {
+            delete [] mFreeBufs[i];
+        }
+        delete mSrcFs;
+        delete mDstFs;
+    }
+    int Start()
+    {
+        mSrcFs = Fs::Create(mCopier.mSrcHost, mCopier.mSrcPort,
+            mCopier.mParams.mNumReplicas);
+        mDstFs = Fs::Create(mCopier.mDstHost, mCopier.mDstPort,
+            mCopier.mParams.mNumReplicas);
+        if (! mSrcFs || ! mDstFs) {
+            return -EHOSTUNREACH;
+        }
+        for (int i = 0; i < kNumBuffers; i++) {
+            mFreeBufs.push_back(new char[mCopier.mParams.mBufSize]);
+        }
+        mReaderThread.Start(&mReader, -1, "copy reader");
+        mWriterThread.Start(&mWriter, -1, "copy writer");
+        return 0;
+    }
+    void Join()
+    {
+        mReaderThread.Join();
+        mWriterThread.Join();
+    }
+    /// Wake up both threads to check the stop flag; copier mutex locked.
+    void Notify()
+    {
+        mBlockCond.NotifyAll();
+        mFreeCond.NotifyAll();
+    }
+private:
+    enum { kNumBuffers = 2 };
+    struct Block
+    {
+        string  mDst;
+        int64_t mPos;
+        char*   mBuf;
+        size_t  mLen;
+        int     mStatus;
+        bool    mLastFlag; // last block of the range
+    };
+    typedef deque<Block> Blocks;
+    class Runner : public QCRunnable
+    {
+    public:
+        typedef void (Stream::*Func)();
+        Runner(Stream* stream, Func func)
+            : mStream(stream),
+              mFunc(func)
+            {}
+        virtual void Run()
+            { (mStream->*mFunc)(); }
+    private:
+        Stream* const mStream;
+        const Func    mFunc;
+    };
+    class Reader : public Runner
+    {
+    public:
+        Reader(Stream* stream)
+            : Runner(stream, &Stream::Read)
+            {}
+    };
+    class Writer : public Runner
+    {
+    public:
+        Writer(Stream* stream)
+            : Runner(stream, &Stream::Write)
+            {}
+    };
+
+    ParallelCopier& mCopier;
+    Fs*             mSrcFs;
+    Fs*             mDstFs;
+    Reader          mReader;
+    Writer          mWriter;
+    QCThread        mReaderThread;
+    QCThread        mWriterThread;
+    Blocks          mBlocks;
+    vector<char*>   mFreeBufs;
+    QCCondVar       mBlockCond;
+    QCCondVar       mFreeCond;
+
+    void Read()
+    {
+        Task task(Task::kDir, string(), string());
+        while (mCopier.GetTask(task)) {
+            switch (task.mType) {
+                case Task::kDir:
+                    mCopier.ProcessDir(task);
+                    break;
+                case Task::kFile:
+                    mCopier.ProcessFile(task);
+                    break;
+                case Task::kRange:
+                    ReadRange(task);
+                    break;
+            }
+        }
+    }
+    char* GetBuffer()
+    {
+        QCStMutexLocker lock(mCopier.mMutex);
+        while (mFreeBufs.empty() && ! mCopier.mStopFlag) {
+            mFreeCond.Wait(mCopier.mMutex);
+        }
+        if (mFreeBufs.empty()) {
+            return 0;
+        }
+        char* const buf = mFreeBufs.back();
+        mFreeBufs.pop_back();
+        return buf;
+    }
+    void PutBlock(const Block& block)
+    {
+        QCStMutexLocker lock(mCopier.mMutex);
+        mBlocks.push_back(block);
+        mBlockCond.Notify();
+    }
+    void ReadRange(const Task& task)
+    {
+        const int fd = mSrcFs->Open(task.mSrc, false);
+        Block block;
+        block.mDst    = task.mDst;
+        block.mPos    = task.mOffset;
+        block.mBuf    = 0;
+        block.mLen    = 0;
+        block.mStatus = fd < 0 ? fd : 0;
+        block.mLastFlag = false;
+        const int64_t end = task.mOffset + task.mSize;
+        while (block.mStatus == 0 && block.mPos < end) {
+            if (! (block.mBuf = GetBuffer())) {
+                block.mStatus = -EINTR;
+                break;
+            }
+            const ssize_t nrd = mSrcFs->PRead(fd, block.mPos, block.mBuf,
+                (size_t)min(int64_t(mCopier.mParams.mBufSize),
+                    end - block.mPos));
+            if (nrd <= 0) {
+                // Error, or the file is shorter than it was.
+                block.mStatus = (int)nrd;
+                break;
+            }
+            block.mLen      = nrd;
+            block.mLastFlag = block.mPos + nrd >= end;
+            PutBlock(block);
+            if (block.mLastFlag) {
+                break;
+            }
+            block.mPos += nrd;
+            block.mBuf = 0;
+            block.mLen = 0;
+        }
+        if (fd >= 0) {
+            mSrcFs->Close(fd);
+        }
+        if (! block.mLastFlag) {
+            // Let the writer finish the range.
+            block.mLen      = 0;
+            block.mLastFlag = true;
+            if (block.mStatus < 0) {
+                mCopier.SetError(block.mStatus, "read " + task.mSrc);
+            }
+            PutBlock(block);
+        }
+    }
+    void Write()
+    {
+        string  dst;
+        int     fd     = -1;
+        int     status = 0;
+        int64_t bytes  = 0;
+        for (; ;) {
+            QCStMutexLocker lock(mCopier.mMutex);
+            while (mBlocks.empty() && ! mCopier.mStopFlag) {
+                mBlockCond.Wait(mCopier.mMutex);
+            }
+            if (mBlocks.empty()) {
+                break;
+            }
+            Block block = mBlocks.front();
+            mBlocks.pop_front();
+            lock.Unlock();
+
+            if (fd < 0 && status == 0) {
+                dst = block.mDst;
+                if ((fd = mDstFs->Open(dst, true)) < 0) {
+                    status = fd;
+                    mCopier.SetError(status, "open " + dst);
+                }
+            }
+            if (status == 0 && block.mLen > 0) {
+                const ssize_t nwr = mDstFs->PWrite(
+                    fd, block.mPos, block.mBuf, block.mLen);
+                if (nwr != (ssize_t)block.mLen) {
+                    status = nwr < 0 ? (int)nwr : -EIO;
+                    mCopier.SetError(status, "write " + dst);
+                } else {
+                    bytes += nwr;
+                }
+            }
+            if (block.mLastFlag) {
+                if (fd >= 0) {
+                    const int res = mDstFs->Close(fd);
+                    if (res < 0 && status == 0) {
+                        status = res;
+                        mCopier.SetError(status, "close " + dst);
+                    }
+                }
+                mCopier.TaskDone(status != 0 ? status : block.mStatus, bytes);
+                fd     = -1;
+                status = 0;
+                bytes  = 0;
+            }
+            if (block.mBuf) {
+                QCStMutexLocker lock(mCopier.mMutex);
+                mFreeBufs.push_back(block.mBuf);
+                mFreeCond.Notify();
+            }
+        }
+        if (fd >= 0) {
+            mDstFs->Close(fd);
+        }
+    }
+private:
+    Stream(const Stream&);
+    Stream& operator=(const Stream&);
+};
+
+ParallelCopier::Params::Params()
+    : mNumStreams(4),
+      mRangeSize(KFS::CHUNKSIZE),
+      mBufSize(4 << 20),
+      mNumReplicas(3),
+      mProgressInterval(0),
+      mTruncateFlag(true),
+      mDeleteFlag(false)
+{
+}
+
+ParallelCopier::ParallelCopier(const Params& params,
+    const string& srcHost, int srcPort,
+    const string& dstHost, int dstPort)
+    : mParams(params),
+      mSrcHost(srcHost),
+      mSrcPort(srcPort),
+      mDstHost(dstHost),
+      mDstPort(dstPort),
+      mSrcMetaFs(0),
+      mDstMetaFs(0),
+      mStreams(),
+      mMutex(),
+      mTaskCond(),
+      mDoneCond(),
+      mTasks(),
+      mOutstanding(0),
+      mStopFlag(false),
+      mStatus(0),
+      mBytesCopied(0),
+      mFilesCopied(0),
+      mStartTime(NowMicroSecs())
+{
+}
+
+ParallelCopier::~ParallelCopier()
+{
+    if (! mStopFlag) {
+        QCStMutexLocker lock(mMutex);
+        mStopFlag = true;
+        mTaskCond.NotifyAll();
+        for (size_t i = 0; i < mStreams.size(); i++) {
+            mStreams[i]->Notify();
+        }
+    }
+    for (size_t i = 0; i < mStreams.size(); i++) {
+        mStreams[i]->Join();
+        delete mStreams[i];
+    }
+    delete mSrcMetaFs;
+    delete mDstMetaFs;
+}
+
+int
+ParallelCopier::Start()
+{
+    if (mParams.mNumStreams <= 0 || mParams.mBufSize <= 0 ||
+            mParams.mRangeSize < (int64_t)KFS::CHUNKSIZE ||
+            mParams.mRangeSize % KFS::CHUNKSIZE != 0) {
+        return -EINVAL;
+    }
+    if (! (mSrcMetaFs = Fs::Create(mSrcHost, mSrcPort, mParams.mNumReplicas)) ||
+            ! (mDstMetaFs = Fs::Create(
+                mDstHost, mDstPort, mParams.mNumReplicas))) {
+        return -EHOSTUNREACH;
+    }
+    for (int i = 0; i < mParams.mNumStreams; i++) {
+        Stream* const stream = new Stream(*this);
+        mStreams.push_back(stream);
+        const int res = stream->Start();
+        if (res != 0) {
+            return res;
+        }
+    }
+    mStartTime = NowMicroSecs();
+    return 0;
+}
+
+int
+ParallelCopier::Copy(const string& src, const string& dst)
+{
+    bool    dirFlag = false;
+    int64_t size    = 0;
+    int     res     = mSrcMetaFs->Stat(src, dirFlag, size);
+    if (res < 0) {
+        SetError(res, "stat " + src);
+        return res;
+    }
+    if (dirFlag) {
+        QueueTask(Task(Task::kDir, src, dst), false);
+        return 0;
+    }
+    bool    dstDirFlag = false;
+    int64_t dstSize    = 0;
+    if (mDstMetaFs->Stat(dst, dstDirFlag, dstSize) == 0 && dstDirFlag) {
+        QueueTask(Task(Task::kFile, src, dst + "/" + BaseName(src),
+            0, size), false);
+    } else {
+        QueueTask(Task(Task::kFile, src, dst, 0, size), false);
+    }
+    return 0;
+}
+
+int
+ParallelCopier::Wait()
+{
+    QCStMutexLocker lock(mMutex);
+    int64_t nextReport = NowMicroSecs() +
+        int64_t(mParams.mProgressInterval) * 1000 * 1000;
+    while (mOutstanding > 0) {
+        mDoneCond.Wait(mMutex, QCMutex::Time(1000) * 1000 * 1000);
+        if (mParams.mProgressInterval > 0 && NowMicroSecs() >= nextReport) {
+            ReportProgress(false);
+            nextReport += int64_t(mParams.mProgressInterval) * 1000 * 1000;
+        }
+    }
+    mStopFlag = true;
+    mTaskCond.NotifyAll();
+    for (size_t i = 0; i < mStreams.size(); i++) {
+        mStreams[i]->Notify();
+    }
+    ReportProgress(true);
+    lock.Unlock();
+    for (size_t i = 0; i < mStreams.size(); i++) {
+        mStreams[i]->Join();
+    }
+    return mStatus;
+}
+
+bool
+ParallelCopier::GetTask(Task& task)
+{
+    QCStMutexLocker lock(mMutex);
+    while (mTasks.empty() && ! mStopFlag) {
+        mTaskCond.Wait(mMutex);
+    }
+    if (mTasks.empty()) {
+        return false;
+    }
+    task = mTasks.front();
+    mTasks.pop_front();
+    return true;
+}
+
+void
+ParallelCopier::QueueTask(const Task& task, bool front)
+{
+    QCStMutexLocker lock(mMutex);
+    if (front) {
+        mTasks.push_front(task);
+    } else {
+        mTasks.push_back(task);
+    }
+    mOutstanding++;
+    mTaskCond.Notify();
+}
+
+void
+ParallelCopier::TaskDone(int status, int64_t bytes)
+{
+    QCStMutexLocker lock(mMutex);
+    if (status < 0) {
+        mStatus = status;
+    }
+    mBytesCopied += bytes;
+    if (--mOutstanding <= 0) {
+        mDoneCond.NotifyAll();
+    }
+}
+
+void
+ParallelCopier::SetError(int status, const string& msg)
+{
+    QCStMutexLocker lock(mMutex);
+    mStatus = status;
+    cerr << msg << ": " << ErrorCodeToStr(status) << endl;
+}
+
+void
+ParallelCopier::ProcessDir(const Task& task)
+{
+    Fs::Entries entries;
+    int res = mDstMetaFs->Mkdirs(task.mDst);
+    if (res < 0) {
+        SetError(res, "mkdir " + task.mDst);
+    } else if ((res = mSrcMetaFs->ReadDir(task.mSrc, entries)) < 0) {
+        SetError(res, "readdir " + task.mSrc);
+    }
+    for (size_t i = 0; res == 0 && i < entries.size(); i++) {
+        const Fs::Entry& entry = entries[i];
+        QueueTask(Task(entry.mDirFlag ? Task::kDir : Task::kFile,
+            task.mSrc + "/" + entry.mName, task.mDst + "/" + entry.mName,
+            0, entry.mSize), false);
+    }
+    TaskDone(res, 0);
+}
+
+void
+ParallelCopier::ProcessFile(const Task& task)
+{
+    const int res = mDstMetaFs->Create(task.mDst, task.mSize,
+        mParams.mTruncateFlag, mParams.mDeleteFlag);
+    if (res < 0) {
+        SetError(res, "create " + task.mDst);
+    } else {
+        // Queue the ranges in front, to finish the files that are
+        // already started first, and to bound the number of open files.
+        int64_t pos = task.mSize;
+        while (pos > 0) {
+            const int64_t off = ((pos - 1) / mParams.mRangeSize) *
+                mParams.mRangeSize;
+            QueueTask(Task(Task::kRange, task.mSrc, task.mDst,
+                off, pos - off), true);
+            pos = off;
+        }
+        QCStMutexLocker lock(mMutex);
+        mFilesCopied++;
+    }
+    TaskDone(res, 0);
+}
+
+void
+ParallelCopier::ReportProgress(bool final)
+{
+    const double secs = max(int64_t(1), NowMicroSecs() - mStartTime) * 1e-6;
+    const double mb   = mBytesCopied / double(1 << 20);
+    fprintf(stderr, "%s%lld files %.1f MB %.1f sec %.2f MB/sec\n",
+        final ? "copied: " : "progress: ",
+        (long long)mFilesCopied, mb, secs, mb / secs);
+}
+
+}
+}
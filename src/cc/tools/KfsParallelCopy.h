@@ -0,0 +1,126 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2010/11/22
+//
+// Copyright 2010 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Parallel copy engine used by cptokfs, cpfromkfs, and kfscp.
+//
+// Copies files and directory trees between the local file system and KFS,
+// or within KFS, with a number of copy streams. Each stream is a reader
+// and a writer thread with their own KFS client, and two buffers: the
+// reader fills one buffer while the writer writes the other one out.
+// The streams take the work from the shared queue: directories to
+// enumerate, files to create, and chunk aligned file ranges to copy.
+// Thus directory trees are enumerated, and large files copied by all
+// streams concurrently.
+//
+//----------------------------------------------------------------------------
+
+#ifndef TOOLS_KFSPARALLELCOPY_H
+#define TOOLS_KFSPARALLELCOPY_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+
+#include "qcdio/qcmutex.h"
+
+namespace KFS
+{
+namespace tools
+{
+
+class ParallelCopier
+{
+public:
+    struct Params
+    {
+        Params();
+        int     mNumStreams;       ///< reader / writer thread pairs
+        int64_t mRangeSize;        ///< file range size, multiple of chunk size
+        int     mBufSize;          ///< copy buffer size
+        int     mNumReplicas;      ///< replication of the created KFS files
+        int     mProgressInterval; ///< secs between progress reports, 0 off
+        bool    mTruncateFlag;     ///< truncate the existing destination
+        bool    mDeleteFlag;       ///< remove the existing destination first
+    };
+    class Fs;
+
+    /// Empty host name means the local file system.
+    ParallelCopier(const Params& params,
+        const std::string& srcHost, int srcPort,
+        const std::string& dstHost, int dstPort);
+    ~ParallelCopier();
+    /// Connect to the KFS meta server(s), and start the copy streams.
+    /// @retval 0 on success; -errno otherwise
+    int Start();
+    /// Queue the copy of src file or directory. If src is a file, and dst
+    /// is an existing directory, then the file is copied into dst.
+    /// If src is a directory, its content is copied into dst, dst is
+    /// created if it doesn't exist.
+    /// @retval 0 on success; -errno if src does not exist
+    int Copy(const std::string& src, const std::string& dst);
+    /// Wait for all queued copies to finish, and stop the streams.
+    /// @retval 0 if all copies succeeded; the last error otherwise
+    int Wait();
+private:
+    struct Task;
+    class Stream;
+    typedef std::deque<Task> Tasks;
+    typedef std::vector<Stream*> Streams;
+
+    const Params mParams;
+    const std::string mSrcHost;
+    const int mSrcPort;
+    const std::string mDstHost;
+    const int mDstPort;
+    /// Src enumeration and dst name space (mkdir, create).
+    Fs* mSrcMetaFs;
+    Fs* mDstMetaFs;
+    Streams mStreams;
+    QCMutex mMutex;
+    QCCondVar mTaskCond;
+    QCCondVar mDoneCond;
+    Tasks mTasks;
+    int64_t mOutstanding;
+    bool mStopFlag;
+    int mStatus;
+    int64_t mBytesCopied;
+    int64_t mFilesCopied;
+    int64_t mStartTime;
+
+    bool GetTask(Task& task);
+    void TaskDone(int status, int64_t bytes);
+    void QueueTask(const Task& task, bool front);
+    void ProcessDir(const Task& task);
+    void ProcessFile(const Task& task);
+    void ReportProgress(bool final);
+    void SetError(int status, const std::string& msg);
+
+private:
+    // No copies.
+    ParallelCopier(const ParallelCopier&);
+    ParallelCopier& operator=(const ParallelCopier&);
+};
+
+}
+}
+
+#endif // TOOLS_KFSPARALLELCOPY_H
@@ -156,6 +156,9 @@ MetaStatsOp::Request(ostringstream &os)
     os << "STATS\r\n";
     os << "Version: " << KFS_VERSION_STR << "\r\n";
     os << "Client-Protocol-Version: " << KFS_CLIENT_PROTO_VERS << "\r\n";
+    if (latencyFlag) {
+        os << "Latency-histograms: 1\r\n";
+    }
     os << "Cseq: " << seq << "\r\n\r\n";
 }
 
@@ -165,6 +168,9 @@ ChunkStatsOp::Request(ostringstream &os)
     os << "STATS\r\n";
     os << "Version: " << KFS_VERSION_STR << "\r\n";
     os << "Client-Protocol-Version: " << KFS_CLIENT_PROTO_VERS << "\r\n";
+    if (latencyFlag) {
+        os << "Latency-histograms: 1\r\n";
+    }
     os << "Cseq: " << seq << "\r\n\r\n";
 }
 
@@ -85,17 +85,19 @@ namespace KFS_MON
     };
 
     struct MetaStatsOp : public KfsMonOp {
+        bool latencyFlag; // request the latency histograms
         KFS::Properties stats; // result
-        MetaStatsOp(int32_t s) :
-            KfsMonOp(CMD_METAPING, s) { };
+        MetaStatsOp(int32_t s, bool l = false) :
+            KfsMonOp(CMD_METAPING, s), latencyFlag(l) { };
         void Request(std::ostringstream &os);
         void ParseResponse(const char *resp, int len);
     };
 
     struct ChunkStatsOp : public KfsMonOp {
+        bool latencyFlag; // request the latency histograms
         KFS::Properties stats; // result
-        ChunkStatsOp(int32_t s) :
-            KfsMonOp(CMD_CHUNKPING, s) { };
+        ChunkStatsOp(int32_t s, bool l = false) :
+            KfsMonOp(CMD_CHUNKPING, s), latencyFlag(l) { };
         void Request(std::ostringstream &os);
         void ParseResponse(const char *resp, int len);
     };
@@ -42,6 +42,7 @@ extern "C" {
 
 #include "libkfsClient/KfsClient.h"
 #include "common/log.h"
+#include "KfsParallelCopy.h"
 
 #define MAX_FILE_NAME_LEN 256
 
@@ -83,7 +84,10 @@ main(int argc, char **argv)
 
     KFS::MsgLogger::Init(NULL);
 
-    while ((optchar = getopt(argc, argv, "d:hp:s:k:a:b:Sv")) != -1) {
+    int numStreams = 0;
+    int progressInterval = 0;
+
+    while ((optchar = getopt(argc, argv, "d:hp:s:k:a:b:Svj:P:")) != -1) {
         switch (optchar) {
             case 'd':
                 localPath = optarg;
@@ -112,6 +116,12 @@ main(int argc, char **argv)
             case 'b':
                 stop = atoll(optarg);
                 break;
+            case 'j':
+                numStreams = atoi(optarg);
+                break;
+            case 'P':
+                progressInterval = atoi(optarg);
+                break;
             default:
                 KFS_LOG_VA_ERROR("Unrecognized flag %c", optchar);
                 help = true;
@@ -124,6 +134,8 @@ main(int argc, char **argv)
              << " -k <kfs source path> -d <local path> {-v} {-S}" << endl;
         cerr << "<local path> of - means stdout and is supported only if <kfs path> is a file" << endl;
         cerr << "-S skip holes" << endl;
+        cerr << "-j <n> number of parallel copy streams" << endl;
+        cerr << "-P <secs> parallel copy progress report interval" << endl;
         exit(1);
     }
 
@@ -146,6 +158,21 @@ main(int argc, char **argv)
 
     int retval;
 
+    // The parallel copy does not support stdout, skip holes, and ranges.
+    if (numStreams > 0 && localPath != "-" && ! skipHoles &&
+            start < 0 && stop < 0) {
+        tools::ParallelCopier::Params params;
+        params.mNumStreams       = numStreams;
+        params.mProgressInterval = progressInterval;
+        tools::ParallelCopier copier(params, serverHost, port, "", -1);
+        retval = copier.Start();
+        if (retval == 0) {
+            copier.Copy(kfsPath, localPath);
+            retval = copier.Wait();
+        }
+        exit(retval == 0 ? 0 : -1);
+    }
+
     if (!S_ISDIR(statInfo.st_mode)) {
 	retval = RestoreFile(kfsPath, localPath);
     } else {
@@ -46,6 +46,7 @@ extern "C" {
 
 #include "libkfsClient/KfsClient.h"
 #include "common/log.h"
+#include "KfsParallelCopy.h"
 
 #define MAX_FILE_NAME_LEN 256
 
@@ -85,6 +86,8 @@ static bool gAppendMode = false;
 static int  gBufSize = 64 << 20;
 static bool gTruncateFlag = false;
 static bool gDeleteFlag = false;
+static int  gNumStreams = 0;
+static int  gProgressInterval = 0;
 
 int
 main(int argc, char **argv)
@@ -101,7 +104,7 @@ main(int argc, char **argv)
 
     KFS::MsgLogger::Init(NULL);
 
-    while ((optchar = getopt(argc, argv, "d:hk:p:s:R:r:vniatxb:")) != -1) {
+    while ((optchar = getopt(argc, argv, "d:hk:p:s:R:r:vniatxb:j:P:")) != -1) {
         switch (optchar) {
             case 'd':
                 sourcePath = optarg;
@@ -145,6 +148,12 @@ main(int argc, char **argv)
             case 'x':
                 gDeleteFlag = true;
                 break;
+            case 'j':
+                gNumStreams = atoi(optarg);
+                break;
+            case 'P':
+                gProgressInterval = atoi(optarg);
+                break;
           default:
                 KFS_LOG_VA_ERROR("Unrecognized flag %c", optchar);
                 help = true;
@@ -165,6 +174,8 @@ main(int argc, char **argv)
             " [-b] -- buffer size in bytes\n"
             " [-t] -- truncate\n"
             " [-x] -- delete\n"
+            " [-j] -- number of parallel copy streams\n"
+            " [-P] -- parallel copy progress report interval in seconds\n"
         ;
         exit(-1);
     }
@@ -187,6 +198,32 @@ main(int argc, char **argv)
 	exit(-1);
     }
 
+    // The parallel copy does not support stdin, append, rewrite test, and
+    // dry run.
+    if (gNumStreams > 0 && sourcePath != "-" && ! gAppendMode &&
+            gTestNumReWrites < 0 && ! gDryRunFlag) {
+        tools::ParallelCopier::Params params;
+        params.mNumStreams       = gNumStreams;
+        params.mBufSize          = gBufSize;
+        params.mNumReplicas      = gNumReplicas;
+        params.mProgressInterval = gProgressInterval;
+        params.mTruncateFlag     = gTruncateFlag;
+        params.mDeleteFlag       = gDeleteFlag;
+        tools::ParallelCopier copier(params, "", -1, serverHost, port);
+        int res = copier.Start();
+        if (res != 0) {
+            cout << "parallel copy failed to start: " <<
+                ErrorCodeToStr(res) << endl;
+            exit(-1);
+        }
+        if (S_ISDIR(statInfo.st_mode)) {
+            MakeKfsLeafDir(sourcePath.c_str(), kfsPath);
+        }
+        copier.Copy(sourcePath, kfsPath);
+        res = copier.Wait();
+        exit(res == 0 ? 0 : -1);
+    }
+
     if (!S_ISDIR(statInfo.st_mode)) {
 	BackupFile(sourcePath.c_str(), kfsPath);
 	exit(0);
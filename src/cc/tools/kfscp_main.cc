@@ -34,6 +34,7 @@ extern "C" {
 #include "libkfsClient/KfsClient.h"
 #include "common/log.h"
 #include "KfsToolsCommon.h"
+#include "KfsParallelCopy.h"
 
 using std::cout;
 using std::endl;
@@ -42,6 +43,24 @@ using std::ofstream;
 using namespace KFS;
 using namespace KFS::tools;
 
+static int gNumStreams = 0;
+static int gProgressInterval = 0;
+
+// Copy with the parallel copy engine, empty host means local path.
+static int
+ParallelCopy(const string &srcHost, int srcPort, const string &srcPath,
+    const string &dstHost, int dstPort, const string &dstPath)
+{
+    ParallelCopier::Params params;
+    params.mNumStreams       = gNumStreams;
+    params.mProgressInterval = gProgressInterval;
+    ParallelCopier copier(params, srcHost, srcPort, dstHost, dstPort);
+    int res = copier.Start();
+    if (res == 0 && (res = copier.Copy(srcPath, dstPath)) == 0)
+	res = copier.Wait();
+    return res;
+}
+
 int
 main(int argc, char **argv)
 {
@@ -59,6 +78,14 @@ main(int argc, char **argv)
 	{
 	    verboseLogging = true;
 	}
+	else if (arg == "-j" && i + 1 < argc)
+	{
+	    gNumStreams = atoi(argv[++i]);
+	}
+	else if (arg == "-P" && i + 1 < argc)
+	{
+	    gProgressInterval = atoi(argv[++i]);
+	}
 	else
 	{
 	    sources.push_back(argv[i]);
@@ -67,7 +94,8 @@ main(int argc, char **argv)
     
     if (sources.size() < 2)
     {
-	cout << "Usage: " << argv[0] << " [-v] source [source2] [source3] ... destination\n";
+	cout << "Usage: " << argv[0] << " [-v] [-j <parallel copy streams>] [-P <progress interval secs>]"
+	    " source [source2] [source3] ... destination\n";
 	return EXIT_FAILURE;
     }
     
@@ -211,7 +239,9 @@ main(int argc, char **argv)
 		    << " to " << getRemotePath(destHost, destPort, destPath) << ": ";
 		cout.flush();
 		
-		if (!CopyFile(destClient, srcPath, destPath))
+		if (!(gNumStreams > 0 ?
+			ParallelCopy(destHost, destPort, srcPath, destHost, destPort, destPath) :
+			CopyFile(destClient, srcPath, destPath)))
 		{
 		    cout << "OK\n";
 		}
@@ -227,7 +257,9 @@ main(int argc, char **argv)
 		    << " to " << getRemotePath(destHost, destPort, destPath) << ": ";
 		cout.flush();
 		
-		if (!CopyDir(destClient, srcPath, destPath))
+		if (!(gNumStreams > 0 ?
+			ParallelCopy(destHost, destPort, srcPath, destHost, destPort, destPath) :
+			CopyDir(destClient, srcPath, destPath)))
 		{
 		    cout << "OK\n";
 		}
@@ -261,7 +293,9 @@ main(int argc, char **argv)
 		    << getRemotePath(destHost, destPort, destPath) << ": ";
 		cout.flush();
 		
-		if(!BackupFile(destClient, srcPath, destPath))
+		if (!(gNumStreams > 0 ?
+			ParallelCopy("", -1, srcPath, destHost, destPort, destPath) :
+			BackupFile(destClient, srcPath, destPath)))
 		{
 		    cout << "OK\n";
 		}
@@ -295,7 +329,9 @@ main(int argc, char **argv)
 		    
 		MakeKfsLeafDir(destClient, srcPath, destPath);
 		
-		if (!BackupDir(destClient, srcPath, destPath))
+		if (!(gNumStreams > 0 ?
+			ParallelCopy("", -1, srcPath, destHost, destPort, destPath) :
+			BackupDir(destClient, srcPath, destPath)))
 		{
 		    cout << "OK\n";
 		}
@@ -335,7 +371,9 @@ main(int argc, char **argv)
 		    << destPath << "': ";
 		cout.flush();
 		
-		if (!RestoreFile(srcClient, srcPath, destPath))
+		if (!(gNumStreams > 0 ?
+			ParallelCopy(srcHost, srcPort, srcPath, "", -1, destPath) :
+			RestoreFile(srcClient, srcPath, destPath)))
 		{
 		    cout << "OK\n";
 		}
@@ -351,7 +389,9 @@ main(int argc, char **argv)
 		    << destPath << "': ";
 		cout.flush();
 		
-		if (!RestoreDir(srcClient, srcPath, destPath))
+		if (!(gNumStreams > 0 ?
+			ParallelCopy(srcHost, srcPort, srcPath, "", -1, destPath) :
+			RestoreDir(srcClient, srcPath, destPath)))
 		{
 		    cout << "OK\n";
 		}
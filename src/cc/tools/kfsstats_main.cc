@@ -31,12 +31,17 @@ extern "C" {
 };
 
 #include <iostream>
+#include <iomanip>
 #include <string>
+#include <map>
 using std::string;
 using std::cout;
 using std::endl;
+using std::setw;
+using std::map;
 
 #include "libkfsIO/TcpSocket.h"
+#include "libkfsIO/LatencyHistogram.h"
 #include "common/log.h"
 
 #include "MonUtils.h"
@@ -45,7 +50,8 @@ using namespace KFS;
 using namespace KFS_MON;
 
 static void
-StatsMetaServer(const ServerLocation &location, bool rpcStats, int numSecs);
+StatsMetaServer(const ServerLocation &location, bool rpcStats,
+    bool latencyStats, int numSecs);
 
 void
 BasicStatsMetaServer(TcpSocket &metaServerSock, int numSecs);
@@ -54,7 +60,11 @@ void
 RpcStatsMetaServer(TcpSocket &metaServerSock, int numSecs);
 
 static void
-StatsChunkServer(const ServerLocation &location, bool rpcStats, int numSecs);
+StatsChunkServer(const ServerLocation &location, bool rpcStats,
+    bool latencyStats, int numSecs);
+
+template<typename T> static void
+LatencyStatsServer(TcpSocket &sock, int numSecs);
 
 static void
 BasicStatsChunkServer(TcpSocket &chunkServerSock, int numSecs);
@@ -73,14 +83,14 @@ int main(int argc, char **argv)
 {
     char optchar;
     bool help = false, meta = false, chunk = false;
-    bool rpcStats = false, verboseLogging = false;
+    bool rpcStats = false, latencyStats = false, verboseLogging = false;
     const char *server = NULL;
     int port = -1, numSecs = 10;
 
 
     KFS::MsgLogger::Init(NULL);
 
-    while ((optchar = getopt(argc, argv, "hcmn:p:s:tv")) != -1) {
+    while ((optchar = getopt(argc, argv, "hcmn:p:s:tlv")) != -1) {
         switch (optchar) {
             case 'm': 
                 meta = true;
@@ -100,6 +110,9 @@ int main(int argc, char **argv)
             case 't':
                 rpcStats = true;
                 break;
+            case 'l':
+                latencyStats = true;
+                break;
             case 'h':
                 help = true;
                 break;
@@ -117,9 +130,10 @@ int main(int argc, char **argv)
 
     if (help || (server == NULL) || (port < 0)) {
         cout << "Usage: " << argv[0] << " [-m|-c] -s <server name> -p <port>" 
-             << " [-n <secs>] [-t] {-v}"  << endl;
+             << " [-n <secs>] [-t] [-l] {-v}"  << endl;
         cout << "Use -m for metaserver and -c for chunk server" << endl;
         cout << "Use -t for RPC stats" << endl;
+        cout << "Use -l for RPC latency percentiles" << endl;
         exit(-1);
     }
 
@@ -132,9 +146,9 @@ int main(int argc, char **argv)
     ServerLocation location(server, port);
 
     if (meta)
-        StatsMetaServer(location, rpcStats, numSecs);
+        StatsMetaServer(location, rpcStats, latencyStats, numSecs);
     else if (chunk)
-        StatsChunkServer(location, rpcStats, numSecs);
+        StatsChunkServer(location, rpcStats, latencyStats, numSecs);
 }
 
 static void
@@ -147,7 +161,8 @@ PrintRpcStat(const string &statName, Properties &prop)
 
 
 void
-StatsMetaServer(const ServerLocation &location, bool rpcStats, int numSecs)
+StatsMetaServer(const ServerLocation &location, bool rpcStats,
+    bool latencyStats, int numSecs)
 {
     TcpSocket metaServerSock;
 
@@ -157,7 +172,9 @@ StatsMetaServer(const ServerLocation &location, bool rpcStats, int numSecs)
         exit(0);
     }
 
-    if (rpcStats) {
+    if (latencyStats) {
+        LatencyStatsServer<MetaStatsOp>(metaServerSock, numSecs);
+    } else if (rpcStats) {
         RpcStatsMetaServer(metaServerSock, numSecs);
     } else {
         BasicStatsMetaServer(metaServerSock, numSecs);
@@ -252,7 +269,8 @@ PrintMetaBasicStatsHeader()
 }
 
 void
-StatsChunkServer(const ServerLocation &location, bool rpcStats, int numSecs)
+StatsChunkServer(const ServerLocation &location, bool rpcStats,
+    bool latencyStats, int numSecs)
 {
     TcpSocket chunkServerSock;
 
@@ -262,7 +280,9 @@ StatsChunkServer(const ServerLocation &location, bool rpcStats, int numSecs)
         exit(0);
     }
 
-    if (rpcStats) {
+    if (latencyStats) {
+        LatencyStatsServer<ChunkStatsOp>(chunkServerSock, numSecs);
+    } else if (rpcStats) {
         RpcStatsChunkServer(chunkServerSock, numSecs);
     } else {
         BasicStatsChunkServer(chunkServerSock, numSecs);
@@ -349,3 +369,62 @@ PrintChunkBasicStatsHeader()
          << "Disk Fds" << '\t' << "Disk Bytes In" << '\t' 
          << "Disk Bytes Out" << endl;
 }
+
+///
+/// Print the latency histogram percentiles, one line per request type and
+/// phase. The first sample is cumulative since the server start, the
+/// subsequent ones cover the last numSecs interval.
+///
+template<typename T> static void
+LatencyStatsServer(TcpSocket &sock, int numSecs)
+{
+    typedef map<string, LatencyHistogram> Histograms;
+    const string prefix(LatencyStats::kKeyPrefix);
+    Histograms   prev;
+    int          cmdSeqNum = 1;
+
+    while (1) {
+        T op(cmdSeqNum, true);
+        ++cmdSeqNum;
+        if (DoOpCommon(&op, &sock) < 0) {
+            KFS_LOG_ERROR("Server isn't responding to stats");
+            exit(0);
+        }
+        cout << std::left << setw(32) << "request-phase" << std::right <<
+            setw(10) << "count" << setw(10) << "avg" <<
+            setw(10) << "p50" << setw(10) << "p90" <<
+            setw(10) << "p99" << setw(10) << "p99.9" <<
+            "  (usec)" << endl;
+        for (Properties::iterator it = op.stats.begin();
+                it != op.stats.end();
+                ++it) {
+            if (it->first.compare(0, prefix.length(), prefix) != 0) {
+                continue;
+            }
+            LatencyHistogram hist;
+            if (! hist.Parse(it->second.c_str())) {
+                continue;
+            }
+            const string name = it->first.substr(prefix.length());
+            LatencyHistogram& last = prev[name];
+            const LatencyHistogram cur = hist;
+            hist.Subtract(last);
+            last = cur;
+            if (hist.GetCount() <= 0) {
+                continue;
+            }
+            cout << std::left << setw(32) << name << std::right <<
+                setw(10) << hist.GetCount() <<
+                setw(10) << hist.GetTotalUsecs() / hist.GetCount() <<
+                setw(10) << hist.GetPercentile(50) <<
+                setw(10) << hist.GetPercentile(90) <<
+                setw(10) << hist.GetPercentile(99) <<
+                setw(10) << hist.GetPercentile(99.9) <<
+            endl;
+        }
+        cout << "----------------------------------" << endl;
+        if (numSecs == 0)
+            break;
+        sleep(numSecs);
+    }
+}
@@ -46,6 +46,12 @@ public class KfsInputChannel implements ReadableByteChannel, Positionable
     private final static native
     int read(long cPtr, int fd, ByteBuffer buf, int begin, int end);
 
+    private final static native
+    int pread(long cPtr, int fd, long offset, ByteBuffer buf, int begin, int end);
+
+    private final static native
+    long preadv(long cPtr, int fd, long offset, ByteBuffer[] bufs, int[] begins, int[] ends);
+
     private final static native
     int close(long cPtr, int fd);
 
@@ -82,6 +88,15 @@ public class KfsInputChannel implements ReadableByteChannel, Positionable
 
         int r0 = dst.remaining();
 
+        // Bulk read: read large requests straight into the direct dst
+        // buffer, bypassing the copy through the read buffer.
+        if (dst.isDirect() && !readBuffer.hasRemaining() &&
+                r0 >= readBuffer.capacity()) {
+            readDirect(dst);
+            int r1 = dst.remaining();
+            return (r1 < r0 ? r0 - r1 : -1);
+        }
+
         // While the dst buffer has space for more data, fill
         while(dst.hasRemaining())
         {
@@ -139,6 +154,101 @@ public class KfsInputChannel implements ReadableByteChannel, Positionable
         buf.position(pos + sz);
     }
 
+    // Positioned read: read into dst starting at the file offset
+    // position.  The channel position is not changed, and the native
+    // read does not serialize with the reads of the other threads, thus
+    // multiple threads can read the same channel concurrently.  Returns
+    // the number of bytes read, or -1 if position is at or past EOF.
+    public int read(long position, ByteBuffer dst) throws IOException
+    {
+        if (kfsFd < 0) 
+            throw new IOException("File closed");
+        if (position < 0)
+            throw new IllegalArgumentException("negative position");
+
+        if (dst.isDirect())
+            return preadDirect(position, dst);
+
+        // Read through a temporary direct buffer.
+        int r0 = dst.remaining();
+        ByteBuffer buf = ByteBuffer.allocateDirect(
+            Math.min(Math.max(r0, 1), DEFAULT_BUF_SIZE));
+        while (dst.hasRemaining()) {
+            buf.clear();
+            if (buf.remaining() > dst.remaining())
+                buf.limit(dst.remaining());
+            int sz = preadDirect(position, buf);
+            if (sz <= 0)
+                break;
+            buf.flip();
+            dst.put(buf);
+            position += sz;
+        }
+        int r1 = dst.remaining();
+        if (r1 < r0 || r0 == 0)
+            return r0 - r1;
+        return -1;
+    }
+
+    // Vectored positioned read: fill the dsts in order, starting at the
+    // file offset position, with a single native call if all dsts are
+    // direct buffers.  The channel position is not changed.  Returns
+    // the number of bytes read, or -1 if position is at or past EOF.
+    public long read(long position, ByteBuffer[] dsts) throws IOException
+    {
+        if (kfsFd < 0) 
+            throw new IOException("File closed");
+        if (position < 0)
+            throw new IllegalArgumentException("negative position");
+
+        boolean direct = true;
+        long r0 = 0;
+        int[] begins = new int[dsts.length];
+        int[] ends = new int[dsts.length];
+        for (int i = 0; i < dsts.length; i++) {
+            direct = direct && dsts[i].isDirect();
+            begins[i] = dsts[i].position();
+            ends[i] = dsts[i].limit();
+            r0 += dsts[i].remaining();
+        }
+        if (!direct) {
+            long nread = 0;
+            for (int i = 0; i < dsts.length; i++) {
+                if (!dsts[i].hasRemaining())
+                    continue;
+                int rem = dsts[i].remaining();
+                int sz = read(position + nread, dsts[i]);
+                if (sz <= 0)
+                    break;
+                nread += sz;
+                if (sz < rem)
+                    break;
+            }
+            return (nread > 0 || r0 == 0) ? nread : -1;
+        }
+
+        long sz = preadv(cPtr, kfsFd, position, dsts, begins, ends);
+        if (sz < 0)
+            throw new IOException("preadv failed");
+        long left = sz;
+        for (int i = 0; i < dsts.length && left > 0; i++) {
+            int n = (int) Math.min(left, (long) (ends[i] - begins[i]));
+            dsts[i].position(begins[i] + n);
+            left -= n;
+        }
+        return (sz > 0 || r0 == 0) ? sz : -1;
+    }
+
+    private int preadDirect(long position, ByteBuffer buf) throws IOException
+    {
+        int pos = buf.position();
+        int sz = pread(cPtr, kfsFd, position, buf, pos, buf.limit());
+        if (sz < 0)
+            throw new IOException("pread failed");
+        buf.position(pos + sz);
+        return (sz > 0 || pos == buf.limit()) ? sz : -1;
+    }
+
     // is modeled after the seek of Java's RandomAccessFile; offset is
     // the offset from the beginning of the file.
     public int seek(long offset) throws IOException
@@ -84,6 +84,18 @@ public class KfsOutputChannel implements WritableByteChannel, Positionable
 
         int r0 = src.remaining();
 
+        // Bulk write: write large direct src buffers out without the
+        // copy through the write buffer.
+        if (src.isDirect() && writeBuffer.position() == 0 &&
+                r0 >= writeBuffer.capacity()) {
+            int pos = src.position();
+            int sz = write(cPtr, kfsFd, src, pos, src.limit());
+            if (sz < 0)
+                throw new IOException("writeDirect failed");
+            src.position(pos + sz);
+            return sz;
+        }
+
         // While the src buffer has data, copy it in and flush
         while(src.hasRemaining())
         {
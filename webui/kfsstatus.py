@@ -384,6 +384,86 @@ def ping(metaserver):
     
     sock.close()    
 
+def latencyStats(server):
+    '''Fetch the request latency histograms from the meta or chunk server.
+    Returns a list of (name, [count, totalUsec, bucket0, bucket1, ...]).'''
+    sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    sock.connect((server.node, server.port))
+    req = "STATS\r\nVersion: KFS/1.0\r\nCseq: 1\r\nLatency-histograms: 1\r\n\r\n"
+    sock.send(req)
+    sockIn = sock.makefile('r')
+    result = []
+    for line in sockIn:
+        if line.strip() == '':
+            break
+        if line.find('Latency-') != 0:
+            continue
+        pos = line.find(':')
+        if pos < 0:
+            continue
+        try:
+            hist = [int(v) for v in line[pos+1:].strip().split(',')]
+        except ValueError:
+            continue
+        if len(hist) < 2 or hist[0] <= 0:
+            continue
+        result.append((line[len('Latency-'):pos], hist))
+    sock.close()
+    result.sort()
+    return result
+
+def bucketLowerBound(idx):
+    if idx <= 0:
+        return 0
+    return 1 << (idx - 1)
+
+def latencyPercentile(hist, pct):
+    '''Percentile estimate in usec, the same as LatencyHistogram::GetPercentile()'''
+    count = hist[0]
+    buckets = hist[2:]
+    rank = count * pct / 100.
+    cnt = 0
+    for i in range(len(buckets)):
+        if buckets[i] <= 0:
+            continue
+        if rank <= cnt + buckets[i]:
+            lo = bucketLowerBound(i)
+            hi = bucketLowerBound(i + 1)
+            return lo + int((hi - lo) * (rank - cnt) / buckets[i])
+        cnt = cnt + buckets[i]
+    return bucketLowerBound(len(buckets))
+
+def latencyView(server, buffer):
+    print >> buffer, '''
+<body class="oneColLiqCtr">
+<div id="container">
+  <div id="mainContent">
+    <h1> Request latency: ''', server.node, ':', server.port, ''' </h1>
+    <p> Cumulative since the server start, usec. </p>
+    <table class="sortable status-table" id="table1" cellspacing="0" cellpadding="0.1em" summary="Request latency">
+    <thead>
+    <tr><th>Request-phase</th><th>Count</th><th>Avg</th><th>50%</th><th>90%</th><th>99%</th><th>99.9%</th></tr>
+    </thead>
+    <tbody>'''
+    count = 0
+    for name, hist in latencyStats(server):
+        if count % 2 == 0:
+            trclass = ""
+        else:
+            trclass = "class=odd"
+        count = count + 1
+        print >> buffer, '''<tr ''', trclass, '''><td>''', name, '''</td><td>''', hist[0], '''</td><td>''', hist[1] / hist[0], '''</td>'''
+        for pct in (50, 90, 99, 99.9):
+            print >> buffer, '''<td>''', latencyPercentile(hist, pct), '''</td>'''
+        print >> buffer, '''</tr>'''
+    print >> buffer, '''
+    </tbody>
+    </table>
+    </div>
+    </div>
+    </body>
+    </html>'''
+
 def printStyle(buffer):
     print >> buffer, '''
     <!DOCTYPE html PUBLIC "-//W3C//DTD XHTML 1.0 Transitional//EN" "http://www.w3.org/TR/xhtml1/DTD/xhtml1-transitional.dtd">
@@ -567,8 +647,25 @@ class Pinger(SimpleHTTPServer.SimpleHTTPRequestHandler):
 
             metaserver = ServerLocation(node='localhost',
                                         port=metaserverPort)
-            ping(metaserver)
             txtStream = StringIO()
+            if self.path.startswith('/latency'):
+                # /latency for the meta server, /latency/<host>:<port> for
+                # a chunk server
+                server = metaserver
+                loc = self.path[len('/latency/'):]
+                if loc.find(':') > 0:
+                    server = ServerLocation(node=loc.split(':')[0],
+                                            port=int(loc.split(':')[1]))
+                printStyle(txtStream)
+                latencyView(server, txtStream)
+                self.send_response(200)
+                self.send_header('Content-type', 'text/html')
+                self.send_header('Content-length', txtStream.tell())
+                self.end_headers()
+                self.wfile.write(txtStream.getvalue())
+                return
+
+            ping(metaserver)
                 
             printStyle(txtStream)            
             if self.path.startswith('/cluster-view'):